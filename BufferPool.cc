@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Pool Of Reusable Large Buffers
+// See BufferPool.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "BufferPool.h"
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+using namespace std;
+
+static const size_t kSmallClass=64*1024;
+static const size_t kLargeClass=2*1024*1024;
+static const size_t kAlignment=4096;
+
+static size_t SizeClass(size_t nbytes)
+{
+  size_t step=(nbytes < kLargeClass) ? kSmallClass : kLargeClass;
+  if (nbytes == 0) nbytes=1;
+  return (nbytes+step-1)/step*step;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Handle
+////////////////////////////////////////////////////////////////////////////////////////
+PooledBuffer::PooledBuffer(PooledBuffer &&other)
+  : pool(other.pool), ptr(other.ptr), nbytes(other.nbytes), capacity(other.capacity)
+{
+  other.pool=NULL; other.ptr=NULL; other.nbytes=0; other.capacity=0;
+}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other)
+{
+  if (this != &other)
+  {
+    Reset();
+    pool=other.pool; ptr=other.ptr; nbytes=other.nbytes; capacity=other.capacity;
+    other.pool=NULL; other.ptr=NULL; other.nbytes=0; other.capacity=0;
+  }
+  return *this;
+}
+
+bool PooledBuffer::mapped() const
+{
+  return ptr != NULL && capacity >= kLargeClass;
+}
+
+void PooledBuffer::Reset()
+{
+  if (pool != NULL && ptr != NULL) pool->Return(ptr,capacity);
+  pool=NULL; ptr=NULL; nbytes=0; capacity=0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Pool
+////////////////////////////////////////////////////////////////////////////////////////
+BufferPool::BufferPool(const BufferPoolOptions &options_) : options(options_), freebytes(0)
+{
+  memset(&stats,0,sizeof(stats));
+}
+
+BufferPool::~BufferPool()
+{
+  Trim();
+}
+
+void BufferPool::Configure(const BufferPoolOptions &options_)
+{
+  lock_guard<mutex> guard(lock);
+  options=options_;
+}
+
+uint8_t *BufferPool::Allocate(size_t capacity)
+{
+  if (capacity >= kLargeClass)
+  {
+    void *ptr=mmap(NULL,capacity,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    if (ptr == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (options.hugepages) madvise(ptr,capacity,MADV_HUGEPAGE);
+#endif
+    return static_cast<uint8_t *>(ptr);
+  }
+  void *ptr=NULL;
+  if (posix_memalign(&ptr,kAlignment,capacity) != 0) return NULL;
+  return static_cast<uint8_t *>(ptr);
+}
+
+void BufferPool::Free(const Block &block)
+{
+  if (block.capacity >= kLargeClass) munmap(block.ptr,block.capacity);
+  else free(block.ptr);
+  stats.releases++;
+  stats.bytes-=block.capacity;
+}
+
+void BufferPool::ReleaseFree(size_t index)
+{
+  Free(freeblocks[index]);
+  freebytes-=freeblocks[index].capacity;
+  freeblocks.erase(freeblocks.begin()+index);
+}
+
+PooledBuffer BufferPool::Acquire(size_t nbytes)
+{
+  size_t capacity=SizeClass(nbytes);
+  PooledBuffer buffer;
+  lock_guard<mutex> guard(lock);
+  stats.requests++;
+
+  // Best Fit From The Free List
+  size_t best=freeblocks.size();
+  for (size_t ii=0;ii<freeblocks.size();ii++)
+  {
+    size_t cap=freeblocks[ii].capacity;
+    if (cap < capacity || cap/2 > capacity) continue;
+    if (best == freeblocks.size() || cap < freeblocks[best].capacity) best=ii;
+  }
+  if (best < freeblocks.size())
+  {
+    buffer.ptr=freeblocks[best].ptr;
+    buffer.capacity=freeblocks[best].capacity;
+    freebytes-=buffer.capacity;
+    freeblocks.erase(freeblocks.begin()+best);
+    stats.reuses++;
+    stats.reusedbytes+=nbytes;
+  }
+  else
+  {
+    // Drop Stale Buffers Of A Similar Size That Can No Longer Be Used, Then Allocate
+    for (size_t ii=freeblocks.size();ii-- > 0;)
+    {
+      if (freeblocks[ii].capacity < capacity && freeblocks[ii].capacity >= capacity/4) ReleaseFree(ii);
+    }
+    buffer.ptr=Allocate(capacity);
+    if (buffer.ptr == NULL) return buffer;
+    buffer.capacity=capacity;
+    stats.allocations++;
+    stats.bytes+=capacity;
+    if (stats.bytes > stats.peakbytes) stats.peakbytes=stats.bytes;
+  }
+  buffer.pool=this;
+  buffer.nbytes=nbytes;
+  stats.inusebytes+=buffer.capacity;
+  if (stats.inusebytes > stats.peakinusebytes) stats.peakinusebytes=stats.inusebytes;
+  return buffer;
+}
+
+void BufferPool::Return(uint8_t *ptr, size_t capacity)
+{
+  lock_guard<mutex> guard(lock);
+  stats.inusebytes-=capacity;
+  Block block={ptr,capacity};
+  freeblocks.push_back(block);
+  freebytes+=capacity;
+
+  // Keep Within The Retained Limit, Dropping The Oldest Free Buffers First
+  while (options.retain_bytes > 0 && freebytes > options.retain_bytes) ReleaseFree(0);
+}
+
+void BufferPool::Trim()
+{
+  lock_guard<mutex> guard(lock);
+  while (!freeblocks.empty()) ReleaseFree(freeblocks.size()-1);
+}
+
+BufferPoolStats BufferPool::Stats() const
+{
+  lock_guard<mutex> guard(lock);
+  return stats;
+}
+
+BufferPool &SharedBufferPool()
+{
+  static BufferPool pool;
+  return pool;
+}
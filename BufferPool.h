@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Pool Of Reusable Large Buffers
+//
+// Field images, decode scratch, RGBA rasters, write staging buffers and mosaic chunks
+// are taken from a pool instead of being allocated and freed each time, so the
+// multi-GB field buffers and their page faults are paid once per size rather than
+// once per channel, field and slide.
+//
+// Buffers are rounded up to a size class (64 KB steps up to 2 MB, 2 MB steps above)
+// and a request is served by the smallest free buffer of at least its size and at
+// most twice it. All buffers are 4 KB aligned, so they also suit O_DIRECT I/O.
+// Buffers of 2 MB or more are mapped anonymously and, with hugepages, advised for
+// transparent huge pages.
+//
+// When a request cannot be served from the free list, free buffers too small for it
+// but at least a quarter of its size are released first: they are usually the
+// previous field's buffers and would otherwise double the footprint.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+struct BufferPoolOptions
+{
+  size_t retain_bytes; // Most free bytes kept for reuse, 0 = no limit
+  bool hugepages;      // Advise transparent huge pages for large buffers
+
+  BufferPoolOptions() : retain_bytes(0), hugepages(false) {}
+};
+
+struct BufferPoolStats
+{
+  uint64_t requests, reuses, allocations, releases;
+  uint64_t reusedbytes;                 // Bytes of all requests served from the free list
+  uint64_t bytes, peakbytes;            // Allocated, in use or free
+  uint64_t inusebytes, peakinusebytes;  // Handed out
+};
+
+class BufferPool;
+
+// A Buffer On Loan From A Pool, Returned When The Handle Is Destroyed Or Reset.
+// data() Is NULL If The Allocation Failed.
+class PooledBuffer
+{
+public:
+  PooledBuffer() : pool(NULL), ptr(NULL), nbytes(0), capacity(0) {}
+  PooledBuffer(PooledBuffer &&other);
+  PooledBuffer &operator=(PooledBuffer &&other);
+  ~PooledBuffer() { Reset(); }
+
+  uint8_t *data() const { return ptr; }
+  size_t size() const { return nbytes; }
+  bool mapped() const; // Its own anonymous mapping (2 MB or more), not heap memory
+  void Reset();
+
+private:
+  friend class BufferPool;
+  PooledBuffer(const PooledBuffer &);
+  PooledBuffer &operator=(const PooledBuffer &);
+
+  BufferPool *pool;
+  uint8_t *ptr;
+  size_t nbytes, capacity;
+};
+
+class BufferPool
+{
+public:
+  explicit BufferPool(const BufferPoolOptions &options=BufferPoolOptions());
+  ~BufferPool();
+
+  // Change Options; Applies To Later Allocations And Returns
+  void Configure(const BufferPoolOptions &options);
+
+  // Borrow A Buffer Of At Least nbytes. Its Contents Are Unspecified.
+  PooledBuffer Acquire(size_t nbytes);
+
+  // Release All Free Buffers
+  void Trim();
+
+  BufferPoolStats Stats() const;
+
+private:
+  friend class PooledBuffer;
+  BufferPool(const BufferPool &);
+  BufferPool &operator=(const BufferPool &);
+
+  struct Block
+  {
+    uint8_t *ptr;
+    size_t capacity;
+  };
+
+  void Return(uint8_t *ptr, size_t capacity);
+  uint8_t *Allocate(size_t capacity);
+  void Free(const Block &block);
+  void ReleaseFree(size_t index);
+
+  mutable std::mutex lock;
+  BufferPoolOptions options;
+  std::vector<Block> freeblocks; // Oldest first
+  size_t freebytes;
+  BufferPoolStats stats;
+};
+
+// Pool Shared By All Readers And Writers Of The Process
+BufferPool &SharedBufferPool();
+
+#endif
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Per-Channel Intensity Statistics
+// See ChannelStats.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ChannelStats.h"
+#include "IOHelpers.h"
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <fstream>
+#include <limits>
+using namespace std;
+
+// Percentiles Reported In Summaries
+static const double PERCENTS[9]={0.1,1.0,5.0,25.0,50.0,75.0,95.0,99.0,99.9};
+
+// Bins Used For A Sample Type, And The Offset Of Value 0 In Exact Histograms
+static size_t StatsBins(SampleType type)
+{
+  return (type == SAMPLE_UINT8 || type == SAMPLE_INT8) ? 256 : 65536;
+}
+
+static bool StatsExact(SampleType type)
+{
+  return (type == SAMPLE_UINT8 || type == SAMPLE_INT8 || type == SAMPLE_UINT16 || type == SAMPLE_INT16);
+}
+
+static int StatsOffset(SampleType type)
+{
+  if (type == SAMPLE_INT8) return 128;
+  if (type == SAMPLE_INT16) return 32768;
+  return 0;
+}
+
+// Order-Preserving Bin Of A Value: Top 16 Bits Of Its float32 Bit Pattern With The
+// Sign Handled So Larger Values Always Get Larger Keys
+static uint32_t BinnedKey(double value)
+{
+  float single=static_cast<float>(value);
+  uint32_t bits;
+  memcpy(&bits,&single,sizeof(bits));
+  uint32_t key=(bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  return key >> 16;
+}
+
+static double BinnedLowerEdge(size_t bin)
+{
+  uint32_t key=static_cast<uint32_t>(bin) << 16;
+  uint32_t bits=(key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+  float single;
+  memcpy(&single,&bits,sizeof(single));
+  return single;
+}
+
+static void AtomicMin(atomic<double> &target, double value)
+{
+  double seen=target.load();
+  while (value < seen && !target.compare_exchange_weak(seen,value)) {}
+}
+
+static void AtomicMax(atomic<double> &target, double value)
+{
+  double seen=target.load();
+  while (value > seen && !target.compare_exchange_weak(seen,value)) {}
+}
+
+static void AtomicAdd(atomic<double> &target, double value)
+{
+  double seen=target.load();
+  while (!target.compare_exchange_weak(seen,seen+value)) {}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Accumulator
+////////////////////////////////////////////////////////////////////////////////////////
+
+ChannelStatsAccumulator::ChannelStatsAccumulator(SampleType type_)
+  : type(type_), bins(StatsBins(type_),0), nan(0), minimum(numeric_limits<double>::infinity()),
+    maximum(-numeric_limits<double>::infinity()), sum(0.0), sumsq(0.0)
+{
+}
+
+template <class T>
+void ChannelStatsAccumulator::AddExact(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes,
+                                       int offset)
+{
+  uint64_t *counts=&bins[offset];
+  for (uint32 yy=0;yy<hh;yy++)
+  {
+    const uint8 *row=first+yy*rowbytes;
+    for (uint32 xx=0;xx<ww;xx++)
+    {
+      T value;
+      memcpy(&value,row+xx*pixelbytes,sizeof(T));
+      counts[value]++;
+    }
+  }
+}
+
+template <class T>
+void ChannelStatsAccumulator::AddBinned(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes)
+{
+  for (uint32 yy=0;yy<hh;yy++)
+  {
+    const uint8 *row=first+yy*rowbytes;
+    for (uint32 xx=0;xx<ww;xx++)
+    {
+      T sample;
+      memcpy(&sample,row+xx*pixelbytes,sizeof(T));
+      double value=static_cast<double>(sample);
+      if (value != value) {nan++; continue;}
+      if (value < minimum) minimum=value;
+      if (value > maximum) maximum=value;
+      sum+=value;
+      sumsq+=value*value;
+      bins[BinnedKey(value)]++;
+    }
+  }
+}
+
+void ChannelStatsAccumulator::Add(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes)
+{
+  switch (type)
+  {
+    case SAMPLE_UINT8: AddExact<uint8_t>(first,ww,hh,rowbytes,pixelbytes,0); break;
+    case SAMPLE_INT8: AddExact<int8_t>(first,ww,hh,rowbytes,pixelbytes,128); break;
+    case SAMPLE_UINT16: AddExact<uint16_t>(first,ww,hh,rowbytes,pixelbytes,0); break;
+    case SAMPLE_INT16: AddExact<int16_t>(first,ww,hh,rowbytes,pixelbytes,32768); break;
+    case SAMPLE_UINT32: AddBinned<uint32_t>(first,ww,hh,rowbytes,pixelbytes); break;
+    case SAMPLE_INT32: AddBinned<int32_t>(first,ww,hh,rowbytes,pixelbytes); break;
+    case SAMPLE_FLOAT32: AddBinned<float>(first,ww,hh,rowbytes,pixelbytes); break;
+    case SAMPLE_FLOAT64: AddBinned<double>(first,ww,hh,rowbytes,pixelbytes); break;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared Statistics
+////////////////////////////////////////////////////////////////////////////////////////
+
+ChannelStats::ChannelStats(SampleType type_)
+  : type(type_), nbins(StatsBins(type_)), bins(new atomic<uint64_t>[StatsBins(type_)]), nan(0),
+    minimum(numeric_limits<double>::infinity()), maximum(-numeric_limits<double>::infinity()), sum(0.0), sumsq(0.0)
+{
+  for (size_t ii=0;ii<nbins;ii++) bins[ii].store(0,memory_order_relaxed);
+}
+
+void ChannelStats::Merge(const ChannelStatsAccumulator &local)
+{
+  if (local.type != type) return;
+  for (size_t ii=0;ii<nbins;ii++)
+  {
+    if (local.bins[ii] != 0) bins[ii].fetch_add(local.bins[ii],memory_order_relaxed);
+  }
+  if (StatsExact(type)) return;
+  nan.fetch_add(local.nan,memory_order_relaxed);
+  AtomicMin(minimum,local.minimum);
+  AtomicMax(maximum,local.maximum);
+  AtomicAdd(sum,local.sum);
+  AtomicAdd(sumsq,local.sumsq);
+}
+
+ChannelSummary ChannelStats::Summary() const
+{
+  ChannelSummary summary;
+  summary.exact=StatsExact(type);
+  summary.nan=nan.load();
+  summary.count=0;
+  vector<uint64_t> counts(nbins);
+  for (size_t ii=0;ii<nbins;ii++) {counts[ii]=bins[ii].load(); summary.count+=counts[ii];}
+
+  // Value Represented By Each Bin
+  int offset=StatsOffset(type);
+  vector<double> values(nbins);
+  for (size_t ii=0;ii<nbins;ii++)
+  {
+    values[ii]=summary.exact ? static_cast<double>(static_cast<long>(ii)-offset) : BinnedLowerEdge(ii);
+  }
+
+  double nanvalue=numeric_limits<double>::quiet_NaN();
+  summary.minimum=summary.maximum=summary.mean=summary.std=nanvalue;
+  if (summary.count > 0)
+  {
+    if (summary.exact)
+    {
+      double total=0.0, totalsq=0.0;
+      for (size_t ii=0;ii<nbins;ii++)
+      {
+        if (counts[ii] == 0) continue;
+        if (summary.minimum != summary.minimum) summary.minimum=values[ii];
+        summary.maximum=values[ii];
+        total+=values[ii]*counts[ii];
+      }
+      summary.mean=total/summary.count;
+      for (size_t ii=0;ii<nbins;ii++)
+      {
+        double delta=values[ii]-summary.mean;
+        if (counts[ii] != 0) totalsq+=delta*delta*counts[ii];
+      }
+      summary.std=sqrt(totalsq/summary.count);
+    }
+    else
+    {
+      summary.minimum=minimum.load();
+      summary.maximum=maximum.load();
+      summary.mean=sum.load()/summary.count;
+      double variance=sumsq.load()/summary.count-summary.mean*summary.mean;
+      summary.std=sqrt(variance > 0.0 ? variance : 0.0);
+    }
+  }
+
+  // Nearest-Rank Percentiles
+  for (int ip=0;ip<9 && summary.count > 0;ip++)
+  {
+    uint64_t rank=static_cast<uint64_t>(ceil(PERCENTS[ip]/100.0*summary.count));
+    if (rank < 1) rank=1;
+    uint64_t seen=0;
+    size_t ii=0;
+    for (;ii<nbins;ii++)
+    {
+      seen+=counts[ii];
+      if (seen >= rank) break;
+    }
+    double value=values[ii];
+    if (value < summary.minimum) value=summary.minimum;
+    if (value > summary.maximum) value=summary.maximum;
+    summary.percentiles.push_back(make_pair(PERCENTS[ip],value));
+  }
+
+  for (size_t ii=0;ii<nbins;ii++)
+  {
+    if (counts[ii] != 0) summary.histogram.push_back(make_pair(values[ii],counts[ii]));
+  }
+  return summary;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// JSON Sidecar
+////////////////////////////////////////////////////////////////////////////////////////
+
+bool WriteChannelStatsJSON(const string &fn_json, const string &fn_data, const vector<ChannelStatsEntry> &entries)
+{
+  ofstream ofile(fn_json.c_str());
+  if (!ofile) return false;
+  string name=fn_data.substr(fn_data.find_last_of('/')+1);
+  ofile << "{\n  \"file\": " << JSONString(name) << ",\n  \"channels\": [";
+  for (size_t ie=0;ie<entries.size();ie++)
+  {
+    ChannelSummary summary=entries[ie].stats->Summary();
+    ofile << (ie > 0 ? "," : "") << "\n    {\n"
+          << "      \"field\": " << entries[ie].field << ",\n"
+          << "      \"channel\": " << entries[ie].channel << ",\n"
+          << "      \"type\": \"" << SampleTypeName(entries[ie].stats->Type()) << "\",\n"
+          << "      \"exact\": " << (summary.exact ? "true" : "false") << ",\n"
+          << "      \"count\": " << summary.count << ",\n"
+          << "      \"nan\": " << summary.nan << ",\n"
+          << "      \"min\": " << JSONNumber(summary.minimum) << ",\n"
+          << "      \"max\": " << JSONNumber(summary.maximum) << ",\n"
+          << "      \"mean\": " << JSONNumber(summary.mean) << ",\n"
+          << "      \"std\": " << JSONNumber(summary.std) << ",\n"
+          << "      \"percentiles\": {";
+    for (size_t ip=0;ip<summary.percentiles.size();ip++)
+    {
+      ofile << (ip > 0 ? ", " : "") << "\"" << JSONNumber(summary.percentiles[ip].first) << "\": "
+            << JSONNumber(summary.percentiles[ip].second);
+    }
+    ofile << "},\n      \"histogram\": [";
+    for (size_t ih=0;ih<summary.histogram.size();ih++)
+    {
+      ofile << (ih > 0 ? "," : "") << "[" << JSONNumber(summary.histogram[ih].first) << ","
+            << summary.histogram[ih].second << "]";
+    }
+    ofile << "]\n    }";
+  }
+  ofile << "\n  ]\n}\n";
+  ofile.close();
+  return !ofile.fail();
+}
@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Per-Channel Intensity Statistics
+//
+// Histogram, min, max, mean, standard deviation and percentiles of one channel,
+// gathered while the channel is decoded so no second pass over the data is needed.
+//
+// Each reading thread fills its own ChannelStatsAccumulator tile by tile and merges
+// it into the shared ChannelStats with atomic operations only (no locks).
+//
+// Histograms:
+//   8 and 16 bit types: One bin per value; all statistics are exact.
+//   32 bit and float types: 65536 bins spaced logarithmically (the top 16 bits of the
+//     value as an order-preserving float32), about 0.8% of the value wide.
+//     Percentiles are the lower edge of their bin; min, max and mean are exact.
+//   NaNs are counted separately and left out of everything else.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CHANNELSTATS_H
+#define CHANNELSTATS_H
+
+#include "LeicaSCN.h"
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Statistics Gathered By One Thread
+class ChannelStatsAccumulator
+{
+public:
+  explicit ChannelStatsAccumulator(SampleType type_);
+
+  // Add A ww x hh Block Of Samples. Rows Start rowbytes Apart And Samples Within A
+  // Row pixelbytes Apart.
+  void Add(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes);
+
+private:
+  friend class ChannelStats;
+  template <class T> void AddExact(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes,
+                                   int offset);
+  template <class T> void AddBinned(const uint8 *first, uint32 ww, uint32 hh, size_t rowbytes, size_t pixelbytes);
+
+  SampleType type;
+  std::vector<uint64_t> bins;
+  uint64_t nan;
+  double minimum, maximum, sum, sumsq; // Binned types only; exact types use the bins
+};
+
+struct ChannelSummary
+{
+  uint64_t count, nan;
+  double minimum, maximum, mean, std;
+  bool exact;                                         // Histogram and percentiles are exact
+  std::vector<std::pair<double, double> > percentiles; // (percent, value)
+  std::vector<std::pair<double, uint64_t> > histogram; // (lowest value of bin, count), non-empty bins
+};
+
+// Statistics Of One Channel, Shared By All Threads Reading It
+class ChannelStats
+{
+public:
+  explicit ChannelStats(SampleType type_);
+
+  SampleType Type() const { return type; }
+
+  // Merge A Thread's Accumulator; Safe To Call Concurrently
+  void Merge(const ChannelStatsAccumulator &local);
+
+  ChannelSummary Summary() const;
+
+private:
+  ChannelStats(const ChannelStats &);
+  ChannelStats &operator=(const ChannelStats &);
+
+  SampleType type;
+  size_t nbins;
+  std::unique_ptr<std::atomic<uint64_t>[]> bins;
+  std::atomic<uint64_t> nan;
+  std::atomic<double> minimum, maximum, sum, sumsq;
+};
+
+// Statistics Of One Channel Written To A Sidecar
+struct ChannelStatsEntry
+{
+  int field;   // Field number, as in output filenames
+  int channel;
+  const ChannelStats *stats;
+};
+
+// Write A JSON Sidecar Describing The Channels Stored In fn_data
+bool WriteChannelStatsJSON(const std::string &fn_json, const std::string &fn_data,
+                           const std::vector<ChannelStatsEntry> &entries);
+
+#endif
@@ -0,0 +1,414 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Checksums Used For Slide Indexes And Output Verification
+// See Checksum.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Checksum.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// XXH64
+////////////////////////////////////////////////////////////////////////////////////////
+static const uint64_t kPrime64_1=0x9E3779B185EBCA87ULL;
+static const uint64_t kPrime64_2=0xC2B2AE3D27D4EB4FULL;
+static const uint64_t kPrime64_3=0x165667B19E3779F9ULL;
+static const uint64_t kPrime64_4=0x85EBCA77C2B2AE63ULL;
+static const uint64_t kPrime64_5=0x27D4EB2F165667C5ULL;
+
+static inline uint64_t Rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64-r));
+}
+
+// Unaligned Little-Endian Loads (x86 And ARM Linux Are Little-Endian)
+static inline uint64_t Read64(const unsigned char *p)
+{
+  uint64_t v; memcpy(&v,p,8); return v;
+}
+
+static inline uint32_t Read32(const unsigned char *p)
+{
+  uint32_t v; memcpy(&v,p,4); return v;
+}
+
+static inline uint64_t XXH64Round(uint64_t acc, uint64_t input)
+{
+  acc+=input*kPrime64_2;
+  acc=Rotl64(acc,31);
+  return acc*kPrime64_1;
+}
+
+static inline uint64_t XXH64MergeRound(uint64_t acc, uint64_t val)
+{
+  acc^=XXH64Round(0,val);
+  return acc*kPrime64_1+kPrime64_4;
+}
+
+// Remaining Bytes And Avalanche
+static uint64_t XXH64Finalize(uint64_t h, const unsigned char *p, const unsigned char *end)
+{
+  while (p+8 <= end)
+  {
+    h^=XXH64Round(0,Read64(p));
+    h=Rotl64(h,27)*kPrime64_1+kPrime64_4;
+    p+=8;
+  }
+  if (p+4 <= end)
+  {
+    h^=static_cast<uint64_t>(Read32(p))*kPrime64_1;
+    h=Rotl64(h,23)*kPrime64_2+kPrime64_3;
+    p+=4;
+  }
+  while (p < end)
+  {
+    h^=(*p)*kPrime64_5;
+    h=Rotl64(h,11)*kPrime64_1;
+    p++;
+  }
+  h^=h >> 33;
+  h*=kPrime64_2;
+  h^=h >> 29;
+  h*=kPrime64_3;
+  h^=h >> 32;
+  return h;
+}
+
+static inline uint64_t XXH64Converge(const uint64_t v[4])
+{
+  uint64_t h=Rotl64(v[0],1)+Rotl64(v[1],7)+Rotl64(v[2],12)+Rotl64(v[3],18);
+  for (int ii=0;ii<4;ii++) h=XXH64MergeRound(h,v[ii]);
+  return h;
+}
+
+uint64_t XXH64(const void *data, size_t nbytes, uint64_t seed)
+{
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+  const unsigned char *end=p+nbytes;
+  uint64_t h;
+
+  // Bulk Of The Input In 32 Byte Stripes
+  if (nbytes >= 32)
+  {
+    uint64_t v1=seed+kPrime64_1+kPrime64_2;
+    uint64_t v2=seed+kPrime64_2;
+    uint64_t v3=seed;
+    uint64_t v4=seed-kPrime64_1;
+    const unsigned char *limit=end-32;
+    do
+    {
+      v1=XXH64Round(v1,Read64(p)); p+=8;
+      v2=XXH64Round(v2,Read64(p)); p+=8;
+      v3=XXH64Round(v3,Read64(p)); p+=8;
+      v4=XXH64Round(v4,Read64(p)); p+=8;
+    } while (p <= limit);
+    uint64_t v[4]={v1,v2,v3,v4};
+    h=XXH64Converge(v);
+  }
+  else h=seed+kPrime64_5;
+  h+=static_cast<uint64_t>(nbytes);
+  return XXH64Finalize(h,p,end);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Incremental XXH64
+////////////////////////////////////////////////////////////////////////////////////////
+XXH64Stream::XXH64Stream(uint64_t seed_)
+{
+  Reset(seed_);
+}
+
+void XXH64Stream::Reset(uint64_t seed_)
+{
+  seed=seed_;
+  v[0]=seed+kPrime64_1+kPrime64_2;
+  v[1]=seed+kPrime64_2;
+  v[2]=seed;
+  v[3]=seed-kPrime64_1;
+  total=0;
+  nbuffer=0;
+}
+
+void XXH64Stream::Update(const void *data, size_t nbytes)
+{
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+  const unsigned char *end=p+nbytes;
+  total+=nbytes;
+
+  // Complete A Partly Filled Stripe
+  if (nbuffer > 0)
+  {
+    size_t ncopy=32-nbuffer;
+    if (ncopy > nbytes) ncopy=nbytes;
+    memcpy(buffer+nbuffer,p,ncopy);
+    nbuffer+=ncopy; p+=ncopy;
+    if (nbuffer < 32) return;
+    for (int ii=0;ii<4;ii++) v[ii]=XXH64Round(v[ii],Read64(buffer+8*ii));
+    nbuffer=0;
+  }
+
+  // Whole Stripes Straight From The Input
+  while (end-p >= 32)
+  {
+    v[0]=XXH64Round(v[0],Read64(p)); p+=8;
+    v[1]=XXH64Round(v[1],Read64(p)); p+=8;
+    v[2]=XXH64Round(v[2],Read64(p)); p+=8;
+    v[3]=XXH64Round(v[3],Read64(p)); p+=8;
+  }
+  memcpy(buffer,p,end-p);
+  nbuffer=end-p;
+}
+
+uint64_t XXH64Stream::Digest() const
+{
+  uint64_t h=(total >= 32) ? XXH64Converge(v) : seed+kPrime64_5;
+  h+=total;
+  return XXH64Finalize(h,buffer,buffer+nbuffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CRC32C
+////////////////////////////////////////////////////////////////////////////////////////
+// Byte-At-A-Time Table For The Reflected Castagnoli Polynomial
+struct CRC32CTable
+{
+  uint32_t entries[256];
+  CRC32CTable()
+  {
+    for (uint32_t ii=0;ii<256;ii++)
+    {
+      uint32_t crc=ii;
+      for (int kk=0;kk<8;kk++) crc=(crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+      entries[ii]=crc;
+    }
+  }
+};
+static const CRC32CTable kCRC32CTable;
+
+static uint32_t CRC32CSoftware(uint32_t crc, const unsigned char *p, size_t nbytes)
+{
+  for (size_t ii=0;ii<nbytes;ii++) crc=kCRC32CTable.entries[(crc ^ p[ii]) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// SSE4.2 crc32 Instruction, Eight Bytes At A Time; Selected At Run Time So The
+// Default Build Still Runs On Older CPUs
+__attribute__((target("sse4.2")))
+static uint32_t CRC32CHardware(uint32_t crc, const unsigned char *p, size_t nbytes)
+{
+  uint64_t crc64=crc;
+  while (nbytes >= 8)
+  {
+    crc64=_mm_crc32_u64(crc64,Read64(p));
+    p+=8; nbytes-=8;
+  }
+  crc=static_cast<uint32_t>(crc64);
+  while (nbytes > 0)
+  {
+    crc=_mm_crc32_u8(crc,*p);
+    p++; nbytes--;
+  }
+  return crc;
+}
+
+static const bool kHaveSSE42=__builtin_cpu_supports("sse4.2");
+#endif
+
+void CRC32CStream::Update(const void *data, size_t nbytes)
+{
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (kHaveSSE42) {crc=CRC32CHardware(crc,p,nbytes); return;}
+#endif
+  crc=CRC32CSoftware(crc,p,nbytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// SHA-256
+////////////////////////////////////////////////////////////////////////////////////////
+static const uint32_t kSHA256Rounds[64]=
+{
+  0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+  0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+  0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+  0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+  0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+  0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+  0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+  0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static inline uint32_t Rotr32(uint32_t x, int r)
+{
+  return (x >> r) | (x << (32-r));
+}
+
+static void SHA256Block(uint32_t state[8], const unsigned char *block)
+{
+  uint32_t w[64];
+  for (int ii=0;ii<16;ii++)
+  {
+    w[ii]=(static_cast<uint32_t>(block[4*ii]) << 24) | (static_cast<uint32_t>(block[4*ii+1]) << 16) |
+          (static_cast<uint32_t>(block[4*ii+2]) << 8) | block[4*ii+3];
+  }
+  for (int ii=16;ii<64;ii++)
+  {
+    uint32_t s0=Rotr32(w[ii-15],7) ^ Rotr32(w[ii-15],18) ^ (w[ii-15] >> 3);
+    uint32_t s1=Rotr32(w[ii-2],17) ^ Rotr32(w[ii-2],19) ^ (w[ii-2] >> 10);
+    w[ii]=w[ii-16]+s0+w[ii-7]+s1;
+  }
+
+  uint32_t a=state[0], b=state[1], c=state[2], d=state[3];
+  uint32_t e=state[4], f=state[5], g=state[6], h=state[7];
+  for (int ii=0;ii<64;ii++)
+  {
+    uint32_t t1=h+(Rotr32(e,6) ^ Rotr32(e,11) ^ Rotr32(e,25))+((e & f) ^ (~e & g))+kSHA256Rounds[ii]+w[ii];
+    uint32_t t2=(Rotr32(a,2) ^ Rotr32(a,13) ^ Rotr32(a,22))+((a & b) ^ (a & c) ^ (b & c));
+    h=g; g=f; f=e; e=d+t1;
+    d=c; c=b; b=a; a=t1+t2;
+  }
+  state[0]+=a; state[1]+=b; state[2]+=c; state[3]+=d;
+  state[4]+=e; state[5]+=f; state[6]+=g; state[7]+=h;
+}
+
+SHA256Stream::SHA256Stream()
+{
+  Reset();
+}
+
+void SHA256Stream::Reset()
+{
+  static const uint32_t initial[8]=
+  {
+    0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+  };
+  memcpy(state,initial,sizeof(state));
+  total=0;
+  nbuffer=0;
+}
+
+void SHA256Stream::Update(const void *data, size_t nbytes)
+{
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+  total+=nbytes;
+
+  // Complete A Partly Filled Block
+  if (nbuffer > 0)
+  {
+    size_t ncopy=64-nbuffer;
+    if (ncopy > nbytes) ncopy=nbytes;
+    memcpy(buffer+nbuffer,p,ncopy);
+    nbuffer+=ncopy; p+=ncopy; nbytes-=ncopy;
+    if (nbuffer < 64) return;
+    SHA256Block(state,buffer);
+    nbuffer=0;
+  }
+
+  // Whole Blocks Straight From The Input
+  while (nbytes >= 64)
+  {
+    SHA256Block(state,p);
+    p+=64; nbytes-=64;
+  }
+  memcpy(buffer,p,nbytes);
+  nbuffer=nbytes;
+}
+
+void SHA256Stream::Digest(unsigned char digest[32]) const
+{
+  // Pad With 0x80, Zeros And The Bit Length On A Copy, So Update Can Continue
+  uint32_t final[8];
+  memcpy(final,state,sizeof(final));
+  unsigned char tail[128];
+  memset(tail,0,sizeof(tail));
+  memcpy(tail,buffer,nbuffer);
+  tail[nbuffer]=0x80;
+  size_t ntail=(nbuffer < 56) ? 64 : 128;
+  uint64_t nbits=total*8;
+  for (int ii=0;ii<8;ii++) tail[ntail-1-ii]=static_cast<unsigned char>(nbits >> (8*ii));
+  SHA256Block(final,tail);
+  if (ntail == 128) SHA256Block(final,tail+64);
+  for (int ii=0;ii<8;ii++)
+  {
+    digest[4*ii]=final[ii] >> 24;
+    digest[4*ii+1]=final[ii] >> 16;
+    digest[4*ii+2]=final[ii] >> 8;
+    digest[4*ii+3]=final[ii];
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Selectable Output Checksum
+////////////////////////////////////////////////////////////////////////////////////////
+bool ParseChecksumType(const string &name, ChecksumType &type)
+{
+  if (name == "none") type=CHECKSUM_NONE;
+  else if (name == "xxh64") type=CHECKSUM_XXH64;
+  else if (name == "crc32c") type=CHECKSUM_CRC32C;
+  else if (name == "sha256") type=CHECKSUM_SHA256;
+  else return false;
+  return true;
+}
+
+const char *ChecksumTypeName(ChecksumType type)
+{
+  switch (type)
+  {
+    case CHECKSUM_XXH64: return "xxh64";
+    case CHECKSUM_CRC32C: return "crc32c";
+    case CHECKSUM_SHA256: return "sha256";
+    default: return "none";
+  }
+}
+
+void StreamChecksum::Reset(ChecksumType type_)
+{
+  type=type_;
+  xxh64.Reset();
+  crc32c.Reset();
+  sha256.Reset();
+}
+
+void StreamChecksum::Update(const void *data, size_t nbytes)
+{
+  switch (type)
+  {
+    case CHECKSUM_XXH64: xxh64.Update(data,nbytes); break;
+    case CHECKSUM_CRC32C: crc32c.Update(data,nbytes); break;
+    case CHECKSUM_SHA256: sha256.Update(data,nbytes); break;
+    default: break;
+  }
+}
+
+string StreamChecksum::HexDigest() const
+{
+  char hex[65];
+  switch (type)
+  {
+    case CHECKSUM_XXH64:
+    {
+      unsigned long long value=xxh64.Digest();
+      snprintf(hex,sizeof(hex),"%016llx",value);
+      return hex;
+    }
+    case CHECKSUM_CRC32C:
+      snprintf(hex,sizeof(hex),"%08x",static_cast<unsigned int>(crc32c.Digest()));
+      return hex;
+    case CHECKSUM_SHA256:
+    {
+      unsigned char digest[32];
+      sha256.Digest(digest);
+      for (int ii=0;ii<32;ii++) snprintf(hex+2*ii,3,"%02x",digest[ii]);
+      return hex;
+    }
+    default:
+      return "";
+  }
+}
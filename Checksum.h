@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Checksums Used For Slide Indexes And Output Verification
+//
+// XXH64:  xxHash 64 bit (https://github.com/Cyan4973/xxHash), a fast non-cryptographic
+//         hash used to fingerprint slide metadata and journal outputs.
+// CRC32C: CRC-32 with the Castagnoli polynomial (as in iSCSI, ext4 and cloud object
+//         stores), using the SSE4.2 crc32 instruction when the CPU has it.
+// SHA256: FIPS 180-4 SHA-256, matching sha256sum.
+//
+// Output checksums are computed by the output writer as data is flushed and listed
+// next to the outputs (see OutputWriter.h).
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// One-Shot XXH64 Of A Buffer
+uint64_t XXH64(const void *data, size_t nbytes, uint64_t seed);
+
+// Incremental XXH64: Digest() Equals The One-Shot XXH64 Of All Bytes Passed To Update
+class XXH64Stream
+{
+public:
+  explicit XXH64Stream(uint64_t seed_=0);
+  void Reset(uint64_t seed_=0);
+  void Update(const void *data, size_t nbytes);
+  uint64_t Digest() const;
+
+private:
+  uint64_t seed;
+  uint64_t v[4];
+  uint64_t total;
+  unsigned char buffer[32]; // Partial stripe
+  size_t nbuffer;
+};
+
+// Incremental CRC32C
+class CRC32CStream
+{
+public:
+  CRC32CStream() : crc(0xFFFFFFFFu) {}
+  void Reset() { crc=0xFFFFFFFFu; }
+  void Update(const void *data, size_t nbytes);
+  uint32_t Digest() const { return ~crc; }
+
+private:
+  uint32_t crc;
+};
+
+// Incremental SHA-256
+class SHA256Stream
+{
+public:
+  SHA256Stream();
+  void Reset();
+  void Update(const void *data, size_t nbytes);
+  void Digest(unsigned char digest[32]) const;
+
+private:
+  uint32_t state[8];
+  uint64_t total;
+  unsigned char buffer[64]; // Partial block
+  size_t nbuffer;
+};
+
+// Output Checksum Types
+enum ChecksumType
+{
+  CHECKSUM_NONE=0,
+  CHECKSUM_XXH64=1,
+  CHECKSUM_CRC32C=2,
+  CHECKSUM_SHA256=3
+};
+
+// Convert Between Checksum Names And Types ("none", "xxh64", "crc32c", "sha256")
+bool ParseChecksumType(const std::string &name, ChecksumType &type);
+const char *ChecksumTypeName(ChecksumType type);
+
+// Any Of The Checksums Above Behind One Interface
+class StreamChecksum
+{
+public:
+  explicit StreamChecksum(ChecksumType type_=CHECKSUM_NONE) : type(type_) {}
+  void Reset(ChecksumType type_);
+  void Update(const void *data, size_t nbytes);
+  ChecksumType Type() const { return type; }
+
+  // Digest As Lowercase Hex, Big-Endian As Printed By The Usual Tools; Empty For None
+  std::string HexDigest() const;
+
+private:
+  ChecksumType type;
+  XXH64Stream xxh64;
+  CRC32CStream crc32c;
+  SHA256Stream sha256;
+};
+
+#endif
@@ -0,0 +1,260 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Conversion Journal For Resumable Conversions
+// See ConversionJournal.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ConversionJournal.h"
+#include "Checksum.h"
+#include "IOHelpers.h"
+#include "SparseWrite.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+static const char kJournalMagic[]="SCNJOURNAL";
+static const int kJournalVersion=1;
+
+// Chunk Size For Reading Files Back
+static const size_t kHashChunk=4*1024*1024;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+static string HexHash(uint64_t hash)
+{
+  char buffer[17];
+  snprintf(buffer,sizeof(buffer),"%016" PRIx64,hash);
+  return buffer;
+}
+
+static bool ParseHash(const string &text, uint64_t &hash)
+{
+  if (text.size() != 16) return false;
+  char *end=0;
+  hash=strtoull(text.c_str(),&end,16);
+  return (*end == '\0');
+}
+
+// Rest Of A Record After The Fields Already Read, Without The Separating Space
+static bool ReadFilename(istringstream &record, string &filename)
+{
+  if (record.get() != ' ') return false;
+  getline(record,filename);
+  return !filename.empty();
+}
+
+bool HashFile(const string &filename, uint64_t &nbytes, uint64_t &hash, StreamChecksum *checksum)
+{
+  int fd=open(filename.c_str(),O_RDONLY);
+  if (fd < 0) return false;
+  posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+  vector<char> chunk(kHashChunk);
+  XXH64Stream stream;
+  nbytes=0;
+  for (;;)
+  {
+    ssize_t nread=read(fd,&chunk[0],chunk.size());
+    if (nread < 0 && errno == EINTR) continue;
+    if (nread < 0) {close(fd); return false;}
+    if (nread == 0) break;
+    stream.Update(&chunk[0],nread);
+    if (checksum != NULL) checksum->Update(&chunk[0],nread);
+    nbytes+=nread;
+  }
+  close(fd);
+  hash=stream.Digest();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Journal
+////////////////////////////////////////////////////////////////////////////////////////
+ConversionJournal::ConversionJournal() : file(NULL)
+{
+}
+
+ConversionJournal::~ConversionJournal()
+{
+  Close();
+}
+
+bool ConversionJournal::Open(const string &fn_journal, const string &signature, bool resume)
+{
+  Close();
+  outputs.clear();
+  partials.clear();
+
+  // Keep A Matching Journal When Resuming, Otherwise Start Over
+  if (resume && Load(fn_journal,signature))
+  {
+    file=fopen(fn_journal.c_str(),"a");
+    return (file != NULL);
+  }
+  if (resume) cout << "Resume: No Matching Journal In " << fn_journal << ", Converting Everything" << endl;
+  file=fopen(fn_journal.c_str(),"w");
+  if (file == NULL) return false;
+  ostringstream header;
+  header << kJournalMagic << " " << kJournalVersion << " " << signature;
+  return Append(header.str());
+}
+
+void ConversionJournal::Close()
+{
+  if (file != NULL) fclose(file);
+  file=NULL;
+}
+
+bool ConversionJournal::Load(const string &fn_journal, const string &signature)
+{
+  ifstream ifile(fn_journal.c_str());
+  if (!ifile) return false;
+
+  // Header Must Match This Conversion
+  string line;
+  ostringstream header;
+  header << kJournalMagic << " " << kJournalVersion << " " << signature;
+  if (!getline(ifile,line) || line != header.str()) return false;
+
+  // Records; Lines That Do Not Parse (A Torn Last Write) Are Skipped
+  while (getline(ifile,line))
+  {
+    istringstream record(line);
+    string kind, shash, filename;
+    record >> kind;
+    if (kind == "output")
+    {
+      OutputRecord output;
+      if (!(record >> output.nbytes >> shash) || !ParseHash(shash,output.hash) ||
+          !ReadFilename(record,filename)) continue;
+      outputs[filename]=output;
+    }
+    else if (kind == "band")
+    {
+      uint64_t totalbytes;
+      JournalBand band;
+      if (!(record >> totalbytes >> band.offset >> band.nbytes >> shash) || !ParseHash(shash,band.hash) ||
+          !ReadFilename(record,filename)) continue;
+      BandRecord &partial=partials[filename];
+      if (!partial.bands.empty() && partial.totalbytes != totalbytes) partial.bands.clear();
+      partial.totalbytes=totalbytes;
+      partial.bands.push_back(band);
+    }
+  }
+  return true;
+}
+
+bool ConversionJournal::Append(const string &record)
+{
+  if (file == NULL) return false;
+  if (fprintf(file,"%s\n",record.c_str()) < 0 || fflush(file) != 0) return false;
+  return (fdatasync(fileno(file)) == 0);
+}
+
+bool ConversionJournal::OutputDone(const string &fn_out, StreamChecksum *checksum) const
+{
+  map<string, OutputRecord>::const_iterator it=outputs.find(fn_out);
+  if (it == outputs.end()) return false;
+  // Hash Into A Copy, So A Failed Check Leaves checksum As It Was For The Rewrite
+  StreamChecksum verified(checksum != NULL ? *checksum : StreamChecksum());
+  uint64_t nbytes, hash;
+  if (!HashFile(fn_out,nbytes,hash,&verified)) return false;
+  if (nbytes != it->second.nbytes || hash != it->second.hash) return false;
+  if (checksum != NULL) *checksum=verified;
+  return true;
+}
+
+vector<JournalBand> ConversionJournal::BandsDone(const string &fn_out, uint64_t totalbytes) const
+{
+  map<string, BandRecord>::const_iterator it=partials.find(fn_out);
+  if (it == partials.end() || it->second.totalbytes != totalbytes) return vector<JournalBand>();
+  return it->second.bands;
+}
+
+bool ConversionJournal::RecordOutput(const string &fn_out, uint64_t nbytes, uint64_t hash)
+{
+  OutputRecord output={nbytes,hash};
+  outputs[fn_out]=output;
+  ostringstream record;
+  record << "output " << nbytes << " " << HexHash(hash) << " " << fn_out;
+  return Append(record.str());
+}
+
+bool ConversionJournal::RecordBand(const string &fn_out, uint64_t totalbytes, const JournalBand &band)
+{
+  ostringstream record;
+  record << "band " << totalbytes << " " << band.offset << " " << band.nbytes << " " << HexHash(band.hash) << " "
+         << fn_out;
+  return Append(record.str());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Checkpointed Output File
+////////////////////////////////////////////////////////////////////////////////////////
+CheckpointFile::CheckpointFile() : fd(-1), sparse(false), headerbytes(0), nholes(0)
+{
+}
+
+CheckpointFile::~CheckpointFile()
+{
+  if (fd >= 0) Close();
+}
+
+bool CheckpointFile::Open(const string &filename, uint64_t totalbytes, bool keep, bool sparse_, const string &header)
+{
+  if (fd >= 0) Close();
+  sparse=sparse_;
+  headerbytes=0;
+  nholes=0;
+  int flags=O_RDWR | O_CREAT | (keep ? 0 : O_TRUNC);
+  fd=open(filename.c_str(),flags,0644);
+  if (fd < 0) return false;
+
+  // Size The File Up Front; Bands Not Yet Written Read Back As Zeros
+  if (ftruncate(fd,header.size()+totalbytes) != 0)
+  {
+    close(fd); fd=-1;
+    return false;
+  }
+
+  // Write The Header Before Band Offsets Are Shifted Past It
+  if (!header.empty() && !WriteBand(0,header.data(),header.size()))
+  {
+    close(fd); fd=-1;
+    return false;
+  }
+  headerbytes=header.size();
+  return true;
+}
+
+bool CheckpointFile::Close()
+{
+  if (fd < 0) return false;
+  bool ok=(close(fd) == 0);
+  fd=-1;
+  return ok;
+}
+
+bool CheckpointFile::WriteBand(uint64_t offset, const void *data, size_t nbytes)
+{
+  if (fd < 0) return false;
+  offset+=headerbytes;
+
+  // Zero Blocks Are Punched Out, Since The File May Hold Data From An Earlier Run
+  if (sparse) return PwriteSparse(fd,data,nbytes,offset,true,&nholes) && fdatasync(fd) == 0;
+  return PwriteAll(fd,data,nbytes,offset) && fdatasync(fd) == 0;
+}
+
+bool CheckpointFile::ReadBand(const JournalBand &band, void *dst)
+{
+  if (fd < 0) return false;
+  if (!PreadAll(fd,dst,band.nbytes,headerbytes+band.offset)) return false;
+  return (XXH64(dst,band.nbytes,0) == band.hash);
+}
@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Conversion Journal For Resumable Conversions
+//
+// An append-only text file next to the outputs recording every finished output file,
+// and for large outputs every finished band of tile rows, with its size and XXH64
+// checksum. Each record is synced to disk before the converter moves on, so a run
+// killed at any point leaves a journal describing exactly what is already on disk.
+//
+// A rerun with --resume skips outputs whose file still has the recorded size and
+// checksum, and within a partly written output re-decodes only the bands that are
+// missing or fail their checksum. Band records are kept once the output is finished,
+// so a finished output that fails its check is repaired band by band in the same
+// way. The journal is ignored when it was written for a different slide or different
+// conversion options (see the signature in Open).
+//
+// Journal Format (one record per line, filenames last so they may hold spaces):
+//   SCNJOURNAL 1 <signature>
+//   output <bytes> <xxh64> <filename>
+//   band <total bytes> <offset> <bytes> <xxh64> <filename>
+//   (xxh64 as 16 hex digits; an incomplete last line from a crash is ignored)
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CONVERSIONJOURNAL_H
+#define CONVERSIONJOURNAL_H
+
+#include "Checksum.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// One Finished Byte Range Of A Partly Written Output
+struct JournalBand
+{
+  uint64_t offset, nbytes, hash;
+};
+
+class ConversionJournal
+{
+public:
+  ConversionJournal();
+  ~ConversionJournal();
+
+  // Open The Journal For A Conversion Identified By signature (Slide And Options).
+  // With resume, Records Of An Earlier Run With The Same Signature Are Kept and
+  // Appended To; Otherwise The Journal Is Started Over.
+  bool Open(const std::string &fn_journal, const std::string &signature, bool resume);
+  void Close();
+
+  // True If An Earlier Run Finished fn_out And The File Still Has The Recorded Size
+  // And Checksum. The File Is Read Back To Check; On A Match It Is Also Fed To
+  // checksum If Given, Which Is Left Untouched Otherwise.
+  bool OutputDone(const std::string &fn_out, StreamChecksum *checksum=NULL) const;
+
+  // Bands Of fn_out Finished By An Earlier Run While It Was totalbytes Long, Also
+  // After The Whole Output Was Recorded. They Are Not Verified; Check Them With
+  // CheckpointFile::ReadBand.
+  std::vector<JournalBand> BandsDone(const std::string &fn_out, uint64_t totalbytes) const;
+
+  // Append A Record And Sync It To Disk
+  bool RecordOutput(const std::string &fn_out, uint64_t nbytes, uint64_t hash);
+  bool RecordBand(const std::string &fn_out, uint64_t totalbytes, const JournalBand &band);
+
+private:
+  ConversionJournal(const ConversionJournal &);
+  ConversionJournal &operator=(const ConversionJournal &);
+
+  bool Load(const std::string &fn_journal, const std::string &signature);
+  bool Append(const std::string &record);
+
+  struct OutputRecord
+  {
+    uint64_t nbytes, hash;
+  };
+  struct BandRecord
+  {
+    uint64_t totalbytes;
+    std::vector<JournalBand> bands;
+  };
+
+  FILE *file;
+  std::map<std::string, OutputRecord> outputs;
+  std::map<std::string, BandRecord> partials;
+};
+
+// Output File Written In Bands At Fixed Offsets, Each Synced To Disk Before It Is
+// Journaled. Opening With keep Preserves Bands Written By An Earlier Run. With sparse,
+// All-Zero Blocks Of A Band Are Punched Out As Holes (see SparseWrite.h). A header
+// (e.g. .npy) Is Written At The Start Of The File And Band Offsets Count From Its End.
+class CheckpointFile
+{
+public:
+  CheckpointFile();
+  ~CheckpointFile();
+
+  bool Open(const std::string &filename, uint64_t totalbytes, bool keep, bool sparse=false,
+            const std::string &header=std::string());
+  bool Close();
+
+  uint64_t BytesInHoles() const { return nholes; }
+
+  // Write A Band And Sync It
+  bool WriteBand(uint64_t offset, const void *data, size_t nbytes);
+
+  // Read A Journaled Band Back Into dst, True If It Matches Its Checksum
+  bool ReadBand(const JournalBand &band, void *dst);
+
+private:
+  CheckpointFile(const CheckpointFile &);
+  CheckpointFile &operator=(const CheckpointFile &);
+
+  int fd;
+  bool sparse;
+  uint64_t headerbytes;
+  uint64_t nholes;
+};
+
+// XXH64 Of A Whole File, Read In Chunks, Also Feeding checksum If Given; false If
+// It Cannot Be Read
+bool HashFile(const std::string &filename, uint64_t &nbytes, uint64_t &hash, StreamChecksum *checksum=NULL);
+
+#endif
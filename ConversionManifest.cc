@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Conversion Manifest
+// See ConversionManifest.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ConversionManifest.h"
+#include "IOHelpers.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// JSON Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+static string JSONArray(const vector<uint64_t> &values)
+{
+  ostringstream text;
+  text << "[";
+  for (size_t ii=0;ii<values.size();ii++) text << (ii > 0 ? ", " : "") << values[ii];
+  text << "]";
+  return text.str();
+}
+
+// Name Relative To The Manifest, Which Sits In The Same Directory As The Outputs
+static string BaseName(const string &filename)
+{
+  return filename.substr(filename.find_last_of('/')+1);
+}
+
+static bool HostIsLittleEndian()
+{
+  const uint16_t probe=1;
+  return (*reinterpret_cast<const unsigned char *>(&probe) == 1);
+}
+
+// NumPy Type String, e.g. "<u2"
+static string NumPyType(SampleType type)
+{
+  const char *kind;
+  switch (type)
+  {
+    case SAMPLE_INT8: case SAMPLE_INT16: case SAMPLE_INT32: kind="i"; break;
+    case SAMPLE_FLOAT32: case SAMPLE_FLOAT64: kind="f"; break;
+    default: kind="u"; break;
+  }
+  ostringstream text;
+  text << (SampleBytes(type) == 1 ? "|" : (HostIsLittleEndian() ? "<" : ">")) << kind << SampleBytes(type);
+  return text.str();
+}
+
+static const char *AxesName(ManifestAxes axes)
+{
+  switch (axes)
+  {
+    case AXES_CYX: return "CYX";
+    case AXES_YXC: return "YXC";
+    default: return "YX";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Outputs
+////////////////////////////////////////////////////////////////////////////////////////
+static const size_t kNpyAlignment=64;
+
+ManifestOutput DescribeOutput(const string &filename, const SCNField &field, const vector<int> &channels,
+                              ManifestAxes axes, SampleType type, uint32 ww, uint32 hh)
+{
+  ManifestOutput output;
+  output.filename=filename;
+  output.field=field.number;
+  output.channels=channels;
+  output.axes=axes;
+  output.type=type;
+  output.width=ww;
+  output.height=hh;
+  output.offset=0;
+  output.pixelSizeX=(ww > 0) ? static_cast<double>(field.viewSizeX)/ww : 0.0;
+  output.pixelSizeY=(hh > 0) ? static_cast<double>(field.viewSizeY)/hh : 0.0;
+  output.viewOffsetX=field.viewOffsetX;
+  output.viewOffsetY=field.viewOffsetY;
+  output.viewSizeX=field.viewSizeX;
+  output.viewSizeY=field.viewSizeY;
+  return output;
+}
+
+void OutputShape(const ManifestOutput &output, vector<uint64_t> &shape, vector<uint64_t> &strides)
+{
+  uint64_t nbytes=SampleBytes(output.type);
+  uint64_t nchannels=output.channels.size();
+  uint64_t ww=output.width, hh=output.height;
+  switch (output.axes)
+  {
+    case AXES_CYX:
+      shape={nchannels,hh,ww};
+      strides={hh*ww*nbytes,ww*nbytes,nbytes};
+      break;
+    case AXES_YXC:
+      shape={hh,ww,nchannels};
+      strides={ww*nchannels*nbytes,nchannels*nbytes,nbytes};
+      break;
+    default:
+      shape={hh,ww};
+      strides={ww*nbytes,nbytes};
+      break;
+  }
+}
+
+string NpyHeader(const ManifestOutput &output)
+{
+  vector<uint64_t> shape, strides;
+  OutputShape(output,shape,strides);
+  ostringstream dict;
+  dict << "{'descr': '" << NumPyType(output.type) << "', 'fortran_order': False, 'shape': (";
+  for (size_t ii=0;ii<shape.size();ii++) dict << (ii > 0 ? ", " : "") << shape[ii];
+  dict << (shape.size() == 1 ? ",), }" : "), }");
+
+  // Magic, Version, Header Length, Then The Dictionary Padded With Spaces And Ended
+  // With A Newline
+  string text=dict.str();
+  size_t total=(10+text.size()+1+kNpyAlignment-1)/kNpyAlignment*kNpyAlignment;
+  text.append(total-10-text.size()-1,' ');
+  text+='\n';
+  string header("\x93NUMPY\x01\x00",8);
+  header+=static_cast<char>(text.size() & 0xFF);
+  header+=static_cast<char>((text.size() >> 8) & 0xFF);
+  return header+text;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// JSON File
+////////////////////////////////////////////////////////////////////////////////////////
+bool WriteConversionManifestJSON(const string &fn_json, const ConversionManifest &manifest)
+{
+  ostringstream convert;
+  convert << fn_json << ".tmp" << getpid();
+  string fn_tmp=convert.str();
+  ofstream ofile(fn_tmp.c_str());
+  if (!ofile) return false;
+
+  ofile << "{\n"
+        << "  \"format\": \"SCNMANIFEST\",\n"
+        << "  \"version\": 1,\n"
+        << "  \"slide\": " << JSONString(manifest.slide) << ",\n"
+        << "  \"byte_order\": \"" << (HostIsLittleEndian() ? "little" : "big") << "\",\n"
+        << "  \"collection_size_nm\": [" << manifest.collectionSizeX << ", " << manifest.collectionSizeY << "],\n"
+        << "  \"outputs\": [";
+  for (size_t io=0;io<manifest.outputs.size();io++)
+  {
+    const ManifestOutput &output=manifest.outputs[io];
+    vector<uint64_t> shape, strides;
+    OutputShape(output,shape,strides);
+    uint64_t nbytes=output.offset+shape[0]*strides[0];
+    ofile << (io > 0 ? "," : "") << "\n    {\n"
+          << "      \"file\": " << JSONString(BaseName(output.filename)) << ",\n"
+          << "      \"field\": " << output.field << ",\n"
+          << "      \"channels\": [";
+    for (size_t ic=0;ic<output.channels.size();ic++) ofile << (ic > 0 ? ", " : "") << output.channels[ic];
+    ofile << "],\n"
+          << "      \"type\": \"" << SampleTypeName(output.type) << "\",\n"
+          << "      \"dtype\": \"" << NumPyType(output.type) << "\",\n"
+          << "      \"axes\": \"" << AxesName(output.axes) << "\",\n"
+          << "      \"shape\": " << JSONArray(shape) << ",\n"
+          << "      \"strides\": " << JSONArray(strides) << ",\n"
+          << "      \"offset\": " << output.offset << ",\n"
+          << "      \"bytes\": " << nbytes << ",\n"
+          << "      \"row_order\": \"bottom_up\",\n"
+          << "      \"pixel_size_nm\": [" << JSONNumber(output.pixelSizeX) << ", " << JSONNumber(output.pixelSizeY) << "],\n"
+          << "      \"field_offset_nm\": [" << output.viewOffsetX << ", " << output.viewOffsetY << "],\n"
+          << "      \"field_size_nm\": [" << output.viewSizeX << ", " << output.viewSizeY << "],\n"
+          << "      \"checksum\": ";
+    if (output.checksumtype.empty()) ofile << "null";
+    else ofile << "{\"type\": " << JSONString(output.checksumtype) << ", \"value\": " << JSONString(output.checksum) << "}";
+    ofile << ",\n"
+          << "      \"stats\": " << (output.fn_stats.empty() ? string("null") : JSONString(BaseName(output.fn_stats)))
+          << "\n    }";
+  }
+  ofile << "\n  ]\n}\n";
+  ofile.close();
+
+  bool ok=!ofile.fail();
+  if (ok) ok=(rename(fn_tmp.c_str(),fn_json.c_str()) == 0);
+  if (!ok) unlink(fn_tmp.c_str());
+  return ok;
+}
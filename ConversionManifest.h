@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Conversion Manifest
+//
+// A JSON file next to the outputs (filename_output_prefix+'Manifest.json') describing
+// every output of a conversion completely enough to memory-map it without parsing
+// filenames or calling stat:
+//
+//   {
+//     "format": "SCNMANIFEST", "version": 1,
+//     "slide": "<slide filename>",
+//     "byte_order": "little",                  (host byte order of all outputs)
+//     "collection_size_nm": [x, y],
+//     "outputs": [
+//       {
+//         "file": "<name relative to the manifest>",
+//         "field": A, "channels": [B, ...],    (in storage order)
+//         "type": "uint16", "dtype": "<u2",    (NumPy type string)
+//         "axes": "YX" | "CYX" | "YXC",
+//         "shape": [...], "strides": [...],    (bytes, per axis, as stored)
+//         "offset": 0,                         (byte offset of the first sample)
+//         "bytes": N,                          (file size)
+//         "row_order": "bottom_up",            (first stored row is the bottom row)
+//         "pixel_size_nm": [x, y],
+//         "field_offset_nm": [x, y],           (<view> offset within the <collection>)
+//         "field_size_nm": [x, y],
+//         "checksum": {"type": "sha256", "value": "..."} | null,
+//         "stats": "<stats sidecar>" | null
+//       }, ...
+//     ]
+//   }
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CONVERSIONMANIFEST_H
+#define CONVERSIONMANIFEST_H
+
+#include "LeicaSCN.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Storage Order Of The Channels Of One Output
+enum ManifestAxes
+{
+  AXES_YX=0,  // One channel
+  AXES_CYX=1, // Channels stored plane by plane
+  AXES_YXC=2  // Channels interleaved per pixel
+};
+
+// One Output File
+struct ManifestOutput
+{
+  std::string filename;
+  int field;                       // Field number, as in output filenames
+  std::vector<int> channels;       // In storage order
+  ManifestAxes axes;
+  SampleType type;
+  uint32 width, height;
+  uint64_t offset;                 // Bytes before the first sample
+  double pixelSizeX, pixelSizeY;   // nm per pixel
+  long viewOffsetX, viewOffsetY;   // nm
+  long viewSizeX, viewSizeY;       // nm
+  std::string checksumtype;        // Empty without a checksum
+  std::string checksum;
+  std::string fn_stats;            // Empty without a statistics sidecar
+};
+
+struct ConversionManifest
+{
+  std::string slide;
+  long collectionSizeX, collectionSizeY; // nm
+  std::vector<ManifestOutput> outputs;
+};
+
+// Describe An Output Holding channels Of field, ww x hh Pixels Each
+ManifestOutput DescribeOutput(const std::string &filename, const SCNField &field, const std::vector<int> &channels,
+                              ManifestAxes axes, SampleType type, uint32 ww, uint32 hh);
+
+// Shape And Strides (Bytes) Of An Output As Stored, Outermost Axis First
+void OutputShape(const ManifestOutput &output, std::vector<uint64_t> &shape, std::vector<uint64_t> &strides);
+
+// NumPy .npy (Version 1.0) Header For An Output: Its dtype And Shape, C Order, Padded
+// So The Data Starts At A Multiple Of 64 Bytes. Rows Stay Bottom Row First, As In
+// .bin Outputs. np.load(filename, mmap_mode='r') Maps The File Directly.
+std::string NpyHeader(const ManifestOutput &output);
+
+// Write The Manifest Through A Temporary File, So Readers Never See A Partial One
+bool WriteConversionManifestJSON(const std::string &fn_json, const ConversionManifest &manifest);
+
+#endif
@@ -8,20 +8,164 @@
 //
 //
 // To Compile (on linux):
-//   g++ -Wall -L/usr/lib64 -ltiff -lxml2 -o ConvertLeicaSCN400F ConvertLeicaSCN400F.cc
+//   g++ -Wall -O2 -pthread -L/usr/lib64 -o ConvertLeicaSCN400F ConvertLeicaSCN400F.cc BufferPool.cc ChannelStats.cc Checksum.cc ConversionJournal.cc ConversionManifest.cc IFDScanner.cc IOHelpers.cc ImageEncode.cc LeicaSCN.cc Mosaic.cc NumaTopology.cc OutputWriter.cc ShardPlan.cc SharedOutput.cc SlideFingerprint.cc SlideIndex.cc SlideReader.cc SparseWrite.cc ThreadPool.cc Thumbnail.cc TileCache.cc TileScheduler.cc TileServer.cc TileStream.cc -ltiff -lxml2 -ljpeg -lrt
 //
-//   Note: libtiff 4 or higher and libxml2 must be installed on your computer
-//         Replace /usr/lib64 with the location of libtiff 4 and libxml2 libraries on your computer
+//   Note: libtiff 4 or higher, libxml2 and libjpeg must be installed on your computer
+//         Replace /usr/lib64 with the location of libtiff 4, libxml2 and libjpeg libraries on your computer
+//
+//   Or with CMake, which builds optimised (-O3) by default and supports LTO and
+//   profile guided builds (see CMakeLists.txt):
+//     cmake -S . -B build && cmake --build build -j
 //
 //
 // To Run (on linux):
-// ./ConvertLeicaSCN400F filename_input filename_output_prefix
+// ./ConvertLeicaSCN400F [options] filename_input filename_output_prefix
+//
+//   Options:
+//     --layout=MODE          Output file layout (default: separate)
+//                              separate:    One file per channel of each field
+//                              planar:      One file per field, all channels stored
+//                                           plane by plane (CHW)
+//                              interleaved: One file per field, all channels stored
+//                                           pixel by pixel (HWC)
+//     --native               Read samples at their stored bit depth and sample format
+//                            instead of through 8 bit RGBA (e.g. 16 bit fluorescence)
+//     --format=FORMAT        Output file format (default: bin)
+//                              bin: Raw samples only
+//                              npy: NumPy .npy, a header with dtype and shape, then
+//                                   the same samples from a 64 byte aligned offset
+//     --index-dir=DIR        Keep the slide metadata index in DIR instead of next to
+//                            the slide (filename_input.scnidx)
+//     --no-index             Do not read or write the slide metadata index
+//     --writer=MODE          Output write backend (default: buffered)
+//                              buffered: Plain buffered writes through the page cache
+//                              dontneed: Buffered writes, written data is dropped from
+//                                        the page cache (posix_fadvise DONTNEED)
+//                              direct:   O_DIRECT writes that bypass the page cache
+//     --write-buffer-mb=N    Size of each of the two write buffers in MB (default: 16)
+//     --stats                Gather intensity statistics of every channel while it is
+//                            read and write them next to each output file (see below)
+//     --resume               Skip the work an earlier, interrupted run of the same
+//                            conversion already finished (see the journal below)
+//     --no-journal           Do not keep the conversion journal
+//     --checkpoint-mb=N      With --native and --layout=separate, outputs larger than
+//                            N MB are written in bands of about N MB of tile rows, each
+//                            journaled once on disk (default: 256)
+//     --sparse               Leave all-zero blocks (e.g. black background tile rows) of
+//                            every output as filesystem holes; the files read back
+//                            byte for byte the same (see SparseWrite.h)
+//     --checksum=TYPE        Checksum every output as it is written (default: none)
+//                              xxh64:  xxHash 64 bit, fastest
+//                              crc32c: CRC-32C, hardware accelerated on SSE4.2 CPUs
+//                              sha256: SHA-256, as printed by sha256sum
+//     --skip-unchanged       Fingerprint the slide (description and compressed tile
+//                            bytes, no decoding) and do nothing if it and the options
+//                            match the last finished conversion (see below)
+//     --huge-pages           Back large field and scratch buffers with transparent huge
+//                            pages (buffers are pooled and reused, see BufferPool.h)
+//     --threads=N            With --native, tile decode threads (default: one per
+//                            hardware thread). Tiles are scheduled largest compressed
+//                            size first, with work stealing (see TileScheduler.h)
+//     --no-numa              Do not pin decode threads to NUMA nodes or place their
+//                            part of each output on the node decoding it (placement is
+//                            used when the process may run on more than one node)
+//     --fields=LIST          Only these fields (positions in the slide), e.g. 0,2-3
+//     --channels=LIST        Only these channels (--layout=separate only)
+//     --tile-rows=A:B        Only tile rows A to B-1 of each selected channel, written
+//                            into place in the full-size output (--native and
+//                            --layout=separate only, not with --stats)
+//     --shm                  Write each output to a POSIX shared memory segment named
+//                            after its filename instead of a file (see below)
+//
+//   With --fields, --channels or --tile-rows the run is a shard: several processes may
+//   fill disjoint parts of the same outputs at once. A shard keeps no journal and writes
+//   no Manifest.json or fingerprint; --resume, --skip-unchanged and --checksum are
+//   not allowed.
 //
 //
 // Example:
 // ./ConvertLeicaSCN400F Slide_899633L_DAPI_CD31_COLIV.scn data_converted/Slide_899633L_DAPI_CD31_COLIV_
 //
 //
+// To Serve Tiles To A Viewer (see TileServer.h for the URL scheme):
+// ./ConvertLeicaSCN400F serve [options] filename_input [filename_input ...]
+//
+//   Options:
+//     --host=ADDR            Address to listen on (default: 127.0.0.1)
+//     --port=N               Port to listen on, 0 for any free port (default: 8080)
+//     --threads=N            Tile render threads (default: one per hardware thread)
+//     --cache-mb=N           Decoded tile cache size in MB (default: 256)
+//     --tile-size=N          Deep Zoom tile size (default: 254)
+//     --overlap=N            Deep Zoom tile overlap (default: 1)
+//     --quality=N            JPEG quality, 1-100 (default: 85)
+//     --index-dir=DIR, --no-index
+//                            As for conversion
+//
+//   The server runs until interrupted (Ctrl-C).
+//
+//
+// To Make Quick Overview Images (see Thumbnail.h):
+// ./ConvertLeicaSCN400F thumbnail [options] filename_input filename_output_prefix
+//
+//   Options:
+//     --size=N               Longest side of each thumbnail in pixels (default: 512)
+//     --field=N              Only this field (position in the slide, default: all)
+//     --channel=C            Only this channel, as grayscale (default: channels 0-2
+//                            as red, green and blue)
+//     --contrast=MODE        full: map the stored bit depth to 0-255 (default)
+//                            auto: stretch the 0.1 to 99.9 percentile of each channel
+//     --format=FORMAT        jpeg (default) or pnm (PGM for one channel, PPM otherwise)
+//     --quality=N            JPEG quality, 1-100 (default: 90)
+//     --index-dir=DIR, --no-index
+//                            As for conversion
+//
+//   Output filenames = filename_output_prefix+'ImageA_Thumbnail_XCCCC_YDDDDD.jpg'
+//                      (.pgm or .ppm with --format=pnm), rows top first
+//
+//
+// To Stitch All Fields Into One Slide-Wide Image By Their Position (see Mosaic.h):
+// ./ConvertLeicaSCN400F mosaic [options] filename_input filename_output_prefix
+//
+//   Options:
+//     --chunk-size=N         Side of each stored chunk in pixels (default: 512)
+//     --channel=C            Only this channel (default: all)
+//     --threads=N            Chunk threads (default: one per hardware thread)
+//     --cache-mb=N           Decoded tile cache size in MB (default: 256)
+//     --index-dir=DIR, --no-index
+//                            As for conversion
+//
+//   Output filenames = filename_output_prefix+'Mosaic_ChannelB_XCCCC_YDDDDD[_type].bin'
+//                      Chunked, rows top first, native bit depth; chunks no field
+//                      touches, and all-zero chunks, are left as holes in the file
+//   filename_output_prefix+'Mosaic.json' describes the grid, field placements and
+//   channel files, with the chunks written to each.
+//
+//
+// To Split A Conversion Into Shards Of About Equal Compressed Size (see ShardPlan.h):
+// ./ConvertLeicaSCN400F plan --shards=N [options] filename_input filename_output_prefix
+//
+//   Prints one shell command line per shard; the options are conversion options and
+//   are passed on to every shard. Run the lines as independent jobs, e.g. with
+//   'xargs -P' or on cluster nodes sharing the output directory.
+//
+//
+// To Stream Tiles Through A Pipe (see TileStream.h for the frame format):
+// ./ConvertLeicaSCN400F stream [options] filename_input [filename_input ...] | consumer
+//
+//   Options:
+//     --raw                  Send tiles as stored (compressed) instead of decoded
+//     --level=N              Resolution level, 0 = highest (default: 0)
+//     --fields=LIST          Only these fields (positions in the slide), e.g. 0,2-3
+//     --channels=LIST        Only these channels
+//     --threads=N            Tile read threads (default: one per hardware thread)
+//     --index-dir=DIR, --no-index
+//                            As for conversion
+//
+//   Writes framed tiles to stdout in the order they finish, then an end frame.
+//   Messages go to stderr. Decoded tiles hold one channel at native bit depth, rows
+//   top first.
+//
+//
 // Output:
 //   The program will generate a series of files, one for each channel of each field, 
 //     where a field is a single sample on the slide. 
@@ -34,6 +178,51 @@
 //                      CCCC = The number of pixels in the X dimension
 //                      DDDDD = The number of pixels in the Y dimension
 //                      File format = Binary, Unsigned 8 Bit Integer
+//                      Row order = Bottom row of the field first
+//
+//   With --native, data that is not 8 bit unsigned keeps its stored type and the type
+//   is added to the filename, e.g. 'ImageA_ChannelB_XCCCC_YDDDDD_uint16.bin'
+//   (types: int8, uint16, int16, uint32, int32, float32, float64; host byte order).
+//
+//   With --layout=planar or --layout=interleaved there is one file per field instead:
+//   Output filenames = filename_output_prefix+'ImageA_LLL_CN_XCCCC_YDDDDD.bin'
+//                      LLL = CHW (planar) or HWC (interleaved)
+//                      N = The number of channels, stored in increasing channel order
+//
+//   With --format=npy the extension is '.npy' and each file starts with a NumPy header
+//   padded to 64 bytes, so np.load(fn, mmap_mode='r') maps the samples without a copy.
+//   The header records dtype and shape only; rows stay bottom row first (np.flipud).
+//   Manifest.json gives the header size as each output's offset.
+//
+//   With --stats, each output file gets a JSON sidecar with '.bin' replaced by
+//   '.stats.json', holding per channel: min, max, mean, std, percentiles and the
+//   histogram (see ChannelStats.h).
+//
+//   The conversion journal, filename_output_prefix+'Conversion.journal', records each
+//   finished output (and each finished band of a large output) with its size and XXH64
+//   checksum. With --resume, outputs that still match the journal are skipped and
+//   partly written outputs continue from their last good band (see ConversionJournal.h).
+//
+//   filename_output_prefix+'Manifest.json' describes every output: element type,
+//   shape, strides, byte offset, row order, pixel size and field placement in nm, and
+//   checksum, so loaders can map outputs without parsing filenames (see
+//   ConversionManifest.h).
+//
+//   With --checksum=TYPE, filename_output_prefix+'Checksums.TYPE' lists one
+//   'checksum  filename' line per output, so with sha256 'sha256sum -c' can check it.
+//
+//   With --shm, filename_output_prefix must not contain '/', and each output goes to
+//   the shared memory segment '/'+its filename (/dev/shm/... on Linux): a 64 byte
+//   header with type, layout, size, field and channel, then the samples, decoded
+//   straight into the segment. Consumers on the same node map it and wait for its
+//   state to be ready (see SharedOutput.h). Nothing is written to the filesystem: no
+//   journal, Manifest.json or fingerprint; --resume, --skip-unchanged, --checksum,
+//   --sparse, --stats, --format=npy and --tile-rows are not allowed.
+//
+//   With --skip-unchanged, a finished conversion leaves its source fingerprint, options
+//   and output list in filename_output_prefix+'Conversion.fingerprint'. A rerun that finds
+//   the same fingerprint and options, and all outputs present, exits at once
+//   (see SlideFingerprint.h).
 //
 //   Exit Codes:
 //     0: Success
@@ -41,6 +230,8 @@
 //     2: Could not parse XML description in .scn file
 //     3: Could not read image from Leica .scn file
 //     4: Could not allocate memory for image
+//     5: Could not write output file
+//     6: Could not start tile server
 //
 // Notes about reading highest resolution pixel data from Leica fluorescence images:
 // [Information from Benjamin Gilbert @ OpenSlide]
@@ -79,9 +270,7 @@
 
 extern "C" {
   #include <tiffio.h>
-  #include <libxml/tree.h>
   #include <libxml/parser.h>
-  #include <libxml/xpath.h>
 }
 #include <stdio.h>
 #include <stdlib.h>
@@ -90,9 +279,34 @@ extern "C" {
 #include <sstream>
 #include <string>
 #include <vector>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <new>
 #include <cstdlib>
 #include <cmath>
 #include <ctime>
+#include "ChannelStats.h"
+#include "BufferPool.h"
+#include "Checksum.h"
+#include "ConversionJournal.h"
+#include "ConversionManifest.h"
+#include "LeicaSCN.h"
+#include "Mosaic.h"
+#include "OutputWriter.h"
+#include "SlideFingerprint.h"
+#include "SlideIndex.h"
+#include "ImageEncode.h"
+#include "ShardPlan.h"
+#include "SharedOutput.h"
+#include "SlideReader.h"
+#include "Thumbnail.h"
+#include "TileScheduler.h"
+#include "TileServer.h"
+#include "TileStream.h"
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 // Error Codes
@@ -113,210 +327,1158 @@ void Error_MemoryAllocate(void)
 {
   cout << "ERROR (ConvertLeicaSCN400F.cc): Could Not Allocate Memory For Image." << endl;
 } // Exit Code: 4
+void Error_FileWrite(void)
+{
+  cout << "ERROR (ConvertLeicaSCN400F.cc): Could Not Write Output File." << endl;
+} // Exit Code: 5
+void Error_ServerStart(void)
+{
+  cout << "ERROR (ConvertLeicaSCN400F.cc): Could Not Start Tile Server." << endl;
+} // Exit Code: 6
+
+// Output Layouts
+enum OutputLayout
+{
+  LAYOUT_SEPARATE=0, // One file per channel
+  LAYOUT_PLANAR=1,   // One file per field, channels stored plane by plane (CHW)
+  LAYOUT_INTERLEAVED=2 // One file per field, channels interleaved per pixel (HWC)
+};
+
+// Exit With The Error Matching A Read Status
+void ExitOnStatus(int status)
+{
+  switch (status)
+  {
+    case 0: return;
+    case 1: atexit(Error_TIFFOpen); exit(1);
+    case 4: atexit(Error_MemoryAllocate); exit(4);
+    default: atexit(Error_ImageRead); exit(3);
+  }
+}
+
+// Sort Dimensions By Channel Number
+bool CompareChannel(const SCNDimension &a, const SCNDimension &b)
+{
+  return a.channel < b.channel;
+}
+
+// Highest Resolution Directories Of A Field, In Channel Order
+vector<SCNDimension> FieldChannels(const SCNField &field)
+{
+  vector<SCNDimension> channels;
+  for (uint32 ii=0;ii<field.dimensions.size();ii++)
+  {
+    if (field.dimensions[ii].r == 0) channels.push_back(field.dimensions[ii]);
+  }
+  stable_sort(channels.begin(),channels.end(),CompareChannel);
+  return channels;
+}
+
+// Get Image Size And Sample Type Of An Indexed Directory. The RGBA Path Always
+// Produces uint8; The Native Path Keeps The Stored Bit Depth And Sample Format.
+bool GetImageInfo(const IndexedDirectory *directory, bool flag_native, uint32 &ww, uint32 &hh, SampleType &type)
+{
+  if (directory == NULL || (flag_native && !directory->nativeok)) return false;
+  ww=directory->layout.width;
+  hh=directory->layout.height;
+  type=flag_native ? directory->layout.type : SAMPLE_UINT8;
+  return (ww > 0 && hh > 0);
+}
+
+// Read One Channel Of An Indexed Directory Through RGBA Or At Native Bit Depth,
+// Gathering Its Statistics When stats Is Given
+int ReadChannel(TIFF *tif, const IndexedDirectory &directory, bool flag_native, int channel, uint8 *out, size_t stride,
+                ChannelStats *stats)
+{
+  if (!SetIndexedDirectory(tif,directory)) return SCN_READ_FAILED;
+  if (flag_native) return ReadChannelNative(tif,directory.layout,channel,out,stride,true,stats);
+  return ReadChannelRGBA(tif,directory.layout.width,directory.layout.height,channel,out,stride,stats);
+}
+
+// Tile Rows firstrow To firstrow+nrows-1 Of One Channel, Decoded At Native Bit Depth
+// Into out (The Whole Channel) Bottom Row First By The Scheduler's Workers. With
+// placeable, out Is In Its Own Mapping And May Be Moved To The Decoding Nodes.
+TileDecodeJob DecodeJob(const IndexedDirectory &directory, int channel, uint32 firstrow, uint32 nrows, uint8 *out,
+                        size_t stride, ChannelStats *stats, bool placeable)
+{
+  TileDecodeJob job={&directory,channel,firstrow,nrows,out,0,stride,true,stats,placeable};
+  return job;
+}
+
+// Filename Suffix For The Element Type; uint8 Keeps The Original Filenames
+string TypeSuffix(SampleType type)
+{
+  if (type == SAMPLE_UINT8) return "";
+  return string("_")+SampleTypeName(type);
+}
+
+// Read One Channel Of A Field Through Its Own TIFF Handle
+void ReadFieldChannel(const string &fn_in, const IndexedDirectory *directory, int channel, bool flag_native,
+                      uint8 *out, size_t stride, ChannelStats *stats, int *status)
+{
+  TIFF *tifchannel=OpenSlideHeaderOnly(fn_in);
+  if (tifchannel == NULL) {*status=1; return;}
+  *status=ReadChannel(tifchannel,*directory,flag_native,channel,out,stride,stats);
+  TIFFClose(tifchannel);
+}
+
+// Report The Part Of A Sparse Output Left As Holes
+void PrintHoles(uint64_t nholes, uint64_t nbytes)
+{
+  if (nholes == 0) return;
+  cout << "Sparse: " << nholes/(1024*1024) << " MB Of " << nbytes/(1024*1024) << " MB Left As Holes" << endl;
+}
+
+// Write One Output File After Its Header (If Any), Returning Its Checksum (Empty
+// Without One)
+string WriteOutput(const string &fn_out, const uint8 *image, size_t nbytes, const WriterOptions &writeroptions,
+                   const string &header="")
+{
+  cout << "Writing " << fn_out << endl << endl;
+  OutputWriter ofile;
+  if (!ofile.Open(fn_out,writeroptions)) {atexit(Error_FileWrite); exit(5);}
+  bool flag_write=ofile.Write(header.data(),header.size()) && ofile.Write(image,nbytes);
+  if (!ofile.Close() || !flag_write) {atexit(Error_FileWrite); exit(5);}
+  PrintHoles(ofile.BytesInHoles(),nbytes);
+  return ofile.Checksum();
+}
+
+// Write The Checksum List Of The Outputs, One 'checksum  filename' Line Each
+void WriteChecksums(const string &fn_list, const vector<ManifestOutput> &outputs)
+{
+  ofstream ofile(fn_list.c_str());
+  for (size_t ii=0;ii<outputs.size();ii++) ofile << outputs[ii].checksum << "  " << outputs[ii].filename << "\n";
+  ofile.close();
+  if (!ofile) {atexit(Error_FileWrite); exit(5);}
+}
+
+// Write The Statistics Sidecar Of An Output File
+string StatsFilename(const string &fn_out)
+{
+  return fn_out.substr(0,fn_out.size()-4)+".stats.json";
+}
+
+void WriteStats(const string &fn_out, const vector<ChannelStatsEntry> &entries)
+{
+  string fn_stats=StatsFilename(fn_out);
+  if (!WriteChannelStatsJSON(fn_stats,fn_out,entries)) {atexit(Error_FileWrite); exit(5);}
+}
+
+// Add An Output File And Its Statistics Sidecar, With Their Sizes, To A List
+void ListOutput(vector<pair<string, uint64_t> > &outputs, const string &fn_out, bool flag_stats)
+{
+  struct stat st;
+  if (stat(fn_out.c_str(),&st) != 0) {atexit(Error_FileWrite); exit(5);}
+  outputs.push_back(make_pair(fn_out,static_cast<uint64_t>(st.st_size)));
+  if (flag_stats) ListOutput(outputs,StatsFilename(fn_out),false);
+}
+
+// Describe An Output Holding channels Of field In An Output Layout
+ManifestOutput DescribeConverted(const string &fn_out, const SCNField &field, const vector<SCNDimension> &channels,
+                                 OutputLayout layout, SampleType type, uint32 ww, uint32 hh)
+{
+  vector<int> numbers;
+  for (size_t ic=0;ic<channels.size();ic++) numbers.push_back(channels[ic].channel);
+  ManifestAxes axes=(layout == LAYOUT_PLANAR) ? AXES_CYX : ((layout == LAYOUT_INTERLEAVED) ? AXES_YXC : AXES_YX);
+  return DescribeOutput(fn_out,field,numbers,axes,type,ww,hh);
+}
+
+// Bytes Written Before The Samples: The .npy Header, Nothing For .bin
+string OutputHeader(bool flag_npy, const string &fn_out, const SCNField &field, const vector<SCNDimension> &channels,
+                    OutputLayout layout, SampleType type, uint32 ww, uint32 hh)
+{
+  if (!flag_npy) return "";
+  return NpyHeader(DescribeConverted(fn_out,field,channels,layout,type,ww,hh));
+}
+
+// Add An Output To The Manifest
+void ManifestAdd(ConversionManifest &manifest, const string &fn_out, const SCNField &field,
+                 const vector<SCNDimension> &channels, OutputLayout layout, SampleType type, uint32 ww, uint32 hh,
+                 const string &header, ChecksumType checksumtype, const string &checksum, bool flag_stats)
+{
+  ManifestOutput output=DescribeConverted(fn_out,field,channels,layout,type,ww,hh);
+  output.offset=header.size();
+  if (checksumtype != CHECKSUM_NONE)
+  {
+    output.checksumtype=ChecksumTypeName(checksumtype);
+    output.checksum=checksum;
+  }
+  if (flag_stats) output.fn_stats=StatsFilename(fn_out);
+  manifest.outputs.push_back(output);
+}
+
+// Skip An Output Finished By An Earlier Run (journal Is NULL Without A Journal). The
+// Output Is Read Once To Verify It, Which Also Fills In checksum.
+bool SkipFinishedOutput(const ConversionJournal *journal, const string &fn_out, StreamChecksum &checksum)
+{
+  if (journal == NULL || !journal->OutputDone(fn_out,&checksum)) return false;
+  cout << "Resume: " << fn_out << " Already Converted" << endl << endl;
+  return true;
+}
+
+// Journal A Finished Output, Its Header Followed By image
+void JournalOutput(ConversionJournal *journal, const string &fn_out, const string &header, const uint8 *image,
+                   size_t nbytes)
+{
+  if (journal == NULL) return;
+  XXH64Stream hash;
+  hash.Update(header.data(),header.size());
+  hash.Update(image,nbytes);
+  if (!journal->RecordOutput(fn_out,header.size()+nbytes,hash.Digest())) {atexit(Error_FileWrite); exit(5);}
+}
+
+// Buffer For One Output: Pooled Memory, Or With flag_shm The Samples Area Of A New
+// Shared Memory Segment, So They Are Decoded Straight Into It. placeable Tells Whether
+// It Is In A Mapping Of Its Own (See TileDecodeJob).
+uint8 *OutputBuffer(bool flag_shm, const ManifestOutput &output, size_t nbytes, PooledBuffer &pooled,
+                    SharedOutput &segment, bool &placeable)
+{
+  if (!flag_shm)
+  {
+    pooled=SharedBufferPool().Acquire(nbytes);
+    placeable=pooled.mapped();
+    return pooled.data();
+  }
+  if (!segment.Create(output)) {atexit(Error_FileWrite); exit(5);}
+  placeable=true;
+  return segment.Data();
+}
+
+// Hand A Finished Shared Memory Output To Its Consumers
+void PublishShared(SharedOutput &segment)
+{
+  segment.Publish();
+  cout << "Shared " << segment.Name() << endl << endl;
+}
+
+// Convert One Channel At Native Bit Depth In Bands Of Whole Tile Rows, Syncing And
+// Journaling Each Band Once Written. Bands Journaled By An Earlier Run Are Read Back
+// Instead Of Decoded While They Match Their Checksum. image Receives The Whole Channel
+// (placeable As For DecodeJob).
+void ConvertChannelBands(const string &fn_in, const IndexedDirectory &directory, int channel, const string &fn_out,
+                         const string &header, uint8 *image, bool placeable, size_t bandbytes, bool flag_resume,
+                         bool flag_sparse, ConversionJournal &journal, ChannelStats *stats, TileScheduler &scheduler)
+{
+  const SCNDirectoryLayout &layout=directory.layout;
+  size_t Nbytes=SampleBytes(layout.type);
+  size_t rowbytes=static_cast<size_t>(layout.width)*Nbytes;
+  uint64_t totalbytes=static_cast<uint64_t>(rowbytes)*layout.height;
+  uint32 bandrows=static_cast<uint32>(min<size_t>(bandbytes/(rowbytes*layout.tilelength),TilesDown(layout)));
+  if (bandrows == 0) bandrows=1;
+  vector<JournalBand> done=journal.BandsDone(fn_out,totalbytes);
+
+  CheckpointFile ofile;
+  if (!ofile.Open(fn_out,totalbytes,flag_resume,flag_sparse,header)) {atexit(Error_FileWrite); exit(5);}
+  uint32 nbands=0, nresumed=0;
+  for (uint32 firstrow=0;firstrow<TilesDown(layout);firstrow+=bandrows)
+  {
+    // Image Rows Of The Band, Stored Bottom Row First
+    uint32 y0=firstrow*layout.tilelength;
+    uint32 y1=static_cast<uint32>(min<uint64_t>(static_cast<uint64_t>(firstrow+bandrows)*layout.tilelength,
+                                                layout.height));
+    JournalBand band;
+    band.offset=static_cast<uint64_t>(layout.height-y1)*rowbytes;
+    band.nbytes=static_cast<uint64_t>(y1-y0)*rowbytes;
+    nbands++;
+
+    // Reuse The Band If An Earlier Run Left It Intact
+    bool flag_resumed=false;
+    for (size_t ib=0;ib<done.size() && !flag_resumed;ib++)
+    {
+      if (done[ib].offset != band.offset || done[ib].nbytes != band.nbytes) continue;
+      flag_resumed=ofile.ReadBand(done[ib],image+band.offset);
+    }
+    if (flag_resumed)
+    {
+      if (stats != NULL)
+      {
+        ChannelStatsAccumulator local(layout.type);
+        local.Add(image+band.offset,layout.width,y1-y0,rowbytes,Nbytes);
+        stats->Merge(local);
+      }
+      nresumed++;
+      continue;
+    }
+
+    // Decode, Write And Journal It
+    ExitOnStatus(DecodeTilesScheduled(fn_in,vector<TileDecodeJob>(1,DecodeJob(directory,channel,firstrow,bandrows,image,1,
+                                                                              stats,placeable)),scheduler));
+    band.hash=XXH64(image+band.offset,band.nbytes,0);
+    if (!ofile.WriteBand(band.offset,image+band.offset,band.nbytes) || !journal.RecordBand(fn_out,totalbytes,band))
+    {
+      atexit(Error_FileWrite); exit(5);
+    }
+  }
+  if (!ofile.Close()) {atexit(Error_FileWrite); exit(5);}
+  cout << "Read: Successful (" << layout.width << " x " << layout.height << ", " << SampleTypeName(layout.type) << ")"
+       << endl;
+  PrintHoles(ofile.BytesInHoles(),totalbytes);
+  cout << "Wrote " << fn_out << " In " << nbands << " Bands (" << nresumed << " Resumed)" << endl << endl;
+}
+
+// Parse A List Of Numbers And Ranges, e.g. "0,2-4"
+bool ParseNumberList(const string &text, vector<int> &numbers)
+{
+  numbers.clear();
+  istringstream list(text);
+  string item;
+  while (getline(list,item,','))
+  {
+    size_t dash=item.find('-',1);
+    char *end;
+    long first=strtol(item.c_str(),&end,10);
+    long last=first;
+    if (end == item.c_str()) return false;
+    if (dash != string::npos)
+    {
+      if (end != item.c_str()+dash) return false;
+      const char *second=item.c_str()+dash+1;
+      last=strtol(second,&end,10);
+      if (end == second) return false;
+    }
+    if (*end != '\0' || first < 0 || last < first) return false;
+    for (long number=first;number<=last;number++) numbers.push_back(static_cast<int>(number));
+  }
+  return !numbers.empty();
+}
+
+// Whether A Selector List Includes A Number; An Empty List Selects Everything
+bool Selected(const vector<int> &numbers, int number)
+{
+  return numbers.empty() || find(numbers.begin(),numbers.end(),number) != numbers.end();
+}
+
+// Convert Tile Rows firstrow To lastrow-1 Of One Channel At Native Bit Depth Into Their
+// Place In The Output. The Output Is Sized But Not Truncated, So Rows Written By Other
+// Shards Stay Intact.
+void ConvertChannelTileRows(const string &fn_in, const IndexedDirectory &directory, int channel, const string &fn_out,
+                            const string &header, uint32 firstrow, uint32 lastrow, bool flag_sparse,
+                            TileScheduler &scheduler)
+{
+  const SCNDirectoryLayout &layout=directory.layout;
+  lastrow=min(lastrow,TilesDown(layout));
+  if (firstrow >= lastrow)
+  {
+    cout << "Shard: No Tile Rows Of " << fn_out << " Selected" << endl << endl;
+    return;
+  }
+  size_t Nbytes=SampleBytes(layout.type);
+  size_t rowbytes=static_cast<size_t>(layout.width)*Nbytes;
+  uint64_t totalbytes=static_cast<uint64_t>(rowbytes)*layout.height;
+  uint32 y0=firstrow*layout.tilelength;
+  uint32 y1=static_cast<uint32>(min<uint64_t>(static_cast<uint64_t>(lastrow)*layout.tilelength,layout.height));
+  uint64_t offset=static_cast<uint64_t>(layout.height-y1)*rowbytes;
+  uint64_t nbytes=static_cast<uint64_t>(y1-y0)*rowbytes;
+
+  // The Buffer Holds Just These Rows, Which Start At Stored Row height-y1
+  PooledBuffer imagebuffer=SharedBufferPool().Acquire(nbytes);
+  uint8 *image=imagebuffer.data();
+  if (image == NULL) {atexit(Error_MemoryAllocate); exit(4);}
+  TileDecodeJob job=DecodeJob(directory,channel,firstrow,lastrow-firstrow,image,1,NULL,imagebuffer.mapped());
+  job.outrow=layout.height-y1;
+  ExitOnStatus(DecodeTilesScheduled(fn_in,vector<TileDecodeJob>(1,job),scheduler));
+
+  CheckpointFile ofile;
+  if (!ofile.Open(fn_out,totalbytes,true,flag_sparse,header) || !ofile.WriteBand(offset,image,nbytes) || !ofile.Close())
+  {
+    atexit(Error_FileWrite); exit(5);
+  }
+  cout << "Read: Successful (" << layout.width << " x " << y1-y0 << ", " << SampleTypeName(layout.type) << ")" << endl;
+  PrintHoles(ofile.BytesInHoles(),nbytes);
+  cout << "Wrote Tile Rows " << firstrow << "-" << lastrow-1 << " Of " << fn_out << endl << endl;
+}
+
+// Serve Tiles Until Interrupted
+TileServer *server_running=NULL;
+void StopServer(int)
+{
+  if (server_running != NULL) server_running->Stop();
+}
+
+int ServeMain(int argc, char * argv[])
+{
+  // Read Inputs
+  TileServerOptions serveroptions;
+  bool flag_index=true;
+  string fn_indexdir;
+  vector<string> fn_slides;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,7,"--host=") == 0) serveroptions.host=arg.substr(7);
+    else if (arg.compare(0,7,"--port=") == 0) serveroptions.port=atoi(arg.substr(7).c_str());
+    else if (arg.compare(0,10,"--threads=") == 0) serveroptions.nthreads=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,11,"--cache-mb=") == 0)
+    {
+      long mb=atol(arg.substr(11).c_str());
+      if (mb <= 0) return -1;
+      serveroptions.cache_bytes=static_cast<size_t>(mb)*1024*1024;
+    }
+    else if (arg.compare(0,12,"--tile-size=") == 0) serveroptions.tilesize=atoi(arg.substr(12).c_str());
+    else if (arg.compare(0,10,"--overlap=") == 0) serveroptions.overlap=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,10,"--quality=") == 0) serveroptions.quality=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    else if (arg.compare(0,2,"--") == 0) return -1;
+    else fn_slides.push_back(arg);
+  }
+  if (fn_slides.empty() || serveroptions.port < 0 || serveroptions.port > 65535 || serveroptions.tilesize <= 0 ||
+      serveroptions.overlap < 0 || serveroptions.quality < 1 || serveroptions.quality > 100) return -1;
+
+  // Open Slides
+  vector<SlideReader *> readers;
+  for (size_t is=0;is<fn_slides.size();is++)
+  {
+    SlideReader *reader=new SlideReader();
+    string fn_index=flag_index ? SlideIndexFilename(fn_slides[is],fn_indexdir) : "";
+    SlideIndexStatus istatus=reader->Open(fn_slides[is],fn_index);
+    if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+    if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+    cout << "Slide " << is << ": " << fn_slides[is] << " (" << reader->Index().description.fields.size() << " fields)" << endl;
+    readers.push_back(reader);
+  }
+  xmlCleanupParser();
+
+  // Serve
+  TileServer *server=new TileServer(readers,serveroptions);
+  if (!server->Start()) {atexit(Error_ServerStart); exit(6);}
+  cout << "Serving on http://" << serveroptions.host << ":" << server->Port() << "/" << endl;
+  server_running=server;
+  signal(SIGINT,StopServer);
+  signal(SIGTERM,StopServer);
+  server->Run();
+  server_running=NULL;
+  cout << "Stopped" << endl;
+
+  // Free Memory
+  delete server;
+  for (size_t is=0;is<readers.size();is++) delete readers[is];
+
+  return 0;
+}
+
+// Write Small Overview Images Of Each Field
+int ThumbnailMain(int argc, char * argv[])
+{
+  // Read Inputs
+  ThumbnailOptions thumboptions;
+  bool flag_index=true;
+  bool flag_jpeg=true;
+  int quality=90;
+  long onlyfield=-1;
+  string fn_indexdir;
+  vector<string> positional;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,7,"--size=") == 0)
+    {
+      long size=atol(arg.substr(7).c_str());
+      if (size <= 0) return -1;
+      thumboptions.size=static_cast<uint32>(size);
+    }
+    else if (arg.compare(0,8,"--field=") == 0) onlyfield=atol(arg.substr(8).c_str());
+    else if (arg.compare(0,10,"--channel=") == 0) thumboptions.channel=atoi(arg.substr(10).c_str());
+    else if (arg == "--contrast=full") thumboptions.autocontrast=false;
+    else if (arg == "--contrast=auto") thumboptions.autocontrast=true;
+    else if (arg == "--format=jpeg") flag_jpeg=true;
+    else if (arg == "--format=pnm") flag_jpeg=false;
+    else if (arg.compare(0,10,"--quality=") == 0) quality=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    else if (arg.compare(0,2,"--") == 0) return -1;
+    else positional.push_back(arg);
+  }
+  if (positional.size() != 2 || quality < 1 || quality > 100) return -1;
+  string fn_in=positional[0], fn_outprefix=positional[1];
+
+  // Open .scn File Through Its Metadata Index
+  SlideIndex index;
+  bool flag_built=false;
+  string fn_index=flag_index ? SlideIndexFilename(fn_in,fn_indexdir) : "";
+  SlideIndexStatus istatus=OpenSlideIndex(fn_in,fn_index,index,flag_built);
+  if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+  if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+  xmlCleanupParser();
+
+  for (size_t ifield=0;ifield<index.description.fields.size();ifield++)
+  {
+    if (onlyfield >= 0 && static_cast<size_t>(onlyfield) != ifield) continue;
+
+    // Render From The Smallest Sufficient Resolution Level
+    Thumbnail thumbnail;
+    ExitOnStatus(RenderThumbnail(fn_in,index,ifield,thumboptions,thumbnail));
+    cout << "Thumbnail: Level " << thumbnail.r << " (" << thumbnail.sourcewidth << " x " << thumbnail.sourceheight
+         << ") -> " << thumbnail.width << " x " << thumbnail.height << endl;
+
+    // Encode And Write
+    vector<uint8_t> encoded;
+    bool flag_encode=flag_jpeg ?
+      EncodeJPEG(&thumbnail.pixels[0],thumbnail.width,thumbnail.height,thumbnail.components,
+                 thumbnail.width*thumbnail.components,quality,encoded) :
+      EncodePNM(&thumbnail.pixels[0],thumbnail.width,thumbnail.height,thumbnail.components,
+                thumbnail.width*thumbnail.components,encoded);
+    if (!flag_encode) {atexit(Error_FileWrite); exit(5);}
+    ostringstream convert;
+    convert << fn_outprefix << "Image" << index.description.fields[ifield].number << "_Thumbnail_X" << thumbnail.width
+            << "_Y" << thumbnail.height << (flag_jpeg ? ".jpg" : (thumbnail.components == 1 ? ".pgm" : ".ppm"));
+    WriterOptions smallwriter;
+    smallwriter.buffer_bytes=1024*1024;
+    WriteOutput(convert.str(),&encoded[0],encoded.size(),smallwriter);
+  }
+
+  return 0;
+}
+
+// Stitch The Fields Into One Image Per Channel At Their Physical Positions
+int MosaicMain(int argc, char * argv[])
+{
+  // Read Inputs
+  uint32 chunksize=512;
+  int onlychannel=-1;
+  int nthreads=0;
+  size_t cache_bytes=static_cast<size_t>(256)*1024*1024;
+  bool flag_index=true;
+  string fn_indexdir;
+  vector<string> positional;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,13,"--chunk-size=") == 0)
+    {
+      long size=atol(arg.substr(13).c_str());
+      if (size <= 0 || size > 65536) return -1;
+      chunksize=static_cast<uint32>(size);
+    }
+    else if (arg.compare(0,10,"--channel=") == 0) onlychannel=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,10,"--threads=") == 0) nthreads=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,11,"--cache-mb=") == 0)
+    {
+      long mb=atol(arg.substr(11).c_str());
+      if (mb <= 0) return -1;
+      cache_bytes=static_cast<size_t>(mb)*1024*1024;
+    }
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    else if (arg.compare(0,2,"--") == 0) return -1;
+    else positional.push_back(arg);
+  }
+  if (positional.size() != 2) return -1;
+  string fn_in=positional[0], fn_outprefix=positional[1];
+
+  // Open Slide
+  SlideReader reader;
+  string fn_index=flag_index ? SlideIndexFilename(fn_in,fn_indexdir) : "";
+  SlideIndexStatus istatus=reader.Open(fn_in,fn_index);
+  if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+  if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+  xmlCleanupParser();
+  TileCache cache(cache_bytes);
+  reader.SetTileCache(&cache);
+
+  // Place Fields
+  MosaicLayout mosaic;
+  if (!PlanMosaic(reader,chunksize,mosaic)) {atexit(Error_ImageRead); exit(3);}
+  cout << "Mosaic: " << mosaic.width << " x " << mosaic.height << " Pixels, " << mosaic.fields.size() << " Fields, "
+       << mosaic.chunks.size() << " Of " << mosaic.chunksacross*mosaic.chunksdown << " Chunks" << endl;
+
+  // Channels Present At r=0 In Every Placed Field
+  vector<int> channels;
+  const SCNField &first=reader.Index().description.fields[mosaic.fields[0].field];
+  for (size_t id=0;id<first.dimensions.size();id++)
+  {
+    int channel=first.dimensions[id].channel;
+    if (first.dimensions[id].r != 0 || (onlychannel >= 0 && channel != onlychannel)) continue;
+    if (find(channels.begin(),channels.end(),channel) == channels.end()) channels.push_back(channel);
+  }
+  sort(channels.begin(),channels.end());
+  if (channels.empty()) {atexit(Error_ImageRead); exit(3);}
+
+  // Write One File Per Channel
+  ThreadPool pool(nthreads);
+  vector<SampleType> types(channels.size());
+  vector<string> files(channels.size());
+  vector<vector<uint64_t> > written(channels.size());
+  for (size_t ic=0;ic<channels.size();ic++)
+  {
+    if (!MosaicChannelType(reader,mosaic,channels[ic],types[ic])) {atexit(Error_ImageRead); exit(3);}
+    ostringstream convert;
+    convert << fn_outprefix << "Mosaic_Channel" << channels[ic] << "_X" << mosaic.width << "_Y" << mosaic.height;
+    if (types[ic] != SAMPLE_UINT8) convert << "_" << SampleTypeName(types[ic]);
+    convert << ".bin";
+    files[ic]=convert.str();
+    bool flag_write=true;
+    ExitOnStatus(WriteMosaicChannel(reader,mosaic,channels[ic],types[ic],files[ic],pool,written[ic],flag_write));
+    if (!flag_write) {atexit(Error_FileWrite); exit(5);}
+    cout << "Wrote " << files[ic] << endl;
+  }
+  if (!WriteMosaicJSON(fn_outprefix+"Mosaic.json",reader,mosaic,channels,types,files,written)) {atexit(Error_FileWrite); exit(5);}
+
+  return 0;
+}
+
+// Stream Framed Tiles To stdout; Everything Else Goes To stderr
+int StreamMain(int argc, char * argv[])
+{
+  // stdout Carries The Stream, So Messages (Errors Included) Go To stderr
+  cout.rdbuf(cerr.rdbuf());
+
+  // Read Inputs
+  TileStreamOptions streamoptions;
+  int nthreads=0;
+  bool flag_index=true;
+  string fn_indexdir;
+  vector<string> fn_slides;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg == "--raw") streamoptions.raw=true;
+    else if (arg.compare(0,8,"--level=") == 0) streamoptions.level=atoi(arg.substr(8).c_str());
+    else if (arg.compare(0,9,"--fields=") == 0)
+    {
+      if (!ParseNumberList(arg.substr(9),streamoptions.fields)) return -1;
+    }
+    else if (arg.compare(0,11,"--channels=") == 0)
+    {
+      if (!ParseNumberList(arg.substr(11),streamoptions.channels)) return -1;
+    }
+    else if (arg.compare(0,10,"--threads=") == 0) nthreads=atoi(arg.substr(10).c_str());
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    else if (arg.compare(0,2,"--") == 0) return -1;
+    else fn_slides.push_back(arg);
+  }
+  if (fn_slides.empty() || streamoptions.level < 0) return -1;
+
+  // Open Slides
+  vector<SlideReader *> readers;
+  for (size_t is=0;is<fn_slides.size();is++)
+  {
+    SlideReader *reader=new SlideReader();
+    string fn_index=flag_index ? SlideIndexFilename(fn_slides[is],fn_indexdir) : "";
+    SlideIndexStatus istatus=reader->Open(fn_slides[is],fn_index);
+    if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+    if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+    readers.push_back(reader);
+  }
+  xmlCleanupParser();
+
+  // Stream; A Consumer That Exits Early Ends The Run With A Write Error, Not SIGPIPE
+  signal(SIGPIPE,SIG_IGN);
+  TileScheduler scheduler(nthreads);
+  TileStreamWriter writer(STDOUT_FILENO);
+  SCNReadStatus status=StreamTiles(readers,streamoptions,scheduler,writer);
+  if (writer.Failed()) {atexit(Error_FileWrite); exit(5);}
+  ExitOnStatus(status);
+  if (!writer.Finish()) {atexit(Error_FileWrite); exit(5);}
+  cerr << "Streamed " << writer.Frames() << " Tiles (" << writer.Bytes()/(1024*1024) << " MB"
+       << (streamoptions.raw ? ", Raw" : "") << ") From " << readers.size() << " Slide(s)" << endl;
+
+  // Free Memory
+  for (size_t is=0;is<readers.size();is++) delete readers[is];
+
+  return 0;
+}
+
+// Quote An Argument For A POSIX Shell When It Needs It
+string ShellQuote(const string &arg)
+{
+  const char *plain="abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-+=.,:/@%";
+  if (!arg.empty() && arg.find_first_not_of(plain) == string::npos) return arg;
+  string quoted="'";
+  for (size_t ii=0;ii<arg.size();ii++)
+  {
+    if (arg[ii] == '\'') quoted+="'\\''";
+    else quoted+=arg[ii];
+  }
+  return quoted+"'";
+}
+
+// Print One Command Line Per Shard, Balanced By Compressed Tile Bytes
+int PlanMain(int argc, char * argv[], const string &program)
+{
+  // Read Inputs; Conversion Options Are Passed Through To Every Shard
+  long nshards=0;
+  bool flag_index=true;
+  bool flag_native=false, flag_stats=false;
+  string slayout="separate";
+  string fn_indexdir;
+  vector<string> convertoptions, positional;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,9,"--shards=") == 0) {nshards=atol(arg.substr(9).c_str()); continue;}
+    if (arg == "--resume" || arg == "--skip-unchanged" || arg.compare(0,11,"--checksum=") == 0 ||
+        arg.compare(0,9,"--fields=") == 0 || arg.compare(0,11,"--channels=") == 0 ||
+        arg.compare(0,12,"--tile-rows=") == 0) return -1;
+    if (arg.compare(0,9,"--layout=") == 0) slayout=arg.substr(9);
+    else if (arg == "--native") flag_native=true;
+    else if (arg == "--stats") flag_stats=true;
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    if (arg.compare(0,2,"--") == 0) convertoptions.push_back(arg);
+    else positional.push_back(arg);
+  }
+  if (positional.size() != 2 || nshards <= 0) return -1;
+  if (slayout != "separate" && slayout != "planar" && slayout != "interleaved") return -1;
+  string fn_in=positional[0], fn_outprefix=positional[1];
+
+  // Open .scn File Through Its Metadata Index
+  SlideIndex index;
+  bool flag_built=false;
+  string fn_index=flag_index ? SlideIndexFilename(fn_in,fn_indexdir) : "";
+  SlideIndexStatus istatus=OpenSlideIndex(fn_in,fn_index,index,flag_built);
+  if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+  if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+  xmlCleanupParser();
+
+  // Tile Row Shards Need The Native Separate Layout, And Statistics Need Whole Channels
+  bool perchannel=(slayout == "separate");
+  bool bytiles=perchannel && flag_native && !flag_stats;
+  vector<Shard> shards=PlanShards(index,static_cast<size_t>(nshards),perchannel,bytiles);
+
+  // One Line Per Shard, Its Pieces Run One After Another
+  string common=ShellQuote(program);
+  for (size_t io=0;io<convertoptions.size();io++) common+=" "+ShellQuote(convertoptions[io]);
+  for (size_t is=0;is<shards.size();is++)
+  {
+    cout << "# Shard " << is << ": " << shards[is].bytes << " Bytes" << endl;
+    for (size_t ip=0;ip<shards[is].pieces.size();ip++)
+    {
+      const ShardPiece &piece=shards[is].pieces[ip];
+      ostringstream command;
+      command << common << " --fields=" << piece.ifield;
+      if (piece.channel >= 0) command << " --channels=" << piece.channel;
+      if (piece.lastrow > 0) command << " --tile-rows=" << piece.firstrow << ":" << piece.lastrow;
+      command << " " << ShellQuote(fn_in) << " " << ShellQuote(fn_outprefix);
+      cout << (ip > 0 ? " && " : "") << command.str();
+    }
+    cout << endl;
+  }
+
+  return 0;
+}
 
 int main (int argc, char * argv[])
 {
+  if (argc > 1 && string(argv[1]) == "serve") return ServeMain(argc-1,argv+1);
+  if (argc > 1 && string(argv[1]) == "thumbnail") return ThumbnailMain(argc-1,argv+1);
+  if (argc > 1 && string(argv[1]) == "mosaic") return MosaicMain(argc-1,argv+1);
+  if (argc > 1 && string(argv[1]) == "plan") return PlanMain(argc-1,argv+1,argv[0]);
+  if (argc > 1 && string(argv[1]) == "stream") return StreamMain(argc-1,argv+1);
+
 
   //////////////////////////////////////////////////////////////////////////////////////
   // Read Inputs
   //////////////////////////////////////////////////////////////////////////////////////
   string fn_in, fn_outprefix;
-  if (argc != 3) return -1;
+  OutputLayout layout=LAYOUT_SEPARATE;
+  bool flag_native=false;
+  bool flag_npy=false;
+  bool flag_shm=false;
+  bool flag_index=true;
+  bool flag_stats=false;
+  bool flag_resume=false;
+  bool flag_journal=true;
+  bool flag_unchanged=false;
+  BufferPoolOptions pooloptions;
+  int nthreads=0;
+  bool flag_numa=true;
+  vector<int> onlyfields, onlychannels;
+  uint32 firstrow=0, lastrow=0;
+  size_t checkpoint_bytes=static_cast<size_t>(256)*1024*1024;
+  string fn_indexdir;
+  WriterOptions writeroptions;
+  vector<string> positional;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,9,"--layout=") == 0)
+    {
+      string slayout=arg.substr(9);
+      if (slayout == "separate") layout=LAYOUT_SEPARATE;
+      else if (slayout == "planar") layout=LAYOUT_PLANAR;
+      else if (slayout == "interleaved") layout=LAYOUT_INTERLEAVED;
+      else return -1;
+    }
+    else if (arg == "--native") flag_native=true;
+    else if (arg == "--format=bin") flag_npy=false;
+    else if (arg == "--format=npy") flag_npy=true;
+    else if (arg == "--shm") flag_shm=true;
+    else if (arg.compare(0,12,"--index-dir=") == 0) fn_indexdir=arg.substr(12);
+    else if (arg == "--no-index") flag_index=false;
+    else if (arg == "--stats") flag_stats=true;
+    else if (arg == "--resume") flag_resume=true;
+    else if (arg == "--no-journal") flag_journal=false;
+    else if (arg == "--skip-unchanged") flag_unchanged=true;
+    else if (arg == "--huge-pages") pooloptions.hugepages=true;
+    else if (arg == "--sparse") writeroptions.sparse=true;
+    else if (arg.compare(0,10,"--threads=") == 0) nthreads=atoi(arg.substr(10).c_str());
+    else if (arg == "--no-numa") flag_numa=false;
+    else if (arg.compare(0,9,"--fields=") == 0)
+    {
+      if (!ParseNumberList(arg.substr(9),onlyfields)) return -1;
+    }
+    else if (arg.compare(0,11,"--channels=") == 0)
+    {
+      if (!ParseNumberList(arg.substr(11),onlychannels)) return -1;
+    }
+    else if (arg.compare(0,12,"--tile-rows=") == 0)
+    {
+      long first=0, last=0;
+      char colon=0;
+      istringstream rows(arg.substr(12));
+      if (!(rows >> first >> colon >> last) || colon != ':' || first < 0 || last <= first) return -1;
+      firstrow=static_cast<uint32>(first);
+      lastrow=static_cast<uint32>(last);
+    }
+    else if (arg.compare(0,11,"--checksum=") == 0)
+    {
+      if (!ParseChecksumType(arg.substr(11),writeroptions.checksum)) return -1;
+    }
+    else if (arg.compare(0,16,"--checkpoint-mb=") == 0)
+    {
+      long mb=atol(arg.substr(16).c_str());
+      if (mb <= 0) return -1;
+      checkpoint_bytes=static_cast<size_t>(mb)*1024*1024;
+    }
+    else if (arg.compare(0,9,"--writer=") == 0)
+    {
+      if (!ParseWriterMode(arg.substr(9),writeroptions.mode)) return -1;
+    }
+    else if (arg.compare(0,18,"--write-buffer-mb=") == 0)
+    {
+      long mb=atol(arg.substr(18).c_str());
+      if (mb <= 0) return -1;
+      writeroptions.buffer_bytes=static_cast<size_t>(mb)*1024*1024;
+    }
+    else if (arg.compare(0,2,"--") == 0) return -1;
+    else positional.push_back(arg);
+  }
+  if (positional.size() != 2 || (flag_resume && !flag_journal)) return -1;
   else
   {
-    fn_in=argv[1];
-    fn_outprefix=argv[2];
+    fn_in=positional[0];
+    fn_outprefix=positional[1];
   }
 
+  // A Shard Converts Part Of The Slide Alongside Other Processes, So It Keeps No
+  // Journal And Writes No Slide-Wide Files
+  bool flag_shard=!onlyfields.empty() || !onlychannels.empty() || lastrow > 0;
+  if (flag_shard && (flag_resume || flag_unchanged || writeroptions.checksum != CHECKSUM_NONE)) return -1;
+  if (!onlychannels.empty() && layout != LAYOUT_SEPARATE) return -1;
+  if (lastrow > 0 && (!flag_native || layout != LAYOUT_SEPARATE || flag_stats)) return -1;
+  if (flag_shard) flag_journal=false;
+
+  // Shared Memory Outputs Touch No Files: Segment Names Cannot Hold A Directory
+  string shmname;
+  if (flag_shm && (!SharedOutputName(fn_outprefix+"Image",shmname) || flag_resume || flag_unchanged || flag_stats ||
+                   flag_npy || lastrow > 0 || writeroptions.checksum != CHECKSUM_NONE || writeroptions.sparse)) return -1;
+  if (flag_shm) flag_journal=false;
+  SharedBufferPool().Configure(pooloptions);
+  TileScheduler scheduler(nthreads,flag_numa);
+
 
   //////////////////////////////////////////////////////////////////////////////////////
   // Open .scn File
+  // Figure Out Which TIFF Directories You Want From The Metadata Index, Which Is Built
+  // From The XML Description In The First Directory When It Is Missing Or Stale
   //////////////////////////////////////////////////////////////////////////////////////
-  TIFF *tif=TIFFOpen(fn_in.c_str(), "r");
-  if (tif == NULL) {atexit(Error_TIFFOpen); exit(1);}
+  SlideIndex index;
+  bool flag_built=false;
+  string fn_index=flag_index ? SlideIndexFilename(fn_in,fn_indexdir) : "";
+  SlideIndexStatus istatus=OpenSlideIndex(fn_in,fn_index,index,flag_built);
+  if (istatus == INDEX_OPEN_FAILED) {atexit(Error_TIFFOpen); exit(1);}
+  if (istatus == INDEX_XML_FAILED) {atexit(Error_XMLParse); exit(2);}
+  if (flag_index) cout << "Index: " << (flag_built ? "Built " : "Loaded ") << fn_index << endl;
+  xmlCleanupParser();
+  const SCNDescription &description=index.description;
+
+  // Options That Change The Output Bytes
+  ostringstream options;
+  options << "layout=" << layout << " native=" << flag_native << " stats=" << flag_stats;
+  if (flag_npy) options << " format=npy";
+  string extension=flag_npy ? ".npy" : ".bin";
 
 
   //////////////////////////////////////////////////////////////////////////////////////
-  // Get Image Description In First Directory of .scn File
+  // With --skip-unchanged, Stop Here If The Slide Content And Options Match The Last
+  // Finished Conversion And Its Outputs Are All Still There
   //////////////////////////////////////////////////////////////////////////////////////
-  int iTIFFdir=0;
-  char *sdescription=0;
-  TIFFGetField(tif,TIFFTAG_IMAGEDESCRIPTION,&sdescription);
-  //cout << sdescription << endl; 
+  string fn_fingerprint=fn_outprefix+"Conversion.fingerprint";
+  ConversionFingerprint fingerprint;
+  fingerprint.options=options.str();
+  fingerprint.source=0;
+  if (flag_unchanged)
+  {
+    vector<int> ifds;
+    for (uint32 ifield=0;ifield<description.fields.size();ifield++)
+    {
+      vector<SCNDimension> channels=FieldChannels(description.fields[ifield]);
+      for (uint32 ic=0;ic<channels.size();ic++) ifds.push_back(channels[ic].ifd);
+    }
+    if (!FingerprintSlide(fn_in,index,ifds,fingerprint.source)) {atexit(Error_ImageRead); exit(3);}
+    ConversionFingerprint previous;
+    if (LoadConversionFingerprint(fn_fingerprint,previous) && previous.options == fingerprint.options &&
+        previous.source == fingerprint.source && OutputsPresent(previous))
+    {
+      cout << "Unchanged: " << fn_in << " Matches " << fn_fingerprint << ", Nothing To Convert" << endl;
+      return 0;
+    }
+  }
+
+  // Outputs Are About To Change, So An Old Fingerprint No Longer Describes Them
+  if (!flag_shm) remove(fn_fingerprint.c_str());
+
+  TIFF *tif=OpenSlideHeaderOnly(fn_in);
+  if (tif == NULL) {atexit(Error_TIFFOpen); exit(1);}
 
 
   //////////////////////////////////////////////////////////////////////////////////////
-  // Process XML Data
-  // Figure Out Which TIFF Directories You Want
+  // Open The Conversion Journal, Keyed To This Slide And The Options That Change The
+  // Output Bytes
   //////////////////////////////////////////////////////////////////////////////////////
-
-  // Replace <scn ...> with <scn> to avoid using Leica's namespace
-  bool flag_stop=false;
-  int jj=0;
-  while (!flag_stop)
+  ConversionJournal journal;
+  ConversionJournal *pjournal=NULL;
+  if (flag_journal)
   {
-    if (sdescription[jj]=='<' && sdescription[jj+1]=='s' && 
-        sdescription[jj+2]=='c' && sdescription[jj+3]=='n')
-    { 
-      jj=jj+4;
-      while (sdescription[jj] != '>') {sdescription[jj]=' '; jj++;} 
-      flag_stop=true;
-    }
-    jj++;
+    ostringstream signature;
+    signature << "slide=" << hex << index.xmlhash << dec << "," << index.filesize << " " << options.str();
+    string fn_journal=fn_outprefix+"Conversion.journal";
+    if (!journal.Open(fn_journal,signature.str(),flag_resume)) {atexit(Error_FileWrite); exit(5);}
+    pjournal=&journal;
   }
 
-  // Parse the XML
-  int xsize=0,xi=0;
-  while (sdescription[xi] != '\0') {xsize++; xi++;}
-  xmlInitParser();
-  LIBXML_TEST_VERSION
-  xmlDocPtr xmldoc;
-  xmlXPathContextPtr xmlcontext;
-  xmlXPathObjectPtr xmlresult;
-  xmlChar *keyword;
-  xmldoc=xmlParseMemory(sdescription,xsize);
-  if (xmldoc == NULL) {atexit(Error_XMLParse); exit(2);}
-  xmlcontext=xmlXPathNewContext(xmldoc);
-
-  // Get Collection Dimensions
-  long xcollection=0,ycollection=0; 
-  xmlresult=xmlXPathEvalExpression((xmlChar *) "//collection",xmlcontext);
-  keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[0],(xmlChar *) "sizeX");
-  xcollection=atol((char *) keyword);
-  xmlFree(keyword);
-  keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[0],(xmlChar *) "sizeY");
-  ycollection=atol((char *) keyword);
-  xmlFree(keyword);
-  xmlXPathFreeObject(xmlresult);
-
-  // Save Information For All Images You Want
-  vector<int> channelID, TIFFDirectories, ImageNo;
-  long xview=0,yview=0;
-  ostringstream convert; string ssearch;
-  int icount=0;
-  jj=1; convert << "//image[" << jj << "]/view"; ssearch=convert.str();
-  xmlresult=xmlXPathEvalExpression((xmlChar *) ssearch.c_str(),xmlcontext);
-  while  (!xmlXPathNodeSetIsEmpty(xmlresult->nodesetval))
+
+  //////////////////////////////////////////////////////////////////////////////////////
+  // Get Data From .scn File
+  //////////////////////////////////////////////////////////////////////////////////////
+  ConversionManifest manifest;
+  manifest.slide=fn_in;
+  manifest.collectionSizeX=description.collectionSizeX;
+  manifest.collectionSizeY=description.collectionSizeY;
+  for (uint32 ifield=0;ifield<description.fields.size();ifield++)
   {
-    // Compare <view> Dimensions With <collection> Dimensions
-    keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[0],(xmlChar *) "sizeX");
-    xview=atol((char *) keyword);
-    xmlFree(keyword);
-    keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[0],(xmlChar *) "sizeY");
-    yview=atol((char *) keyword);
-    xmlFree(keyword);
-    if (xview != xcollection && yview != ycollection)
+    if (!Selected(onlyfields,static_cast<int>(ifield))) continue;
+    const SCNField &field=description.fields[ifield];
+
+    // Highest Resolution Directories Of This Field, In Channel Order
+    vector<SCNDimension> channels=FieldChannels(field);
+    if (channels.empty()) continue;
+
+    if (layout == LAYOUT_SEPARATE)
     {
-      // Save Information For <view>s Whose Dimensions Do Not Match <collection>
-      xmlXPathFreeObject(xmlresult);
-      convert.str(""); convert.clear(); convert << "//image[" << jj << "]/pixels/dimension[@r=0]"; ssearch=convert.str(); 
-      xmlresult=xmlXPathEvalExpression((xmlChar *) ssearch.c_str(),xmlcontext);
-      for (int ii=0;ii<xmlresult->nodesetval->nodeNr;ii++)
+      for (uint32 ic=0;ic<channels.size();ic++)
       {
-        keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[ii],(xmlChar *) "c");
-        if (keyword == NULL)
+        if (!Selected(onlychannels,channels[ic].channel)) continue;
+
+        // Get Image Size
+        uint32 ww,hh;
+        SampleType type;
+        const IndexedDirectory *directory=index.FindDirectory(channels[ic].ifd);
+        if (!GetImageInfo(directory,flag_native,ww,hh,type)) {atexit(Error_ImageRead); exit(3);}
+        size_t Nbytes=SampleBytes(type);
+
+        // Create Output Filename
+        ostringstream convert;
+        convert << fn_outprefix << "Image" << field.number << "_Channel" << channels[ic].channel << "_X" << ww << "_Y" << hh
+                << TypeSuffix(type) << extension; 
+        string fn_out=convert.str(); 
+        vector<SCNDimension> outchannels(1,channels[ic]);
+        string header=OutputHeader(flag_npy,fn_out,field,outchannels,layout,type,ww,hh);
+        if (lastrow > 0)
         {
-          // No "c" property - Leica has different format in this case, so just force it
-          channelID.push_back(0);
+          ConvertChannelTileRows(fn_in,*directory,channels[ic].channel,fn_out,header,firstrow,lastrow,writeroptions.sparse,
+                                 scheduler);
+          continue;
         }
-        else
+        StreamChecksum checksum(writeroptions.checksum);
+        if (SkipFinishedOutput(pjournal,fn_out,checksum))
         {
-          channelID.push_back(atoi((char*) keyword));
+          ListOutput(fingerprint.outputs,fn_out,flag_stats);
+          ManifestAdd(manifest,fn_out,field,outchannels,layout,type,ww,hh,header,checksum.Type(),checksum.HexDigest(),
+                      flag_stats);
+          continue;
         }
-        xmlFree(keyword);
-        keyword=xmlGetProp(xmlresult->nodesetval->nodeTab[ii],(xmlChar *) "ifd");
-        TIFFDirectories.push_back(atoi((char*) keyword));
-        xmlFree(keyword);
-        ImageNo.push_back(icount);
-      }
-      icount++;
-    }
-
-    xmlXPathFreeObject(xmlresult);
-    jj++; convert.str(""); convert.clear(); convert << "//image[" << jj << "]/view"; ssearch=convert.str(); 
-    xmlresult=xmlXPathEvalExpression((xmlChar *) ssearch.c_str(),xmlcontext);
-  }
 
-  // Clean Up
-  xmlXPathFreeContext(xmlcontext);
-  xmlFreeDoc(xmldoc);
-  xmlCleanupParser();
+        // Read In Image Data
+        size_t Npixels=static_cast<size_t>(ww)*hh;
+        PooledBuffer imagebuffer;
+        SharedOutput segment;
+        bool placeable;
+        uint8 *image=OutputBuffer(flag_shm,DescribeConverted(fn_out,field,outchannels,layout,type,ww,hh),Npixels*Nbytes,
+                                  imagebuffer,segment,placeable);
+        if (image == NULL) {atexit(Error_MemoryAllocate); exit(4);}
+        ChannelStats stats(type);
+        string written;
+        if (pjournal != NULL && flag_native && Npixels*Nbytes > checkpoint_bytes)
+        {
+          // Large Output: Read And Write In Journaled Bands. Bands Are Written Out Of File
+          // Order, So The Checksum Is Taken Over The Finished Image In Memory.
+          ConvertChannelBands(fn_in,*directory,channels[ic].channel,fn_out,header,image,placeable,checkpoint_bytes,
+                              flag_resume,writeroptions.sparse,*pjournal,flag_stats ? &stats : NULL,scheduler);
+          checksum.Update(header.data(),header.size());
+          checksum.Update(image,Nbytes*Npixels);
+          written=checksum.HexDigest();
+        }
+        else
+        {
+          // Native Tiles Are Decoded On All Workers, Balanced By Compressed Size
+          int status;
+          if (flag_native)
+          {
+            vector<TileDecodeJob> jobs(1,DecodeJob(*directory,channels[ic].channel,0,TilesDown(directory->layout),image,1,
+                                                   flag_stats ? &stats : NULL,placeable));
+            status=DecodeTilesScheduled(fn_in,jobs,scheduler);
+          }
+          else status=ReadChannel(tif,*directory,flag_native,channels[ic].channel,image,1,flag_stats ? &stats : NULL);
+          ExitOnStatus(status);
+          cout << "Read: Successful (" << ww << " x " << hh << ", " << SampleTypeName(type) << ")" << endl;
 
+          // Write Out Image Data In Binary Format
+          if (flag_shm) PublishShared(segment);
+          else written=WriteOutput(fn_out,image,Nbytes*Npixels,writeroptions,header);
+        }
+        if (flag_stats)
+        {
+          ChannelStatsEntry entry={field.number,channels[ic].channel,&stats};
+          WriteStats(fn_out,vector<ChannelStatsEntry>(1,entry));
+        }
+        JournalOutput(pjournal,fn_out,header,image,Nbytes*Npixels);
+        if (!flag_shm) ListOutput(fingerprint.outputs,fn_out,flag_stats);
+        ManifestAdd(manifest,fn_out,field,outchannels,layout,type,ww,hh,header,checksum.Type(),written,flag_stats);
 
-  //////////////////////////////////////////////////////////////////////////////////////
-  // Get Data From .scn File
-  //////////////////////////////////////////////////////////////////////////////////////
-  uint32 ww,hh;
-  bool flag_dir=false;
-  int iwrite;
-  while (TIFFReadDirectory(tif))
-  {
-    iTIFFdir++;
-    for (uint32 ii=0;ii<TIFFDirectories.size();ii++) 
-    {
-      if (TIFFDirectories[ii]==iTIFFdir)
-      {
-        iwrite=ii;
-        flag_dir=true;
+        // Return Memory To The Pool For The Next Channel
+        imagebuffer.Reset();
       }
     }
-    if (flag_dir)
+    else
     {
-      // Get Image Size
-      TIFFGetField(tif,TIFFTAG_IMAGEWIDTH,&ww);
-      TIFFGetField(tif,TIFFTAG_IMAGELENGTH,&hh);
+      // Get Image Size From The First Channel; All Channels Must Match It
+      uint32 ww=0,hh=0;
+      SampleType type=SAMPLE_UINT8;
+      vector<const IndexedDirectory *> directories;
+      for (uint32 ic=0;ic<channels.size();ic++)
+      {
+        uint32 wwc,hhc;
+        SampleType typec;
+        directories.push_back(index.FindDirectory(channels[ic].ifd));
+        if (!GetImageInfo(directories[ic],flag_native,wwc,hhc,typec)) {atexit(Error_ImageRead); exit(3);}
+        if (ic == 0) {ww=wwc; hh=hhc; type=typec;}
+        else if (wwc != ww || hhc != hh || typec != type) {atexit(Error_ImageRead); exit(3);}
+      }
+      size_t Nbytes=SampleBytes(type);
+      size_t Nchannels=channels.size();
 
       // Create Output Filename
       ostringstream convert;
-      convert << fn_outprefix << "Image" << ImageNo[iwrite] << "_Channel" << channelID[iwrite] << "_X" << ww << "_Y" << hh << ".bin"; 
+      convert << fn_outprefix << "Image" << field.number << (layout == LAYOUT_PLANAR ? "_CHW" : "_HWC")
+              << "_C" << Nchannels << "_X" << ww << "_Y" << hh << TypeSuffix(type) << extension; 
       string fn_out=convert.str(); 
+      string header=OutputHeader(flag_npy,fn_out,field,channels,layout,type,ww,hh);
+      StreamChecksum checksum(writeroptions.checksum);
+      if (SkipFinishedOutput(pjournal,fn_out,checksum))
+      {
+        ListOutput(fingerprint.outputs,fn_out,flag_stats);
+        ManifestAdd(manifest,fn_out,field,channels,layout,type,ww,hh,header,checksum.Type(),checksum.HexDigest(),
+                    flag_stats);
+        continue;
+      }
 
-      // Read In Image Data
-      uint32 Npixels=ww*hh;
-      uint32* raster;
-      raster=(uint32*) _TIFFmalloc(Npixels*sizeof(uint32));
-      uint8* image=new uint8[Npixels];
-      if (raster != NULL)
+      // Fill All Channels Concurrently: Native Tiles Of Every Channel In One Scheduled
+      // Run, Through RGBA One Thread And TIFF Handle Per Channel
+      size_t Npixels=static_cast<size_t>(ww)*hh;
+      PooledBuffer imagebuffer;
+      SharedOutput segment;
+      bool placeable;
+      uint8 *image=OutputBuffer(flag_shm,DescribeConverted(fn_out,field,channels,layout,type,ww,hh),Nchannels*Npixels*Nbytes,
+                                imagebuffer,segment,placeable);
+      if (image == NULL) {atexit(Error_MemoryAllocate); exit(4);}
+      vector<int> status(Nchannels,0);
+      vector<thread> workers;
+      vector<TileDecodeJob> jobs;
+      vector<ChannelStats *> stats(Nchannels,(ChannelStats *) NULL);
+      for (uint32 ic=0;ic<Nchannels;ic++)
       {
-        if (TIFFReadRGBAImage(tif,ww,hh,raster,0)) 
+        uint8 *out=(layout == LAYOUT_PLANAR) ? image+ic*Npixels*Nbytes : image+ic*Nbytes;
+        size_t stride=(layout == LAYOUT_PLANAR) ? 1 : Nchannels;
+        if (flag_stats) stats[ic]=new ChannelStats(type);
+        if (flag_native)
         {
-          cout << "Read: Successful (" << ww << " x " << hh << ")" << endl;
-          for (uint32 ii=0;ii<Npixels;ii++)
-          {
-            switch (channelID[iwrite])
-            {
-              case 0: image[ii]=static_cast<uint8>(TIFFGetR(raster[ii])); break;
-              case 1: image[ii]=static_cast<uint8>(TIFFGetG(raster[ii])); break;
-              case 2: image[ii]=static_cast<uint8>(TIFFGetB(raster[ii])); break;
-              default: cout << "Invalid channelID" << endl;
-            }
-          }
-        } 
-        else {atexit(Error_ImageRead); exit(3);}
+          jobs.push_back(DecodeJob(*directories[ic],channels[ic].channel,0,TilesDown(directories[ic]->layout),out,stride,
+                                   stats[ic],placeable));
+          continue;
+        }
+        workers.push_back(thread(ReadFieldChannel,cref(fn_in),directories[ic],channels[ic].channel,flag_native,out,stride,
+                                 stats[ic],&status[ic]));
       }
-      else {atexit(Error_MemoryAllocate); exit(4);}
-      _TIFFfree(raster);
+      if (flag_native) ExitOnStatus(DecodeTilesScheduled(fn_in,jobs,scheduler));
+      for (size_t iw=0;iw<workers.size();iw++) workers[iw].join();
+      for (uint32 ic=0;ic<Nchannels;ic++) ExitOnStatus(status[ic]);
+      cout << "Read: Successful (" << Nchannels << " x " << ww << " x " << hh << ", " << SampleTypeName(type) << ")" << endl;
 
       // Write Out Image Data In Binary Format
-      cout << "Writing " << fn_out << endl << endl;
-      ofstream ofile;
-      ofile.open(fn_out.c_str(), ios::out | ios::binary);
-      ofile.write((char *) image, sizeof(uint8)*Npixels); 
-      ofile.close();
-
-      // Free Memory
-      delete [] image;
+      string written;
+      if (flag_shm) PublishShared(segment);
+      else written=WriteOutput(fn_out,image,Nbytes*Nchannels*Npixels,writeroptions,header);
+      if (flag_stats)
+      {
+        vector<ChannelStatsEntry> entries;
+        for (uint32 ic=0;ic<Nchannels;ic++)
+        {
+          ChannelStatsEntry entry={field.number,channels[ic].channel,stats[ic]};
+          entries.push_back(entry);
+        }
+        WriteStats(fn_out,entries);
+      }
+      JournalOutput(pjournal,fn_out,header,image,Nbytes*Nchannels*Npixels);
+      if (!flag_shm) ListOutput(fingerprint.outputs,fn_out,flag_stats);
+      ManifestAdd(manifest,fn_out,field,channels,layout,type,ww,hh,header,checksum.Type(),written,flag_stats);
 
+      // Free Memory, Returning The Field Buffer To The Pool
+      imagebuffer.Reset();
+      for (uint32 ic=0;ic<Nchannels;ic++) delete stats[ic];
     }
-    flag_dir=false;
   }
 
   // Close TIFF File
   TIFFClose(tif);
 
+  // Describe The Outputs And List Their Checksums; Left To A Whole-Slide Run When Sharded
+  if (!flag_shard && !flag_shm && !WriteConversionManifestJSON(fn_outprefix+"Manifest.json",manifest))
+  {
+    atexit(Error_FileWrite); exit(5);
+  }
+  if (writeroptions.checksum != CHECKSUM_NONE)
+  {
+    WriteChecksums(fn_outprefix+"Checksums."+ChecksumTypeName(writeroptions.checksum),manifest.outputs);
+  }
 
-  return 0;
-}
+  // Remember What Was Converted From What
+  if (flag_unchanged && !SaveConversionFingerprint(fn_fingerprint,fingerprint))
+  {
+    cout << "WARNING (ConvertLeicaSCN400F.cc): Could Not Save Conversion Fingerprint " << fn_fingerprint << endl;
+  }
 
+  // Buffer Reuse
+  BufferPoolStats poolstats=SharedBufferPool().Stats();
+  cout << "Buffers: " << poolstats.requests << " Requests, " << poolstats.reuses << " Reused ("
+       << poolstats.reusedbytes/(1024*1024) << " MB), Peak " << poolstats.peakbytes/(1024*1024) << " MB" << endl;
+  TileSchedulerStats schedulerstats=scheduler.Stats();
+  if (schedulerstats.tasks > 0)
+  {
+    cout << "Tiles: " << schedulerstats.tasks << " Decoded On " << scheduler.Size() << " Threads, "
+         << schedulerstats.steals << " Stolen (" << schedulerstats.remotesteals << " Across Nodes)" << endl;
+    for (size_t in=0;in<schedulerstats.nodes.size();in++)
+    {
+      const TileSchedulerNodeStats &node=schedulerstats.nodes[in];
+      double mb=node.bytes/(1024.0*1024.0);
+      cout << "  Node " << node.node << ": " << node.nworkers << " Threads, " << node.tasks << " Tiles, " << mb
+           << " MB Compressed, " << node.seconds << " s Busy (" << (node.seconds > 0 ? mb/node.seconds : 0.0)
+           << " MB/s Per Thread)" << endl;
+    }
+  }
 
 
+  return 0;
+}
@@ -0,0 +1,339 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Lightweight TIFF / BigTIFF IFD Scanner
+// See IFDScanner.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "IFDScanner.h"
+#include "IOHelpers.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <set>
+using namespace std;
+
+// Read-Ahead Window; Leica Slides Keep Their IFDs Close Together, So One Window
+// Usually Covers Many Directories
+static const size_t kWindowBytes=1024*1024;
+
+// Directories With More Entries Than This, Or Chains Longer Than This, Are Damaged
+static const uint64_t kMaxEntries=4096;
+static const size_t kMaxDirectories=1<<20;
+
+// Tags Used
+enum
+{
+  TAG_IMAGEWIDTH=256, TAG_IMAGELENGTH=257, TAG_BITSPERSAMPLE=258, TAG_COMPRESSION=259,
+  TAG_PHOTOMETRIC=262, TAG_IMAGEDESCRIPTION=270, TAG_STRIPOFFSETS=273, TAG_SAMPLESPERPIXEL=277,
+  TAG_ROWSPERSTRIP=278, TAG_STRIPBYTECOUNTS=279, TAG_PLANARCONFIG=284, TAG_TILEWIDTH=322,
+  TAG_TILELENGTH=323, TAG_TILEOFFSETS=324, TAG_TILEBYTECOUNTS=325, TAG_SAMPLEFORMAT=339,
+  TAG_JPEGTABLES=347
+};
+
+// Field Types Used
+enum
+{
+  TYPE_BYTE=1, TYPE_ASCII=2, TYPE_SHORT=3, TYPE_LONG=4, TYPE_UNDEFINED=7, TYPE_LONG8=16
+};
+
+// Bytes Per Value Of Each Field Type, 0 For Unknown Types
+static size_t TypeBytes(uint16_t type)
+{
+  switch (type)
+  {
+    case 1: case 2: case 6: case 7: return 1;
+    case 3: case 8: return 2;
+    case 4: case 9: case 11: case 13: return 4;
+    case 5: case 10: case 12: case 16: case 17: case 18: return 8;
+    default: return 0;
+  }
+}
+
+IFDScanner::IFDScanner() : fd(-1), filesize(0), bigtiff(false), swap(false), firstifd(0), windowoffset(0),
+                           windowbytes(0)
+{
+}
+
+IFDScanner::~IFDScanner()
+{
+  Close();
+}
+
+void IFDScanner::Close()
+{
+  if (fd >= 0) close(fd);
+  fd=-1;
+  windowbytes=0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Reading
+////////////////////////////////////////////////////////////////////////////////////////
+uint16_t IFDScanner::Get16(const uint8_t *p) const
+{
+  uint16_t value;
+  memcpy(&value,p,sizeof(value));
+  return swap ? __builtin_bswap16(value) : value;
+}
+
+uint32_t IFDScanner::Get32(const uint8_t *p) const
+{
+  uint32_t value;
+  memcpy(&value,p,sizeof(value));
+  return swap ? __builtin_bswap32(value) : value;
+}
+
+uint64_t IFDScanner::Get64(const uint8_t *p) const
+{
+  uint64_t value;
+  memcpy(&value,p,sizeof(value));
+  return swap ? __builtin_bswap64(value) : value;
+}
+
+bool IFDScanner::ReadAt(uint64_t offset, void *dst, size_t nbytes)
+{
+  if (fd < 0 || offset > filesize || nbytes > filesize-offset) return false;
+
+  // Served From The Window, Refilling It At offset When Needed
+  if (nbytes <= kWindowBytes)
+  {
+    if (windowbytes == 0 || offset < windowoffset || offset+nbytes > windowoffset+windowbytes)
+    {
+      window.resize(kWindowBytes);
+      size_t nwant=(filesize-offset < kWindowBytes) ? static_cast<size_t>(filesize-offset) : kWindowBytes;
+      size_t nhave=0;
+      while (nhave < nwant)
+      {
+        ssize_t nread=pread(fd,&window[nhave],nwant-nhave,offset+nhave);
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread <= 0) break;
+        nhave+=nread;
+      }
+      windowoffset=offset;
+      windowbytes=nhave;
+      if (nhave < nbytes) return false;
+    }
+    memcpy(dst,&window[offset-windowoffset],nbytes);
+    return true;
+  }
+
+  // Large Arrays Are Read Directly
+  return PreadAll(fd,dst,nbytes,offset);
+}
+
+bool IFDScanner::Open(const string &filename)
+{
+  Close();
+  fd=open(filename.c_str(),O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd,&st) != 0) {Close(); return false;}
+  filesize=st.st_size;
+
+  // Byte Order, Version And First IFD Offset
+  uint8_t header[16];
+  if (!ReadAt(0,header,(filesize < 16) ? 8 : 16)) {Close(); return false;}
+  if (header[0] == 'I' && header[1] == 'I') swap=(__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__);
+  else if (header[0] == 'M' && header[1] == 'M') swap=(__BYTE_ORDER__ != __ORDER_BIG_ENDIAN__);
+  else {Close(); return false;}
+  uint16_t version=Get16(header+2);
+  if (version == 42)
+  {
+    bigtiff=false;
+    firstifd=Get32(header+4);
+  }
+  else if (version == 43 && filesize >= 16 && Get16(header+4) == 8 && Get16(header+6) == 0)
+  {
+    bigtiff=true;
+    firstifd=Get64(header+8);
+  }
+  else {Close(); return false;}
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Directories
+////////////////////////////////////////////////////////////////////////////////////////
+bool IFDScanner::ScanDirectory(uint64_t offset, ScannedIFD &ifd, uint64_t &next)
+{
+  size_t countbytes=bigtiff ? 8 : 2, entrybytes=bigtiff ? 20 : 12, nextbytes=bigtiff ? 8 : 4;
+  size_t valuebytes=bigtiff ? 8 : 4;
+
+  // Entry Count, Then All Entries And The Next Offset In One Read
+  uint8_t countfield[8];
+  if (!ReadAt(offset,countfield,countbytes)) return false;
+  uint64_t nentries=bigtiff ? Get64(countfield) : Get16(countfield);
+  if (nentries == 0 || nentries > kMaxEntries) return false;
+  vector<uint8_t> entries(nentries*entrybytes+nextbytes);
+  if (!ReadAt(offset+countbytes,&entries[0],entries.size())) return false;
+  const uint8_t *pnext=&entries[nentries*entrybytes];
+  next=bigtiff ? Get64(pnext) : Get32(pnext);
+
+  // Defaults
+  memset(&ifd,0,sizeof(ifd));
+  ifd.diroffset=offset;
+  ifd.bitspersample=1;
+  ifd.samplesperpixel=1;
+  ifd.sampleformat=1;
+  ifd.planarconfig=1;
+  ifd.compression=1;
+  ifd.rowsperstrip=0xFFFFFFFF;
+  IFDTagValues stripoffsets, stripbytecounts, tileoffsets, tilebytecounts;
+  memset(&stripoffsets,0,sizeof(IFDTagValues));
+  memset(&stripbytecounts,0,sizeof(IFDTagValues));
+  memset(&tileoffsets,0,sizeof(IFDTagValues));
+  memset(&tilebytecounts,0,sizeof(IFDTagValues));
+
+  for (uint64_t ii=0;ii<nentries;ii++)
+  {
+    const uint8_t *entry=&entries[ii*entrybytes];
+    IFDTagValues values;
+    uint16_t tag=Get16(entry);
+    values.type=Get16(entry+2);
+    values.count=bigtiff ? Get64(entry+4) : Get32(entry+4);
+    const uint8_t *field=entry+(bigtiff ? 12 : 8);
+    size_t nbytes=TypeBytes(values.type);
+    if (nbytes == 0) continue;
+    values.present=true;
+    values.isinline=(values.count <= valuebytes/nbytes);
+    memset(values.inlinebytes,0,sizeof(values.inlinebytes));
+    if (values.isinline)
+    {
+      memcpy(values.inlinebytes,field,valuebytes);
+      values.offset=0;
+    }
+    else values.offset=bigtiff ? Get64(field) : Get32(field);
+
+    // First Value Of Integer Tags (BitsPerSample Has One Per Sample, Which Do Not Fit
+    // In A Classic TIFF Entry Once There Are Three)
+    uint64_t scalar=0;
+    uint8_t first[8];
+    const uint8_t *pfirst=values.isinline ? field : first;
+    bool integer=(values.type == TYPE_SHORT || values.type == TYPE_LONG || values.type == TYPE_LONG8 ||
+                  values.type == TYPE_BYTE);
+    if (integer && values.count >= 1 && (values.isinline || (tag == TAG_BITSPERSAMPLE || tag == TAG_SAMPLEFORMAT)))
+    {
+      if (!values.isinline && !ReadAt(values.offset,first,nbytes)) return false;
+      if (values.type == TYPE_SHORT) scalar=Get16(pfirst);
+      else if (values.type == TYPE_LONG) scalar=Get32(pfirst);
+      else if (values.type == TYPE_LONG8) scalar=Get64(pfirst);
+      else scalar=pfirst[0];
+    }
+
+    switch (tag)
+    {
+      case TAG_IMAGEWIDTH: ifd.width=static_cast<uint32_t>(scalar); break;
+      case TAG_IMAGELENGTH: ifd.height=static_cast<uint32_t>(scalar); break;
+      case TAG_BITSPERSAMPLE: ifd.bitspersample=static_cast<uint16_t>(scalar); break;
+      case TAG_COMPRESSION: ifd.compression=static_cast<uint16_t>(scalar); break;
+      case TAG_PHOTOMETRIC: ifd.photometric=static_cast<uint16_t>(scalar); break;
+      case TAG_SAMPLESPERPIXEL: ifd.samplesperpixel=static_cast<uint16_t>(scalar); break;
+      case TAG_ROWSPERSTRIP: ifd.rowsperstrip=static_cast<uint32_t>(scalar); break;
+      case TAG_PLANARCONFIG: ifd.planarconfig=static_cast<uint16_t>(scalar); break;
+      case TAG_TILEWIDTH: ifd.tilewidth=static_cast<uint32_t>(scalar); ifd.tiled=true; break;
+      case TAG_TILELENGTH: ifd.tilelength=static_cast<uint32_t>(scalar); break;
+      case TAG_SAMPLEFORMAT: ifd.sampleformat=static_cast<uint16_t>(scalar); break;
+      case TAG_IMAGEDESCRIPTION: ifd.description=values; break;
+      case TAG_JPEGTABLES: ifd.jpegtables=values; break;
+      case TAG_STRIPOFFSETS: stripoffsets=values; break;
+      case TAG_STRIPBYTECOUNTS: stripbytecounts=values; break;
+      case TAG_TILEOFFSETS: tileoffsets=values; break;
+      case TAG_TILEBYTECOUNTS: tilebytecounts=values; break;
+    }
+  }
+  ifd.offsets=ifd.tiled ? tileoffsets : stripoffsets;
+  ifd.bytecounts=ifd.tiled ? tilebytecounts : stripbytecounts;
+  if (ifd.rowsperstrip == 0xFFFFFFFF || ifd.rowsperstrip == 0) ifd.rowsperstrip=ifd.height;
+  return true;
+}
+
+bool IFDScanner::ScanDirectories(vector<ScannedIFD> &ifds)
+{
+  ifds.clear();
+  set<uint64_t> visited;
+  uint64_t offset=firstifd;
+  while (offset != 0)
+  {
+    // A Loop In The Chain Or An Absurd Length Means The File Is Damaged
+    if (!visited.insert(offset).second || ifds.size() >= kMaxDirectories) return false;
+    ScannedIFD ifd;
+    uint64_t next;
+    if (!ScanDirectory(offset,ifd,next)) return false;
+    ifds.push_back(ifd);
+    offset=next;
+  }
+  return !ifds.empty();
+}
+
+bool IFDScanner::ScanFirstDirectory(ScannedIFD &ifd)
+{
+  return ScanDirectoryAt(firstifd,ifd);
+}
+
+bool IFDScanner::ScanDirectoryAt(uint64_t offset, ScannedIFD &ifd)
+{
+  uint64_t next;
+  return offset != 0 && ScanDirectory(offset,ifd,next);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Tag Values
+////////////////////////////////////////////////////////////////////////////////////////
+bool IFDScanner::ReadBytes(const IFDTagValues &values, vector<uint8_t> &bytes)
+{
+  bytes.clear();
+  if (!values.present) return false;
+  size_t nbytes=TypeBytes(values.type);
+  if (values.count > (filesize/nbytes)) return false;
+  bytes.resize(values.count*nbytes);
+  if (bytes.empty()) return true;
+  if (values.isinline)
+  {
+    memcpy(&bytes[0],values.inlinebytes,bytes.size());
+    return true;
+  }
+  return ReadAt(values.offset,&bytes[0],bytes.size());
+}
+
+bool IFDScanner::ReadIntegers(const IFDTagValues &values, vector<uint64_t> &integers)
+{
+  integers.clear();
+  if (values.type != TYPE_SHORT && values.type != TYPE_LONG && values.type != TYPE_LONG8) return false;
+  vector<uint8_t> bytes;
+  if (!ReadBytes(values,bytes)) return false;
+  integers.resize(values.count);
+  for (uint64_t ii=0;ii<values.count;ii++)
+  {
+    if (values.type == TYPE_SHORT) integers[ii]=Get16(&bytes[2*ii]);
+    else if (values.type == TYPE_LONG) integers[ii]=Get32(&bytes[4*ii]);
+    else integers[ii]=Get64(&bytes[8*ii]);
+  }
+  return true;
+}
+
+bool IFDScanner::ReadImageDescription(const ScannedIFD &ifd, string &description)
+{
+  vector<uint8_t> bytes;
+  if (ifd.description.type != TYPE_ASCII || !ReadBytes(ifd.description,bytes)) return false;
+
+  // Up To The First NUL, As libtiff Returns It
+  size_t nchars=0;
+  while (nchars < bytes.size() && bytes[nchars] != 0) nchars++;
+  description.assign(bytes.begin(),bytes.begin()+nchars);
+  return true;
+}
+
+bool IFDScanner::ReadJPEGTables(const ScannedIFD &ifd, vector<uint8_t> &tables)
+{
+  if (ifd.jpegtables.type != TYPE_UNDEFINED && ifd.jpegtables.type != TYPE_BYTE) return false;
+  return ReadBytes(ifd.jpegtables,tables);
+}
+
+bool IFDScanner::ReadTileArrays(const ScannedIFD &ifd, vector<uint64_t> &offsets, vector<uint64_t> &bytecounts)
+{
+  if (!ReadIntegers(ifd.offsets,offsets) || !ReadIntegers(ifd.bytecounts,bytecounts)) return false;
+  return offsets.size() == bytecounts.size();
+}
@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Lightweight TIFF / BigTIFF IFD Scanner
+//
+// Walks the IFD chain of a classic or BigTIFF file (either byte order) with pread
+// through a large read-ahead window, and extracts only the tags the slide index
+// needs: image and tile geometry, sample layout, compression, photometric
+// interpretation, tile (or strip) offsets and byte counts, JPEGTables and the
+// ImageDescription. Unlike TIFFReadDirectory it does not decode every tag of every
+// directory, and offset / byte count arrays are read only for directories asked for.
+//
+// Absent tags get their TIFF 6.0 defaults (rowsperstrip: the image height).
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IFDSCANNER_H
+#define IFDSCANNER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Location Of A Tag's Values In The File (Or Inline In The Entry)
+struct IFDTagValues
+{
+  uint16_t type;          // TIFF field type
+  uint64_t count;         // Number of values
+  uint64_t offset;        // File offset of the values, when not inline
+  uint8_t inlinebytes[8]; // Values stored in the entry itself
+  bool isinline;
+  bool present;
+};
+
+// One Directory As Scanned
+struct ScannedIFD
+{
+  uint64_t diroffset;
+  uint32_t width, height;
+  bool tiled;
+  uint32_t tilewidth, tilelength, rowsperstrip;
+  uint16_t bitspersample, samplesperpixel, sampleformat;
+  uint16_t planarconfig, compression, photometric;
+  IFDTagValues description, jpegtables;
+  IFDTagValues offsets, bytecounts;  // Tile or strip arrays, see ReadTileArrays
+};
+
+class IFDScanner
+{
+public:
+  IFDScanner();
+  ~IFDScanner();
+
+  // Open A File And Read Its Header; false If It Is Not A TIFF Or BigTIFF File
+  bool Open(const std::string &filename);
+  void Close();
+  bool BigTIFF() const { return bigtiff; }
+
+  // Scan The Whole IFD Chain, In Order. false If Any Directory Is Damaged.
+  bool ScanDirectories(std::vector<ScannedIFD> &ifds);
+  bool ScanFirstDirectory(ScannedIFD &ifd);
+
+  // Scan One Directory At A Known File Offset (e.g. IndexedDirectory::diroffset)
+  bool ScanDirectoryAt(uint64_t offset, ScannedIFD &ifd);
+
+  // Read The Values Of A Directory's Tags
+  bool ReadImageDescription(const ScannedIFD &ifd, std::string &description);
+  bool ReadJPEGTables(const ScannedIFD &ifd, std::vector<uint8_t> &tables);
+  bool ReadTileArrays(const ScannedIFD &ifd, std::vector<uint64_t> &offsets, std::vector<uint64_t> &bytecounts);
+
+private:
+  IFDScanner(const IFDScanner &);
+  IFDScanner &operator=(const IFDScanner &);
+
+  bool ReadAt(uint64_t offset, void *dst, size_t nbytes);
+  bool ScanDirectory(uint64_t offset, ScannedIFD &ifd, uint64_t &next);
+  bool ReadBytes(const IFDTagValues &values, std::vector<uint8_t> &bytes);
+  bool ReadIntegers(const IFDTagValues &values, std::vector<uint64_t> &integers);
+  uint16_t Get16(const uint8_t *p) const;
+  uint32_t Get32(const uint8_t *p) const;
+  uint64_t Get64(const uint8_t *p) const;
+
+  int fd;
+  uint64_t filesize;
+  bool bigtiff, swap;
+  uint64_t firstifd;
+
+  // Read-Ahead Window
+  std::vector<uint8_t> window;
+  uint64_t windowoffset;
+  size_t windowbytes;
+};
+
+#endif
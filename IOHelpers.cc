@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared I/O Helpers
+// See IOHelpers.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "IOHelpers.h"
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <cmath>
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// JSON
+////////////////////////////////////////////////////////////////////////////////////////
+string JSONString(const string &text)
+{
+  string quoted="\"";
+  for (size_t ii=0;ii<text.size();ii++)
+  {
+    unsigned char ch=text[ii];
+    if (ch == '"' || ch == '\\') {quoted+='\\'; quoted+=ch;}
+    else if (ch < 0x20)
+    {
+      char escape[8];
+      snprintf(escape,sizeof(escape),"\\u%04x",ch);
+      quoted+=escape;
+    }
+    else quoted+=ch;
+  }
+  return quoted+"\"";
+}
+
+string JSONNumber(double value)
+{
+  if (!std::isfinite(value)) return "null";
+  char text[32];
+  snprintf(text,sizeof(text),"%.10g",value);
+  return text;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Whole-Buffer Reads And Writes
+////////////////////////////////////////////////////////////////////////////////////////
+bool PreadAll(int fd, void *dst, size_t nbytes, uint64_t offset)
+{
+  char *out=static_cast<char *>(dst);
+  while (nbytes > 0)
+  {
+    ssize_t nn=pread(fd,out,nbytes,offset);
+    if (nn < 0 && errno == EINTR) continue;
+    if (nn <= 0) return false;
+    out+=nn; nbytes-=nn; offset+=nn;
+  }
+  return true;
+}
+
+bool PwriteAll(int fd, const void *src, size_t nbytes, uint64_t offset)
+{
+  const char *in=static_cast<const char *>(src);
+  while (nbytes > 0)
+  {
+    ssize_t nn=pwrite(fd,in,nbytes,offset);
+    if (nn < 0 && errno == EINTR) continue;
+    if (nn <= 0) return false;
+    in+=nn; nbytes-=nn; offset+=nn;
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared I/O Helpers
+//
+// Small helpers used by several modules: quoting strings and numbers for the JSON
+// sidecars (manifest, statistics, server listings), and pread/pwrite loops that
+// retry interrupted and short transfers until the whole buffer has been moved.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IOHELPERS_H
+#define IOHELPERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// JSON String Literal, Quoted, With Quotes, Backslashes And Control Characters Escaped
+std::string JSONString(const std::string &text);
+
+// JSON Number With 10 Significant Digits; null For NaN And Infinities
+std::string JSONNumber(double value);
+
+// Read Exactly nbytes At offset; false On Error Or End Of File
+bool PreadAll(int fd, void *dst, size_t nbytes, uint64_t offset);
+
+// Write All nbytes At offset; false On Error
+bool PwriteAll(int fd, const void *src, size_t nbytes, uint64_t offset);
+
+#endif
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Image Encoding
+// See ImageEncode.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ImageEncode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+extern "C" {
+  #include <jpeglib.h>
+}
+using namespace std;
+
+// libjpeg Calls exit() On Errors By Default; Jump Back Out Instead
+struct JPEGErrorManager
+{
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void JPEGErrorExit(j_common_ptr cinfo)
+{
+  JPEGErrorManager *err=reinterpret_cast<JPEGErrorManager *>(cinfo->err);
+  longjmp(err->jump,1);
+}
+
+// Compress Into A libjpeg Memory Buffer. buffer And size Belong To The Caller, Not To
+// The Frame Calling setjmp, So They Keep Their Values After An Error Jumps Back Here.
+static bool CompressJPEG(const uint8_t *pixels, uint32_t ww, uint32_t hh, int ncomponents, size_t rowbytes,
+                         int quality, unsigned char **buffer, unsigned long *size)
+{
+  jpeg_compress_struct cinfo;
+  JPEGErrorManager jerr;
+  cinfo.err=jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit=JPEGErrorExit;
+  if (setjmp(jerr.jump))
+  {
+    jpeg_destroy_compress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo,buffer,size);
+  cinfo.image_width=ww;
+  cinfo.image_height=hh;
+  cinfo.input_components=ncomponents;
+  cinfo.in_color_space=(ncomponents == 1) ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo,quality,TRUE);
+  jpeg_start_compress(&cinfo,TRUE);
+  while (cinfo.next_scanline < hh)
+  {
+    JSAMPROW row=const_cast<JSAMPROW>(pixels+cinfo.next_scanline*rowbytes);
+    jpeg_write_scanlines(&cinfo,&row,1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  return true;
+}
+
+bool EncodeJPEG(const uint8_t *pixels, uint32_t ww, uint32_t hh, int ncomponents, size_t rowbytes, int quality,
+                vector<uint8_t> &out)
+{
+  if (ww == 0 || hh == 0 || (ncomponents != 1 && ncomponents != 3)) return false;
+
+  unsigned char *buffer=NULL;
+  unsigned long size=0;
+  bool ok=CompressJPEG(pixels,ww,hh,ncomponents,rowbytes,quality,&buffer,&size);
+  if (ok) out.assign(buffer,buffer+size);
+  free(buffer);
+  return ok;
+}
+
+bool EncodePNM(const uint8_t *pixels, uint32_t ww, uint32_t hh, int ncomponents, size_t rowbytes,
+               vector<uint8_t> &out)
+{
+  if (ww == 0 || hh == 0 || (ncomponents != 1 && ncomponents != 3)) return false;
+  char header[64];
+  int nheader=snprintf(header,sizeof(header),"P%d\n%u %u\n255\n",(ncomponents == 1) ? 5 : 6,ww,hh);
+  size_t linebytes=static_cast<size_t>(ww)*ncomponents;
+  out.assign(header,header+nheader);
+  for (uint32_t yy=0;yy<hh;yy++) out.insert(out.end(),pixels+yy*rowbytes,pixels+yy*rowbytes+linebytes);
+  return true;
+}
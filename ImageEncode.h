@@ -0,0 +1,26 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Image Encoding
+//
+// Encodes 8 bit grayscale or RGB images for viewing: JPEG through libjpeg, or binary
+// PGM/PPM (Netpbm) which needs no library to read.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGEENCODE_H
+#define IMAGEENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Encode A ww x hh Image With ncomponents (1 = Gray, 3 = RGB) Interleaved 8 Bit
+// Samples Per Pixel, Top Row First, Rows rowbytes Apart. quality Is 1-100.
+bool EncodeJPEG(const uint8_t *pixels, uint32_t ww, uint32_t hh, int ncomponents, size_t rowbytes, int quality,
+                std::vector<uint8_t> &out);
+
+// Encode The Same Kind Of Image As Binary PGM (1 Component) Or PPM (3 Components)
+bool EncodePNM(const uint8_t *pixels, uint32_t ww, uint32_t hh, int ncomponents, size_t rowbytes,
+               std::vector<uint8_t> &out);
+
+#endif
@@ -0,0 +1,393 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Leica SCN400F Slide Access
+// See LeicaSCN.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "LeicaSCN.h"
+#include "BufferPool.h"
+#include "ChannelStats.h"
+extern "C" {
+  #include <libxml/tree.h>
+  #include <libxml/parser.h>
+  #include <libxml/xpath.h>
+}
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sstream>
+#include <string>
+using namespace std;
+
+// Read A Numeric Attribute, Returning fallback If It Is Missing
+static long GetLongProp(xmlNodePtr node, const char *name, long fallback)
+{
+  xmlChar *keyword=xmlGetProp(node,(xmlChar *) name);
+  if (keyword == NULL) return fallback;
+  long value=atol((char *) keyword);
+  xmlFree(keyword);
+  return value;
+}
+
+bool ParseSCNDescription(const char *sdescription, SCNDescription &description)
+{
+  description.collectionSizeX=description.collectionSizeY=0;
+  description.fields.clear();
+  if (sdescription == NULL) return false;
+
+  // Replace <scn ...> with <scn> to avoid using Leica's namespace
+  string sxml(sdescription);
+  size_t iscn=sxml.find("<scn");
+  if (iscn != string::npos)
+  {
+    for (size_t jj=iscn+4;jj<sxml.size() && sxml[jj] != '>';jj++) sxml[jj]=' ';
+  }
+
+  // Parse the XML
+  xmlInitParser();
+  LIBXML_TEST_VERSION
+  xmlDocPtr xmldoc;
+  xmlXPathContextPtr xmlcontext;
+  xmlXPathObjectPtr xmlresult;
+  xmldoc=xmlParseMemory(sxml.c_str(),sxml.size());
+  if (xmldoc == NULL) return false;
+  xmlcontext=xmlXPathNewContext(xmldoc);
+
+  // Get Collection Dimensions
+  xmlresult=xmlXPathEvalExpression((xmlChar *) "//collection",xmlcontext);
+  if (xmlresult == NULL || xmlXPathNodeSetIsEmpty(xmlresult->nodesetval))
+  {
+    if (xmlresult != NULL) xmlXPathFreeObject(xmlresult);
+    xmlXPathFreeContext(xmlcontext);
+    xmlFreeDoc(xmldoc);
+    return false;
+  }
+  description.collectionSizeX=GetLongProp(xmlresult->nodesetval->nodeTab[0],"sizeX",0);
+  description.collectionSizeY=GetLongProp(xmlresult->nodesetval->nodeTab[0],"sizeY",0);
+  xmlXPathFreeObject(xmlresult);
+
+  // Save Information For All <image>s Whose <view> Dimensions Do Not Match <collection>
+  ostringstream convert;
+  int icount=0;
+  int jj=1; convert << "//image[" << jj << "]/view";
+  xmlresult=xmlXPathEvalExpression((xmlChar *) convert.str().c_str(),xmlcontext);
+  while (xmlresult != NULL && !xmlXPathNodeSetIsEmpty(xmlresult->nodesetval))
+  {
+    xmlNodePtr view=xmlresult->nodesetval->nodeTab[0];
+    SCNField field;
+    field.number=icount;
+    field.viewSizeX=GetLongProp(view,"sizeX",0);
+    field.viewSizeY=GetLongProp(view,"sizeY",0);
+    field.viewOffsetX=GetLongProp(view,"offsetX",0);
+    field.viewOffsetY=GetLongProp(view,"offsetY",0);
+    xmlXPathFreeObject(xmlresult);
+
+    if (field.viewSizeX != description.collectionSizeX && field.viewSizeY != description.collectionSizeY)
+    {
+      convert.str(""); convert.clear(); convert << "//image[" << jj << "]/pixels/dimension";
+      xmlresult=xmlXPathEvalExpression((xmlChar *) convert.str().c_str(),xmlcontext);
+      for (int ii=0;xmlresult != NULL && ii<xmlresult->nodesetval->nodeNr;ii++)
+      {
+        xmlNodePtr node=xmlresult->nodesetval->nodeTab[ii];
+        SCNDimension dimension;
+        // No "c" property - Leica has different format in this case, so just force it
+        dimension.channel=static_cast<int>(GetLongProp(node,"c",0));
+        dimension.ifd=static_cast<int>(GetLongProp(node,"ifd",-1));
+        dimension.r=static_cast<int>(GetLongProp(node,"r",0));
+        dimension.sizeX=GetLongProp(node,"sizeX",0);
+        dimension.sizeY=GetLongProp(node,"sizeY",0);
+        if (dimension.ifd >= 0) field.dimensions.push_back(dimension);
+      }
+      if (xmlresult != NULL) xmlXPathFreeObject(xmlresult);
+      description.fields.push_back(field);
+      icount++;
+    }
+
+    jj++; convert.str(""); convert.clear(); convert << "//image[" << jj << "]/view";
+    xmlresult=xmlXPathEvalExpression((xmlChar *) convert.str().c_str(),xmlcontext);
+  }
+  if (xmlresult != NULL) xmlXPathFreeObject(xmlresult);
+
+  // Clean Up
+  xmlXPathFreeContext(xmlcontext);
+  xmlFreeDoc(xmldoc);
+  return true;
+}
+
+SCNReadStatus ReadChannelRGBA(TIFF *tif, uint32 ww, uint32 hh, int channel, uint8 *out, size_t stride,
+                              ChannelStats *stats)
+{
+  if (channel < 0 || channel > 2) return SCN_READ_FAILED;
+  size_t Npixels=static_cast<size_t>(ww)*hh;
+  PooledBuffer rasterbuffer=SharedBufferPool().Acquire(Npixels*sizeof(uint32));
+  uint32 *raster=reinterpret_cast<uint32 *>(rasterbuffer.data());
+  if (raster == NULL) return SCN_READ_NOMEMORY;
+  if (!TIFFReadRGBAImage(tif,ww,hh,raster,0)) return SCN_READ_FAILED;
+  ChannelStatsAccumulator *local=(stats != NULL) ? new ChannelStatsAccumulator(SAMPLE_UINT8) : NULL;
+  for (size_t row=0;row<hh;row++)
+  {
+    for (size_t ii=row*ww;ii<(row+1)*ww;ii++)
+    {
+      switch (channel)
+      {
+        case 0: out[ii*stride]=static_cast<uint8>(TIFFGetR(raster[ii])); break;
+        case 1: out[ii*stride]=static_cast<uint8>(TIFFGetG(raster[ii])); break;
+        case 2: out[ii*stride]=static_cast<uint8>(TIFFGetB(raster[ii])); break;
+      }
+    }
+    if (local != NULL) local->Add(out+row*ww*stride,ww,1,0,stride);
+  }
+  if (local != NULL)
+  {
+    stats->Merge(*local);
+    delete local;
+  }
+  return SCN_READ_OK;
+}
+
+size_t SampleBytes(SampleType type)
+{
+  switch (type)
+  {
+    case SAMPLE_UINT8: case SAMPLE_INT8: return 1;
+    case SAMPLE_UINT16: case SAMPLE_INT16: return 2;
+    case SAMPLE_UINT32: case SAMPLE_INT32: case SAMPLE_FLOAT32: return 4;
+    case SAMPLE_FLOAT64: return 8;
+  }
+  return 1;
+}
+
+const char *SampleTypeName(SampleType type)
+{
+  switch (type)
+  {
+    case SAMPLE_UINT8: return "uint8";
+    case SAMPLE_INT8: return "int8";
+    case SAMPLE_UINT16: return "uint16";
+    case SAMPLE_INT16: return "int16";
+    case SAMPLE_UINT32: return "uint32";
+    case SAMPLE_INT32: return "int32";
+    case SAMPLE_FLOAT32: return "float32";
+    case SAMPLE_FLOAT64: return "float64";
+  }
+  return "uint8";
+}
+
+// Factor Mapping Stored Values To 0-255
+double DisplayScale(const SCNDirectoryLayout &layout)
+{
+  int bits=layout.bitspersample;
+  switch (layout.type)
+  {
+    case SAMPLE_FLOAT32:
+    case SAMPLE_FLOAT64: return 255.0;
+    case SAMPLE_INT8:
+    case SAMPLE_INT16:
+    case SAMPLE_INT32: bits--; break;
+    default: break;
+  }
+  if (bits <= 8) return 1.0;
+  return 255.0/(ldexp(1.0,bits)-1.0);
+}
+
+
+bool ReadDirectoryLayout(TIFF *tif, SCNDirectoryLayout &layout)
+{
+  memset(&layout,0,sizeof(layout));
+  TIFFGetField(tif,TIFFTAG_IMAGEWIDTH,&layout.width);
+  TIFFGetField(tif,TIFFTAG_IMAGELENGTH,&layout.height);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_BITSPERSAMPLE,&layout.bitspersample);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_SAMPLESPERPIXEL,&layout.samplesperpixel);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_SAMPLEFORMAT,&layout.sampleformat);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_PLANARCONFIG,&layout.planarconfig);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_COMPRESSION,&layout.compression);
+  TIFFGetFieldDefaulted(tif,TIFFTAG_PHOTOMETRIC,&layout.photometric);
+  if (layout.width == 0 || layout.height == 0 || layout.samplesperpixel == 0) return false;
+
+  PrepareDirectory(tif,layout);
+
+  // Tile Or Strip Geometry
+  layout.tiled=(TIFFIsTiled(tif) != 0);
+  uint32 rowsperstrip=layout.height;
+  if (layout.tiled)
+  {
+    TIFFGetField(tif,TIFFTAG_TILEWIDTH,&layout.tilewidth);
+    TIFFGetField(tif,TIFFTAG_TILELENGTH,&layout.tilelength);
+  }
+  else TIFFGetFieldDefaulted(tif,TIFFTAG_ROWSPERSTRIP,&rowsperstrip);
+  return CompleteDirectoryLayout(layout,rowsperstrip);
+}
+
+bool CompleteDirectoryLayout(SCNDirectoryLayout &layout, uint32 rowsperstrip)
+{
+  if (layout.width == 0 || layout.height == 0 || layout.samplesperpixel == 0) return false;
+  if (!layout.tiled)
+  {
+    layout.tilewidth=layout.width;
+    layout.tilelength=(rowsperstrip < layout.height) ? rowsperstrip : layout.height;
+  }
+  if (layout.tilewidth == 0 || layout.tilelength == 0) return false;
+
+  // Map Bits Per Sample And Sample Format To An Element Type
+  switch (layout.sampleformat)
+  {
+    case SAMPLEFORMAT_UINT:
+      if (layout.bitspersample == 8) layout.type=SAMPLE_UINT8;
+      else if (layout.bitspersample == 16) layout.type=SAMPLE_UINT16;
+      else if (layout.bitspersample == 32) layout.type=SAMPLE_UINT32;
+      else return false;
+      break;
+    case SAMPLEFORMAT_INT:
+      if (layout.bitspersample == 8) layout.type=SAMPLE_INT8;
+      else if (layout.bitspersample == 16) layout.type=SAMPLE_INT16;
+      else if (layout.bitspersample == 32) layout.type=SAMPLE_INT32;
+      else return false;
+      break;
+    case SAMPLEFORMAT_IEEEFP:
+      if (layout.bitspersample == 32) layout.type=SAMPLE_FLOAT32;
+      else if (layout.bitspersample == 64) layout.type=SAMPLE_FLOAT64;
+      else return false;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+void PrepareDirectory(TIFF *tif, const SCNDirectoryLayout &layout)
+{
+  // Let libjpeg Convert YCbCr To RGB So Samples Map Directly To Channels
+  if (layout.compression == COMPRESSION_JPEG && layout.photometric == PHOTOMETRIC_YCBCR)
+  {
+    TIFFSetField(tif,TIFFTAG_JPEGCOLORMODE,JPEGCOLORMODE_RGB);
+  }
+}
+
+uint32 TilesAcross(const SCNDirectoryLayout &layout)
+{
+  return (layout.width+layout.tilewidth-1)/layout.tilewidth;
+}
+
+uint32 TilesDown(const SCNDirectoryLayout &layout)
+{
+  return (layout.height+layout.tilelength-1)/layout.tilelength;
+}
+
+int ChannelSample(const SCNDirectoryLayout &layout, int channel)
+{
+  if (channel < 0) return -1;
+  if (layout.samplesperpixel == 1) return 0;
+  return (channel < layout.samplesperpixel) ? channel : -1;
+}
+
+uint32 TileIndex(const SCNDirectoryLayout &layout, uint32 col, uint32 row, int sample)
+{
+  uint32 plane=(layout.planarconfig == PLANARCONFIG_SEPARATE) ? static_cast<uint32>(sample) : 0;
+  return (plane*TilesDown(layout)+row)*TilesAcross(layout)+col;
+}
+
+size_t TilePixelBytes(const SCNDirectoryLayout &layout)
+{
+  size_t nbytes=SampleBytes(layout.type);
+  return (layout.planarconfig == PLANARCONFIG_SEPARATE) ? nbytes : nbytes*layout.samplesperpixel;
+}
+
+tmsize_t DecodeTile(TIFF *tif, const SCNDirectoryLayout &layout, uint32 itile, uint8 *buffer, tmsize_t size)
+{
+  if (layout.tiled) return TIFFReadEncodedTile(tif,itile,buffer,size);
+  return TIFFReadEncodedStrip(tif,itile,buffer,size);
+}
+
+void CopyTileSamples(const SCNDirectoryLayout &layout, const uint8 *tile, int sample, uint32 tx, uint32 ty,
+                     uint32 ww, uint32 hh, uint8 *dst, ptrdiff_t dstrowbytes, size_t stride)
+{
+  size_t nbytes=SampleBytes(layout.type);
+  size_t pixelstep=TilePixelBytes(layout);
+  size_t sampleoffset=(layout.planarconfig == PLANARCONFIG_SEPARATE) ? 0 : nbytes*sample;
+  size_t outstep=nbytes*stride;
+  for (uint32 yy=0;yy<hh;yy++)
+  {
+    const uint8 *src=tile+((static_cast<size_t>(ty)+yy)*layout.tilewidth+tx)*pixelstep+sampleoffset;
+    uint8 *out=dst+yy*dstrowbytes;
+    if (pixelstep == nbytes && outstep == nbytes) memcpy(out,src,ww*nbytes);
+    else if (nbytes == 1)
+    {
+      for (uint32 xx=0;xx<ww;xx++) out[xx*outstep]=src[xx*pixelstep];
+    }
+    else
+    {
+      for (uint32 xx=0;xx<ww;xx++) memcpy(out+xx*outstep,src+xx*pixelstep,nbytes);
+    }
+  }
+}
+
+SCNReadStatus ReadChannelNative(TIFF *tif, const SCNDirectoryLayout &layout, int channel, uint8 *out, size_t stride,
+                                bool bottomup, ChannelStats *stats)
+{
+  return ReadTileRowsNative(tif,layout,channel,0,TilesDown(layout),out,stride,bottomup,stats);
+}
+
+SCNReadStatus ReadTileNative(TIFF *tif, const SCNDirectoryLayout &layout, int sample, uint32 col, uint32 row,
+                             uint8 *scratch, tmsize_t scratchsize, uint8 *out, uint32 outrow, size_t stride,
+                             bool bottomup, ChannelStatsAccumulator *local)
+{
+  size_t pixelstep=TilePixelBytes(layout);
+  size_t nbytes=SampleBytes(layout.type);
+  ptrdiff_t outrowbytes=static_cast<ptrdiff_t>(layout.width*nbytes*stride);
+  uint32 x0=col*layout.tilewidth;
+  uint32 y0=row*layout.tilelength;
+  uint32 wvalid=(layout.width-x0 < layout.tilewidth) ? layout.width-x0 : layout.tilewidth;
+  uint32 hvalid=(layout.height-y0 < layout.tilelength) ? layout.height-y0 : layout.tilelength;
+
+  // Decode Tile Or Strip
+  tmsize_t nread=DecodeTile(tif,layout,TileIndex(layout,col,row,sample),scratch,scratchsize);
+  if (nread < 0 || static_cast<size_t>(nread) < ((hvalid-1)*layout.tilewidth+wvalid)*pixelstep) return SCN_READ_FAILED;
+
+  // Copy The Channel Samples Of The Valid Region
+  ptrdiff_t storedrow=bottomup ? static_cast<ptrdiff_t>(layout.height-1-y0) : static_cast<ptrdiff_t>(y0);
+  uint8 *dst=out+(storedrow-static_cast<ptrdiff_t>(outrow))*outrowbytes+x0*nbytes*stride;
+  CopyTileSamples(layout,scratch,sample,0,0,wvalid,hvalid,dst,bottomup ? -outrowbytes : outrowbytes,stride);
+  if (local != NULL)
+  {
+    size_t sampleoffset=(layout.planarconfig == PLANARCONFIG_SEPARATE) ? 0 : nbytes*sample;
+    local->Add(scratch+sampleoffset,wvalid,hvalid,layout.tilewidth*pixelstep,pixelstep);
+  }
+  return SCN_READ_OK;
+}
+
+SCNReadStatus ReadTileRowsNative(TIFF *tif, const SCNDirectoryLayout &layout, int channel, uint32 firstrow,
+                                 uint32 nrows, uint8 *out, size_t stride, bool bottomup, ChannelStats *stats)
+{
+  // Pick The Sample Holding This Channel
+  int sample=ChannelSample(layout,channel);
+  if (sample < 0) return SCN_READ_FAILED;
+  if (firstrow >= TilesDown(layout) || nrows == 0) return SCN_READ_OK;
+
+  // Scratch Buffer For One Decoded Tile Or Strip
+  tmsize_t scratchsize=layout.tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+  if (scratchsize <= 0) return SCN_READ_FAILED;
+  PooledBuffer scratchbuffer=SharedBufferPool().Acquire(scratchsize);
+  uint8 *scratch=scratchbuffer.data();
+  if (scratch == NULL) return SCN_READ_NOMEMORY;
+  ChannelStatsAccumulator *local=(stats != NULL) ? new ChannelStatsAccumulator(layout.type) : NULL;
+
+  uint32 lastrow=(nrows < TilesDown(layout)-firstrow) ? firstrow+nrows : TilesDown(layout);
+  for (uint32 row=firstrow;row<lastrow;row++)
+  {
+    for (uint32 col=0;col<TilesAcross(layout);col++)
+    {
+      if (ReadTileNative(tif,layout,sample,col,row,scratch,scratchsize,out,0,stride,bottomup,local) != SCN_READ_OK)
+      {
+        delete local;
+        return SCN_READ_FAILED;
+      }
+    }
+  }
+  if (local != NULL)
+  {
+    stats->Merge(*local);
+    delete local;
+  }
+  return SCN_READ_OK;
+}
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Leica SCN400F Slide Access
+//
+// Parses the XML IMAGEDESCRIPTION of a Leica .scn file into fields and TIFF
+// directories, and reads channel data out of those directories.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LEICASCN_H
+#define LEICASCN_H
+
+extern "C" {
+  #include <tiffio.h>
+}
+#include <stddef.h>
+#include <vector>
+
+class ChannelStats;
+class ChannelStatsAccumulator;
+
+// One <dimension> Of An <image>: A Single Channel At A Single Resolution Level
+struct SCNDimension
+{
+  int ifd;           // TIFF directory holding the pixel data
+  int channel;       // "c" attribute (0 if Leica left it out)
+  int r;             // Resolution level, 0 = highest
+  long sizeX, sizeY; // Pixels
+};
+
+// One Field: An <image> Whose <view> Does Not Match The <collection>
+struct SCNField
+{
+  int number;                           // Field number used in output filenames
+  long viewSizeX, viewSizeY;            // nm
+  long viewOffsetX, viewOffsetY;        // nm, relative to the <collection>
+  std::vector<SCNDimension> dimensions; // All channels and resolution levels
+};
+
+struct SCNDescription
+{
+  long collectionSizeX, collectionSizeY; // nm
+  std::vector<SCNField> fields;
+};
+
+// Read Status, Matching The Converter Exit Codes
+enum SCNReadStatus
+{
+  SCN_READ_OK=0,
+  SCN_READ_FAILED=3,
+  SCN_READ_NOMEMORY=4
+};
+
+// Sample Types Of Decoded Channel Data
+enum SampleType
+{
+  SAMPLE_UINT8=0,
+  SAMPLE_INT8=1,
+  SAMPLE_UINT16=2,
+  SAMPLE_INT16=3,
+  SAMPLE_UINT32=4,
+  SAMPLE_INT32=5,
+  SAMPLE_FLOAT32=6,
+  SAMPLE_FLOAT64=7
+};
+
+// Bytes Per Sample And Name ("uint8", "uint16", ...) Of A Sample Type
+size_t SampleBytes(SampleType type);
+const char *SampleTypeName(SampleType type);
+
+// Pixel Layout Of One TIFF Directory
+struct SCNDirectoryLayout
+{
+  uint32 width, height;
+  bool tiled;
+  uint32 tilewidth, tilelength; // Tile size, or width x rows per strip for stripped images
+  uint16 bitspersample, samplesperpixel, sampleformat;
+  uint16 planarconfig, compression;
+  uint16 photometric;           // As stored; JPEG compressed YCbCr is decoded as RGB
+  SampleType type;
+};
+
+// Factor Mapping Stored Values Of A Directory To 0-255 For Display, From Its Bit Depth
+// (Floating Point Data Is Taken To Be 0-1)
+double DisplayScale(const SCNDirectoryLayout &layout);
+
+// Parse The IMAGEDESCRIPTION XML Of A Leica .scn File
+bool ParseSCNDescription(const char *sdescription, SCNDescription &description);
+
+// Read One Channel (0: Red, 1: Green, 2: Blue) Of The Current TIFF Directory Through
+// The RGBA Interface. Pixel ii Is Stored At out[ii*stride], Bottom Row First. With
+// stats, The Channel Values Are Added To It Row By Row As They Are Extracted.
+SCNReadStatus ReadChannelRGBA(TIFF *tif, uint32 ww, uint32 hh, int channel, uint8 *out, size_t stride,
+                              ChannelStats *stats=NULL);
+
+// Read The Pixel Layout Of The Current TIFF Directory And Prepare The Handle For It.
+// Returns false For Sample Layouts The Native Path Does Not Support.
+bool ReadDirectoryLayout(TIFF *tif, SCNDirectoryLayout &layout);
+
+// Fill In The Tile Geometry Of Stripped Images And The Sample Type Of A Layout Whose
+// Tags Were Read Elsewhere (e.g. By IFDScanner); false As For ReadDirectoryLayout
+bool CompleteDirectoryLayout(SCNDirectoryLayout &layout, uint32 rowsperstrip);
+
+// Prepare A Handle That Was Moved To A Directory With This Layout: JPEG Compressed
+// YCbCr Data Is Switched To RGB Output So Samples Map Directly To Channels
+void PrepareDirectory(TIFF *tif, const SCNDirectoryLayout &layout);
+
+// Tile Geometry. Stripped Images Are Treated As Tiles One Strip High And The Full
+// Width Across, With Strip Numbers As Tile Indexes.
+uint32 TilesAcross(const SCNDirectoryLayout &layout);
+uint32 TilesDown(const SCNDirectoryLayout &layout);
+size_t TilePixelBytes(const SCNDirectoryLayout &layout); // Bytes per pixel in a decoded tile
+
+// Sample Holding A Channel (Single-Sample Images Always Use Sample 0), -1 If None
+int ChannelSample(const SCNDirectoryLayout &layout, int channel);
+
+// Index Of The Tile At (col,row) Holding A Sample
+uint32 TileIndex(const SCNDirectoryLayout &layout, uint32 col, uint32 row, int sample);
+
+// Decode One Tile (Or Strip) Of The Current Directory, Returning The Decoded Size Or -1
+tmsize_t DecodeTile(TIFF *tif, const SCNDirectoryLayout &layout, uint32 itile, uint8 *buffer, tmsize_t size);
+
+// Copy A ww x hh Rectangle Of One Sample Out Of A Decoded Tile, Starting At (tx,ty)
+// Within The Tile. Rows Of dst Are dstrowbytes Apart (Negative For Bottom-Up Output)
+// And Pixels Are stride Samples Apart.
+void CopyTileSamples(const SCNDirectoryLayout &layout, const uint8 *tile, int sample, uint32 tx, uint32 ty,
+                     uint32 ww, uint32 hh, uint8 *dst, ptrdiff_t dstrowbytes, size_t stride);
+
+// Read One Channel Of The Current TIFF Directory At Its Native Bit Depth, Tile By Tile
+// (Or Strip By Strip) Without RGBA Conversion. Single-Sample Images Always Use Sample 0.
+// Pixel ii Is Stored At out+ii*stride*SampleBytes(layout.type). With bottomup, Rows Are
+// Stored Bottom Row First, Matching ReadChannelRGBA. With stats, Each Decoded Tile Is
+// Also Added To It While Still In Cache.
+SCNReadStatus ReadChannelNative(TIFF *tif, const SCNDirectoryLayout &layout, int channel, uint8 *out, size_t stride,
+                                bool bottomup, ChannelStats *stats=NULL);
+
+// Decode Tile (col,row) Of One Sample Into Its Place In A Channel Laid Out As For
+// ReadChannelNative, Through A Scratch Buffer Of At Least One Decoded Tile. out Holds
+// The Channel From Stored Row outrow On (0 For The Whole Channel), So A Buffer Of Just
+// The Rows Being Decoded Will Do. With local, The Tile Is Also Added To It.
+SCNReadStatus ReadTileNative(TIFF *tif, const SCNDirectoryLayout &layout, int sample, uint32 col, uint32 row,
+                             uint8 *scratch, tmsize_t scratchsize, uint8 *out, uint32 outrow, size_t stride,
+                             bool bottomup, ChannelStatsAccumulator *local=NULL);
+
+// As ReadChannelNative, For Tile Rows firstrow To firstrow+nrows-1 Only. out Still
+// Points At The Whole Channel, Of Which Only Those Rows Are Filled.
+SCNReadStatus ReadTileRowsNative(TIFF *tif, const SCNDirectoryLayout &layout, int channel, uint32 firstrow,
+                                 uint32 nrows, uint8 *out, size_t stride, bool bottomup, ChannelStats *stats=NULL);
+
+#endif
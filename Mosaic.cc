@@ -0,0 +1,242 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide-Wide Mosaic Of All Fields
+// See Mosaic.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Mosaic.h"
+#include "BufferPool.h"
+#include "IOHelpers.h"
+#include "SparseWrite.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+using namespace std;
+
+// Fields Whose Pixel Size Differs From The Mosaic's By More Than This Are Reported
+static const double kPixelSizeTolerance=0.01;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Layout
+////////////////////////////////////////////////////////////////////////////////////////
+// r=0 Size Of A Field, From Its First r=0 Dimension
+static bool FieldSize(const SCNField &field, uint32 &ww, uint32 &hh)
+{
+  for (size_t ii=0;ii<field.dimensions.size();ii++)
+  {
+    if (field.dimensions[ii].r != 0 || field.dimensions[ii].sizeX <= 0 || field.dimensions[ii].sizeY <= 0) continue;
+    ww=static_cast<uint32>(field.dimensions[ii].sizeX);
+    hh=static_cast<uint32>(field.dimensions[ii].sizeY);
+    return true;
+  }
+  return false;
+}
+
+bool PlanMosaic(const SlideReader &reader, uint32 chunksize, MosaicLayout &mosaic)
+{
+  const SCNDescription &description=reader.Index().description;
+  mosaic.fields.clear();
+  mosaic.chunks.clear();
+  mosaic.chunksize=chunksize;
+  mosaic.pixelSizeX=mosaic.pixelSizeY=0.0;
+  if (chunksize == 0) return false;
+
+  // Pixel Size From The First Field, Corners Of Every Field
+  for (size_t ifield=0;ifield<description.fields.size();ifield++)
+  {
+    const SCNField &field=description.fields[ifield];
+    MosaicField placement;
+    if (!FieldSize(field,placement.width,placement.height) || field.viewSizeX <= 0 || field.viewSizeY <= 0) continue;
+    double sizeX=static_cast<double>(field.viewSizeX)/placement.width;
+    double sizeY=static_cast<double>(field.viewSizeY)/placement.height;
+    if (mosaic.fields.empty())
+    {
+      mosaic.pixelSizeX=sizeX;
+      mosaic.pixelSizeY=sizeY;
+    }
+    else if (fabs(sizeX/mosaic.pixelSizeX-1.0) > kPixelSizeTolerance ||
+             fabs(sizeY/mosaic.pixelSizeY-1.0) > kPixelSizeTolerance)
+    {
+      cout << "WARNING (Mosaic.cc): Field " << field.number << " Has Pixel Size " << sizeX << " x " << sizeY
+           << " nm, Placed Without Resampling." << endl;
+    }
+    placement.field=ifield;
+    placement.x=lround(field.viewOffsetX/mosaic.pixelSizeX);
+    placement.y=lround(field.viewOffsetY/mosaic.pixelSizeY);
+    if (placement.x < 0) placement.x=0;
+    if (placement.y < 0) placement.y=0;
+    mosaic.fields.push_back(placement);
+  }
+  if (mosaic.fields.empty()) return false;
+
+  // Extent Of The Collection, Grown To Hold Every Field
+  mosaic.width=static_cast<uint64_t>(ceil(description.collectionSizeX/mosaic.pixelSizeX));
+  mosaic.height=static_cast<uint64_t>(ceil(description.collectionSizeY/mosaic.pixelSizeY));
+  for (size_t ii=0;ii<mosaic.fields.size();ii++)
+  {
+    const MosaicField &placement=mosaic.fields[ii];
+    mosaic.width=max<uint64_t>(mosaic.width,placement.x+placement.width);
+    mosaic.height=max<uint64_t>(mosaic.height,placement.y+placement.height);
+  }
+  mosaic.chunksacross=(mosaic.width+chunksize-1)/chunksize;
+  mosaic.chunksdown=(mosaic.height+chunksize-1)/chunksize;
+
+  // Chunks Touched By Any Field
+  set<uint64_t> touched;
+  for (size_t ii=0;ii<mosaic.fields.size();ii++)
+  {
+    const MosaicField &placement=mosaic.fields[ii];
+    uint64_t cx0=placement.x/chunksize, cx1=(placement.x+placement.width-1)/chunksize;
+    uint64_t cy0=placement.y/chunksize, cy1=(placement.y+placement.height-1)/chunksize;
+    for (uint64_t cy=cy0;cy<=cy1;cy++)
+    {
+      for (uint64_t cx=cx0;cx<=cx1;cx++) touched.insert(cy*mosaic.chunksacross+cx);
+    }
+  }
+  mosaic.chunks.assign(touched.begin(),touched.end());
+  return true;
+}
+
+bool MosaicChannelType(const SlideReader &reader, const MosaicLayout &mosaic, int channel, SampleType &type)
+{
+  for (size_t ii=0;ii<mosaic.fields.size();ii++)
+  {
+    const IndexedDirectory *directory=reader.FindChannel(mosaic.fields[ii].field,channel,0);
+    if (directory == NULL) return false;
+    if (ii == 0) type=directory->layout.type;
+    else if (directory->layout.type != type) return false;
+  }
+  return !mosaic.fields.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Chunks
+////////////////////////////////////////////////////////////////////////////////////////
+// Fill One Chunk From Every Field Overlapping It
+static SCNReadStatus FillChunk(SlideReader &reader, const MosaicLayout &mosaic, int channel, size_t nbytes,
+                               uint64_t ichunk, uint8 *chunk)
+{
+  size_t rowbytes=static_cast<size_t>(mosaic.chunksize)*nbytes;
+  memset(chunk,0,rowbytes*mosaic.chunksize);
+  long X0=static_cast<long>((ichunk%mosaic.chunksacross)*mosaic.chunksize);
+  long Y0=static_cast<long>((ichunk/mosaic.chunksacross)*mosaic.chunksize);
+  long X1=X0+mosaic.chunksize, Y1=Y0+mosaic.chunksize;
+  for (size_t ii=0;ii<mosaic.fields.size();ii++)
+  {
+    const MosaicField &placement=mosaic.fields[ii];
+    long x0=max(X0,placement.x), x1=min(X1,placement.x+static_cast<long>(placement.width));
+    long y0=max(Y0,placement.y), y1=min(Y1,placement.y+static_cast<long>(placement.height));
+    if (x0 >= x1 || y0 >= y1) continue;
+    const IndexedDirectory *directory=reader.FindChannel(placement.field,channel,0);
+    if (directory == NULL) return SCN_READ_FAILED;
+    SCNReadStatus status=reader.ReadRegion(*directory,channel,x0-placement.x,y0-placement.y,x1-x0,y1-y0,
+                                           chunk+(y0-Y0)*rowbytes+(x0-X0)*nbytes,rowbytes);
+    if (status != SCN_READ_OK) return status;
+  }
+  return SCN_READ_OK;
+}
+
+SCNReadStatus WriteMosaicChannel(SlideReader &reader, const MosaicLayout &mosaic, int channel, SampleType type,
+                                 const string &fn_out, ThreadPool &pool, vector<uint64_t> &written,
+                                 bool &flag_write)
+{
+  size_t nbytes=SampleBytes(type);
+  size_t chunkbytes=static_cast<size_t>(mosaic.chunksize)*mosaic.chunksize*nbytes;
+
+  // Size The File Up Front So Chunks Never Written Stay Holes
+  flag_write=false;
+  written.clear();
+  int fd=open(fn_out.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+  if (fd < 0) return SCN_READ_OK;
+  if (ftruncate(fd,static_cast<off_t>(mosaic.chunksacross*mosaic.chunksdown*chunkbytes)) != 0)
+  {
+    close(fd);
+    return SCN_READ_OK;
+  }
+
+  // Chunks Are Handed Out In File Order, So Neighbouring Chunks Decode Shared Tiles
+  // Close Together In Time While They Are Still In The Tile Cache
+  atomic<int> failed(SCN_READ_OK);
+  atomic<bool> writefailed(false);
+  vector<char> flag_written(mosaic.chunks.size(),0);
+  pool.ParallelFor(mosaic.chunks.size(),[&](size_t ii)
+  {
+    if (failed.load() != SCN_READ_OK || writefailed.load()) return;
+    PooledBuffer chunk=SharedBufferPool().Acquire(chunkbytes);
+    if (chunk.data() == NULL) {failed=SCN_READ_NOMEMORY; return;}
+    SCNReadStatus status=FillChunk(reader,mosaic,channel,nbytes,mosaic.chunks[ii],chunk.data());
+    if (status != SCN_READ_OK) {failed=status; return;}
+
+    // All-Zero Chunks (Background Between And Around Tissue) Stay Holes Too
+    if (AllZero(chunk.data(),chunkbytes)) return;
+    if (!PwriteAll(fd,chunk.data(),chunkbytes,mosaic.chunks[ii]*chunkbytes)) writefailed=true;
+    else flag_written[ii]=1;
+  });
+  if (close(fd) != 0) writefailed=true;
+  for (size_t ii=0;ii<mosaic.chunks.size();ii++) if (flag_written[ii]) written.push_back(mosaic.chunks[ii]);
+  flag_write=!writefailed.load();
+  return static_cast<SCNReadStatus>(failed.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// JSON Description
+////////////////////////////////////////////////////////////////////////////////////////
+bool WriteMosaicJSON(const string &fn_json, const SlideReader &reader, const MosaicLayout &mosaic,
+                     const vector<int> &channels, const vector<SampleType> &types, const vector<string> &files,
+                     const vector<vector<uint64_t> > &written)
+{
+  // Written Beside fn_json And Renamed Into Place, So Readers Never See Part Of It
+  const SCNDescription &description=reader.Index().description;
+  ostringstream convert;
+  convert << fn_json << ".tmp" << getpid();
+  string fn_tmp=convert.str();
+  ofstream ofile(fn_tmp.c_str());
+  if (!ofile) return false;
+  ofile.precision(10);
+  ofile << "{\n"
+        << "  \"width\": " << mosaic.width << ",\n"
+        << "  \"height\": " << mosaic.height << ",\n"
+        << "  \"pixel_size_nm\": [" << mosaic.pixelSizeX << ", " << mosaic.pixelSizeY << "],\n"
+        << "  \"collection_size_nm\": [" << description.collectionSizeX << ", " << description.collectionSizeY << "],\n"
+        << "  \"chunk_size\": " << mosaic.chunksize << ",\n"
+        << "  \"chunks_across\": " << mosaic.chunksacross << ",\n"
+        << "  \"chunks_down\": " << mosaic.chunksdown << ",\n"
+        << "  \"row_order\": \"top_down\",\n"
+        << "  \"channels\": [";
+  for (size_t ic=0;ic<channels.size();ic++)
+  {
+    ofile << (ic > 0 ? "," : "") << "\n    {\"channel\": " << channels[ic] << ", \"type\": \"" << SampleTypeName(types[ic])
+          << "\", \"file\": " << JSONString(files[ic].substr(files[ic].find_last_of('/')+1)) << ",\n     \"chunks\": [";
+    for (size_t ii=0;ii<written[ic].size();ii++)
+    {
+      ofile << (ii > 0 ? "," : "") << (ii%8 == 0 ? "\n       " : " ") << "[" << written[ic][ii]%mosaic.chunksacross << ","
+            << written[ic][ii]/mosaic.chunksacross << "]";
+    }
+    ofile << (written[ic].empty() ? "]}" : "\n     ]}");
+  }
+  ofile << "\n  ],\n  \"fields\": [";
+  for (size_t ii=0;ii<mosaic.fields.size();ii++)
+  {
+    const MosaicField &placement=mosaic.fields[ii];
+    ofile << (ii > 0 ? "," : "") << "\n    {\"field\": " << description.fields[placement.field].number
+          << ", \"x\": " << placement.x << ", \"y\": " << placement.y << ", \"width\": " << placement.width
+          << ", \"height\": " << placement.height << "}";
+  }
+  ofile << "\n  ]\n}\n";
+  ofile.close();
+
+  bool ok=!ofile.fail();
+  if (ok) ok=(rename(fn_tmp.c_str(),fn_json.c_str()) == 0);
+  if (!ok) unlink(fn_tmp.c_str());
+  return ok;
+}
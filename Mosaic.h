@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide-Wide Mosaic Of All Fields
+//
+// Places every field at its physical position in the <collection>, using the <view>
+// offsets and the r=0 pixel size, and writes each channel as one chunked raster of
+// the whole collection extent at native bit depth.
+//
+// Mosaic File Format (one file per channel, host byte order):
+//   The mosaic is cut into chunksize x chunksize chunks, stored one after another in
+//   row-major chunk order; chunk (cx,cy) starts at byte
+//   (cy*chunksacross+cx)*chunksize*chunksize*SampleBytes(type) and holds its pixels
+//   row-major, top row first. Edge chunks are padded to full size with zeros.
+//   Only chunks overlapping a field and holding a non-zero sample are written; the
+//   file is sized up front, so the rest are holes that take no disk space and read
+//   back as zeros. Mosaic.json lists the written chunks of each channel file.
+//
+// Where fields overlap, the later field in the slide is on top. Fields whose pixel
+// size differs from the first field's are placed without resampling.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include "SlideReader.h"
+#include "ThreadPool.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Placement Of One Field In The Mosaic
+struct MosaicField
+{
+  size_t field;            // Position in the slide's fields
+  long x, y;               // Top left corner, in mosaic pixels
+  uint32 width, height;    // r=0 size in pixels
+};
+
+struct MosaicLayout
+{
+  double pixelSizeX, pixelSizeY;     // nm per pixel
+  uint64_t width, height;            // Pixels
+  uint32 chunksize;
+  uint64_t chunksacross, chunksdown;
+  std::vector<MosaicField> fields;
+  std::vector<uint64_t> chunks;      // Indexes (cy*chunksacross+cx) of chunks overlapping a field, sorted
+};
+
+// Work Out The Placement Of Every Field With An r=0 Level. False If There Is None.
+bool PlanMosaic(const SlideReader &reader, uint32 chunksize, MosaicLayout &mosaic);
+
+// Sample Type Of A Channel Across All Fields; false If Fields Disagree Or Lack It
+bool MosaicChannelType(const SlideReader &reader, const MosaicLayout &mosaic, int channel, SampleType &type);
+
+// Write One Channel Of The Mosaic, Filling Chunks In Parallel On pool. written Receives
+// The Sorted Indexes Of The Chunks Actually Written (Not Left As Holes). flag_write Is
+// Cleared If fn_out Could Not Be Written.
+SCNReadStatus WriteMosaicChannel(SlideReader &reader, const MosaicLayout &mosaic, int channel, SampleType type,
+                                 const std::string &fn_out, ThreadPool &pool, std::vector<uint64_t> &written,
+                                 bool &flag_write);
+
+// Describe The Mosaic And Its Channel Files (channels[ii] Is Stored In files[ii], Its
+// Written Chunks Listed In written[ii])
+bool WriteMosaicJSON(const std::string &fn_json, const SlideReader &reader, const MosaicLayout &mosaic,
+                     const std::vector<int> &channels, const std::vector<SampleType> &types,
+                     const std::vector<std::string> &files, const std::vector<std::vector<uint64_t> > &written);
+
+#endif
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// NUMA Topology, Thread Pinning And Memory Placement
+// See NumaTopology.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "NumaTopology.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+static const int kPreferredPolicy=1; // MPOL_PREFERRED
+static const unsigned kMoveFlag=2;    // MPOL_MF_MOVE
+
+// Parse A Kernel CPU List, e.g. "0-15,32-47"
+static vector<int> ParseCPUList(const string &text)
+{
+  vector<int> cpus;
+  istringstream list(text);
+  string item;
+  while (getline(list,item,','))
+  {
+    int first=0, last=0;
+    if (item.find('-') != string::npos)
+    {
+      if (sscanf(item.c_str(),"%d-%d",&first,&last) != 2) continue;
+    }
+    else if (sscanf(item.c_str(),"%d",&first) == 1) last=first;
+    else continue;
+    for (int cpu=first;cpu<=last;cpu++) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+vector<int> CurrentThreadCPUs()
+{
+  vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(),sizeof(set),&set) != 0) return cpus;
+  for (int cpu=0;cpu<CPU_SETSIZE;cpu++) if (CPU_ISSET(cpu,&set)) cpus.push_back(cpu);
+  return cpus;
+}
+
+bool PinCurrentThread(const vector<int> &cpus)
+{
+  if (cpus.empty()) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t ii=0;ii<cpus.size();ii++) if (cpus[ii] >= 0 && cpus[ii] < CPU_SETSIZE) CPU_SET(cpus[ii],&set);
+  return pthread_setaffinity_np(pthread_self(),sizeof(set),&set) == 0;
+}
+
+vector<NumaNode> AllowedNumaNodes()
+{
+  vector<int> allowed=CurrentThreadCPUs();
+  vector<NumaNode> nodes;
+  DIR *dir=opendir("/sys/devices/system/node");
+  if (dir != NULL)
+  {
+    struct dirent *entry;
+    while ((entry=readdir(dir)) != NULL)
+    {
+      string name=entry->d_name;
+      if (name.compare(0,4,"node") != 0 || name.size() == 4 ||
+          name.find_first_not_of("0123456789",4) != string::npos) continue;
+      ifstream ifile(("/sys/devices/system/node/"+name+"/cpulist").c_str());
+      string cpulist;
+      if (!getline(ifile,cpulist)) continue;
+      NumaNode node;
+      node.id=atoi(name.c_str()+4);
+      vector<int> cpus=ParseCPUList(cpulist);
+      for (size_t ii=0;ii<cpus.size();ii++)
+      {
+        if (find(allowed.begin(),allowed.end(),cpus[ii]) != allowed.end()) node.cpus.push_back(cpus[ii]);
+      }
+      if (!node.cpus.empty()) nodes.push_back(node);
+    }
+    closedir(dir);
+  }
+  sort(nodes.begin(),nodes.end(),[](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+
+  // No NUMA Information: One Node Holding Every Allowed CPU
+  if (nodes.empty())
+  {
+    NumaNode node;
+    node.id=0;
+    node.cpus=allowed;
+    nodes.push_back(node);
+  }
+  return nodes;
+}
+
+bool PreferNumaNode(void *ptr, size_t nbytes, int node)
+{
+#ifdef SYS_mbind
+  if (node < 0) return false;
+  uintptr_t page=static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  uintptr_t start=(reinterpret_cast<uintptr_t>(ptr)+page-1)/page*page;
+  uintptr_t end=(reinterpret_cast<uintptr_t>(ptr)+nbytes)/page*page;
+  if (end <= start) return false;
+  vector<unsigned long> mask(node/(8*sizeof(unsigned long))+1,0);
+  mask[node/(8*sizeof(unsigned long))]|=1UL << (node%(8*sizeof(unsigned long)));
+  unsigned long maxnode=mask.size()*8*sizeof(unsigned long)+1;
+  return syscall(SYS_mbind,start,end-start,kPreferredPolicy,&mask[0],maxnode,kMoveFlag) == 0;
+#else
+  (void) ptr; (void) nbytes; (void) node;
+  return false;
+#endif
+}
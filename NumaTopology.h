@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// NUMA Topology, Thread Pinning And Memory Placement
+//
+// Reads the NUMA nodes and their CPUs from /sys/devices/system/node, keeping only the
+// CPUs this process is allowed to run on (taskset, cgroup cpusets). Memory placement
+// uses the mbind system call directly, so libnuma is not needed. Systems without NUMA
+// information are treated as a single node.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NUMATOPOLOGY_H
+#define NUMATOPOLOGY_H
+
+#include <stddef.h>
+#include <vector>
+
+struct NumaNode
+{
+  int id;                // Kernel node number
+  std::vector<int> cpus;
+};
+
+// Nodes With At Least One CPU This Process May Use, In Node Order
+std::vector<NumaNode> AllowedNumaNodes();
+
+// CPUs The Calling Thread May Run On, And Restrict It To cpus
+std::vector<int> CurrentThreadCPUs();
+bool PinCurrentThread(const std::vector<int> &cpus);
+
+// Prefer Node node For Pages Of [ptr, ptr+nbytes), Moving Those Already Faulted In
+// Elsewhere (Pages Shared With Another Process Stay). The Range Is Shrunk To Whole
+// Pages. Only For Memory In Its Own Mapping: On Heap Blocks The Policy Would Outlive
+// The Block And Apply To Unrelated Allocations.
+bool PreferNumaNode(void *ptr, size_t nbytes, int node);
+
+#endif
@@ -0,0 +1,234 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Output Writer For Converted Slide Data
+// See OutputWriter.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "OutputWriter.h"
+#include "IOHelpers.h"
+#include "SparseWrite.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+using namespace std;
+
+// O_DIRECT Requires Buffer Addresses, Lengths And File Offsets Aligned To The Device
+// Logical Block Size; 4096 Covers All Common Devices
+static const size_t kDirectAlignment=4096;
+
+bool ParseWriterMode(const string &name, WriterMode &mode)
+{
+  if (name == "buffered") mode=WRITER_BUFFERED;
+  else if (name == "dontneed") mode=WRITER_DONTNEED;
+  else if (name == "direct") mode=WRITER_DIRECT;
+  else return false;
+  return true;
+}
+
+const char *WriterModeName(WriterMode mode)
+{
+  switch (mode)
+  {
+    case WRITER_DONTNEED: return "dontneed";
+    case WRITER_DIRECT: return "direct";
+    default: return "buffered";
+  }
+}
+
+OutputWriter::OutputWriter()
+  : fd(-1), mode(WRITER_BUFFERED), sparse(false), capacity(0), ifill(0), nfill(0), fileoffset(0),
+    nwritten(0), nholes(0), pending(false), stopping(false), failed(false), pendingbuffer(0),
+    pendingbytes(0), pendingoffset(0)
+{
+  buffers[0]=buffers[1]=0;
+}
+
+OutputWriter::~OutputWriter()
+{
+  if (fd >= 0) Close();
+  ReleaseBuffers();
+}
+
+bool OutputWriter::Open(const string &filename, const WriterOptions &options)
+{
+  if (fd >= 0) Close();
+
+  // Round Buffers Up To A Whole Number Of Aligned Blocks
+  mode=options.mode;
+  sparse=options.sparse;
+  capacity=options.buffer_bytes;
+  if (capacity < kDirectAlignment) capacity=kDirectAlignment;
+  capacity=(capacity+kDirectAlignment-1)/kDirectAlignment*kDirectAlignment;
+
+  // Open File, Falling Back To Buffered I/O If O_DIRECT Is Not Supported
+  int flags=O_WRONLY | O_CREAT | O_TRUNC;
+  if (mode == WRITER_DIRECT)
+  {
+    fd=open(filename.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL)
+    {
+      cout << "WARNING (OutputWriter.cc): O_DIRECT Not Supported For " << filename
+           << ", Using dontneed Writer." << endl;
+      mode=WRITER_DONTNEED;
+    }
+  }
+  if (fd < 0) fd=open(filename.c_str(), flags, 0644);
+  if (fd < 0) return false;
+
+  // Borrow Aligned Staging Buffers (Pool Buffers Are kDirectAlignment Aligned)
+  for (int ii=0;ii<2;ii++)
+  {
+    staging[ii]=SharedBufferPool().Acquire(capacity);
+    if (staging[ii].data() == NULL)
+    {
+      ReleaseBuffers();
+      close(fd); fd=-1;
+      return false;
+    }
+    buffers[ii]=reinterpret_cast<char *>(staging[ii].data());
+  }
+
+  // Start Background Flush Thread
+  checksum.Reset(options.checksum);
+  ifill=0; nfill=0; fileoffset=0; nwritten=0; nholes=0;
+  pending=false; stopping=false; failed=false;
+  flusher=thread(&OutputWriter::FlushLoop, this);
+  return true;
+}
+
+bool OutputWriter::Write(const void *data, size_t nbytes)
+{
+  if (fd < 0) return false;
+  const char *src=static_cast<const char *>(data);
+  while (nbytes > 0)
+  {
+    size_t ncopy=capacity-nfill;
+    if (ncopy > nbytes) ncopy=nbytes;
+    memcpy(buffers[ifill]+nfill, src, ncopy);
+    nfill+=ncopy; src+=ncopy; nbytes-=ncopy; nwritten+=ncopy;
+    if (nfill == capacity && !SubmitFill(nfill)) return false;
+  }
+  return true;
+}
+
+bool OutputWriter::Close()
+{
+  if (fd < 0) return false;
+  bool ok=WaitIdle();
+
+  // Write The Final Partial Buffer; O_DIRECT Needs It Padded To A Full Block,
+  // The Padding Is Trimmed Again With ftruncate
+  if (ok && nfill > 0)
+  {
+    size_t nflush=nfill;
+    if (mode == WRITER_DIRECT)
+    {
+      nflush=(nfill+kDirectAlignment-1)/kDirectAlignment*kDirectAlignment;
+      memset(buffers[ifill]+nfill, 0, nflush-nfill);
+    }
+    checksum.Update(buffers[ifill], nfill);
+    ok=FlushBuffer(buffers[ifill], nflush, fileoffset);
+    if (ok && nflush != nfill) ok=(ftruncate(fd, nwritten) == 0);
+    nfill=0;
+  }
+
+  // A Sparse File Ending In A Hole Is Still Short Of Its Size
+  if (ok && sparse) ok=(ftruncate(fd, nwritten) == 0);
+
+  // Stop Background Flush Thread
+  {
+    lock_guard<mutex> guard(lock);
+    stopping=true;
+  }
+  cv.notify_all();
+  if (flusher.joinable()) flusher.join();
+
+  if (close(fd) != 0) ok=false;
+  fd=-1;
+  ReleaseBuffers();
+  return ok;
+}
+
+bool OutputWriter::SubmitFill(size_t nbytes)
+{
+  // Wait For The Previous Flush, Then Hand Over The Fill Buffer And Swap
+  if (!WaitIdle()) return false;
+  {
+    lock_guard<mutex> guard(lock);
+    pendingbuffer=buffers[ifill];
+    pendingbytes=nbytes;
+    pendingoffset=fileoffset;
+    pending=true;
+  }
+  cv.notify_all();
+  ifill^=1;
+  fileoffset+=nbytes;
+  nfill=0;
+  return true;
+}
+
+bool OutputWriter::WaitIdle()
+{
+  unique_lock<mutex> guard(lock);
+  while (pending) cv.wait(guard);
+  return !failed;
+}
+
+void OutputWriter::FlushLoop()
+{
+  unique_lock<mutex> guard(lock);
+  while (true)
+  {
+    while (!pending && !stopping) cv.wait(guard);
+    if (!pending) break;
+    const char *buffer=pendingbuffer;
+    size_t nbytes=pendingbytes;
+    uint64_t offset=pendingoffset;
+    guard.unlock();
+    checksum.Update(buffer, nbytes);
+    bool ok=FlushBuffer(buffer, nbytes, offset);
+    guard.lock();
+    if (!ok) failed=true;
+    pending=false;
+    cv.notify_all();
+  }
+}
+
+bool OutputWriter::FlushBuffer(const char *buffer, size_t nbytes, uint64_t offset)
+{
+  // The File Was Truncated On Open, So Skipped Zero Blocks Are Holes
+  if (sparse)
+  {
+    if (!PwriteSparse(fd, buffer, nbytes, offset, false, &nholes)) return false;
+  }
+  else if (!PwriteAll(fd, buffer, nbytes, offset)) return false;
+
+  // Drop The Written Range From The Page Cache Once It Is On Disk
+  if (mode == WRITER_DONTNEED)
+  {
+#ifdef __linux__
+    sync_file_range(fd, offset, nbytes,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+    fdatasync(fd);
+#endif
+    posix_fadvise(fd, offset, nbytes, POSIX_FADV_DONTNEED);
+  }
+  return true;
+}
+
+void OutputWriter::ReleaseBuffers()
+{
+  for (int ii=0;ii<2;ii++)
+  {
+    staging[ii].Reset();
+    buffers[ii]=0;
+  }
+}
@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Output Writer For Converted Slide Data
+//
+// Streams output bytes to disk through large double-buffered writes. One buffer is
+// filled by the caller while the other is flushed by a background thread.
+//
+// Backends:
+//   buffered: Plain write(2) through the page cache.
+//   dontneed: Buffered write(2), each flushed range is synced and dropped from the
+//             page cache with posix_fadvise(POSIX_FADV_DONTNEED).
+//   direct:   O_DIRECT with aligned buffers, bypassing the page cache. Falls back to
+//             dontneed if the filesystem does not support O_DIRECT.
+//
+// With sparse, all-zero blocks are not written and stay holes in the file (see
+// SparseWrite.h); readers see the same bytes.
+//
+// An optional checksum of the file contents (see Checksum.h) is updated by the flush
+// thread just before each buffer is written, while the buffer is still in cache and
+// the caller fills the other one, so verifying outputs needs no second read.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include "BufferPool.h"
+#include "Checksum.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Writer Backends
+enum WriterMode
+{
+  WRITER_BUFFERED=0,
+  WRITER_DONTNEED=1,
+  WRITER_DIRECT=2
+};
+
+// Writer Settings
+struct WriterOptions
+{
+  WriterMode mode;
+  size_t buffer_bytes; // Size of each of the two staging buffers
+  ChecksumType checksum;
+  bool sparse;         // Leave all-zero blocks as holes
+
+  WriterOptions() : mode(WRITER_BUFFERED), buffer_bytes(16*1024*1024), checksum(CHECKSUM_NONE), sparse(false) {}
+};
+
+// Convert Between Backend Names And Modes ("buffered", "dontneed", "direct")
+bool ParseWriterMode(const std::string &name, WriterMode &mode);
+const char *WriterModeName(WriterMode mode);
+
+class OutputWriter
+{
+public:
+  OutputWriter();
+  ~OutputWriter();
+
+  // Create (Or Truncate) The Output File
+  bool Open(const std::string &filename, const WriterOptions &options);
+
+  // Append Bytes To The Output File
+  bool Write(const void *data, size_t nbytes);
+
+  // Flush Remaining Data And Close The File
+  bool Close();
+
+  uint64_t BytesWritten() const { return nwritten; }
+  uint64_t BytesInHoles() const { return nholes; } // With sparse, valid after Close
+  WriterMode Mode() const { return mode; }
+
+  // Checksum Of Everything Written, Valid After Close (Empty Without A Checksum)
+  std::string Checksum() const { return checksum.HexDigest(); }
+
+private:
+  OutputWriter(const OutputWriter &);
+  OutputWriter &operator=(const OutputWriter &);
+
+  bool SubmitFill(size_t nbytes);
+  bool WaitIdle();
+  void FlushLoop();
+  bool FlushBuffer(const char *buffer, size_t nbytes, uint64_t offset);
+  void ReleaseBuffers();
+
+  int fd;
+  WriterMode mode;
+  bool sparse;
+  size_t capacity;
+  PooledBuffer staging[2]; // From SharedBufferPool, reused across outputs
+  char *buffers[2];
+  int ifill;            // Buffer currently being filled by the caller
+  size_t nfill;         // Bytes in the fill buffer
+  uint64_t fileoffset;  // File offset of the fill buffer
+  uint64_t nwritten;
+  uint64_t nholes;      // Updated by the flush thread
+  StreamChecksum checksum; // Updated by the flush thread, in file order
+
+  // Background Flush State
+  std::thread flusher;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool pending, stopping, failed;
+  const char *pendingbuffer;
+  size_t pendingbytes;
+  uint64_t pendingoffset;
+};
+
+#endif
@@ -0,0 +1,172 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Random Patch Sampler
+// See PatchSampler.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "PatchSampler.h"
+#include <string.h>
+#include <atomic>
+#include <unordered_map>
+using namespace std;
+
+// One Distinct Tile Needed By A Batch
+struct PatchTileJob
+{
+  SlideReader *reader;
+  const IndexedDirectory *directory;
+  uint32 itile;
+  shared_ptr<const DecodedTile> tile;
+};
+
+// Range Of Tiles Overlapped By A Patch, Clipped To The Image
+static bool PatchTileRange(const SCNDirectoryLayout &layout, long x, long y, uint32 size,
+                           uint32 &col0, uint32 &col1, uint32 &row0, uint32 &row1)
+{
+  long x0=(x > 0) ? x : 0, y0=(y > 0) ? y : 0;
+  long x1=x+static_cast<long>(size), y1=y+static_cast<long>(size);
+  if (x1 > static_cast<long>(layout.width)) x1=layout.width;
+  if (y1 > static_cast<long>(layout.height)) y1=layout.height;
+  if (x0 >= x1 || y0 >= y1) return false;
+  col0=x0/layout.tilewidth; col1=(x1-1)/layout.tilewidth;
+  row0=y0/layout.tilelength; row1=(y1-1)/layout.tilelength;
+  return true;
+}
+
+size_t PatchSampler::BatchBytes(const PatchBatch &batch, size_t npatches)
+{
+  return npatches*batch.channels.size()*batch.size*batch.size*SampleBytes(batch.type);
+}
+
+SCNReadStatus PatchSampler::Sample(const PatchBatch &batch, const vector<PatchRequest> &requests, void *out,
+                                   PatchSamplerStats *stats)
+{
+  size_t Nchannels=batch.channels.size();
+  size_t Nbytes=SampleBytes(batch.type);
+  size_t planebytes=static_cast<size_t>(batch.size)*batch.size*Nbytes;
+  if (Nchannels == 0 || batch.size == 0) return SCN_READ_FAILED;
+
+  //////////////////////////////////////////////////////////////////////////////////////
+  // Collect The Distinct Tiles Of The Batch
+  //////////////////////////////////////////////////////////////////////////////////////
+  vector<const IndexedDirectory *> directories(requests.size()*Nchannels);
+  vector<PatchTileJob> jobs;
+  unordered_map<TileKey, size_t, TileKeyHash> jobindex;
+  uint64_t ntilerefs=0;
+  for (size_t ip=0;ip<requests.size();ip++)
+  {
+    const PatchRequest &request=requests[ip];
+    if (request.slide >= slides.size()) return SCN_READ_FAILED;
+    SlideReader *reader=slides[request.slide];
+    for (size_t ic=0;ic<Nchannels;ic++)
+    {
+      const IndexedDirectory *directory=reader->FindChannel(request.field,batch.channels[ic],batch.r);
+      if (directory == NULL || directory->layout.type != batch.type) return SCN_READ_FAILED;
+      directories[ip*Nchannels+ic]=directory;
+      int sample=ChannelSample(directory->layout,batch.channels[ic]);
+      if (sample < 0) return SCN_READ_FAILED;
+
+      uint32 col0,col1,row0,row1;
+      if (!PatchTileRange(directory->layout,request.x,request.y,batch.size,col0,col1,row0,row1)) continue;
+      for (uint32 row=row0;row<=row1;row++)
+      {
+        for (uint32 col=col0;col<=col1;col++)
+        {
+          TileKey key;
+          key.slide=reader->Id();
+          key.ifd=directory->ifd;
+          key.tile=TileIndex(directory->layout,col,row,sample);
+          ntilerefs++;
+          if (jobindex.count(key)) continue;
+          jobindex[key]=jobs.size();
+          PatchTileJob job;
+          job.reader=reader;
+          job.directory=directory;
+          job.itile=key.tile;
+          jobs.push_back(job);
+        }
+      }
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////////////
+  // Decode Each Distinct Tile Once, In Parallel
+  //////////////////////////////////////////////////////////////////////////////////////
+  atomic<int> failure(SCN_READ_OK);
+  pool.ParallelFor(jobs.size(),[&](size_t ii)
+  {
+    PatchTileJob &job=jobs[ii];
+    SCNReadStatus status=job.reader->ReadTile(*job.directory,job.itile,job.tile);
+    if (status != SCN_READ_OK) failure=status;
+  });
+  if (failure != SCN_READ_OK) return static_cast<SCNReadStatus>(failure.load());
+
+
+  //////////////////////////////////////////////////////////////////////////////////////
+  // Fill The Patches, In Parallel
+  //////////////////////////////////////////////////////////////////////////////////////
+  uint8 *base=static_cast<uint8 *>(out);
+  size_t rowbytes=static_cast<size_t>(batch.size)*Nbytes;
+  pool.ParallelFor(requests.size(),[&](size_t ip)
+  {
+    const PatchRequest &request=requests[ip];
+    for (size_t ic=0;ic<Nchannels;ic++)
+    {
+      const IndexedDirectory *directory=directories[ip*Nchannels+ic];
+      const SCNDirectoryLayout &layout=directory->layout;
+      int sample=ChannelSample(layout,batch.channels[ic]);
+      uint8 *plane=base+(ip*Nchannels+ic)*planebytes;
+
+      // Zero Everything First When The Patch Reaches Outside The Image
+      long x=request.x, y=request.y;
+      long size=batch.size;
+      if (x < 0 || y < 0 || x+size > static_cast<long>(layout.width) || y+size > static_cast<long>(layout.height))
+      {
+        memset(plane,0,planebytes);
+      }
+
+      uint32 col0,col1,row0,row1;
+      if (!PatchTileRange(layout,x,y,batch.size,col0,col1,row0,row1)) continue;
+      for (uint32 row=row0;row<=row1;row++)
+      {
+        long ty0=static_cast<long>(row)*layout.tilelength;
+        long ry0=(y > ty0) ? y : ty0;
+        long ry1=ty0+layout.tilelength;
+        if (ry1 > y+size) ry1=y+size;
+        if (ry1 > static_cast<long>(layout.height)) ry1=layout.height;
+        for (uint32 col=col0;col<=col1;col++)
+        {
+          long tx0=static_cast<long>(col)*layout.tilewidth;
+          long rx0=(x > tx0) ? x : tx0;
+          long rx1=tx0+layout.tilewidth;
+          if (rx1 > x+size) rx1=x+size;
+          if (rx1 > static_cast<long>(layout.width)) rx1=layout.width;
+
+          TileKey key;
+          key.slide=slides[request.slide]->Id();
+          key.ifd=directory->ifd;
+          key.tile=TileIndex(layout,col,row,sample);
+          const DecodedTile &tile=*jobs[jobindex.find(key)->second].tile;
+          if (tile.data.size() < static_cast<size_t>(ry1-ty0-1)*layout.tilewidth*TilePixelBytes(layout)+
+                                 static_cast<size_t>(rx1-tx0)*TilePixelBytes(layout))
+          {
+            failure=SCN_READ_FAILED;
+            continue;
+          }
+          uint8 *dst=plane+(ry0-y)*rowbytes+(rx0-x)*Nbytes;
+          CopyTileSamples(layout,&tile.data[0],sample,rx0-tx0,ry0-ty0,rx1-rx0,ry1-ry0,dst,rowbytes,1);
+        }
+      }
+    }
+  });
+
+  if (stats != NULL)
+  {
+    stats->patches=requests.size();
+    stats->tilerefs=ntilerefs;
+    stats->tiles=jobs.size();
+  }
+  return static_cast<SCNReadStatus>(failure.load());
+}
@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Random Patch Sampler
+//
+// Reads batches of square patches from many slides straight into a caller-provided
+// tensor buffer, for model training without converting whole fields first.
+//
+// A batch is handled in three steps: the tiles overlapped by every patch and channel
+// are collected and deduplicated, each distinct tile is decoded once in parallel
+// (through the readers' TileCache when attached), and the patches are then filled in
+// parallel from the decoded tiles.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PATCHSAMPLER_H
+#define PATCHSAMPLER_H
+
+#include "SlideReader.h"
+#include "ThreadPool.h"
+#include <stdint.h>
+#include <vector>
+
+// One Patch Of A Batch
+struct PatchRequest
+{
+  uint32_t slide; // Position in the sampler's slide list
+  uint32_t field; // Position in the slide's fields
+  long x, y;      // Top left corner, in pixels of the batch resolution level
+};
+
+// Settings Shared By All Patches Of A Batch, Which Make Up One Contiguous Tensor
+struct PatchBatch
+{
+  std::vector<int> channels; // Channel numbers, in output order
+  int r;                     // Resolution level, 0 = highest
+  uint32_t size;             // Patches are size x size pixels
+  SampleType type;           // Element type; every directory read must match it
+
+  PatchBatch() : r(0), size(256), type(SAMPLE_UINT8) {}
+};
+
+struct PatchSamplerStats
+{
+  uint64_t patches;  // Patches filled
+  uint64_t tilerefs; // Tile reads the patches needed
+  uint64_t tiles;    // Distinct tiles decoded (or found in the cache)
+};
+
+class PatchSampler
+{
+public:
+  PatchSampler(const std::vector<SlideReader *> &slides_, ThreadPool &pool_) : slides(slides_), pool(pool_) {}
+
+  // Bytes Needed For A Batch Of npatches: npatches x channels x size x size Elements
+  static size_t BatchBytes(const PatchBatch &batch, size_t npatches);
+
+  // Fill out (Laid Out As [patch][channel][row][column], Top Row First) With One Patch
+  // Per Request. Pixels Outside A Field Are Zero.
+  SCNReadStatus Sample(const PatchBatch &batch, const std::vector<PatchRequest> &requests, void *out,
+                       PatchSamplerStats *stats=NULL);
+
+private:
+  std::vector<SlideReader *> slides;
+  ThreadPool &pool;
+};
+
+#endif
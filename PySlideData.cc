@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Python Bindings: The Slide Reader And Patch Sampler As NumPy Arrays
+//
+// Built as the 'slidedata' Python module with -DSLIDEDATA_PYTHON=ON (needs pybind11).
+//
+//   import slidedata
+//   slide=slidedata.Slide('Slide.scn')          # index: None = sidecar next to the
+//                                                # slide, '' = none, else its path
+//   slide.fields()                               # [{number, view sizes/offsets (nm),
+//                                                #   dimensions: [{channel, level,
+//                                                #   width, height, dtype}]}]
+//   a=slide.read_region(field, channel, x, y, width, height, level=0, out=None)
+//
+//   sampler=slidedata.PatchSampler([slide, ...], threads=0)
+//   b=sampler.sample(patches, channels, size=256, level=0, out=None)
+//
+// read_region returns a height x width array of the channel's native type, top row
+// first (unlike the converter's bottom-up output files). patches is an N x 4 integer
+// array of (slide, field, x, y) rows, and sample returns an N x C x size x size array.
+//
+// Arrays are not copied: without out, the samples are decoded straight into a buffer
+// the returned array owns; with out (any writable buffer of the right type and shape,
+// e.g. a preallocated NumPy array or a view into one), they are decoded into it and
+// out is returned. Region rows of out may be padded; sample's out must be C contiguous.
+//
+// The GIL is released while decoding, so Python threads can read one or several slides
+// concurrently. Slide(..., cache_bytes=N) gives a slide a decoded tile cache.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "PatchSampler.h"
+#include "SlideReader.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+namespace py=pybind11;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+static py::dtype SampleDType(SampleType type)
+{
+  return py::dtype::from_args(py::str(SampleTypeName(type)));
+}
+
+static void ThrowOnStatus(SCNReadStatus status)
+{
+  if (status == SCN_READ_NOMEMORY) throw std::bad_alloc();
+  if (status != SCN_READ_OK) throw std::runtime_error("Failed To Read Slide Data");
+}
+
+// Array Of shape Owning A New Library Buffer, Freed With The Array
+static py::array OwnedArray(SampleType type, const vector<py::ssize_t> &shape, uint8 *&data)
+{
+  size_t nbytes=SampleBytes(type);
+  for (size_t ii=0;ii<shape.size();ii++) nbytes*=static_cast<size_t>(shape[ii]);
+  data=new uint8[nbytes > 0 ? nbytes : 1];
+  py::capsule owner(data,[](void *ptr) { delete[] static_cast<uint8 *>(ptr); });
+  return py::array(SampleDType(type),shape,data,owner);
+}
+
+// Check A Caller-Provided Buffer: Writable, Of type, Of shape, With Contiguous Pixels.
+// Returns The Row Pitch In Bytes (The Stride Of The Second To Last Axis).
+static size_t CheckOut(const py::buffer_info &info, SampleType type, const vector<py::ssize_t> &shape,
+                       bool contiguous)
+{
+  if (info.readonly) throw py::value_error("out Must Be Writable");
+  py::dtype dtype(info);
+  py::dtype expected=SampleDType(type);
+  if (dtype.kind() != expected.kind() || dtype.itemsize() != expected.itemsize())
+  {
+    throw py::type_error("out Must Have dtype "+string(SampleTypeName(type)));
+  }
+  if (info.shape != shape) throw py::value_error("out Has The Wrong Shape");
+  py::ssize_t stride=info.itemsize;
+  for (size_t ii=shape.size();ii-->0;)
+  {
+    bool packed=(info.strides[ii] == stride || shape[ii] == 1);
+    if (!packed && (contiguous || ii+2 != shape.size() || info.strides[ii] < stride))
+    {
+      throw py::value_error(contiguous ? "out Must Be C Contiguous" : "out Must Have Contiguous Rows");
+    }
+    stride=info.strides[ii]*shape[ii];
+  }
+  return static_cast<size_t>(shape.size() >= 2 ? info.strides[shape.size()-2] : info.itemsize);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide
+////////////////////////////////////////////////////////////////////////////////////////
+class PySlide
+{
+public:
+  PySlide(const string &filename, py::object index, size_t cache_bytes)
+  {
+    string fn_index=index.is_none() ? SlideIndexFilename(filename,"") : index.cast<string>();
+    SlideIndexStatus status;
+    {
+      py::gil_scoped_release release;
+      status=reader.Open(filename,fn_index);
+    }
+    if (status == INDEX_OPEN_FAILED) throw py::value_error("Cannot Open "+filename);
+    if (status == INDEX_XML_FAILED) throw py::value_error("Cannot Parse The Description Of "+filename);
+    if (cache_bytes > 0)
+    {
+      cache.reset(new TileCache(cache_bytes));
+      reader.SetTileCache(cache.get());
+    }
+  }
+
+  SlideReader &Reader() { return reader; }
+
+  string Filename() const { return reader.Filename(); }
+
+  py::list Fields() const
+  {
+    const SlideIndex &index=reader.Index();
+    py::list fields;
+    for (size_t ifield=0;ifield<index.description.fields.size();ifield++)
+    {
+      const SCNField &field=index.description.fields[ifield];
+      py::list dimensions;
+      for (size_t ii=0;ii<field.dimensions.size();ii++)
+      {
+        const SCNDimension &dimension=field.dimensions[ii];
+        py::dict entry;
+        entry["channel"]=dimension.channel;
+        entry["level"]=dimension.r;
+        entry["width"]=dimension.sizeX;
+        entry["height"]=dimension.sizeY;
+        const IndexedDirectory *directory=reader.FindChannel(ifield,dimension.channel,dimension.r);
+        entry["dtype"]=(directory != NULL) ? py::object(SampleDType(directory->layout.type)) : py::object(py::none());
+        dimensions.append(entry);
+      }
+      py::dict entry;
+      entry["number"]=field.number;
+      entry["view_size_nm"]=py::make_tuple(field.viewSizeX,field.viewSizeY);
+      entry["view_offset_nm"]=py::make_tuple(field.viewOffsetX,field.viewOffsetY);
+      entry["dimensions"]=dimensions;
+      fields.append(entry);
+    }
+    return fields;
+  }
+
+  const IndexedDirectory &Channel(size_t field, int channel, int level) const
+  {
+    const IndexedDirectory *directory=reader.FindChannel(field,channel,level);
+    if (directory == NULL) throw py::value_error("No Natively Readable Channel At That Field And Level");
+    return *directory;
+  }
+
+  py::object ReadRegion(size_t field, int channel, long x, long y, uint32 width, uint32 height, int level,
+                        py::object out)
+  {
+    const IndexedDirectory &directory=Channel(field,channel,level);
+    SampleType type=directory.layout.type;
+    vector<py::ssize_t> shape;
+    shape.push_back(height);
+    shape.push_back(width);
+
+    py::array result;
+    uint8 *data;
+    size_t rowbytes;
+    py::buffer_info info;
+    if (out.is_none())
+    {
+      result=OwnedArray(type,shape,data);
+      rowbytes=width*SampleBytes(type);
+    }
+    else
+    {
+      info=py::reinterpret_borrow<py::buffer>(out).request(true);
+      rowbytes=CheckOut(info,type,shape,false);
+      data=static_cast<uint8 *>(info.ptr);
+    }
+
+    SCNReadStatus status;
+    {
+      py::gil_scoped_release release;
+      status=reader.ReadRegion(directory,channel,x,y,width,height,data,rowbytes);
+    }
+    ThrowOnStatus(status);
+    return out.is_none() ? py::object(result) : out;
+  }
+
+private:
+  unique_ptr<TileCache> cache; // Destroyed after reader
+  SlideReader reader;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Patch Sampler
+////////////////////////////////////////////////////////////////////////////////////////
+class PyPatchSampler
+{
+public:
+  // Holds A Reference To Each Slide, So They Outlive The Sampler Whatever Happens To
+  // The Sequence They Were Passed In
+  PyPatchSampler(const py::sequence &slides_, int threads) : pool(threads)
+  {
+    for (size_t ii=0;ii<slides_.size();ii++)
+    {
+      py::object slide=slides_[ii];
+      owners.push_back(slide);
+      slides.push_back(slide.cast<PySlide *>());
+      readers.push_back(&slides.back()->Reader());
+    }
+    sampler.reset(new PatchSampler(readers,pool));
+  }
+
+  py::object Sample(py::array_t<long, py::array::c_style | py::array::forcecast> patches, const vector<int> &channels,
+                    uint32_t size, int level, py::object out)
+  {
+    if (patches.ndim() != 2 || patches.shape(1) != 4) throw py::value_error("patches Must Be N x 4");
+    if (channels.empty() || size == 0) throw py::value_error("Need At Least One Channel And A Size");
+    size_t npatches=patches.shape(0);
+    vector<PatchRequest> requests(npatches);
+    for (size_t ip=0;ip<npatches;ip++)
+    {
+      PatchRequest &request=requests[ip];
+      long slide=patches.at(ip,0), field=patches.at(ip,1);
+      if (slide < 0 || static_cast<size_t>(slide) >= slides.size()) throw py::index_error("Slide Out Of Range");
+      if (field < 0) throw py::index_error("Field Out Of Range");
+      request.slide=slide;
+      request.field=field;
+      request.x=patches.at(ip,2);
+      request.y=patches.at(ip,3);
+    }
+
+    // The Batch Type Is That Of The First Patch; Sample Fails If Another Differs
+    PatchBatch batch;
+    batch.channels=channels;
+    batch.r=level;
+    batch.size=size;
+    if (npatches > 0) batch.type=slides[requests[0].slide]->Channel(requests[0].field,channels[0],level).layout.type;
+    vector<py::ssize_t> shape;
+    shape.push_back(npatches);
+    shape.push_back(channels.size());
+    shape.push_back(size);
+    shape.push_back(size);
+
+    py::array result;
+    uint8 *data;
+    py::buffer_info info;
+    if (out.is_none()) result=OwnedArray(batch.type,shape,data);
+    else
+    {
+      info=py::reinterpret_borrow<py::buffer>(out).request(true);
+      CheckOut(info,batch.type,shape,true);
+      data=static_cast<uint8 *>(info.ptr);
+    }
+
+    SCNReadStatus status;
+    {
+      py::gil_scoped_release release;
+      status=sampler->Sample(batch,requests,data);
+    }
+    ThrowOnStatus(status);
+    return out.is_none() ? py::object(result) : out;
+  }
+
+private:
+  vector<py::object> owners; // References keeping slides alive
+  vector<PySlide *> slides;
+  vector<SlideReader *> readers;
+  ThreadPool pool;
+  unique_ptr<PatchSampler> sampler;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Module
+////////////////////////////////////////////////////////////////////////////////////////
+PYBIND11_MODULE(slidedata, m)
+{
+  m.doc()="Leica SCN400F slide reader returning NumPy arrays";
+
+  py::class_<PySlide>(m,"Slide")
+    .def(py::init<const string &, py::object, size_t>(),py::arg("filename"),py::arg("index")=py::none(),
+         py::arg("cache_bytes")=0)
+    .def_property_readonly("filename",&PySlide::Filename)
+    .def("fields",&PySlide::Fields,"Fields with their channels and resolution levels")
+    .def("read_region",&PySlide::ReadRegion,py::arg("field"),py::arg("channel"),py::arg("x"),py::arg("y"),
+         py::arg("width"),py::arg("height"),py::arg("level")=0,py::arg("out")=py::none(),
+         "Read a region of one channel, top row first, at native bit depth");
+
+  py::class_<PyPatchSampler>(m,"PatchSampler")
+    .def(py::init<const py::sequence &, int>(),py::arg("slides"),py::arg("threads")=0)
+    .def("sample",&PyPatchSampler::Sample,py::arg("patches"),py::arg("channels"),py::arg("size")=256,
+         py::arg("level")=0,py::arg("out")=py::none(),
+         "Read a batch of patches given as (slide, field, x, y) rows into an N x C x size x size array");
+}
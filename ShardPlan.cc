@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shard Planning For Converting One Slide In Several Processes
+// See ShardPlan.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShardPlan.h"
+#include <algorithm>
+using namespace std;
+
+// One Unit Of Work Before It Is Assigned
+struct ShardUnit
+{
+  ShardPiece piece;
+  uint64_t bytes;
+};
+
+static bool LargerUnit(const ShardUnit &a, const ShardUnit &b)
+{
+  return a.bytes > b.bytes;
+}
+
+static bool PieceOrder(const ShardPiece &a, const ShardPiece &b)
+{
+  if (a.ifield != b.ifield) return a.ifield < b.ifield;
+  if (a.channel != b.channel) return a.channel < b.channel;
+  return a.firstrow < b.firstrow;
+}
+
+// Compressed Bytes Of Tile Rows firstrow To lastrow-1 Of One Channel Of A Directory
+static uint64_t TileRowBytes(const IndexedDirectory &directory, int channel, uint32 firstrow, uint32 lastrow)
+{
+  const SCNDirectoryLayout &layout=directory.layout;
+  int sample=ChannelSample(layout,channel);
+  if (sample < 0) sample=0;
+  uint64_t bytes=0;
+  for (uint32 row=firstrow;row<lastrow;row++)
+  {
+    for (uint32 col=0;col<TilesAcross(layout);col++)
+    {
+      uint32 itile=TileIndex(layout,col,row,sample);
+      if (itile < directory.bytecounts.size()) bytes+=directory.bytecounts[itile];
+    }
+  }
+  return bytes;
+}
+
+// r=0 Channels Of A Field, In Channel Order, With Their Directories
+static vector<pair<int, const IndexedDirectory *> > FieldDirectories(const SlideIndex &index, const SCNField &field)
+{
+  vector<pair<int, const IndexedDirectory *> > channels;
+  for (size_t ii=0;ii<field.dimensions.size();ii++)
+  {
+    if (field.dimensions[ii].r != 0) continue;
+    const IndexedDirectory *directory=index.FindDirectory(field.dimensions[ii].ifd);
+    if (directory != NULL) channels.push_back(make_pair(field.dimensions[ii].channel,directory));
+  }
+  stable_sort(channels.begin(),channels.end(),
+              [](const pair<int, const IndexedDirectory *> &a, const pair<int, const IndexedDirectory *> &b)
+              { return a.first < b.first; });
+  return channels;
+}
+
+vector<Shard> PlanShards(const SlideIndex &index, size_t nshards, bool perchannel, bool bytiles)
+{
+  const SCNDescription &description=index.description;
+  if (nshards == 0) nshards=1;
+  vector<Shard> shards(nshards);
+  for (size_t is=0;is<nshards;is++) shards[is].bytes=0;
+
+  // Units Of Work
+  vector<ShardUnit> units;
+  for (size_t ifield=0;ifield<description.fields.size();ifield++)
+  {
+    vector<pair<int, const IndexedDirectory *> > channels=FieldDirectories(index,description.fields[ifield]);
+    ShardUnit whole;
+    whole.piece.ifield=ifield;
+    whole.piece.channel=-1;
+    whole.piece.firstrow=whole.piece.lastrow=0;
+    whole.bytes=0;
+    for (size_t ic=0;ic<channels.size();ic++)
+    {
+      const IndexedDirectory &directory=*channels[ic].second;
+      uint32 nrows=TilesDown(directory.layout);
+      ShardUnit unit;
+      unit.piece.ifield=ifield;
+      unit.piece.channel=channels[ic].first;
+      if (bytiles)
+      {
+        for (uint32 row=0;row<nrows;row++)
+        {
+          unit.piece.firstrow=row;
+          unit.piece.lastrow=row+1;
+          unit.bytes=TileRowBytes(directory,channels[ic].first,row,row+1);
+          units.push_back(unit);
+        }
+      }
+      else
+      {
+        unit.piece.firstrow=unit.piece.lastrow=0;
+        unit.bytes=TileRowBytes(directory,channels[ic].first,0,nrows);
+        if (perchannel) units.push_back(unit);
+        whole.bytes+=unit.bytes;
+      }
+    }
+    if (!bytiles && !perchannel && !channels.empty()) units.push_back(whole);
+  }
+
+  if (bytiles)
+  {
+    // Consecutive Runs: Each Row Goes To The Shard Its Midpoint Falls In
+    uint64_t total=0;
+    for (size_t iu=0;iu<units.size();iu++) total+=units[iu].bytes;
+    uint64_t before=0;
+    for (size_t iu=0;iu<units.size();iu++)
+    {
+      double mid=(total > 0) ? (before+0.5*units[iu].bytes)/total : (iu+0.5)/units.size();
+      size_t is=min(nshards-1,static_cast<size_t>(mid*nshards));
+      before+=units[iu].bytes;
+      Shard &shard=shards[is];
+      shard.bytes+=units[iu].bytes;
+
+      // Extend The Last Piece When This Row Continues It
+      const ShardPiece &piece=units[iu].piece;
+      if (!shard.pieces.empty() && shard.pieces.back().ifield == piece.ifield &&
+          shard.pieces.back().channel == piece.channel && shard.pieces.back().lastrow == piece.firstrow)
+      {
+        shard.pieces.back().lastrow=piece.lastrow;
+      }
+      else shard.pieces.push_back(piece);
+    }
+
+    // Pieces Covering A Whole Channel Need No Row Selector
+    for (size_t is=0;is<nshards;is++)
+    {
+      for (size_t ip=0;ip<shards[is].pieces.size();ip++)
+      {
+        ShardPiece &piece=shards[is].pieces[ip];
+        vector<pair<int, const IndexedDirectory *> > channels=FieldDirectories(index,description.fields[piece.ifield]);
+        for (size_t ic=0;ic<channels.size();ic++)
+        {
+          if (channels[ic].first == piece.channel && piece.firstrow == 0 &&
+              piece.lastrow == TilesDown(channels[ic].second->layout)) piece.lastrow=0;
+        }
+      }
+    }
+  }
+  else
+  {
+    // Largest Unit First To The Least Loaded Shard
+    stable_sort(units.begin(),units.end(),LargerUnit);
+    for (size_t iu=0;iu<units.size();iu++)
+    {
+      size_t best=0;
+      for (size_t is=1;is<nshards;is++) if (shards[is].bytes < shards[best].bytes) best=is;
+      shards[best].bytes+=units[iu].bytes;
+      shards[best].pieces.push_back(units[iu].piece);
+    }
+    for (size_t is=0;is<nshards;is++) sort(shards[is].pieces.begin(),shards[is].pieces.end(),PieceOrder);
+  }
+
+  // Drop Shards Left Without Work (More Shards Than Units)
+  vector<Shard> planned;
+  for (size_t is=0;is<nshards;is++) if (!shards[is].pieces.empty()) planned.push_back(shards[is]);
+  return planned;
+}
@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shard Planning For Converting One Slide In Several Processes
+//
+// Splits a conversion into shards of about equal compressed tile bytes, the best cheap
+// predictor of decode time. Each shard is a list of pieces, and each piece is one
+// converter invocation restricted with --fields, --channels and --tile-rows, so shards
+// can run as independent jobs on one host or on many sharing a filesystem.
+//
+//   separate layout, native:  Units are single tile rows of one channel, in field,
+//                             channel and row order; shards take consecutive runs
+//                             of them, so a channel is split across at most two
+//                             neighbouring shards per boundary.
+//   otherwise:                Units are whole outputs (a channel of a field, or a
+//                             whole field for planar and interleaved), assigned
+//                             largest first to the least loaded shard.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHARDPLAN_H
+#define SHARDPLAN_H
+
+#include "SlideIndex.h"
+#include <stdint.h>
+#include <vector>
+
+// One Invocation: Field ifield (Position In The Slide), And Either One Channel Or All
+// (channel < 0), Over Tile Rows firstrow To lastrow-1 Or All Rows (lastrow == 0)
+struct ShardPiece
+{
+  size_t ifield;
+  int channel;
+  uint32 firstrow, lastrow;
+};
+
+struct Shard
+{
+  uint64_t bytes; // Compressed tile bytes
+  std::vector<ShardPiece> pieces;
+};
+
+// Plan nshards Shards. bytiles Allows Splitting Channels By Tile Rows, Which The
+// Converter Supports For The Native Separate Layout; perchannel Makes Each Channel
+// Its Own Unit (Separate Layout) Rather Than Each Field.
+std::vector<Shard> PlanShards(const SlideIndex &index, size_t nshards, bool perchannel, bool bytiles);
+
+#endif
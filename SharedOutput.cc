@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared Memory Outputs For Consumers On The Same Node
+// See SharedOutput.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SharedOutput.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <mutex>
+#include <set>
+using namespace std;
+
+static_assert(sizeof(SharedOutputHeader) == 64,"SharedOutputHeader Must Stay 64 Bytes");
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Unpublished Segments
+////////////////////////////////////////////////////////////////////////////////////////
+// Error Paths End In exit(), Which Skips Destructors, So Segments Not Yet Published Are
+// Also Listed Here And Removed By An atexit Hook. Never Freed: The Hook May Run After
+// Static Destructors.
+static mutex pendinglock;
+static set<string> *pending=NULL;
+
+static void UnlinkPending()
+{
+  lock_guard<mutex> guard(pendinglock);
+  if (pending == NULL) return;
+  for (set<string>::const_iterator it=pending->begin();it!=pending->end();++it) shm_unlink(it->c_str());
+  pending->clear();
+}
+
+static void AddPending(const string &shmname)
+{
+  lock_guard<mutex> guard(pendinglock);
+  if (pending == NULL)
+  {
+    pending=new set<string>();
+    atexit(UnlinkPending);
+  }
+  pending->insert(shmname);
+}
+
+static void RemovePending(const string &shmname)
+{
+  lock_guard<mutex> guard(pendinglock);
+  if (pending != NULL) pending->erase(shmname);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Segments
+////////////////////////////////////////////////////////////////////////////////////////
+bool SharedOutputName(const string &name, string &shmname)
+{
+  string base=(!name.empty() && name[0] == '/') ? name.substr(1) : name;
+  if (base.empty() || base.find('/') != string::npos) return false;
+  shmname="/"+base;
+  return true;
+}
+
+SharedOutput::SharedOutput() : mapping(NULL), mappingbytes(0), data(NULL), databytes(0)
+{
+}
+
+SharedOutput::~SharedOutput()
+{
+  // Never Published: Remove The Incomplete Segment
+  if (mapping != NULL)
+  {
+    Unmap();
+    shm_unlink(shmname.c_str());
+    RemovePending(shmname);
+  }
+}
+
+void SharedOutput::Unmap()
+{
+  if (mapping != NULL) munmap(mapping,mappingbytes);
+  mapping=NULL;
+  data=NULL;
+}
+
+bool SharedOutput::Create(const ManifestOutput &output)
+{
+  if (mapping != NULL) return false;
+  if (!SharedOutputName(output.filename,shmname)) return false;
+  databytes=static_cast<uint64_t>(SampleBytes(output.type))*output.width*output.height*output.channels.size();
+  mappingbytes=sizeof(SharedOutputHeader)+databytes;
+
+  // Replace A Segment Left By An Earlier Run; Its Consumers Keep Their Mappings
+  shm_unlink(shmname.c_str());
+  int fd=shm_open(shmname.c_str(),O_RDWR | O_CREAT | O_EXCL,0644);
+  if (fd < 0) return false;
+  AddPending(shmname);
+  bool flag_ok=(ftruncate(fd,mappingbytes) == 0);
+  if (flag_ok)
+  {
+    mapping=mmap(NULL,mappingbytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    if (mapping == MAP_FAILED) mapping=NULL;
+    flag_ok=(mapping != NULL);
+  }
+  close(fd);
+  if (!flag_ok)
+  {
+    shm_unlink(shmname.c_str());
+    RemovePending(shmname);
+    return false;
+  }
+
+  SharedOutputHeader *header=static_cast<SharedOutputHeader *>(mapping);
+  memset(header,0,sizeof(SharedOutputHeader));
+  memcpy(header->magic,"SCNSHM1",8);
+  header->headerbytes=sizeof(SharedOutputHeader);
+  header->state=SHARED_WRITING;
+  header->databytes=databytes;
+  header->type=output.type;
+  header->axes=output.axes;
+  header->width=output.width;
+  header->height=output.height;
+  header->nchannels=output.channels.size();
+  header->field=output.field;
+  header->channel=output.channels.empty() ? 0 : output.channels[0];
+  data=static_cast<uint8_t *>(mapping)+sizeof(SharedOutputHeader);
+  return true;
+}
+
+void SharedOutput::Publish()
+{
+  if (mapping == NULL) return;
+  SharedOutputHeader *header=static_cast<SharedOutputHeader *>(mapping);
+  __atomic_store_n(&header->state,static_cast<uint32_t>(SHARED_READY),__ATOMIC_RELEASE);
+  Unmap();
+  RemovePending(shmname);
+}
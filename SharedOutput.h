@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared Memory Outputs For Consumers On The Same Node
+//
+// Instead of a file, an output can be a POSIX shared memory segment (shm_open, i.e.
+// /dev/shm/<name> on Linux) that a consumer maps directly, so nothing goes through a
+// filesystem backed by disk. The segment is a 64 byte SharedOutputHeader followed by
+// the same samples an output file would hold, laid out as described by axes and
+// bottom row first; the converter decodes straight into the mapping.
+//
+// A segment is created in state SHARED_WRITING and set to SHARED_READY (a release
+// store) once every sample is in place. Consumers map it read-only, wait for
+// SHARED_READY (an acquire load), and shm_unlink it when done; a new segment of the
+// same name replaces the old one without disturbing mappings of it. A producer that
+// fails removes its unpublished segments, also when it ends through exit(); one left
+// in SHARED_WRITING belongs to a producer still running or killed by a signal.
+//
+//   Python: m=mmap.mmap(os.open('/dev/shm/'+name,os.O_RDONLY),0,prot=mmap.PROT_READ)
+//           (state,)=struct.unpack_from('<I',m,12)     # 1 = ready
+//           a=np.frombuffer(m,dtype,offset=64).reshape(shape)
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHAREDOUTPUT_H
+#define SHAREDOUTPUT_H
+
+#include "ConversionManifest.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+enum SharedOutputState
+{
+  SHARED_WRITING=0,
+  SHARED_READY=1
+};
+
+// Segment Header, In Host Byte Order
+struct SharedOutputHeader
+{
+  char magic[8];        // "SCNSHM1\0"
+  uint32_t headerbytes; // Offset of the first sample (64)
+  uint32_t state;       // SharedOutputState
+  uint64_t databytes;   // Bytes of samples after the header
+  uint32_t type;        // SampleType
+  uint32_t axes;        // ManifestAxes
+  uint32_t width, height;
+  uint32_t nchannels;
+  int32_t field;        // Field number, as in output filenames
+  int32_t channel;      // First channel number, in storage order
+  uint32_t reserved[3];
+};
+
+// Segment Name For An Output Name: A Leading '/' And No Other
+bool SharedOutputName(const std::string &name, std::string &shmname);
+
+class SharedOutput
+{
+public:
+  SharedOutput();
+  ~SharedOutput();
+
+  // Create (Or Replace) The Segment Named After output.filename (See SharedOutputName)
+  // And Map It, Sized For output's Samples
+  bool Create(const ManifestOutput &output);
+
+  // Samples Area, Valid Between Create And Publish
+  uint8_t *Data() const { return data; }
+  uint64_t DataBytes() const { return databytes; }
+  const std::string &Name() const { return shmname; }
+
+  // Mark The Samples Complete And Unmap The Segment, Which Stays For Consumers
+  void Publish();
+
+private:
+  SharedOutput(const SharedOutput &);
+  SharedOutput &operator=(const SharedOutput &);
+
+  void Unmap();
+
+  std::string shmname;
+  void *mapping;
+  size_t mappingbytes;
+  uint8_t *data;
+  uint64_t databytes;
+};
+
+#endif
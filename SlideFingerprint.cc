@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide Content Fingerprints For Skipping Unchanged Conversions
+// See SlideFingerprint.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SlideFingerprint.h"
+#include "Checksum.h"
+#include "IFDScanner.h"
+#include "IOHelpers.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+static const char kFingerprintMagic[]="SCNFINGERPRINT";
+static const int kFingerprintVersion=1;
+
+// Largest Single Read When Hashing Runs Of Adjacent Tiles
+static const size_t kFingerprintChunk=8*1024*1024;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Fingerprint
+////////////////////////////////////////////////////////////////////////////////////////
+// Hash nbytes Of The Slide Starting At offset
+static bool HashRange(int fd, uint64_t offset, uint64_t nbytes, vector<char> &chunk, XXH64Stream &stream)
+{
+  while (nbytes > 0)
+  {
+    size_t nwant=(nbytes < chunk.size()) ? static_cast<size_t>(nbytes) : chunk.size();
+    if (!PreadAll(fd,&chunk[0],nwant,offset)) return false;
+    stream.Update(&chunk[0],nwant);
+    offset+=nwant; nbytes-=nwant;
+  }
+  return true;
+}
+
+bool FingerprintSlide(const string &fn_slide, const SlideIndex &index, const vector<int> &ifds, uint64_t &hash)
+{
+  // IMAGEDESCRIPTION As Stored Now, Not As Cached In The Index
+  IFDScanner scanner;
+  ScannedIFD first;
+  if (!scanner.Open(fn_slide) || !scanner.ScanFirstDirectory(first)) return false;
+  string sdescription;
+  uint64_t xmlhash=scanner.ReadImageDescription(first,sdescription) ?
+    XXH64(sdescription.data(),sdescription.size(),0) : 0;
+  scanner.Close();
+
+  int fd=open(fn_slide.c_str(),O_RDONLY);
+  if (fd < 0) return false;
+  posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+  vector<char> chunk(kFingerprintChunk);
+  XXH64Stream stream;
+  stream.Update(&xmlhash,sizeof(xmlhash));
+  for (size_t ii=0;ii<ifds.size();ii++)
+  {
+    const IndexedDirectory *directory=index.FindDirectory(ifds[ii]);
+    if (directory == NULL) {close(fd); return false;}
+    int32_t ifd=directory->ifd;
+    uint32_t ntiles=directory->offsets.size();
+    stream.Update(&ifd,sizeof(ifd));
+    stream.Update(&ntiles,sizeof(ntiles));
+
+    // Tiles Stored Back To Back Are Hashed As One Range
+    size_t itile=0;
+    while (itile < directory->offsets.size())
+    {
+      uint64_t offset=directory->offsets[itile];
+      uint64_t nbytes=directory->bytecounts[itile];
+      stream.Update(&nbytes,sizeof(nbytes));
+      for (itile++;itile<directory->offsets.size() && directory->offsets[itile] == offset+nbytes;itile++)
+      {
+        nbytes+=directory->bytecounts[itile];
+        stream.Update(&directory->bytecounts[itile],sizeof(uint64_t));
+      }
+      if (!HashRange(fd,offset,nbytes,chunk,stream)) {close(fd); return false;}
+    }
+  }
+  close(fd);
+  hash=stream.Digest();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Record
+////////////////////////////////////////////////////////////////////////////////////////
+bool SaveConversionFingerprint(const string &fn_record, const ConversionFingerprint &record)
+{
+  ostringstream convert;
+  convert << fn_record << ".tmp" << getpid();
+  string fn_tmp=convert.str();
+  FILE *fp=fopen(fn_tmp.c_str(),"w");
+  if (fp == NULL) return false;
+  bool ok=(fprintf(fp,"%s %d %s\n",kFingerprintMagic,kFingerprintVersion,record.options.c_str()) >= 0);
+  ok=ok && (fprintf(fp,"source %016" PRIx64 "\n",record.source) >= 0);
+  for (size_t ii=0;ii<record.outputs.size() && ok;ii++)
+  {
+    ok=(fprintf(fp,"output %" PRIu64 " %s\n",record.outputs[ii].second,record.outputs[ii].first.c_str()) >= 0);
+  }
+  if (fclose(fp) != 0) ok=false;
+  if (ok) ok=(rename(fn_tmp.c_str(),fn_record.c_str()) == 0);
+  if (!ok) unlink(fn_tmp.c_str());
+  return ok;
+}
+
+bool LoadConversionFingerprint(const string &fn_record, ConversionFingerprint &record)
+{
+  ifstream ifile(fn_record.c_str());
+  if (!ifile) return false;
+
+  // Header: Magic, Version, Options
+  string line;
+  ostringstream header;
+  header << kFingerprintMagic << " " << kFingerprintVersion << " ";
+  if (!getline(ifile,line) || line.compare(0,header.str().size(),header.str()) != 0) return false;
+  record.options=line.substr(header.str().size());
+
+  // Source Hash
+  string shash;
+  if (!getline(ifile,line) || line.compare(0,7,"source ") != 0) return false;
+  shash=line.substr(7);
+  char *end=0;
+  record.source=strtoull(shash.c_str(),&end,16);
+  if (shash.size() != 16 || *end != '\0') return false;
+
+  // Outputs
+  record.outputs.clear();
+  while (getline(ifile,line))
+  {
+    istringstream entry(line);
+    string kind, filename;
+    uint64_t nbytes;
+    if (!(entry >> kind >> nbytes) || kind != "output" || entry.get() != ' ') return false;
+    getline(entry,filename);
+    if (filename.empty()) return false;
+    record.outputs.push_back(make_pair(filename,nbytes));
+  }
+  return true;
+}
+
+bool OutputsPresent(const ConversionFingerprint &record)
+{
+  for (size_t ii=0;ii<record.outputs.size();ii++)
+  {
+    struct stat st;
+    if (stat(record.outputs[ii].first.c_str(),&st) != 0) return false;
+    if (static_cast<uint64_t>(st.st_size) != record.outputs[ii].second) return false;
+  }
+  return true;
+}
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide Content Fingerprints For Skipping Unchanged Conversions
+//
+// The fingerprint of a conversion source is the XXH64 of the slide's IMAGEDESCRIPTION
+// followed by the compressed bytes of every tile (or strip) of the TIFF directories
+// the conversion reads, taken straight from the file without decoding. Adjacent
+// tiles are read together in large sequential chunks, so fingerprinting runs at disk
+// speed.
+//
+// After a successful conversion the fingerprint is saved next to the outputs with
+// the conversion options and the list of outputs. A later run with --skip-unchanged
+// recomputes it and does nothing if the fingerprint and options match and every
+// listed output is still there with its recorded size.
+//
+// Record Format (text, filenames last so they may hold spaces):
+//   SCNFINGERPRINT 1 <options>
+//   source <xxh64>
+//   output <bytes> <filename>
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SLIDEFINGERPRINT_H
+#define SLIDEFINGERPRINT_H
+
+#include "SlideIndex.h"
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Fingerprint The IMAGEDESCRIPTION And The Tiles Of Directories ifds, In That Order
+bool FingerprintSlide(const std::string &fn_slide, const SlideIndex &index, const std::vector<int> &ifds,
+                      uint64_t &hash);
+
+// Source, Options And Outputs Of A Finished Conversion
+struct ConversionFingerprint
+{
+  std::string options;
+  uint64_t source;
+  std::vector<std::pair<std::string, uint64_t> > outputs; // (filename, bytes)
+};
+
+// Save (Through A Temporary File) / Load A Fingerprint Record
+bool SaveConversionFingerprint(const std::string &fn_record, const ConversionFingerprint &record);
+bool LoadConversionFingerprint(const std::string &fn_record, ConversionFingerprint &record);
+
+// True If Every Output Of The Record Exists With Its Recorded Size
+bool OutputsPresent(const ConversionFingerprint &record);
+
+#endif
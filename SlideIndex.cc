@@ -0,0 +1,414 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Persistent Slide Metadata Index
+// See SlideIndex.h for details.
+//
+// Sidecar Format (host byte order):
+//   "SCNIDX01", uint32 version
+//   uint64 filesize, int64 mtime_sec, int64 mtime_nsec, uint64 xmlhash
+//   int64 collectionSizeX, collectionSizeY
+//   uint32 nfields, per field: int32 number, int64 viewSizeX, viewSizeY, viewOffsetX,
+//     viewOffsetY, uint32 ndimensions, per dimension: int32 ifd, channel, r,
+//     int64 sizeX, sizeY
+//   uint32 ndirectories, per directory: int32 ifd, uint64 diroffset, uint8 nativeok,
+//     layout (uint32 width, height, tilewidth, tilelength, uint8 tiled, uint16
+//     bitspersample, samplesperpixel, sampleformat, planarconfig, compression,
+//     photometric, uint32 type), uint32 ntiles, uint64 offsets[ntiles],
+//     uint64 bytecounts[ntiles]
+//   uint64 XXH64 of all preceding bytes
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SlideIndex.h"
+#include "Checksum.h"
+#include "IFDScanner.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <sstream>
+using namespace std;
+
+static const char kIndexMagic[8]={'S','C','N','I','D','X','0','1'};
+static const uint32_t kIndexVersion=1;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Serialization Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+class IndexBuffer
+{
+public:
+  vector<char> bytes;
+  template <typename T> void Put(T value)
+  {
+    const char *p=reinterpret_cast<const char *>(&value);
+    bytes.insert(bytes.end(),p,p+sizeof(T));
+  }
+};
+
+class IndexReader
+{
+public:
+  IndexReader(const char *begin, const char *end) : p(begin), pend(end) {}
+  template <typename T> bool Get(T &value)
+  {
+    if (pend-p < static_cast<ptrdiff_t>(sizeof(T))) return false;
+    memcpy(&value,p,sizeof(T));
+    p+=sizeof(T);
+    return true;
+  }
+private:
+  const char *p, *pend;
+};
+
+static bool StatSlide(const string &fn_slide, uint64_t &filesize, int64_t &mtime_sec, int64_t &mtime_nsec)
+{
+  struct stat st;
+  if (stat(fn_slide.c_str(),&st) != 0) return false;
+  filesize=st.st_size;
+  mtime_sec=st.st_mtim.tv_sec;
+  mtime_nsec=st.st_mtim.tv_nsec;
+  return true;
+}
+
+static bool CompareIFD(const IndexedDirectory &a, const IndexedDirectory &b)
+{
+  return a.ifd < b.ifd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Index Access
+////////////////////////////////////////////////////////////////////////////////////////
+const IndexedDirectory *SlideIndex::FindDirectory(int ifd) const
+{
+  IndexedDirectory key;
+  key.ifd=ifd;
+  vector<IndexedDirectory>::const_iterator it=lower_bound(directories.begin(),directories.end(),key,CompareIFD);
+  if (it == directories.end() || it->ifd != ifd) return NULL;
+  return &(*it);
+}
+
+string SlideIndexFilename(const string &fn_slide, const string &indexdir)
+{
+  if (indexdir.empty()) return fn_slide+".scnidx";
+  size_t islash=fn_slide.find_last_of('/');
+  string basename=(islash == string::npos) ? fn_slide : fn_slide.substr(islash+1);
+  return indexdir+"/"+basename+".scnidx";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Build
+////////////////////////////////////////////////////////////////////////////////////////
+// Directories Referenced By Any Field At Any Resolution Level
+static set<int> WantedDirectories(const SCNDescription &description)
+{
+  set<int> wanted;
+  for (size_t ii=0;ii<description.fields.size();ii++)
+  {
+    const SCNField &field=description.fields[ii];
+    for (size_t jj=0;jj<field.dimensions.size();jj++) wanted.insert(field.dimensions[jj].ifd);
+  }
+  return wanted;
+}
+
+// Build From The Tags Read By IFDScanner. Returns false (Leaving index Incomplete) If
+// The File Is Not Laid Out As Expected, So The Caller Can Fall Back To libtiff.
+static bool ScanSlideIndex(const string &fn_slide, SlideIndex &index, SlideIndexStatus &status)
+{
+  IFDScanner scanner;
+  vector<ScannedIFD> ifds;
+  if (!scanner.Open(fn_slide) || !scanner.ScanDirectories(ifds)) return false;
+
+  // Parse The Description In The First Directory
+  string sdescription;
+  if (!scanner.ReadImageDescription(ifds[0],sdescription)) return false;
+  if (!ParseSCNDescription(sdescription.c_str(),index.description))
+  {
+    status=INDEX_XML_FAILED;
+    return true;
+  }
+  index.xmlhash=XXH64(sdescription.data(),sdescription.size(),0);
+
+  // Wanted Directories, Checking Their Arrays Cover Every Tile
+  set<int> wanted=WantedDirectories(index.description);
+  for (set<int>::const_iterator it=wanted.begin();it!=wanted.end();++it)
+  {
+    if (*it < 0 || static_cast<size_t>(*it) >= ifds.size()) continue;
+    const ScannedIFD &ifd=ifds[*it];
+    IndexedDirectory directory;
+    directory.ifd=*it;
+    directory.diroffset=ifd.diroffset;
+    SCNDirectoryLayout &layout=directory.layout;
+    memset(&layout,0,sizeof(layout));
+    layout.width=ifd.width;
+    layout.height=ifd.height;
+    layout.tiled=ifd.tiled;
+    layout.tilewidth=ifd.tilewidth;
+    layout.tilelength=ifd.tilelength;
+    layout.bitspersample=ifd.bitspersample;
+    layout.samplesperpixel=ifd.samplesperpixel;
+    layout.sampleformat=ifd.sampleformat;
+    layout.planarconfig=ifd.planarconfig;
+    layout.compression=ifd.compression;
+    layout.photometric=ifd.photometric;
+    directory.nativeok=CompleteDirectoryLayout(layout,ifd.rowsperstrip);
+    if (!scanner.ReadTileArrays(ifd,directory.offsets,directory.bytecounts)) return false;
+    if (directory.nativeok)
+    {
+      size_t nplanes=(layout.planarconfig == PLANARCONFIG_SEPARATE) ? layout.samplesperpixel : 1;
+      if (directory.offsets.size() != static_cast<size_t>(TilesAcross(layout))*TilesDown(layout)*nplanes) return false;
+    }
+    index.directories.push_back(directory);
+  }
+  status=INDEX_OK;
+  return true;
+}
+
+// Build By Walking The IFD Chain With libtiff
+static SlideIndexStatus ReadSlideIndex(const string &fn_slide, SlideIndex &index)
+{
+  TIFF *tif=TIFFOpen(fn_slide.c_str(), "r");
+  if (tif == NULL) return INDEX_OPEN_FAILED;
+
+  // Parse The Description In The First Directory
+  char *sdescription=0;
+  TIFFGetField(tif,TIFFTAG_IMAGEDESCRIPTION,&sdescription);
+  if (sdescription == NULL || !ParseSCNDescription(sdescription,index.description))
+  {
+    TIFFClose(tif);
+    return INDEX_XML_FAILED;
+  }
+  index.xmlhash=XXH64(sdescription,strlen(sdescription),0);
+
+  // Walk The IFD Chain Once
+  set<int> wanted=WantedDirectories(index.description);
+  int iTIFFdir=0;
+  do
+  {
+    if (wanted.count(iTIFFdir))
+    {
+      IndexedDirectory directory;
+      directory.ifd=iTIFFdir;
+      directory.diroffset=TIFFCurrentDirOffset(tif);
+      directory.nativeok=ReadDirectoryLayout(tif,directory.layout);
+      uint32 ntiles=directory.layout.tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+      uint64 *offsets=0, *bytecounts=0;
+      TIFFGetField(tif,directory.layout.tiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS,&offsets);
+      TIFFGetField(tif,directory.layout.tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS,&bytecounts);
+      if (offsets != NULL && bytecounts != NULL)
+      {
+        directory.offsets.assign(offsets,offsets+ntiles);
+        directory.bytecounts.assign(bytecounts,bytecounts+ntiles);
+      }
+      index.directories.push_back(directory);
+    }
+    iTIFFdir++;
+  } while (TIFFReadDirectory(tif));
+  TIFFClose(tif);
+  return INDEX_OK;
+}
+
+SlideIndexStatus BuildSlideIndex(const string &fn_slide, SlideIndex &index)
+{
+  index.directories.clear();
+  if (!StatSlide(fn_slide,index.filesize,index.mtime_sec,index.mtime_nsec)) return INDEX_OPEN_FAILED;
+  SlideIndexStatus status=INDEX_OK;
+  if (!ScanSlideIndex(fn_slide,index,status))
+  {
+    index.directories.clear();
+    status=ReadSlideIndex(fn_slide,index);
+  }
+  if (status != INDEX_OK) return status;
+  sort(index.directories.begin(),index.directories.end(),CompareIFD);
+  return INDEX_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Save / Load
+////////////////////////////////////////////////////////////////////////////////////////
+bool SaveSlideIndex(const string &fn_index, const SlideIndex &index)
+{
+  IndexBuffer out;
+  out.bytes.insert(out.bytes.end(),kIndexMagic,kIndexMagic+8);
+  out.Put<uint32_t>(kIndexVersion);
+  out.Put<uint64_t>(index.filesize);
+  out.Put<int64_t>(index.mtime_sec);
+  out.Put<int64_t>(index.mtime_nsec);
+  out.Put<uint64_t>(index.xmlhash);
+  out.Put<int64_t>(index.description.collectionSizeX);
+  out.Put<int64_t>(index.description.collectionSizeY);
+
+  out.Put<uint32_t>(index.description.fields.size());
+  for (size_t ii=0;ii<index.description.fields.size();ii++)
+  {
+    const SCNField &field=index.description.fields[ii];
+    out.Put<int32_t>(field.number);
+    out.Put<int64_t>(field.viewSizeX);
+    out.Put<int64_t>(field.viewSizeY);
+    out.Put<int64_t>(field.viewOffsetX);
+    out.Put<int64_t>(field.viewOffsetY);
+    out.Put<uint32_t>(field.dimensions.size());
+    for (size_t jj=0;jj<field.dimensions.size();jj++)
+    {
+      const SCNDimension &dimension=field.dimensions[jj];
+      out.Put<int32_t>(dimension.ifd);
+      out.Put<int32_t>(dimension.channel);
+      out.Put<int32_t>(dimension.r);
+      out.Put<int64_t>(dimension.sizeX);
+      out.Put<int64_t>(dimension.sizeY);
+    }
+  }
+
+  out.Put<uint32_t>(index.directories.size());
+  for (size_t ii=0;ii<index.directories.size();ii++)
+  {
+    const IndexedDirectory &directory=index.directories[ii];
+    const SCNDirectoryLayout &layout=directory.layout;
+    out.Put<int32_t>(directory.ifd);
+    out.Put<uint64_t>(directory.diroffset);
+    out.Put<uint8_t>(directory.nativeok ? 1 : 0);
+    out.Put<uint32_t>(layout.width);
+    out.Put<uint32_t>(layout.height);
+    out.Put<uint32_t>(layout.tilewidth);
+    out.Put<uint32_t>(layout.tilelength);
+    out.Put<uint8_t>(layout.tiled ? 1 : 0);
+    out.Put<uint16_t>(layout.bitspersample);
+    out.Put<uint16_t>(layout.samplesperpixel);
+    out.Put<uint16_t>(layout.sampleformat);
+    out.Put<uint16_t>(layout.planarconfig);
+    out.Put<uint16_t>(layout.compression);
+    out.Put<uint16_t>(layout.photometric);
+    out.Put<uint32_t>(layout.type);
+    out.Put<uint32_t>(directory.offsets.size());
+    for (size_t jj=0;jj<directory.offsets.size();jj++) out.Put<uint64_t>(directory.offsets[jj]);
+    for (size_t jj=0;jj<directory.bytecounts.size();jj++) out.Put<uint64_t>(directory.bytecounts[jj]);
+  }
+  out.Put<uint64_t>(XXH64(&out.bytes[0],out.bytes.size(),0));
+
+  // Write To A Temporary File And Rename, So Readers Never See A Partial Index
+  ostringstream convert;
+  convert << fn_index << ".tmp" << getpid();
+  string fn_tmp=convert.str();
+  FILE *fp=fopen(fn_tmp.c_str(),"wb");
+  if (fp == NULL) return false;
+  bool ok=(fwrite(&out.bytes[0],1,out.bytes.size(),fp) == out.bytes.size());
+  if (fclose(fp) != 0) ok=false;
+  if (ok) ok=(rename(fn_tmp.c_str(),fn_index.c_str()) == 0);
+  if (!ok) unlink(fn_tmp.c_str());
+  return ok;
+}
+
+bool LoadSlideIndex(const string &fn_index, const string &fn_slide, SlideIndex &index)
+{
+  ifstream ifile(fn_index.c_str(), ios::in | ios::binary);
+  if (!ifile) return false;
+  vector<char> bytes((istreambuf_iterator<char>(ifile)),istreambuf_iterator<char>());
+  if (bytes.size() < 8+sizeof(uint64_t) || memcmp(&bytes[0],kIndexMagic,8) != 0) return false;
+
+  // Check Integrity
+  size_t nbody=bytes.size()-sizeof(uint64_t);
+  uint64_t checksum;
+  memcpy(&checksum,&bytes[nbody],sizeof(uint64_t));
+  if (checksum != XXH64(&bytes[0],nbody,0)) return false;
+
+  // Check It Still Describes The Slide
+  IndexReader in(&bytes[8],&bytes[nbody]);
+  uint32_t version;
+  uint64_t filesize;
+  int64_t mtime_sec, mtime_nsec;
+  if (!in.Get(version) || version != kIndexVersion) return false;
+  if (!in.Get(index.filesize) || !in.Get(index.mtime_sec) || !in.Get(index.mtime_nsec)) return false;
+  if (!StatSlide(fn_slide,filesize,mtime_sec,mtime_nsec)) return false;
+  if (filesize != index.filesize || mtime_sec != index.mtime_sec || mtime_nsec != index.mtime_nsec) return false;
+
+  int64_t collectionSizeX, collectionSizeY;
+  uint32_t nfields;
+  if (!in.Get(index.xmlhash) || !in.Get(collectionSizeX) || !in.Get(collectionSizeY) || !in.Get(nfields)) return false;
+  index.description.collectionSizeX=collectionSizeX;
+  index.description.collectionSizeY=collectionSizeY;
+  index.description.fields.clear();
+  for (uint32_t ii=0;ii<nfields;ii++)
+  {
+    SCNField field;
+    int32_t number;
+    int64_t view[4];
+    uint32_t ndimensions;
+    if (!in.Get(number) || !in.Get(view[0]) || !in.Get(view[1]) || !in.Get(view[2]) || !in.Get(view[3]) ||
+        !in.Get(ndimensions)) return false;
+    field.number=number;
+    field.viewSizeX=view[0]; field.viewSizeY=view[1];
+    field.viewOffsetX=view[2]; field.viewOffsetY=view[3];
+    for (uint32_t jj=0;jj<ndimensions;jj++)
+    {
+      SCNDimension dimension;
+      int32_t ifd, channel, r;
+      int64_t sizeX, sizeY;
+      if (!in.Get(ifd) || !in.Get(channel) || !in.Get(r) || !in.Get(sizeX) || !in.Get(sizeY)) return false;
+      dimension.ifd=ifd; dimension.channel=channel; dimension.r=r;
+      dimension.sizeX=sizeX; dimension.sizeY=sizeY;
+      field.dimensions.push_back(dimension);
+    }
+    index.description.fields.push_back(field);
+  }
+
+  uint32_t ndirectories;
+  if (!in.Get(ndirectories)) return false;
+  index.directories.assign(ndirectories,IndexedDirectory());
+  for (uint32_t ii=0;ii<ndirectories;ii++)
+  {
+    IndexedDirectory &directory=index.directories[ii];
+    SCNDirectoryLayout &layout=directory.layout;
+    memset(&layout,0,sizeof(layout));
+    int32_t ifd;
+    uint8_t nativeok, tiled;
+    uint32_t type, ntiles;
+    if (!in.Get(ifd) || !in.Get(directory.diroffset) || !in.Get(nativeok) ||
+        !in.Get(layout.width) || !in.Get(layout.height) || !in.Get(layout.tilewidth) || !in.Get(layout.tilelength) ||
+        !in.Get(tiled) || !in.Get(layout.bitspersample) || !in.Get(layout.samplesperpixel) ||
+        !in.Get(layout.sampleformat) || !in.Get(layout.planarconfig) || !in.Get(layout.compression) ||
+        !in.Get(layout.photometric) || !in.Get(type) || !in.Get(ntiles)) return false;
+    directory.ifd=ifd;
+    directory.nativeok=(nativeok != 0);
+    layout.tiled=(tiled != 0);
+    layout.type=static_cast<SampleType>(type);
+    directory.offsets.resize(ntiles);
+    directory.bytecounts.resize(ntiles);
+    for (uint32_t jj=0;jj<ntiles;jj++) if (!in.Get(directory.offsets[jj])) return false;
+    for (uint32_t jj=0;jj<ntiles;jj++) if (!in.Get(directory.bytecounts[jj])) return false;
+  }
+  return true;
+}
+
+SlideIndexStatus OpenSlideIndex(const string &fn_slide, const string &fn_index, SlideIndex &index, bool &built)
+{
+  built=false;
+  if (!fn_index.empty() && LoadSlideIndex(fn_index,fn_slide,index)) return INDEX_OK;
+  SlideIndexStatus status=BuildSlideIndex(fn_slide,index);
+  if (status != INDEX_OK) return status;
+  built=true;
+  if (!fn_index.empty() && !SaveSlideIndex(fn_index,index))
+  {
+    cout << "WARNING (SlideIndex.cc): Could Not Save Slide Index " << fn_index << endl;
+  }
+  return INDEX_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Directory Access
+////////////////////////////////////////////////////////////////////////////////////////
+TIFF *OpenSlideHeaderOnly(const string &fn_slide)
+{
+  return TIFFOpen(fn_slide.c_str(), "rh");
+}
+
+bool SetIndexedDirectory(TIFF *tif, const IndexedDirectory &directory)
+{
+  if (!TIFFSetSubDirectory(tif,directory.diroffset)) return false;
+  PrepareDirectory(tif,directory.layout);
+  return true;
+}
@@ -0,0 +1,78 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Persistent Slide Metadata Index
+//
+// A compact binary sidecar (<slide>.scnidx) holding everything needed to read a Leica
+// .scn file without re-reading the IMAGEDESCRIPTION, reparsing the XML or walking the
+// IFD chain: the parsed fields, and for every directory they reference its IFD file
+// offset, pixel layout, and tile (or strip) offsets and byte counts.
+//
+// The index is built on first open and reused while the slide's size and mtime match.
+// Building it reads only the tags it needs with IFDScanner, not every tag of every
+// directory through libtiff.
+// Directories are then reached in O(1) with TIFFSetSubDirectory on a handle opened in
+// header-only mode.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SLIDEINDEX_H
+#define SLIDEINDEX_H
+
+#include "LeicaSCN.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// One Indexed TIFF Directory
+struct IndexedDirectory
+{
+  int ifd;
+  uint64_t diroffset;           // File offset of the IFD
+  bool nativeok;                // layout is supported by the native read path
+  SCNDirectoryLayout layout;
+  std::vector<uint64_t> offsets;    // Tile (or strip) file offsets
+  std::vector<uint64_t> bytecounts; // Tile (or strip) compressed sizes
+};
+
+struct SlideIndex
+{
+  uint64_t filesize;            // Validation: slide size and modification time
+  int64_t mtime_sec, mtime_nsec;
+  uint64_t xmlhash;             // XXH64 of the IMAGEDESCRIPTION
+  SCNDescription description;
+  std::vector<IndexedDirectory> directories; // Sorted by ifd
+
+  // Find A Directory By Its TIFF Directory Number, NULL If Not Indexed
+  const IndexedDirectory *FindDirectory(int ifd) const;
+};
+
+// Index Status, Matching The Converter Exit Codes
+enum SlideIndexStatus
+{
+  INDEX_OK=0,
+  INDEX_OPEN_FAILED=1,
+  INDEX_XML_FAILED=2
+};
+
+// Sidecar Filename: <slide>.scnidx Next To The Slide, Or In indexdir If Given
+std::string SlideIndexFilename(const std::string &fn_slide, const std::string &indexdir);
+
+// Build An Index By Scanning The IFD Chain With IFDScanner, Falling Back To libtiff If
+// The Scanner Cannot Make Sense Of The File
+SlideIndexStatus BuildSlideIndex(const std::string &fn_slide, SlideIndex &index);
+
+// Save / Load A Sidecar. Loading Fails If The File Is Damaged Or Does Not Match The
+// Current Size And mtime Of The Slide.
+bool SaveSlideIndex(const std::string &fn_index, const SlideIndex &index);
+bool LoadSlideIndex(const std::string &fn_index, const std::string &fn_slide, SlideIndex &index);
+
+// Load The Sidecar If It Is Valid, Otherwise Build It And Try To Save It. An Empty
+// fn_index Disables The Sidecar. built Reports Whether The Slide Had To Be Read.
+SlideIndexStatus OpenSlideIndex(const std::string &fn_slide, const std::string &fn_index, SlideIndex &index,
+                                bool &built);
+
+// Open A Slide Without Reading Any Directory, And Move A Handle To An Indexed Directory
+TIFF *OpenSlideHeaderOnly(const std::string &fn_slide);
+bool SetIndexedDirectory(TIFF *tif, const IndexedDirectory &directory);
+
+#endif
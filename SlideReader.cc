@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Leica SCN400F Slide Reader
+// See SlideReader.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SlideReader.h"
+#include <string.h>
+#include <atomic>
+using namespace std;
+
+// Process-Wide Reader Ids, So Cache Keys Of Different Slides Never Collide
+static atomic<uint64_t> nextreaderid(1);
+
+SlideReader::SlideReader() : id(0), cache(NULL)
+{
+}
+
+SlideReader::~SlideReader()
+{
+  Close();
+}
+
+SlideIndexStatus SlideReader::Open(const string &fn_slide, const string &fn_index)
+{
+  Close();
+  bool built;
+  SlideIndexStatus status=OpenSlideIndex(fn_slide,fn_index,index,built);
+  if (status != INDEX_OK) return status;
+  filename=fn_slide;
+  id=nextreaderid++;
+
+  // Keep One Handle Open So A Missing File Is Reported Here
+  Handle handle;
+  if (!AcquireHandle(handle)) return INDEX_OPEN_FAILED;
+  ReleaseHandle(handle);
+  return INDEX_OK;
+}
+
+void SlideReader::Close()
+{
+  lock_guard<mutex> guard(handlelock);
+  for (size_t ii=0;ii<handles.size();ii++) TIFFClose(handles[ii].tif);
+  handles.clear();
+}
+
+const IndexedDirectory *SlideReader::FindChannel(size_t field, int channel, int r) const
+{
+  if (field >= index.description.fields.size()) return NULL;
+  const vector<SCNDimension> &dimensions=index.description.fields[field].dimensions;
+  for (size_t ii=0;ii<dimensions.size();ii++)
+  {
+    if (dimensions[ii].channel != channel || dimensions[ii].r != r) continue;
+    const IndexedDirectory *directory=index.FindDirectory(dimensions[ii].ifd);
+    if (directory == NULL || !directory->nativeok) return NULL;
+    return directory;
+  }
+  return NULL;
+}
+
+bool SlideReader::AcquireHandle(Handle &handle)
+{
+  {
+    lock_guard<mutex> guard(handlelock);
+    if (!handles.empty())
+    {
+      handle=handles.back();
+      handles.pop_back();
+      return true;
+    }
+  }
+  handle.tif=OpenSlideHeaderOnly(filename);
+  handle.ifd=-1;
+  return (handle.tif != NULL);
+}
+
+void SlideReader::ReleaseHandle(const Handle &handle)
+{
+  lock_guard<mutex> guard(handlelock);
+  handles.push_back(handle);
+}
+
+SCNReadStatus SlideReader::ReadTile(const IndexedDirectory &directory, uint32 itile, shared_ptr<const DecodedTile> &tile)
+{
+  TileKey key;
+  key.slide=id;
+  key.ifd=directory.ifd;
+  key.tile=itile;
+  if (cache != NULL)
+  {
+    tile=cache->Find(key);
+    if (tile) return SCN_READ_OK;
+  }
+
+  // Decode On A Pooled Handle, Moving It To The Directory Only When Needed
+  Handle handle;
+  if (!AcquireHandle(handle)) return SCN_READ_FAILED;
+  if (handle.ifd != directory.ifd)
+  {
+    if (!SetIndexedDirectory(handle.tif,directory))
+    {
+      TIFFClose(handle.tif);
+      return SCN_READ_FAILED;
+    }
+    handle.ifd=directory.ifd;
+  }
+  tmsize_t tilesize=directory.layout.tiled ? TIFFTileSize(handle.tif) : TIFFStripSize(handle.tif);
+  shared_ptr<DecodedTile> decoded(new DecodedTile());
+  if (tilesize > 0) decoded->data.resize(tilesize);
+  tmsize_t nread=(tilesize > 0) ? DecodeTile(handle.tif,directory.layout,itile,&decoded->data[0],tilesize) : -1;
+  ReleaseHandle(handle);
+  if (nread < 0) return SCN_READ_FAILED;
+
+  tile=decoded;
+  if (cache != NULL) cache->Insert(key,tile);
+  return SCN_READ_OK;
+}
+
+SCNReadStatus SlideReader::ReadRegion(const IndexedDirectory &directory, int channel, long x, long y, uint32 ww,
+                                      uint32 hh, uint8 *out, size_t outrowbytes)
+{
+  const SCNDirectoryLayout &layout=directory.layout;
+  int sample=ChannelSample(layout,channel);
+  if (!directory.nativeok || sample < 0) return SCN_READ_FAILED;
+  size_t nbytes=SampleBytes(layout.type);
+
+  // Zero Everything First When The Region Reaches Outside The Image
+  if (x < 0 || y < 0 || x+static_cast<long>(ww) > static_cast<long>(layout.width) ||
+      y+static_cast<long>(hh) > static_cast<long>(layout.height))
+  {
+    for (uint32 yy=0;yy<hh;yy++) memset(out+yy*outrowbytes,0,ww*nbytes);
+  }
+
+  // Clip To The Image
+  long x0=(x > 0) ? x : 0, y0=(y > 0) ? y : 0;
+  long x1=x+static_cast<long>(ww), y1=y+static_cast<long>(hh);
+  if (x1 > static_cast<long>(layout.width)) x1=layout.width;
+  if (y1 > static_cast<long>(layout.height)) y1=layout.height;
+  if (x0 >= x1 || y0 >= y1) return SCN_READ_OK;
+
+  // Copy From Every Overlapping Tile
+  for (uint32 row=y0/layout.tilelength;row<=static_cast<uint32>((y1-1)/layout.tilelength);row++)
+  {
+    long ty0=static_cast<long>(row)*layout.tilelength;
+    long ry0=(y0 > ty0) ? y0 : ty0;
+    long ry1=(y1 < ty0+static_cast<long>(layout.tilelength)) ? y1 : ty0+layout.tilelength;
+    for (uint32 col=x0/layout.tilewidth;col<=static_cast<uint32>((x1-1)/layout.tilewidth);col++)
+    {
+      long tx0=static_cast<long>(col)*layout.tilewidth;
+      long rx0=(x0 > tx0) ? x0 : tx0;
+      long rx1=(x1 < tx0+static_cast<long>(layout.tilewidth)) ? x1 : tx0+layout.tilewidth;
+
+      shared_ptr<const DecodedTile> tile;
+      SCNReadStatus status=ReadTile(directory,TileIndex(layout,col,row,sample),tile);
+      if (status != SCN_READ_OK) return status;
+      if (tile->data.size() < static_cast<size_t>(ry1-ty0-1)*layout.tilewidth*TilePixelBytes(layout)+
+                              static_cast<size_t>(rx1-tx0)*TilePixelBytes(layout)) return SCN_READ_FAILED;
+
+      uint8 *dst=out+(ry0-y)*outrowbytes+(rx0-x)*nbytes;
+      CopyTileSamples(layout,&tile->data[0],sample,rx0-tx0,ry0-ty0,rx1-rx0,ry1-ry0,dst,outrowbytes,1);
+    }
+  }
+  return SCN_READ_OK;
+}
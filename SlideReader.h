@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Leica SCN400F Slide Reader
+//
+// Library access to an opened slide: fields and channels come from the metadata
+// index, tiles are decoded at native bit depth (optionally through a shared
+// TileCache), and arbitrary regions of one channel can be read top row first.
+//
+// All read functions are thread-safe; each thread borrows its own TIFF handle from
+// a small pool kept by the reader.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SLIDEREADER_H
+#define SLIDEREADER_H
+
+#include "LeicaSCN.h"
+#include "SlideIndex.h"
+#include "TileCache.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SlideReader
+{
+public:
+  SlideReader();
+  ~SlideReader();
+
+  // Open A Slide Through Its Metadata Index (fn_index As In OpenSlideIndex)
+  SlideIndexStatus Open(const std::string &fn_slide, const std::string &fn_index);
+  void Close();
+
+  // Share A Decoded Tile Cache Between Readers (NULL Disables Caching)
+  void SetTileCache(TileCache *cache_) { cache=cache_; }
+
+  const std::string &Filename() const { return filename; }
+  const SlideIndex &Index() const { return index; }
+  uint64_t Id() const { return id; }
+
+  // Directory Holding A Channel Of A Field (Position In Index().description.fields)
+  // At Resolution Level r, NULL If There Is None Or It Cannot Be Read Natively
+  const IndexedDirectory *FindChannel(size_t field, int channel, int r) const;
+
+  // Decode One Tile (Or Strip) Of A Directory, Through The Cache When One Is Set
+  SCNReadStatus ReadTile(const IndexedDirectory &directory, uint32 itile, std::shared_ptr<const DecodedTile> &tile);
+
+  // Read A ww x hh Region Of One Channel Starting At (x,y), Top Row First, At Native
+  // Bit Depth. Rows Of out Are outrowbytes Apart; Pixels Outside The Image Are Zero.
+  SCNReadStatus ReadRegion(const IndexedDirectory &directory, int channel, long x, long y, uint32 ww, uint32 hh,
+                           uint8 *out, size_t outrowbytes);
+
+private:
+  SlideReader(const SlideReader &);
+  SlideReader &operator=(const SlideReader &);
+
+  // Pooled TIFF Handle, Remembering Which Directory It Is On
+  struct Handle
+  {
+    TIFF *tif;
+    int ifd;
+  };
+  bool AcquireHandle(Handle &handle);
+  void ReleaseHandle(const Handle &handle);
+
+  std::string filename;
+  SlideIndex index;
+  uint64_t id;
+  TileCache *cache;
+  std::mutex handlelock;
+  std::vector<Handle> handles;
+};
+
+#endif
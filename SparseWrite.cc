@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Sparse Writes: All-Zero Blocks Left As Filesystem Holes
+// See SparseWrite.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "SparseWrite.h"
+#include "IOHelpers.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Zero Check
+////////////////////////////////////////////////////////////////////////////////////////
+static bool AllZeroWords(const unsigned char *p, size_t nbytes)
+{
+  while (nbytes >= 8)
+  {
+    uint64_t word;
+    memcpy(&word,p,8);
+    if (word != 0) return false;
+    p+=8; nbytes-=8;
+  }
+  while (nbytes > 0)
+  {
+    if (*p != 0) return false;
+    p++; nbytes--;
+  }
+  return true;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// SSE2 Is Part Of x86-64, 64 Bytes At A Time
+static bool AllZeroSSE2(const unsigned char *p, size_t nbytes)
+{
+  const __m128i zero=_mm_setzero_si128();
+  while (nbytes >= 64)
+  {
+    __m128i v=_mm_or_si128(_mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p+16))),
+                           _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p+32)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p+48))));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v,zero)) != 0xFFFF) return false;
+    p+=64; nbytes-=64;
+  }
+  return AllZeroWords(p,nbytes);
+}
+
+// AVX2, 128 Bytes At A Time; Selected At Run Time So The Default Build Still Runs On
+// Older CPUs
+__attribute__((target("avx2")))
+static bool AllZeroAVX2(const unsigned char *p, size_t nbytes)
+{
+  while (nbytes >= 128)
+  {
+    __m256i v=_mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)),
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+32))),
+                              _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+64)),
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+96))));
+    if (!_mm256_testz_si256(v,v)) return false;
+    p+=128; nbytes-=128;
+  }
+  return AllZeroWords(p,nbytes);
+}
+
+static const bool kHaveAVX2=__builtin_cpu_supports("avx2");
+#endif
+
+bool AllZero(const void *data, size_t nbytes)
+{
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (kHaveAVX2) return AllZeroAVX2(p,nbytes);
+  return AllZeroSSE2(p,nbytes);
+#else
+  return AllZeroWords(p,nbytes);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Writing
+////////////////////////////////////////////////////////////////////////////////////////
+// Write One Run Of Blocks That Are All Zero Or All Not
+static bool WriteRun(int fd, const char *src, size_t nbytes, uint64_t offset, bool zero, bool punch, uint64_t *nholes)
+{
+  if (!zero) return PwriteAll(fd,src,nbytes,offset);
+  if (punch)
+  {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(fd,FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,offset,nbytes) != 0)
+#endif
+    {
+      // No Hole Punching On This Filesystem: Write The Zeros
+      return PwriteAll(fd,src,nbytes,offset);
+    }
+  }
+  if (nholes != NULL) *nholes+=nbytes;
+  return true;
+}
+
+bool PwriteSparse(int fd, const void *data, size_t nbytes, uint64_t offset, bool punch, uint64_t *nholes)
+{
+  const char *src=static_cast<const char *>(data);
+  uint64_t end=offset+nbytes;
+  uint64_t runstart=offset;
+  bool runzero=false;
+  for (uint64_t pos=offset;pos<end;)
+  {
+    uint64_t blockend=(pos/kSparseBlock+1)*kSparseBlock;
+    if (blockend > end) blockend=end;
+    bool zero=AllZero(src+(pos-offset),blockend-pos);
+    if (pos == offset) runzero=zero;
+    else if (zero != runzero)
+    {
+      if (!WriteRun(fd,src+(runstart-offset),pos-runstart,runstart,runzero,punch,nholes)) return false;
+      runstart=pos;
+      runzero=zero;
+    }
+    pos=blockend;
+  }
+  if (end > runstart) return WriteRun(fd,src+(runstart-offset),end-runstart,runstart,runzero,punch,nholes);
+  return true;
+}
@@ -0,0 +1,35 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Sparse Writes: All-Zero Blocks Left As Filesystem Holes
+//
+// Dark background in fluorescence slides decodes to long runs of zero samples. A
+// sparse write checks the data block by block (blocks aligned to file offsets) and
+// writes only the blocks holding a non-zero byte. Zero blocks are skipped, which
+// leaves holes in a freshly created or truncated file, or are punched out with
+// fallocate(FALLOC_FL_PUNCH_HOLE) where the file may already hold data. Holes read
+// back as zeros, so the file contents and layout are exactly those of a dense write.
+//
+// The zero check is vectorised: AVX2 when the CPU has it (chosen at run time), SSE2
+// otherwise on x86-64, and 64 bit words elsewhere.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SPARSEWRITE_H
+#define SPARSEWRITE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Zero Check Granularity; A Multiple Of The O_DIRECT Alignment And Of Common
+// Filesystem Block Sizes
+static const size_t kSparseBlock=64*1024;
+
+// Whether Every Byte Of [data, data+nbytes) Is Zero
+bool AllZero(const void *data, size_t nbytes);
+
+// pwrite All Of data At offset, Skipping (Or With punch, Punching Out) All-Zero
+// Blocks. Adds The Bytes Not Written To *nholes When Given. The File Size Is Not
+// Extended Over A Trailing Hole; Size The File First (ftruncate).
+bool PwriteSparse(int fd, const void *data, size_t nbytes, uint64_t offset, bool punch, uint64_t *nholes=NULL);
+
+#endif
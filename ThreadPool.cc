@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Fixed Size Thread Pool
+// See ThreadPool.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+using namespace std;
+
+ThreadPool::ThreadPool(int nthreads) : stopping(false)
+{
+  if (nthreads <= 0) nthreads=static_cast<int>(thread::hardware_concurrency());
+  if (nthreads <= 0) nthreads=1;
+  for (int ii=0;ii<nthreads;ii++) workers.push_back(thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    stopping=true;
+  }
+  cv.notify_all();
+  for (size_t ii=0;ii<workers.size();ii++) workers[ii].join();
+}
+
+void ThreadPool::Submit(const function<void()> &task)
+{
+  {
+    lock_guard<mutex> guard(lock);
+    tasks.push_back(task);
+  }
+  cv.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  while (true)
+  {
+    function<void()> task;
+    {
+      unique_lock<mutex> guard(lock);
+      while (tasks.empty() && !stopping) cv.wait(guard);
+      if (tasks.empty()) return;
+      task=tasks.front();
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+// Shared State Of One ParallelFor Call
+struct ParallelForState
+{
+  size_t n;
+  const function<void(size_t)> *body;
+  atomic<size_t> next;
+  size_t nactive; // Helpers currently running
+  bool finished;  // The caller is done; helpers starting now have nothing to do
+  mutex lock;
+  condition_variable done;
+};
+
+static void RunParallelFor(ParallelForState &state)
+{
+  size_t ii;
+  while ((ii=state.next++) < state.n) (*state.body)(ii);
+}
+
+static void HelpParallelFor(ParallelForState &state)
+{
+  {
+    lock_guard<mutex> guard(state.lock);
+    if (state.finished) return;
+    state.nactive++;
+  }
+  RunParallelFor(state);
+  lock_guard<mutex> guard(state.lock);
+  if (--state.nactive == 0) state.done.notify_all();
+}
+
+void ThreadPool::ParallelFor(size_t n, const function<void(size_t)> &body)
+{
+  if (n == 0) return;
+
+  // Indexes Are Handed Out One At A Time, So Uneven Work Balances Itself. The Calling
+  // Thread Takes Part And Only Waits For Helpers That Actually Started, So Nested
+  // Calls From Inside A Task Cannot Deadlock.
+  shared_ptr<ParallelForState> state(new ParallelForState());
+  state->n=n;
+  state->body=&body;
+  state->next=0;
+  state->nactive=0;
+  state->finished=false;
+  size_t nhelpers=(n-1 < workers.size()) ? n-1 : workers.size();
+  for (size_t ii=0;ii<nhelpers;ii++) Submit([state]() { HelpParallelFor(*state); });
+  RunParallelFor(*state);
+
+  unique_lock<mutex> guard(state->lock);
+  state->finished=true;
+  while (state->nactive > 0) state->done.wait(guard);
+}
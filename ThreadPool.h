@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Fixed Size Thread Pool
+//
+// Runs submitted tasks on a fixed set of worker threads. ParallelFor splits an index
+// range across the workers and the calling thread and blocks until it is done.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // nthreads <= 0 Uses One Worker Per Hardware Thread
+  explicit ThreadPool(int nthreads);
+  ~ThreadPool();
+
+  int Size() const { return static_cast<int>(workers.size()); }
+
+  // Queue A Task To Run On A Worker
+  void Submit(const std::function<void()> &task);
+
+  // Run body(0) ... body(n-1) On The Workers And The Calling Thread
+  void ParallelFor(size_t n, const std::function<void(size_t)> &body);
+
+private:
+  ThreadPool(const ThreadPool &);
+  ThreadPool &operator=(const ThreadPool &);
+
+  void WorkerLoop();
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()> > tasks;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool stopping;
+};
+
+#endif
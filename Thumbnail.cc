@@ -0,0 +1,290 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Field Thumbnails
+// See Thumbnail.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Thumbnail.h"
+#include "ChannelStats.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <thread>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Area Filter
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Source Pixels And Weights Covering Each Output Pixel Along One Axis
+struct AreaTaps
+{
+  vector<uint32_t> first, count, start; // Per output pixel
+  vector<float> weights;
+};
+
+static void AreaWeights(uint32_t ns, uint32_t nd, AreaTaps &taps)
+{
+  double scale=static_cast<double>(ns)/nd;
+  for (uint32_t od=0;od<nd;od++)
+  {
+    double a=od*scale, b=(od+1)*scale;
+    uint32_t i0=static_cast<uint32_t>(floor(a));
+    uint32_t i1=static_cast<uint32_t>(ceil(b));
+    if (i1 > ns) i1=ns;
+    if (i1 <= i0) i1=i0+1;
+    taps.first.push_back(i0);
+    taps.count.push_back(i1-i0);
+    taps.start.push_back(taps.weights.size());
+    for (uint32_t ii=i0;ii<i1;ii++)
+    {
+      double lo=(a > ii) ? a : ii;
+      double hi=(b < ii+1) ? b : ii+1;
+      taps.weights.push_back(static_cast<float>((hi > lo ? hi-lo : 0.0)/scale));
+    }
+  }
+}
+
+// acc[x] += weight*row[x]
+static void AccumulateRow(float *acc, const float *row, float weight, uint32_t ww)
+{
+  uint32_t xx=0;
+#ifdef __SSE2__
+  __m128 w=_mm_set1_ps(weight);
+  for (;xx+4<=ww;xx+=4)
+  {
+    __m128 sum=_mm_add_ps(_mm_loadu_ps(acc+xx),_mm_mul_ps(w,_mm_loadu_ps(row+xx)));
+    _mm_storeu_ps(acc+xx,sum);
+  }
+#endif
+  for (;xx<ww;xx++) acc[xx]+=weight*row[xx];
+}
+
+void ResizeArea(const float *src, uint32_t sw, uint32_t sh, float *dst, uint32_t dw, uint32_t dh)
+{
+  AreaTaps horizontal, vertical;
+  AreaWeights(sw,dw,horizontal);
+  AreaWeights(sh,dh,vertical);
+
+  // Vertical Pass First, Vectorised Across Whole Source Rows
+  vector<float> rows(static_cast<size_t>(sw)*dh,0.0f);
+  for (uint32_t oy=0;oy<dh;oy++)
+  {
+    float *acc=&rows[static_cast<size_t>(oy)*sw];
+    for (uint32_t it=0;it<vertical.count[oy];it++)
+    {
+      const float *row=src+static_cast<size_t>(vertical.first[oy]+it)*sw;
+      AccumulateRow(acc,row,vertical.weights[vertical.start[oy]+it],sw);
+    }
+  }
+
+  // Horizontal Pass On The Much Smaller Intermediate Image
+  for (uint32_t oy=0;oy<dh;oy++)
+  {
+    const float *row=&rows[static_cast<size_t>(oy)*sw];
+    float *out=dst+static_cast<size_t>(oy)*dw;
+    for (uint32_t ox=0;ox<dw;ox++)
+    {
+      const float *weights=&horizontal.weights[horizontal.start[ox]];
+      const float *pixels=row+horizontal.first[ox];
+      float sum=0.0f;
+      for (uint32_t it=0;it<horizontal.count[ox];it++) sum+=weights[it]*pixels[it];
+      out[ox]=sum;
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Thumbnail Rendering
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Convert Samples To Display Values (value-offset)*gain, Flipping Bottom-Up Data
+template <class T>
+static void ToDisplay(const uint8 *data, uint32_t ww, uint32_t hh, bool bottomup, double offset, double gain, float *out)
+{
+  const T *values=reinterpret_cast<const T *>(data);
+  for (uint32_t yy=0;yy<hh;yy++)
+  {
+    const T *row=values+static_cast<size_t>(bottomup ? hh-1-yy : yy)*ww;
+    float *dst=out+static_cast<size_t>(yy)*ww;
+    for (uint32_t xx=0;xx<ww;xx++)
+    {
+      double value=(static_cast<double>(row[xx])-offset)*gain;
+      dst[xx]=(value == value) ? static_cast<float>(value) : 0.0f;
+    }
+  }
+}
+
+static void ToDisplay(SampleType type, const uint8 *data, uint32_t ww, uint32_t hh, bool bottomup, double offset,
+                      double gain, float *out)
+{
+  switch (type)
+  {
+    case SAMPLE_UINT8: ToDisplay<uint8_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_INT8: ToDisplay<int8_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_UINT16: ToDisplay<uint16_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_INT16: ToDisplay<int16_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_UINT32: ToDisplay<uint32_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_INT32: ToDisplay<int32_t>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_FLOAT32: ToDisplay<float>(data,ww,hh,bottomup,offset,gain,out); break;
+    case SAMPLE_FLOAT64: ToDisplay<double>(data,ww,hh,bottomup,offset,gain,out); break;
+  }
+}
+
+// Read One Channel Of The Chosen Level And Shrink It Into Component ic Of The Thumbnail
+static void RenderThumbnailChannel(const string &fn_slide, const IndexedDirectory *directory, int channel,
+                                   bool autocontrast, Thumbnail *thumbnail, int ic, int *status)
+{
+  const SCNDirectoryLayout &layout=directory->layout;
+  uint32_t ww=layout.width, hh=layout.height;
+  size_t Npixels=static_cast<size_t>(ww)*hh;
+  SampleType type=directory->nativeok ? layout.type : SAMPLE_UINT8;
+
+  // Decode The Whole Directory
+  TIFF *tif=OpenSlideHeaderOnly(fn_slide);
+  if (tif == NULL) {*status=SCN_READ_FAILED; return;}
+  uint8 *data=new (nothrow) uint8[Npixels*SampleBytes(type)];
+  if (data == NULL) {TIFFClose(tif); *status=SCN_READ_NOMEMORY; return;}
+  ChannelStats stats(type);
+  ChannelStats *pstats=autocontrast ? &stats : NULL;
+  if (!SetIndexedDirectory(tif,*directory)) *status=SCN_READ_FAILED;
+  else if (directory->nativeok) *status=ReadChannelNative(tif,layout,channel,data,1,false,pstats);
+  else *status=ReadChannelRGBA(tif,ww,hh,channel,data,1,pstats);
+  TIFFClose(tif);
+  if (*status != SCN_READ_OK) {delete [] data; return;}
+
+  // Map To 0-255
+  double offset=0.0;
+  double gain=directory->nativeok ? DisplayScale(layout) : 1.0;
+  if (autocontrast)
+  {
+    ChannelSummary summary=stats.Summary();
+    if (summary.percentiles.size() == 9 && summary.percentiles[8].second > summary.percentiles[0].second)
+    {
+      offset=summary.percentiles[0].second;
+      gain=255.0/(summary.percentiles[8].second-offset);
+    }
+  }
+  float *display=new (nothrow) float[Npixels];
+  float *small=new (nothrow) float[static_cast<size_t>(thumbnail->width)*thumbnail->height];
+  if (display == NULL || small == NULL)
+  {
+    delete [] data;
+    delete [] display;
+    delete [] small;
+    *status=SCN_READ_NOMEMORY;
+    return;
+  }
+  ToDisplay(type,data,ww,hh,!directory->nativeok,offset,gain,display);
+  delete [] data;
+
+  ResizeArea(display,ww,hh,small,thumbnail->width,thumbnail->height);
+  delete [] display;
+  size_t Nsmall=static_cast<size_t>(thumbnail->width)*thumbnail->height;
+  for (size_t ii=0;ii<Nsmall;ii++)
+  {
+    float value=small[ii]+0.5f;
+    thumbnail->pixels[ii*thumbnail->components+ic]=(value > 0.0f) ? ((value < 255.0f) ? static_cast<uint8>(value) : 255) : 0;
+  }
+  delete [] small;
+}
+
+SCNReadStatus RenderThumbnail(const string &fn_slide, const SlideIndex &index, size_t field,
+                              const ThumbnailOptions &options, Thumbnail &thumbnail)
+{
+  if (field >= index.description.fields.size() || options.size == 0) return SCN_READ_FAILED;
+  const vector<SCNDimension> &dimensions=index.description.fields[field].dimensions;
+
+  // Channels To Show
+  vector<int> channels;
+  for (size_t ii=0;ii<dimensions.size();ii++)
+  {
+    if (dimensions[ii].r != 0) continue;
+    if (options.channel >= 0 && dimensions[ii].channel != options.channel) continue;
+    channels.push_back(dimensions[ii].channel);
+  }
+  sort(channels.begin(),channels.end());
+  channels.erase(unique(channels.begin(),channels.end()),channels.end());
+  if (channels.empty()) return SCN_READ_FAILED;
+  if (channels.size() > 3) channels.resize(3);
+
+  // Directories Of Every Level Of The First Channel
+  vector<const IndexedDirectory *> levels;
+  vector<int> levelr;
+  const IndexedDirectory *full=NULL;
+  for (size_t ii=0;ii<dimensions.size();ii++)
+  {
+    if (dimensions[ii].channel != channels[0]) continue;
+    const IndexedDirectory *directory=index.FindDirectory(dimensions[ii].ifd);
+    if (directory == NULL) continue;
+    levels.push_back(directory);
+    levelr.push_back(dimensions[ii].r);
+    if (dimensions[ii].r == 0) full=directory;
+  }
+  if (full == NULL) return SCN_READ_FAILED;
+
+  // Thumbnail Size, Keeping The Aspect Ratio Of The Full Resolution Image
+  uint32_t w0=full->layout.width, h0=full->layout.height;
+  uint32_t longest=(w0 > h0) ? w0 : h0;
+  uint32_t size=(options.size < longest) ? options.size : longest;
+  thumbnail.width=static_cast<uint32_t>(floor(static_cast<double>(w0)*size/longest+0.5));
+  thumbnail.height=static_cast<uint32_t>(floor(static_cast<double>(h0)*size/longest+0.5));
+  if (thumbnail.width == 0) thumbnail.width=1;
+  if (thumbnail.height == 0) thumbnail.height=1;
+
+  // Smallest Level Still At Least As Large As The Thumbnail
+  const IndexedDirectory *chosen=full;
+  thumbnail.r=0;
+  for (size_t ii=0;ii<levels.size();ii++)
+  {
+    const SCNDirectoryLayout &layout=levels[ii]->layout;
+    if (layout.width < thumbnail.width || layout.height < thumbnail.height) continue;
+    if (static_cast<uint64_t>(layout.width)*layout.height < static_cast<uint64_t>(chosen->layout.width)*chosen->layout.height)
+    {
+      chosen=levels[ii];
+      thumbnail.r=levelr[ii];
+    }
+  }
+  thumbnail.sourcewidth=chosen->layout.width;
+  thumbnail.sourceheight=chosen->layout.height;
+
+  // The Same Level Of Every Channel, Which Must Match In Size
+  vector<const IndexedDirectory *> directories;
+  for (size_t ic=0;ic<channels.size();ic++)
+  {
+    const IndexedDirectory *directory=NULL;
+    for (size_t ii=0;ii<dimensions.size();ii++)
+    {
+      if (dimensions[ii].channel == channels[ic] && dimensions[ii].r == thumbnail.r)
+      {
+        directory=index.FindDirectory(dimensions[ii].ifd);
+      }
+    }
+    if (directory == NULL || directory->layout.width != chosen->layout.width ||
+        directory->layout.height != chosen->layout.height) return SCN_READ_FAILED;
+    directories.push_back(directory);
+  }
+
+  // Render All Channels Concurrently
+  thumbnail.components=(channels.size() == 1) ? 1 : 3;
+  thumbnail.pixels.assign(static_cast<size_t>(thumbnail.width)*thumbnail.height*thumbnail.components,0);
+  vector<int> status(channels.size(),0);
+  vector<thread> workers;
+  for (size_t ic=0;ic<channels.size();ic++)
+  {
+    workers.push_back(thread(RenderThumbnailChannel,cref(fn_slide),directories[ic],channels[ic],options.autocontrast,
+                             &thumbnail,static_cast<int>(ic),&status[ic]));
+  }
+  for (size_t ic=0;ic<workers.size();ic++) workers[ic].join();
+  for (size_t ic=0;ic<status.size();ic++)
+  {
+    if (status[ic] != SCN_READ_OK) return static_cast<SCNReadStatus>(status[ic]);
+  }
+  return SCN_READ_OK;
+}
@@ -0,0 +1,50 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Field Thumbnails
+//
+// Renders a small overview of one field without touching the full resolution data:
+// the smallest stored resolution level that is at least as large as the requested
+// thumbnail is decoded (one thread per channel), converted to 8 bits and shrunk with
+// an area filter (SSE2 when available).
+//
+// One channel gives a grayscale thumbnail; two or three channels are shown as red,
+// green and blue in increasing channel order.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include "LeicaSCN.h"
+#include "SlideIndex.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Thumbnail Settings
+struct ThumbnailOptions
+{
+  uint32_t size;     // Longest side of the thumbnail in pixels
+  int channel;       // Single channel to show, -1 for up to the first three
+  bool autocontrast; // Stretch each channel from its 0.1 to 99.9 percentile
+
+  ThumbnailOptions() : size(512), channel(-1), autocontrast(false) {}
+};
+
+struct Thumbnail
+{
+  uint32_t width, height;
+  int components;               // 1 = gray, 3 = RGB
+  std::vector<uint8_t> pixels;  // Interleaved, top row first
+  int r;                        // Resolution level read
+  uint32_t sourcewidth, sourceheight;
+};
+
+// Render A Thumbnail Of One Field (Position In index.description.fields)
+SCNReadStatus RenderThumbnail(const std::string &fn_slide, const SlideIndex &index, size_t field,
+                              const ThumbnailOptions &options, Thumbnail &thumbnail);
+
+// Resize A Single-Channel Float Image With An Area (Box) Filter
+void ResizeArea(const float *src, uint32_t sw, uint32_t sh, float *dst, uint32_t dw, uint32_t dh);
+
+#endif
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Decoded Tile Cache
+// See TileCache.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "TileCache.h"
+using namespace std;
+
+TileCache::TileCache(size_t capacity_, int nshards)
+  : capacity(capacity_), hits(0), misses(0), insertions(0), evictions(0)
+{
+  if (nshards < 1) nshards=1;
+  for (int ii=0;ii<nshards;ii++)
+  {
+    shards.push_back(unique_ptr<Shard>(new Shard()));
+    shards.back()->bytes=0;
+  }
+  shardcapacity=capacity/nshards;
+}
+
+TileCache::Shard &TileCache::ShardFor(const TileKey &key)
+{
+  // Use The High Bits Of The Hash; The Low Bits Pick Buckets Inside The Shard
+  uint64_t h=TileKeyHash()(key);
+  return *shards[(h >> 40) % shards.size()];
+}
+
+size_t TileCache::EntryBytes(const DecodedTile &tile)
+{
+  return tile.data.capacity()+sizeof(DecodedTile)+sizeof(Entry);
+}
+
+shared_ptr<const DecodedTile> TileCache::Find(const TileKey &key)
+{
+  Shard &shard=ShardFor(key);
+  lock_guard<mutex> guard(shard.lock);
+  unordered_map<TileKey, list<Entry>::iterator, TileKeyHash>::iterator it=shard.entries.find(key);
+  if (it == shard.entries.end())
+  {
+    misses++;
+    return shared_ptr<const DecodedTile>();
+  }
+  shard.lru.splice(shard.lru.begin(),shard.lru,it->second);
+  hits++;
+  return it->second->second;
+}
+
+void TileCache::Insert(const TileKey &key, const shared_ptr<const DecodedTile> &tile)
+{
+  if (!tile) return;
+  size_t nbytes=EntryBytes(*tile);
+  if (nbytes > shardcapacity) return;
+
+  Shard &shard=ShardFor(key);
+  lock_guard<mutex> guard(shard.lock);
+
+  // Replace An Existing Entry (Another Thread Decoded The Same Tile)
+  unordered_map<TileKey, list<Entry>::iterator, TileKeyHash>::iterator it=shard.entries.find(key);
+  if (it != shard.entries.end())
+  {
+    shard.bytes-=EntryBytes(*it->second->second);
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+  }
+
+  // Evict Least Recently Used Tiles Until The New One Fits
+  while (!shard.lru.empty() && shard.bytes+nbytes > shardcapacity)
+  {
+    Entry &victim=shard.lru.back();
+    shard.bytes-=EntryBytes(*victim.second);
+    shard.entries.erase(victim.first);
+    shard.lru.pop_back();
+    evictions++;
+  }
+
+  shard.lru.push_front(Entry(key,tile));
+  shard.entries[key]=shard.lru.begin();
+  shard.bytes+=nbytes;
+  insertions++;
+}
+
+void TileCache::Clear()
+{
+  for (size_t ii=0;ii<shards.size();ii++)
+  {
+    lock_guard<mutex> guard(shards[ii]->lock);
+    shards[ii]->lru.clear();
+    shards[ii]->entries.clear();
+    shards[ii]->bytes=0;
+  }
+}
+
+TileCacheStats TileCache::Stats() const
+{
+  TileCacheStats stats;
+  stats.hits=hits;
+  stats.misses=misses;
+  stats.insertions=insertions;
+  stats.evictions=evictions;
+  stats.bytes=stats.entries=0;
+  stats.capacity=capacity;
+  for (size_t ii=0;ii<shards.size();ii++)
+  {
+    lock_guard<mutex> guard(shards[ii]->lock);
+    stats.bytes+=shards[ii]->bytes;
+    stats.entries+=shards[ii]->entries.size();
+  }
+  return stats;
+}
@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Decoded Tile Cache
+//
+// A thread-safe LRU cache of decoded tiles keyed by (slide, IFD, tile index) with a
+// byte capacity. The cache is split into independently locked shards so concurrent
+// readers rarely contend; each shard holds an equal share of the capacity.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct TileKey
+{
+  uint64_t slide; // SlideReader::Id()
+  int32_t ifd;
+  uint32_t tile;
+
+  bool operator==(const TileKey &other) const
+  {
+    return slide == other.slide && ifd == other.ifd && tile == other.tile;
+  }
+};
+
+struct TileKeyHash
+{
+  size_t operator()(const TileKey &key) const
+  {
+    // splitmix64 Finalizer Over The Combined Key
+    uint64_t h=key.slide*0x9E3779B97F4A7C15ULL ^ (static_cast<uint64_t>(static_cast<uint32_t>(key.ifd)) << 32 | key.tile);
+    h=(h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+    h=(h ^ (h >> 27))*0x94D049BB133111EBULL;
+    return static_cast<size_t>(h ^ (h >> 31));
+  }
+};
+
+// One Decoded Tile (Or Strip) As Returned By DecodeTile
+struct DecodedTile
+{
+  std::vector<uint8_t> data;
+};
+
+struct TileCacheStats
+{
+  uint64_t hits, misses, insertions, evictions;
+  uint64_t bytes, entries, capacity;
+};
+
+class TileCache
+{
+public:
+  // capacity Is The Total Byte Limit Across All Shards
+  explicit TileCache(size_t capacity, int nshards=16);
+
+  // Look Up A Tile, Marking It Most Recently Used. Returns NULL On A Miss.
+  std::shared_ptr<const DecodedTile> Find(const TileKey &key);
+
+  // Add A Tile, Evicting Least Recently Used Tiles Of The Shard To Make Room. Tiles
+  // Larger Than A Whole Shard Are Not Cached.
+  void Insert(const TileKey &key, const std::shared_ptr<const DecodedTile> &tile);
+
+  void Clear();
+  TileCacheStats Stats() const;
+
+private:
+  TileCache(const TileCache &);
+  TileCache &operator=(const TileCache &);
+
+  typedef std::pair<TileKey, std::shared_ptr<const DecodedTile> > Entry;
+  struct Shard
+  {
+    std::mutex lock;
+    std::list<Entry> lru; // Front = most recently used
+    std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> entries;
+    size_t bytes;
+  };
+
+  Shard &ShardFor(const TileKey &key);
+  static size_t EntryBytes(const DecodedTile &tile);
+
+  std::vector<std::unique_ptr<Shard> > shards;
+  size_t capacity, shardcapacity;
+  std::atomic<uint64_t> hits, misses, insertions, evictions;
+};
+
+#endif
@@ -0,0 +1,324 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Work-Stealing Scheduler For Decoding Tiles Of Uneven Cost
+// See TileScheduler.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "TileScheduler.h"
+#include "BufferPool.h"
+#include "ChannelStats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Scheduler
+////////////////////////////////////////////////////////////////////////////////////////
+struct WorkerQueue
+{
+  mutex lock;
+  deque<size_t> tasks;
+};
+
+TileScheduler::TileScheduler(int nthreads_, bool numa) : nthreads(nthreads_)
+{
+  if (numa) nodes=AllowedNumaNodes();
+  if (nthreads <= 0 && nodes.size() > 1)
+  {
+    nthreads=0;
+    for (size_t in=0;in<nodes.size();in++) nthreads+=static_cast<int>(nodes[in].cpus.size());
+  }
+  if (nthreads <= 0) nthreads=static_cast<int>(thread::hardware_concurrency());
+  if (nthreads <= 0) nthreads=1;
+
+  // Every Node Group Needs At Least One Worker
+  if (nodes.size() > static_cast<size_t>(nthreads)) nodes.resize(nthreads);
+  if (nodes.size() < 2) nodes.clear();
+
+  stats.tasks=0;
+  stats.steals=0;
+  stats.remotesteals=0;
+  for (size_t in=0;in<nodes.size();in++)
+  {
+    TileSchedulerNodeStats node={nodes[in].id,0,0,0,0.0};
+    stats.nodes.push_back(node);
+  }
+  for (int iw=0;iw<nthreads;iw++) if (!stats.nodes.empty()) stats.nodes[WorkerGroup(iw)].nworkers++;
+}
+
+void TileScheduler::Run(const vector<uint64_t> &costs, const function<void(size_t, int)> &body)
+{
+  Run(costs,vector<int>(),body);
+}
+
+void TileScheduler::Run(const vector<uint64_t> &costs, const vector<int> &groups,
+                        const function<void(size_t, int)> &body)
+{
+  size_t ntasks=costs.size();
+  if (ntasks == 0) return;
+  int nworkers=(ntasks < static_cast<size_t>(nthreads)) ? static_cast<int>(ntasks) : nthreads;
+  int ngroups=nodes.empty() ? 1 : Nodes();
+
+  // Workers Of Each Node Group Taking Part In This Run
+  vector<vector<int> > members(ngroups);
+  for (int iw=0;iw<nworkers;iw++) members[nodes.empty() ? 0 : WorkerGroup(iw)].push_back(iw);
+  vector<int> everyone;
+  for (int iw=0;iw<nworkers;iw++) everyone.push_back(iw);
+
+  // Deal Tasks Largest First, Round Robin Over The Workers Of Their Group (All
+  // Workers When The Task Has No Group Or Its Group Has No Worker In This Run)
+  vector<size_t> order(ntasks);
+  for (size_t ii=0;ii<ntasks;ii++) order[ii]=ii;
+  stable_sort(order.begin(),order.end(),[&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+  vector<WorkerQueue> queues(nworkers);
+  vector<size_t> dealt(ngroups+1,0);
+  for (size_t ii=0;ii<ntasks;ii++)
+  {
+    size_t task=order[ii];
+    int group=(task < groups.size()) ? groups[task] : -1;
+    const vector<int> &targets=(group >= 0 && group < ngroups && !members[group].empty()) ? members[group] : everyone;
+    size_t &next=(&targets == &everyone) ? dealt[ngroups] : dealt[group];
+    queues[targets[next++%targets.size()]].tasks.push_back(task);
+  }
+
+  // Victims In Stealing Order: The Worker's Own Node First, Then The Others
+  vector<vector<int> > victims(nworkers);
+  for (int iw=0;iw<nworkers;iw++)
+  {
+    int group=nodes.empty() ? 0 : WorkerGroup(iw);
+    for (int ii=1;ii<nworkers;ii++)
+    {
+      int victim=(iw+ii)%nworkers;
+      if ((nodes.empty() ? 0 : WorkerGroup(victim)) == group) victims[iw].push_back(victim);
+    }
+    for (int ii=1;ii<nworkers;ii++)
+    {
+      int victim=(iw+ii)%nworkers;
+      if ((nodes.empty() ? 0 : WorkerGroup(victim)) != group) victims[iw].push_back(victim);
+    }
+  }
+
+  // Own Queue From The Front, Then Steal From The Back Of The Others. No Task Is
+  // Added During A Run, So A Worker That Finds Every Queue Empty Is Done.
+  atomic<uint64_t> steals(0), remotesteals(0);
+  vector<TileSchedulerNodeStats> nodestats(stats.nodes.size());
+  mutex statslock;
+  auto work=[&](int worker)
+  {
+    int group=nodes.empty() ? 0 : WorkerGroup(worker);
+    uint64_t ntasksrun=0, nbytes=0;
+    chrono::steady_clock::duration busy(0);
+    while (true)
+    {
+      size_t task=0;
+      bool found=false;
+      {
+        lock_guard<mutex> guard(queues[worker].lock);
+        if (!queues[worker].tasks.empty())
+        {
+          task=queues[worker].tasks.front();
+          queues[worker].tasks.pop_front();
+          found=true;
+        }
+      }
+      for (size_t ii=0;ii<victims[worker].size() && !found;ii++)
+      {
+        int victim=victims[worker][ii];
+        lock_guard<mutex> guard(queues[victim].lock);
+        if (queues[victim].tasks.empty()) continue;
+        task=queues[victim].tasks.back();
+        queues[victim].tasks.pop_back();
+        found=true;
+        steals++;
+        if (!nodes.empty() && WorkerGroup(victim) != group) remotesteals++;
+      }
+      if (!found) break;
+      chrono::steady_clock::time_point start=chrono::steady_clock::now();
+      body(task,worker);
+      busy+=chrono::steady_clock::now()-start;
+      ntasksrun++;
+      nbytes+=costs[task];
+    }
+    if (nodes.empty()) return;
+    lock_guard<mutex> guard(statslock);
+    nodestats[group].tasks+=ntasksrun;
+    nodestats[group].bytes+=nbytes;
+    nodestats[group].seconds+=chrono::duration<double>(busy).count();
+  };
+
+  // Workers Are Pinned To Their Node; The Calling Thread Gets Its CPUs Back After
+  auto pinned=[&](int worker)
+  {
+    if (!nodes.empty()) PinCurrentThread(nodes[WorkerGroup(worker)].cpus);
+    work(worker);
+  };
+  vector<int> callercpus;
+  if (!nodes.empty()) callercpus=CurrentThreadCPUs();
+  vector<thread> threads;
+  for (int iw=1;iw<nworkers;iw++) threads.push_back(thread(pinned,iw));
+  pinned(0);
+  for (size_t ii=0;ii<threads.size();ii++) threads[ii].join();
+  if (!callercpus.empty()) PinCurrentThread(callercpus);
+
+  stats.tasks+=ntasks;
+  stats.steals+=steals;
+  stats.remotesteals+=remotesteals;
+  for (size_t in=0;in<nodestats.size();in++)
+  {
+    stats.nodes[in].tasks+=nodestats[in].tasks;
+    stats.nodes[in].bytes+=nodestats[in].bytes;
+    stats.nodes[in].seconds+=nodestats[in].seconds;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Tile Decoding
+////////////////////////////////////////////////////////////////////////////////////////
+
+// A Worker's Handle On One Directory
+struct DecodeHandle
+{
+  const IndexedDirectory *directory;
+  TIFF *tif;
+  tmsize_t scratchsize;
+};
+
+// Per Worker State, Kept Across The Tasks Of A Run
+struct DecodeWorker
+{
+  vector<DecodeHandle> handles;
+  PooledBuffer scratch;
+  vector<ChannelStatsAccumulator *> locals; // Per job
+};
+
+static const DecodeHandle *WorkerHandle(DecodeWorker &worker, const string &fn_slide,
+                                        const IndexedDirectory *directory)
+{
+  for (size_t ii=0;ii<worker.handles.size();ii++)
+  {
+    if (worker.handles[ii].directory == directory) return &worker.handles[ii];
+  }
+  DecodeHandle handle;
+  handle.directory=directory;
+  handle.tif=OpenSlideHeaderOnly(fn_slide);
+  if (handle.tif == NULL) return NULL;
+  if (!SetIndexedDirectory(handle.tif,*directory))
+  {
+    TIFFClose(handle.tif);
+    return NULL;
+  }
+  handle.scratchsize=directory->layout.tiled ? TIFFTileSize(handle.tif) : TIFFStripSize(handle.tif);
+  worker.handles.push_back(handle);
+  return &worker.handles.back();
+}
+
+SCNReadStatus DecodeTilesScheduled(const string &fn_slide, const vector<TileDecodeJob> &jobs, TileScheduler &scheduler)
+{
+  // Tiles Of All Jobs, Weighted By Compressed Size
+  vector<uint32> taskjob, taskcol, taskrow;
+  vector<uint64_t> costs;
+  vector<int> groups;
+  int nnodes=scheduler.Nodes();
+  vector<int> samples(jobs.size());
+  for (size_t ij=0;ij<jobs.size();ij++)
+  {
+    const IndexedDirectory &directory=*jobs[ij].directory;
+    const SCNDirectoryLayout &layout=directory.layout;
+    samples[ij]=ChannelSample(layout,jobs[ij].channel);
+    if (samples[ij] < 0) return SCN_READ_FAILED;
+    uint32 lastrow=TilesDown(layout);
+    if (jobs[ij].firstrow < lastrow && jobs[ij].nrows < lastrow-jobs[ij].firstrow) lastrow=jobs[ij].firstrow+jobs[ij].nrows;
+    size_t firsttask=costs.size();
+    for (uint32 row=jobs[ij].firstrow;row<lastrow;row++)
+    {
+      for (uint32 col=0;col<TilesAcross(layout);col++)
+      {
+        uint32 itile=TileIndex(layout,col,row,samples[ij]);
+        taskjob.push_back(static_cast<uint32>(ij));
+        taskcol.push_back(col);
+        taskrow.push_back(row);
+        costs.push_back(itile < directory.bytecounts.size() ? directory.bytecounts[itile] : 0);
+      }
+    }
+    if (nnodes < 2 || firsttask == costs.size()) continue;
+
+    // One Band Of Tile Rows Per Node, Of About Equal Compressed Size: A Row Goes To The
+    // Node Its Byte Midpoint Falls In, And Its Part Of A Placeable Output Goes There
+    uint64_t total=0, before=0;
+    for (size_t it=firsttask;it<costs.size();it++) total+=costs[it];
+    vector<uint32> bandstart(nnodes+1,jobs[ij].firstrow);
+    bandstart[nnodes]=lastrow;
+    size_t perrow=TilesAcross(layout);
+    for (size_t it=firsttask;it<costs.size();it+=perrow)
+    {
+      uint64_t rowbytes=0;
+      for (size_t ic=0;ic<perrow;ic++) rowbytes+=costs[it+ic];
+      double mid=(total > 0) ? (before+0.5*rowbytes)/total : (it-firsttask+0.5*perrow)/(costs.size()-firsttask);
+      int group=min(nnodes-1,static_cast<int>(mid*nnodes));
+      before+=rowbytes;
+      for (size_t ic=0;ic<perrow;ic++) groups.push_back(group);
+      for (int ig=group+1;ig<nnodes;ig++) bandstart[ig]=max(bandstart[ig],taskrow[it]+1);
+    }
+    size_t outrowbytes=static_cast<size_t>(layout.width)*SampleBytes(layout.type)*jobs[ij].stride;
+    for (int ig=0;ig<nnodes;ig++)
+    {
+      uint64_t y0=static_cast<uint64_t>(bandstart[ig])*layout.tilelength;
+      uint64_t y1=min<uint64_t>(static_cast<uint64_t>(bandstart[ig+1])*layout.tilelength,layout.height);
+      if (y1 <= y0 || !jobs[ij].placeable) continue;
+      uint64_t first=jobs[ij].bottomup ? layout.height-y1 : y0;
+      PreferNumaNode(jobs[ij].out+(first-jobs[ij].outrow)*outrowbytes,(y1-y0)*outrowbytes,scheduler.NodeId(ig));
+    }
+  }
+  if (groups.size() != costs.size()) groups.clear();
+
+  vector<DecodeWorker> workers(scheduler.Size());
+  atomic<int> status(SCN_READ_OK);
+  scheduler.Run(costs,groups,[&](size_t task, int iw)
+  {
+    if (status != SCN_READ_OK) return;
+    DecodeWorker &worker=workers[iw];
+    uint32 ij=taskjob[task];
+    const TileDecodeJob &job=jobs[ij];
+    const DecodeHandle *handle=WorkerHandle(worker,fn_slide,job.directory);
+    if (handle == NULL || handle->scratchsize <= 0) {status=SCN_READ_FAILED; return;}
+    if (worker.scratch.size() < static_cast<size_t>(handle->scratchsize))
+    {
+      worker.scratch=SharedBufferPool().Acquire(handle->scratchsize);
+      if (worker.scratch.data() == NULL) {status=SCN_READ_NOMEMORY; return;}
+      if (worker.scratch.mapped())
+      {
+        PreferNumaNode(worker.scratch.data(),worker.scratch.size(),scheduler.NodeId(scheduler.WorkerGroup(iw)));
+      }
+    }
+    ChannelStatsAccumulator *local=NULL;
+    if (job.stats != NULL)
+    {
+      if (worker.locals.empty()) worker.locals.resize(jobs.size(),(ChannelStatsAccumulator *) NULL);
+      if (worker.locals[ij] == NULL) worker.locals[ij]=new ChannelStatsAccumulator(job.directory->layout.type);
+      local=worker.locals[ij];
+    }
+    if (ReadTileNative(handle->tif,job.directory->layout,samples[ij],taskcol[task],taskrow[task],worker.scratch.data(),
+                       handle->scratchsize,job.out,job.outrow,job.stride,job.bottomup,local) != SCN_READ_OK)
+    {
+      status=SCN_READ_FAILED;
+    }
+  });
+
+  // Merge Statistics And Close Handles
+  for (size_t iw=0;iw<workers.size();iw++)
+  {
+    for (size_t ij=0;ij<workers[iw].locals.size();ij++)
+    {
+      if (workers[iw].locals[ij] == NULL) continue;
+      jobs[ij].stats->Merge(*workers[iw].locals[ij]);
+      delete workers[iw].locals[ij];
+    }
+    for (size_t ih=0;ih<workers[iw].handles.size();ih++) TIFFClose(workers[iw].handles[ih].tif);
+  }
+  return static_cast<SCNReadStatus>(status.load());
+}
@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Work-Stealing Scheduler For Decoding Tiles Of Uneven Cost
+//
+// Decode time per tile varies widely between blank background and dense tissue, and
+// the compressed size of a tile (TIFFTAG_TILEBYTECOUNTS, kept in the slide index) is
+// a cheap predictor of it. Tasks are sorted largest first and dealt round robin into
+// one deque per worker, so every worker starts on the biggest remaining work. A worker
+// takes tasks from the front of its own deque and, once that is empty, steals from
+// the back of the others', where the smallest tasks are, so the tail of a run is
+// filled with small pieces instead of leaving cores idle.
+//
+// DecodeTilesScheduled decodes any number of channel regions (of one or several
+// fields) as one run, so a cheap channel's workers help with an expensive one. Each
+// worker keeps its own TIFF handle per directory and its own scratch buffer.
+//
+// NUMA: With more than one node, workers are split into one group per node and pinned
+// to its CPUs. Each job's tile rows are cut into one band of about equal compressed
+// size per node; a band's tiles are dealt to that node's workers only, and its part of
+// the output buffer is placed on that node (mbind, preferred, moving pages a pooled
+// buffer already has elsewhere), so decoded pixels are written into local memory.
+// Buffers on the heap (pooled buffers under 2 MB) are left where they are. Workers
+// steal from their own node first and cross nodes only when it has run dry. Per node
+// tile, byte and busy time counters are kept.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include "LeicaSCN.h"
+#include "NumaTopology.h"
+#include "SlideIndex.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct TileSchedulerNodeStats
+{
+  int node;       // Kernel node number
+  int nworkers;
+  uint64_t tasks;
+  uint64_t bytes; // Sum of task costs (compressed tile bytes)
+  double seconds; // Busy time summed over the node's workers
+};
+
+struct TileSchedulerStats
+{
+  uint64_t tasks;
+  uint64_t steals;       // Tasks run by a worker other than the one they were dealt to
+  uint64_t remotesteals; // Of those, tasks taken from another node
+  std::vector<TileSchedulerNodeStats> nodes; // With NUMA placement only
+};
+
+class TileScheduler
+{
+public:
+  // nthreads <= 0 Uses One Worker Per Hardware Thread (Allowed CPU With numa). numa
+  // Enables Placement When The Process May Run On More Than One Node.
+  explicit TileScheduler(int nthreads, bool numa=false);
+
+  int Size() const { return nthreads; }
+  int Nodes() const { return static_cast<int>(nodes.size() > 1 ? nodes.size() : 1); }
+
+  // Kernel Node Number Of Node Group group, Or -1 Without NUMA Placement
+  int NodeId(int group) const { return nodes.size() > 1 ? nodes[group].id : -1; }
+
+  // Node Group Of A Worker, 0 Without NUMA Placement
+  int WorkerGroup(int worker) const { return static_cast<int>(static_cast<size_t>(worker)*Nodes()/nthreads); }
+
+  // Run body(task, worker) For Every Task, Largest Cost First, With worker In
+  // [0, Size()). The Calling Thread Is Worker 0. Blocks Until All Tasks Are Done.
+  // groups, When Given, Holds The Node Group Each Task Is Dealt To.
+  void Run(const std::vector<uint64_t> &costs, const std::function<void(size_t, int)> &body);
+  void Run(const std::vector<uint64_t> &costs, const std::vector<int> &groups,
+           const std::function<void(size_t, int)> &body);
+
+  TileSchedulerStats Stats() const { return stats; }
+
+private:
+  int nthreads;
+  std::vector<NumaNode> nodes; // More than one only with NUMA placement
+  TileSchedulerStats stats;
+};
+
+// One Channel Region To Decode At Native Bit Depth, Laid Out As For ReadTileRowsNative
+struct TileDecodeJob
+{
+  const IndexedDirectory *directory;
+  int channel;
+  uint32 firstrow, nrows; // Tile rows
+  uint8 *out;             // Channel from stored row outrow on
+  uint32 outrow;          // 0 when out is the whole channel
+  size_t stride;
+  bool bottomup;
+  ChannelStats *stats;    // NULL for none
+  bool placeable;         // out is in its own mapping, so bands may be moved to nodes
+};
+
+// Decode The Tiles Of All Jobs As One Scheduled Run, Each Tile Weighted By Its
+// Compressed Size
+SCNReadStatus DecodeTilesScheduled(const std::string &fn_slide, const std::vector<TileDecodeJob> &jobs,
+                                   TileScheduler &scheduler);
+
+#endif
@@ -0,0 +1,688 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Local Tile Server
+// See TileServer.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "TileServer.h"
+#include "ImageEncode.h"
+#include "IOHelpers.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+using namespace std;
+
+// Largest Request Header Accepted
+static const size_t MAXREQUESTBYTES=64*1024;
+
+static uint64_t MicrosecondsSince(const chrono::steady_clock::time_point &start)
+{
+  return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now()-start).count();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Latency Histogram
+////////////////////////////////////////////////////////////////////////////////////////
+
+LatencyHistogram::LatencyHistogram() : count(0), total(0), maximum(0)
+{
+  for (int ii=0;ii<NBUCKETS;ii++) buckets[ii]=0;
+}
+
+void LatencyHistogram::Record(uint64_t us)
+{
+  int bucket=0;
+  while (bucket < NBUCKETS-1 && (us+1) >> (bucket+1) != 0) bucket++;
+  buckets[bucket]++;
+  count++;
+  total+=us;
+  uint64_t seen=maximum.load();
+  while (us > seen && !maximum.compare_exchange_weak(seen,us)) {}
+}
+
+string LatencyHistogram::JSON() const
+{
+  uint64_t snapshot[NBUCKETS];
+  uint64_t n=0;
+  for (int ii=0;ii<NBUCKETS;ii++) {snapshot[ii]=buckets[ii].load(); n+=snapshot[ii];}
+
+  // Percentiles Are Reported As The Upper Bound Of The Bucket They Fall In
+  const double fractions[3]={0.50,0.90,0.99};
+  const char *names[3]={"p50_us","p90_us","p99_us"};
+  ostringstream json;
+  json << "{\"count\":" << n << ",\"mean_us\":" << (n > 0 ? total.load()/n : 0) << ",\"max_us\":" << maximum.load();
+  for (int ip=0;ip<3;ip++)
+  {
+    uint64_t target=static_cast<uint64_t>(ceil(fractions[ip]*n)), seen=0;
+    uint64_t bound=0;
+    for (int ii=0;ii<NBUCKETS && n > 0;ii++)
+    {
+      seen+=snapshot[ii];
+      bound=(static_cast<uint64_t>(1) << (ii+1))-1;
+      if (seen >= target) break;
+    }
+    json << ",\"" << names[ip] << "\":" << bound;
+  }
+  json << ",\"buckets\":[";
+  for (int ii=0;ii<NBUCKETS;ii++) json << (ii > 0 ? "," : "") << snapshot[ii];
+  json << "]}";
+  return json.str();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// HTTP Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+
+static const char *StatusText(int status)
+{
+  switch (status)
+  {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 431: return "Request Header Fields Too Large";
+    default: return "Internal Server Error";
+  }
+}
+
+static string HTTPResponse(int status, const string &contenttype, const string &body, bool head, bool keepalive)
+{
+  ostringstream response;
+  response << "HTTP/1.1 " << status << " " << StatusText(status) << "\r\n"
+           << "Content-Type: " << contenttype << "\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Access-Control-Allow-Origin: *\r\n";
+  if (status == 200 && contenttype == "image/jpeg") response << "Cache-Control: max-age=3600\r\n";
+  response << "Connection: " << (keepalive ? "keep-alive" : "close") << "\r\n\r\n";
+  if (!head) response << body;
+  return response.str();
+}
+
+static string ErrorResponse(int status, bool head, bool keepalive)
+{
+  return HTTPResponse(status,"text/plain",string(StatusText(status))+"\n",head,keepalive);
+}
+
+// Parse A Non-Empty String Of Decimal Digits
+static bool ParseNumber(const string &text, unsigned long &value)
+{
+  if (text.empty() || text.size() > 9) return false;
+  value=0;
+  for (size_t ii=0;ii<text.size();ii++)
+  {
+    if (text[ii] < '0' || text[ii] > '9') return false;
+    value=value*10+(text[ii]-'0');
+  }
+  return true;
+}
+
+static vector<string> SplitPath(const string &path)
+{
+  vector<string> parts;
+  size_t start=1;
+  while (start <= path.size())
+  {
+    size_t end=path.find('/',start);
+    if (end == string::npos) end=path.size();
+    parts.push_back(path.substr(start,end-start));
+    start=end+1;
+  }
+  return parts;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Tile Rendering
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Deep Zoom Level Holding The Full Resolution Image
+static int DeepZoomMaxLevel(uint32 ww, uint32 hh)
+{
+  uint32 size=(ww > hh) ? ww : hh;
+  int level=0;
+  while ((static_cast<uint64_t>(1) << level) < size) level++;
+  return level;
+}
+
+// Reduce One Row Of Output Pixels From krows Rows Of Source Pixels. Each Output Pixel
+// Averages A k x k Block, Or Samples The Block Centre When Only One Row Was Read.
+template <class T>
+static void ReduceRow(const uint8 *source, size_t sourcewidth, uint32 ww, int k, int krows, double scale, uint8 *out)
+{
+  const T *values=reinterpret_cast<const T *>(source);
+  int kcols=(krows == k) ? k : 1;
+  size_t col0=(k-kcols)/2;
+  double norm=scale/(krows*kcols);
+  for (uint32 ox=0;ox<ww;ox++)
+  {
+    double sum=0.0;
+    for (int yy=0;yy<krows;yy++)
+    {
+      const T *row=values+yy*sourcewidth+static_cast<size_t>(ox)*k+col0;
+      for (int xx=0;xx<kcols;xx++) sum+=row[xx];
+    }
+    double value=sum*norm+0.5;
+    out[ox]=(value > 0.0) ? ((value < 255.0) ? static_cast<uint8>(value) : 255) : 0;
+  }
+}
+
+static void ReduceRow(SampleType type, const uint8 *source, size_t sourcewidth, uint32 ww, int k, int krows,
+                      double scale, uint8 *out)
+{
+  switch (type)
+  {
+    case SAMPLE_UINT8: ReduceRow<uint8_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_INT8: ReduceRow<int8_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_UINT16: ReduceRow<uint16_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_INT16: ReduceRow<int16_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_UINT32: ReduceRow<uint32_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_INT32: ReduceRow<int32_t>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_FLOAT32: ReduceRow<float>(source,sourcewidth,ww,k,krows,scale,out); break;
+    case SAMPLE_FLOAT64: ReduceRow<double>(source,sourcewidth,ww,k,krows,scale,out); break;
+  }
+}
+
+// Read Every k-th Sample Of Source Row y From Column x On, ww In All, Straight From The
+// Decoded Tiles; Samples Outside The Image Are Zero
+static SCNReadStatus ReadSampledRow(SlideReader &reader, const IndexedDirectory &directory, int channel, long x, long y,
+                                    uint32 ww, int k, uint8 *out)
+{
+  const SCNDirectoryLayout &layout=directory.layout;
+  int sample=ChannelSample(layout,channel);
+  if (!directory.nativeok || sample < 0) return SCN_READ_FAILED;
+  size_t nbytes=SampleBytes(layout.type);
+  memset(out,0,ww*nbytes);
+  if (y < 0 || y >= static_cast<long>(layout.height)) return SCN_READ_OK;
+
+  uint32 row=y/layout.tilelength, ty=y-static_cast<long>(row)*layout.tilelength;
+  uint32 tilecol=TilesAcross(layout);
+  shared_ptr<const DecodedTile> tile;
+  for (uint32 ox=0;ox<ww;ox++)
+  {
+    long xs=x+static_cast<long>(ox)*k;
+    if (xs < 0 || xs >= static_cast<long>(layout.width)) continue;
+    uint32 col=xs/layout.tilewidth, tx=xs-static_cast<long>(col)*layout.tilewidth;
+    if (col != tilecol)
+    {
+      SCNReadStatus status=reader.ReadTile(directory,TileIndex(layout,col,row,sample),tile);
+      if (status != SCN_READ_OK) return status;
+      tilecol=col;
+    }
+    if (tile->data.size() < (static_cast<size_t>(ty)*layout.tilewidth+tx+1)*TilePixelBytes(layout)) return SCN_READ_FAILED;
+    CopyTileSamples(layout,&tile->data[0],sample,tx,ty,1,1,out+ox*nbytes,0,1);
+  }
+  return SCN_READ_OK;
+}
+
+string TileServer::RenderTile(size_t slide, size_t field, int channel, int level, uint32 col, uint32 row, bool head,
+                              bool keepalive)
+{
+  SlideReader *reader=slides[slide];
+  const IndexedDirectory *base=reader->FindChannel(field,channel,0);
+  if (base == NULL) return ErrorResponse(404,head,keepalive);
+  uint32 w0=base->layout.width, h0=base->layout.height;
+  int maxlevel=DeepZoomMaxLevel(w0,h0);
+  if (level < 0 || level > maxlevel) return ErrorResponse(404,head,keepalive);
+
+  // Tile Bounds At This Deep Zoom Level
+  double scale=ldexp(1.0,maxlevel-level);
+  long wl=static_cast<long>(ceil(w0/scale)), hl=static_cast<long>(ceil(h0/scale));
+  long tilesize=options.tilesize, overlap=options.overlap;
+  long x0=col*tilesize-(col > 0 ? overlap : 0), y0=row*tilesize-(row > 0 ? overlap : 0);
+  if (x0 >= wl || y0 >= hl) return ErrorResponse(404,head,keepalive);
+  long x1=min((col+1)*tilesize+overlap,wl), y1=min((row+1)*tilesize+overlap,hl);
+  uint32 ww=x1-x0, hh=y1-y0;
+
+  // Read From The Coarsest SCN Level That Is Still At Least As Fine As This One
+  const IndexedDirectory *directory=base;
+  double downsample=1.0;
+  for (int r=1;;r++)
+  {
+    const IndexedDirectory *candidate=reader->FindChannel(field,channel,r);
+    if (candidate == NULL) break;
+    double dr=static_cast<double>(w0)/candidate->layout.width;
+    if (dr <= scale*1.01 && dr > downsample) {directory=candidate; downsample=dr;}
+  }
+  int k=static_cast<int>(floor(scale/downsample+0.5));
+  if (k < 1) k=1;
+  int krows=(k <= 8) ? k : 1; // Large reductions sample instead of averaging
+  long xr=static_cast<long>(floor(x0*scale/downsample+0.5));
+  long yr=static_cast<long>(floor(y0*scale/downsample+0.5));
+
+  // Averaged Reductions Read k Whole Rows Per Output Row; Sampled Ones Only The Samples
+  // They Keep, So A Large k Does Not Copy k Times The Tile Width Per Row
+  const SCNDirectoryLayout &layout=directory->layout;
+  size_t Nbytes=SampleBytes(layout.type);
+  size_t sourcewidth=(krows == k) ? static_cast<size_t>(ww)*k : ww;
+  vector<uint8> source(sourcewidth*krows*Nbytes);
+  vector<uint8> pixels(static_cast<size_t>(ww)*hh);
+  double displayscale=DisplayScale(layout);
+  for (uint32 oy=0;oy<hh;oy++)
+  {
+    long ys=yr+static_cast<long>(oy)*k+(k-krows)/2;
+    SCNReadStatus status;
+    if (krows == k) status=reader->ReadRegion(*directory,channel,xr,ys,sourcewidth,krows,&source[0],sourcewidth*Nbytes);
+    else status=ReadSampledRow(*reader,*directory,channel,xr+(k-1)/2,ys,ww,k,&source[0]);
+    if (status != SCN_READ_OK) return ErrorResponse(500,head,keepalive);
+    ReduceRow(layout.type,&source[0],sourcewidth,ww,krows,krows,displayscale,&pixels[oy*static_cast<size_t>(ww)]);
+  }
+
+  vector<uint8_t> jpeg;
+  if (!EncodeJPEG(&pixels[0],ww,hh,1,ww,options.quality,jpeg)) return ErrorResponse(500,head,keepalive);
+  return HTTPResponse(200,"image/jpeg",string(jpeg.begin(),jpeg.end()),head,keepalive);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Metadata Responses
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Channel Numbers Of A Field At The Highest Resolution, In Increasing Order
+static vector<int> FieldChannels(const SCNField &field)
+{
+  vector<int> channels;
+  for (size_t ii=0;ii<field.dimensions.size();ii++)
+  {
+    if (field.dimensions[ii].r == 0) channels.push_back(field.dimensions[ii].channel);
+  }
+  sort(channels.begin(),channels.end());
+  channels.erase(unique(channels.begin(),channels.end()),channels.end());
+  return channels;
+}
+
+string TileServer::SlideListJSON() const
+{
+  ostringstream json;
+  json << "{\"tilesize\":" << options.tilesize << ",\"overlap\":" << options.overlap << ",\"slides\":[";
+  for (size_t is=0;is<slides.size();is++)
+  {
+    const SCNDescription &description=slides[is]->Index().description;
+    json << (is > 0 ? "," : "") << "{\"slide\":" << is << ",\"filename\":" << JSONString(slides[is]->Filename())
+         << ",\"fields\":[";
+    for (size_t ifield=0;ifield<description.fields.size();ifield++)
+    {
+      const SCNField &field=description.fields[ifield];
+      vector<int> channels=FieldChannels(field);
+      json << (ifield > 0 ? "," : "") << "{\"field\":" << ifield << ",\"number\":" << field.number << ",\"channels\":[";
+      bool first=true;
+      for (size_t ic=0;ic<channels.size();ic++)
+      {
+        const IndexedDirectory *directory=slides[is]->FindChannel(ifield,channels[ic],0);
+        if (directory == NULL) continue;
+        json << (first ? "" : ",") << "{\"channel\":" << channels[ic] << ",\"width\":" << directory->layout.width
+             << ",\"height\":" << directory->layout.height << ",\"type\":\"" << SampleTypeName(directory->layout.type)
+             << "\",\"dzi\":\"/" << is << "/" << ifield << "/" << channels[ic] << ".dzi\"}";
+        first=false;
+      }
+      json << "]}";
+    }
+    json << "]}";
+  }
+  json << "]}\n";
+  return json.str();
+}
+
+string TileServer::StatsJSON() const
+{
+  TileCacheStats cachestats=cache.Stats();
+  ostringstream json;
+  json << "{\"requests\":" << requests.load() << ",\"errors\":" << errors.load() << ",\"connections\":"
+       << connections.size() << ",\"threads\":" << pool->Size()
+       << ",\"tile_total\":" << tile_total.JSON() << ",\"tile_queue\":" << tile_queue.JSON()
+       << ",\"tile_render\":" << tile_render.JSON() << ",\"metadata\":" << metadata.JSON()
+       << ",\"cache\":{\"hits\":" << cachestats.hits << ",\"misses\":" << cachestats.misses
+       << ",\"insertions\":" << cachestats.insertions << ",\"evictions\":" << cachestats.evictions
+       << ",\"bytes\":" << cachestats.bytes << ",\"entries\":" << cachestats.entries
+       << ",\"capacity\":" << cachestats.capacity << "}}\n";
+  return json.str();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Server
+////////////////////////////////////////////////////////////////////////////////////////
+
+TileServer::TileServer(const vector<SlideReader *> &slides_, const TileServerOptions &options_)
+  : slides(slides_), options(options_), cache(options_.cache_bytes), listenfd(-1), epollfd(-1), wakefd(-1), port(0),
+    stopping(false), nextid(1), requests(0), errors(0), pool(new ThreadPool(options_.nthreads))
+{
+  for (size_t ii=0;ii<slides.size();ii++) slides[ii]->SetTileCache(&cache);
+}
+
+TileServer::~TileServer()
+{
+  pool.reset();
+  for (map<int, Connection>::iterator it=connections.begin();it!=connections.end();++it) close(it->first);
+  if (listenfd >= 0) close(listenfd);
+  if (epollfd >= 0) close(epollfd);
+  if (wakefd >= 0) close(wakefd);
+}
+
+bool TileServer::Start()
+{
+  sockaddr_in address;
+  memset(&address,0,sizeof(address));
+  address.sin_family=AF_INET;
+  address.sin_port=htons(static_cast<uint16_t>(options.port));
+  if (inet_pton(AF_INET,options.host.c_str(),&address.sin_addr) != 1) return false;
+
+  listenfd=socket(AF_INET,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+  if (listenfd < 0) return false;
+  int one=1;
+  setsockopt(listenfd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+  if (bind(listenfd,reinterpret_cast<sockaddr *>(&address),sizeof(address)) != 0) return false;
+  if (listen(listenfd,128) != 0) return false;
+  socklen_t length=sizeof(address);
+  if (getsockname(listenfd,reinterpret_cast<sockaddr *>(&address),&length) != 0) return false;
+  port=ntohs(address.sin_port);
+
+  epollfd=epoll_create1(EPOLL_CLOEXEC);
+  wakefd=eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollfd < 0 || wakefd < 0) return false;
+  epoll_event event;
+  memset(&event,0,sizeof(event));
+  event.events=EPOLLIN;
+  event.data.fd=listenfd;
+  if (epoll_ctl(epollfd,EPOLL_CTL_ADD,listenfd,&event) != 0) return false;
+  event.data.fd=wakefd;
+  if (epoll_ctl(epollfd,EPOLL_CTL_ADD,wakefd,&event) != 0) return false;
+  return true;
+}
+
+void TileServer::Stop()
+{
+  stopping=true;
+  Wake();
+}
+
+void TileServer::Wake()
+{
+  uint64_t one=1;
+  ssize_t nwritten=write(wakefd,&one,sizeof(one));
+  (void)nwritten;
+}
+
+void TileServer::Run()
+{
+  epoll_event events[64];
+  while (!stopping)
+  {
+    int nevents=epoll_wait(epollfd,events,64,-1);
+    if (nevents < 0)
+    {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (int ii=0;ii<nevents;ii++)
+    {
+      int fd=events[ii].data.fd;
+      if (fd == listenfd) Accept();
+      else if (fd == wakefd)
+      {
+        uint64_t value;
+        while (read(wakefd,&value,sizeof(value)) > 0) {}
+        DrainCompletions();
+      }
+      else
+      {
+        if (events[ii].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) ReadConnection(fd);
+        if ((events[ii].events & EPOLLOUT) && connections.count(fd)) WriteConnection(fd);
+      }
+    }
+  }
+  while (!connections.empty()) CloseConnection(connections.begin()->first);
+}
+
+void TileServer::Accept()
+{
+  while (true)
+  {
+    int fd=accept4(listenfd,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    int one=1;
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+    epoll_event event;
+    memset(&event,0,sizeof(event));
+    event.events=EPOLLIN;
+    event.data.fd=fd;
+    if (epoll_ctl(epollfd,EPOLL_CTL_ADD,fd,&event) != 0) {close(fd); continue;}
+    Connection &connection=connections[fd];
+    connection.id=nextid++;
+    connection.outpos=0;
+    connection.busy=false;
+    connection.keepalive=true;
+    connection.writing=false;
+  }
+}
+
+void TileServer::CloseConnection(int fd)
+{
+  epoll_ctl(epollfd,EPOLL_CTL_DEL,fd,NULL);
+  close(fd);
+  connections.erase(fd);
+}
+
+void TileServer::ReadConnection(int fd)
+{
+  map<int, Connection>::iterator it=connections.find(fd);
+  if (it == connections.end()) return;
+  char buffer[16384];
+  while (true)
+  {
+    ssize_t nread=recv(fd,buffer,sizeof(buffer),0);
+    if (nread > 0) {it->second.in.append(buffer,nread); continue;}
+    if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (nread < 0 && errno == EINTR) continue;
+    CloseConnection(fd); // Peer closed or failed; a pending render is dropped
+    return;
+  }
+  HandleRequests(fd);
+}
+
+void TileServer::WriteConnection(int fd)
+{
+  map<int, Connection>::iterator it=connections.find(fd);
+  if (it == connections.end()) return;
+  Connection &connection=it->second;
+  while (connection.outpos < connection.out.size())
+  {
+    ssize_t nsent=send(fd,connection.out.data()+connection.outpos,connection.out.size()-connection.outpos,MSG_NOSIGNAL);
+    if (nsent > 0) {connection.outpos+=nsent; continue;}
+    if (nsent < 0 && errno == EINTR) continue;
+    if (nsent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      if (!connection.writing)
+      {
+        epoll_event event;
+        memset(&event,0,sizeof(event));
+        event.events=EPOLLIN | EPOLLOUT;
+        event.data.fd=fd;
+        epoll_ctl(epollfd,EPOLL_CTL_MOD,fd,&event);
+        connection.writing=true;
+      }
+      return;
+    }
+    CloseConnection(fd);
+    return;
+  }
+
+  // Response Sent
+  connection.out.clear();
+  connection.outpos=0;
+  if (connection.writing)
+  {
+    epoll_event event;
+    memset(&event,0,sizeof(event));
+    event.events=EPOLLIN;
+    event.data.fd=fd;
+    epoll_ctl(epollfd,EPOLL_CTL_MOD,fd,&event);
+    connection.writing=false;
+  }
+  if (!connection.keepalive) {CloseConnection(fd); return;}
+  HandleRequests(fd);
+}
+
+void TileServer::QueueResponse(int fd, const string &response)
+{
+  map<int, Connection>::iterator it=connections.find(fd);
+  if (it == connections.end()) return;
+  if (response.compare(9,1,"2") != 0) errors++;
+  it->second.out=response;
+  it->second.outpos=0;
+  WriteConnection(fd);
+}
+
+void TileServer::DrainCompletions()
+{
+  vector<Completion> done;
+  {
+    lock_guard<mutex> guard(completionlock);
+    done.swap(completions);
+  }
+  for (size_t ii=0;ii<done.size();ii++)
+  {
+    map<int, Connection>::iterator it=connections.find(done[ii].fd);
+    if (it == connections.end() || it->second.id != done[ii].id) continue;
+    it->second.busy=false;
+    tile_total.Record(MicrosecondsSince(done[ii].start));
+    QueueResponse(done[ii].fd,done[ii].response);
+  }
+}
+
+void TileServer::HandleRequests(int fd)
+{
+  map<int, Connection>::iterator it=connections.find(fd);
+  if (it == connections.end()) return;
+  Connection &connection=it->second;
+
+  // One Request At A Time Per Connection; Pipelined Requests Wait In connection.in
+  if (connection.busy || !connection.out.empty()) return;
+  size_t end=connection.in.find("\r\n\r\n");
+  if (end == string::npos)
+  {
+    if (connection.in.size() > MAXREQUESTBYTES)
+    {
+      connection.keepalive=false;
+      QueueResponse(fd,ErrorResponse(431,false,false));
+    }
+    return;
+  }
+  string header=connection.in.substr(0,end);
+  connection.in.erase(0,end+4);
+  chrono::steady_clock::time_point start=chrono::steady_clock::now();
+  requests++;
+
+  // Request Line And Connection Header
+  istringstream lines(header);
+  string requestline, method, target, version;
+  getline(lines,requestline);
+  istringstream fields(requestline);
+  fields >> method >> target >> version;
+  bool keepalive=(version == "HTTP/1.1");
+  string line;
+  while (getline(lines,line))
+  {
+    string lower=line;
+    transform(lower.begin(),lower.end(),lower.begin(),::tolower);
+    if (lower.compare(0,11,"connection:") != 0) continue;
+    if (lower.find("close") != string::npos) keepalive=false;
+    else if (lower.find("keep-alive") != string::npos) keepalive=true;
+  }
+  connection.keepalive=keepalive;
+  bool head=(method == "HEAD");
+  if (method != "GET" && !head)
+  {
+    connection.keepalive=false; // Any request body is not read
+    QueueResponse(fd,ErrorResponse(405,false,false));
+    return;
+  }
+  string path=target.substr(0,target.find('?'));
+  if (path.empty() || path[0] != '/')
+  {
+    QueueResponse(fd,ErrorResponse(400,head,keepalive));
+    return;
+  }
+
+  // Listing And Statistics
+  if (path == "/")
+  {
+    QueueResponse(fd,HTTPResponse(200,"application/json",SlideListJSON(),head,keepalive));
+    metadata.Record(MicrosecondsSince(start));
+    return;
+  }
+  if (path == "/stats")
+  {
+    QueueResponse(fd,HTTPResponse(200,"application/json",StatsJSON(),head,keepalive));
+    return;
+  }
+
+  // Deep Zoom Descriptor: /S/F/C.dzi
+  vector<string> parts=SplitPath(path);
+  unsigned long slide, field, channel;
+  if (parts.size() == 3 && parts[2].size() > 4 && parts[2].compare(parts[2].size()-4,4,".dzi") == 0 &&
+      ParseNumber(parts[0],slide) && ParseNumber(parts[1],field) &&
+      ParseNumber(parts[2].substr(0,parts[2].size()-4),channel))
+  {
+    const IndexedDirectory *directory=(slide < slides.size()) ? slides[slide]->FindChannel(field,channel,0) : NULL;
+    if (directory == NULL) {QueueResponse(fd,ErrorResponse(404,head,keepalive)); return;}
+    ostringstream dzi;
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"jpeg\" Overlap=\""
+        << options.overlap << "\" TileSize=\"" << options.tilesize << "\">\n"
+        << "  <Size Width=\"" << directory->layout.width << "\" Height=\"" << directory->layout.height << "\"/>\n"
+        << "</Image>\n";
+    QueueResponse(fd,HTTPResponse(200,"application/xml",dzi.str(),head,keepalive));
+    metadata.Record(MicrosecondsSince(start));
+    return;
+  }
+
+  // Deep Zoom Tile: /S/F/C_files/L/COL_ROW.jpeg, Rendered On The Pool
+  unsigned long level, col, row;
+  if (parts.size() == 5 && parts[2].size() > 6 && parts[2].compare(parts[2].size()-6,6,"_files") == 0 &&
+      ParseNumber(parts[0],slide) && ParseNumber(parts[1],field) &&
+      ParseNumber(parts[2].substr(0,parts[2].size()-6),channel) && ParseNumber(parts[3],level))
+  {
+    string name=parts[4];
+    size_t dot=name.rfind('.'), underscore=name.find('_');
+    string extension=(dot == string::npos) ? "" : name.substr(dot);
+    if ((extension == ".jpeg" || extension == ".jpg") && underscore != string::npos && underscore < dot &&
+        ParseNumber(name.substr(0,underscore),col) && ParseNumber(name.substr(underscore+1,dot-underscore-1),row) &&
+        slide < slides.size())
+    {
+      connection.busy=true;
+      uint64_t id=connection.id;
+      pool->Submit([this, fd, id, start, slide, field, channel, level, col, row, head, keepalive]()
+      {
+        tile_queue.Record(MicrosecondsSince(start));
+        chrono::steady_clock::time_point renderstart=chrono::steady_clock::now();
+        Completion completion;
+        completion.fd=fd;
+        completion.id=id;
+        completion.start=start;
+        completion.response=RenderTile(slide,field,channel,level,col,row,head,keepalive);
+        tile_render.Record(MicrosecondsSince(renderstart));
+        {
+          lock_guard<mutex> guard(completionlock);
+          completions.push_back(completion);
+        }
+        Wake();
+      });
+      return;
+    }
+  }
+
+  QueueResponse(fd,ErrorResponse(404,head,keepalive));
+}
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Local Tile Server
+//
+// Serves slides opened with SlideReader to viewers over HTTP using the Deep Zoom path
+// scheme. Each channel of each field is its own Deep Zoom image, rendered as 8 bit
+// grayscale JPEG tiles:
+//
+//   GET /                                     JSON list of slides, fields and channels
+//   GET /S/F/C.dzi                            Deep Zoom descriptor
+//   GET /S/F/C_files/L/COL_ROW.jpeg           Tile COL,ROW of Deep Zoom level L
+//   GET /stats                                Latency histograms and cache counters
+//
+//   S = Slide (position on the command line), F = Field (position in the slide),
+//   C = Channel number
+//
+// Connections are handled by a single epoll event loop. Tiles are rendered on a
+// thread pool: the nearest finer SCN resolution level is read through the shared
+// decoded tile cache, box filtered down to the Deep Zoom level, scaled to 8 bits
+// from the stored bit depth and JPEG encoded.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILESERVER_H
+#define TILESERVER_H
+
+#include "SlideReader.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Server Settings
+struct TileServerOptions
+{
+  std::string host;   // Address to listen on
+  int port;           // 0 picks a free port (see TileServer::Port)
+  int nthreads;       // Render threads, <= 0 uses one per hardware thread
+  size_t cache_bytes; // Decoded tile cache capacity
+  int tilesize;       // Deep Zoom tile size
+  int overlap;        // Deep Zoom tile overlap
+  int quality;        // JPEG quality
+
+  TileServerOptions() : host("127.0.0.1"), port(8080), nthreads(0), cache_bytes(static_cast<size_t>(256)*1024*1024),
+                        tilesize(254), overlap(1), quality(85) {}
+};
+
+// Latency Histogram With Power Of Two Microsecond Buckets
+class LatencyHistogram
+{
+public:
+  static const int NBUCKETS=32; // Bucket b holds latencies in [2^b-1, 2^(b+1)-1) us
+
+  LatencyHistogram();
+  void Record(uint64_t us);
+
+  // JSON Object With Count, Mean, Max, Percentile Estimates And Bucket Counts
+  std::string JSON() const;
+
+private:
+  std::atomic<uint64_t> buckets[NBUCKETS];
+  std::atomic<uint64_t> count, total, maximum;
+};
+
+class TileServer
+{
+public:
+  // Readers Stay Owned By The Caller And Get The Server's Tile Cache Attached
+  TileServer(const std::vector<SlideReader *> &slides_, const TileServerOptions &options_);
+  ~TileServer();
+
+  // Bind And Listen; Returns false If The Address Cannot Be Used
+  bool Start();
+  int Port() const { return port; }
+
+  // Serve Until Stop() Is Called
+  void Run();
+
+  // Ask Run() To Return. Safe To Call From Any Thread Or A Signal Handler.
+  void Stop();
+
+private:
+  TileServer(const TileServer &);
+  TileServer &operator=(const TileServer &);
+
+  struct Connection
+  {
+    uint64_t id;        // Distinguishes connections reusing a file descriptor
+    std::string in;     // Received bytes not yet handled
+    std::string out;    // Response bytes not yet sent
+    size_t outpos;
+    bool busy;          // A response is being rendered on the pool
+    bool keepalive;
+    bool writing;       // Registered for EPOLLOUT
+  };
+
+  // Response Handed Back From The Pool To The Event Loop
+  struct Completion
+  {
+    int fd;
+    uint64_t id;
+    std::chrono::steady_clock::time_point start; // When the request was parsed
+    std::string response;
+  };
+
+  void Accept();
+  void ReadConnection(int fd);
+  void WriteConnection(int fd);
+  void CloseConnection(int fd);
+  void HandleRequests(int fd);
+  void QueueResponse(int fd, const std::string &response);
+  void DrainCompletions();
+  void Wake();
+
+  // Response Bodies And Rendering
+  std::string SlideListJSON() const;
+  std::string StatsJSON() const;
+  std::string RenderTile(size_t slide, size_t field, int channel, int level, uint32_t col, uint32_t row, bool head,
+                         bool keepalive);
+
+  std::vector<SlideReader *> slides;
+  TileServerOptions options;
+  TileCache cache;
+  int listenfd, epollfd, wakefd;
+  int port;
+  std::atomic<bool> stopping;
+  uint64_t nextid;
+  std::map<int, Connection> connections;
+  std::mutex completionlock;
+  std::vector<Completion> completions;
+
+  LatencyHistogram tile_total, tile_queue, tile_render, metadata;
+  std::atomic<uint64_t> requests, errors;
+  std::unique_ptr<ThreadPool> pool; // Shut down first, so pending renders finish before the rest goes away
+};
+
+#endif
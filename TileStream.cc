@@ -0,0 +1,301 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Framed Tile Stream For Piping
+// See TileStream.h for details.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "TileStream.h"
+#include "IFDScanner.h"
+#include "IOHelpers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Frames
+////////////////////////////////////////////////////////////////////////////////////////
+static void PutLE(uint8_t *out, uint64_t value, int nbytes)
+{
+  for (int ii=0;ii<nbytes;ii++) out[ii]=static_cast<uint8_t>(value >> (8*ii));
+}
+
+void EncodeTileFrame(const TileFrame &frame, uint8_t *out)
+{
+  memset(out,0,kTileFrameBytes);
+  memcpy(out,"SCNT",4);
+  PutLE(out+4,1,2);
+  PutLE(out+6,kTileFrameBytes,2);
+  out[8]=static_cast<uint8_t>(frame.kind);
+  out[9]=static_cast<uint8_t>(frame.encoding);
+  out[10]=static_cast<uint8_t>(frame.type);
+  PutLE(out+12,frame.compression,2);
+  PutLE(out+16,frame.slide,4);
+  PutLE(out+20,static_cast<uint32_t>(frame.field),4);
+  PutLE(out+24,static_cast<uint32_t>(frame.channel),4);
+  PutLE(out+28,static_cast<uint32_t>(frame.level),4);
+  PutLE(out+32,frame.col,4);
+  PutLE(out+36,frame.row,4);
+  PutLE(out+40,frame.x,4);
+  PutLE(out+44,frame.y,4);
+  PutLE(out+48,frame.width,4);
+  PutLE(out+52,frame.height,4);
+  PutLE(out+56,frame.payloadbytes,8);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Writer
+////////////////////////////////////////////////////////////////////////////////////////
+bool TileStreamWriter::Write(const TileFrame &frame, const void *payload)
+{
+  uint8_t header[kTileFrameBytes];
+  EncodeTileFrame(frame,header);
+  struct iovec iov[2];
+  iov[0].iov_base=header;
+  iov[0].iov_len=kTileFrameBytes;
+  iov[1].iov_base=const_cast<void *>(payload);
+  iov[1].iov_len=(payload != NULL) ? frame.payloadbytes : 0;
+
+  lock_guard<mutex> guard(lock);
+  if (failed) return false;
+  int iiov=0;
+  while (iiov < 2)
+  {
+    ssize_t nn=writev(fd,iov+iiov,2-iiov);
+    if (nn < 0 && errno == EINTR) continue;
+    if (nn <= 0)
+    {
+      failed=true;
+      return false;
+    }
+    // Step Past What Was Written, Which May End Inside Either Part
+    size_t left=static_cast<size_t>(nn);
+    while (iiov < 2 && left >= iov[iiov].iov_len) left-=iov[iiov++].iov_len;
+    if (iiov < 2)
+    {
+      iov[iiov].iov_base=static_cast<char *>(iov[iiov].iov_base)+left;
+      iov[iiov].iov_len-=left;
+    }
+  }
+  if (frame.kind == TILE_FRAME_TILE)
+  {
+    frames++;
+    bytes+=frame.payloadbytes;
+  }
+  return true;
+}
+
+bool TileStreamWriter::Finish()
+{
+  TileFrame frame;
+  memset(&frame,0,sizeof(frame));
+  frame.kind=TILE_FRAME_END;
+  return Write(frame,NULL);
+}
+
+bool TileStreamWriter::Failed() const
+{
+  lock_guard<mutex> guard(lock);
+  return failed;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Streaming
+////////////////////////////////////////////////////////////////////////////////////////
+// One Tile Of One Channel
+struct StreamTask
+{
+  uint32_t slide;
+  int field, channel;
+  const IndexedDirectory *directory;
+  int sample;
+  uint32 col, row;
+};
+
+static bool Selected(const vector<int> &numbers, int number)
+{
+  return numbers.empty() || find(numbers.begin(),numbers.end(),number) != numbers.end();
+}
+
+// Write A Tables Frame For Each Plane Whose Directory Has JPEGTables. A Failed Write Is
+// Left For The Caller To See In writer.Failed().
+static SCNReadStatus SendJPEGTables(const vector<SlideReader *> &slides, const vector<StreamTask> &planes, int level,
+                                    TileStreamWriter &writer)
+{
+  for (uint32_t is=0;is<slides.size();is++)
+  {
+    IFDScanner scanner;
+    bool flag_open=false;
+    for (size_t ip=0;ip<planes.size();ip++)
+    {
+      const StreamTask &plane=planes[ip];
+      if (plane.slide != is) continue;
+      if (!flag_open && !scanner.Open(slides[is]->Filename())) return SCN_READ_FAILED;
+      flag_open=true;
+      ScannedIFD ifd;
+      vector<uint8_t> tables;
+      if (!scanner.ScanDirectoryAt(plane.directory->diroffset,ifd)) return SCN_READ_FAILED;
+      if (!scanner.ReadJPEGTables(ifd,tables) || tables.empty()) continue;
+
+      const SCNDirectoryLayout &layout=plane.directory->layout;
+      TileFrame frame;
+      memset(&frame,0,sizeof(frame));
+      frame.kind=TILE_FRAME_TABLES;
+      frame.encoding=TILE_RAW;
+      frame.type=layout.type;
+      frame.compression=layout.compression;
+      frame.slide=is;
+      frame.field=plane.field;
+      frame.channel=plane.channel;
+      frame.level=level;
+      frame.width=layout.width;
+      frame.height=layout.height;
+      frame.payloadbytes=tables.size();
+      if (!writer.Write(frame,&tables[0])) return SCN_READ_OK;
+    }
+  }
+  return SCN_READ_OK;
+}
+
+SCNReadStatus StreamTiles(const vector<SlideReader *> &slides, const TileStreamOptions &options,
+                          TileScheduler &scheduler, TileStreamWriter &writer)
+{
+  // Collect Tiles, Weighted By Compressed Size. Raw Tiles Holding Several Channels
+  // (Chunky Samples) Are Sent Once, Under The First Channel.
+  vector<StreamTask> tasks, planes;
+  vector<uint64_t> costs;
+  for (uint32_t is=0;is<slides.size();is++)
+  {
+    const SlideIndex &index=slides[is]->Index();
+    vector<pair<int, int> > rawplanes;
+    for (size_t ifield=0;ifield<index.description.fields.size();ifield++)
+    {
+      if (!Selected(options.fields,static_cast<int>(ifield))) continue;
+      const vector<SCNDimension> &dimensions=index.description.fields[ifield].dimensions;
+      for (size_t id=0;id<dimensions.size();id++)
+      {
+        const SCNDimension &dimension=dimensions[id];
+        if (dimension.r != options.level || !Selected(options.channels,dimension.channel)) continue;
+        const IndexedDirectory *directory=options.raw ? index.FindDirectory(dimension.ifd) :
+                                                        slides[is]->FindChannel(ifield,dimension.channel,dimension.r);
+        if (directory == NULL) continue;
+        const SCNDirectoryLayout &layout=directory->layout;
+        int sample=ChannelSample(layout,dimension.channel);
+        if (sample < 0) continue;
+        if (options.raw)
+        {
+          pair<int, int> plane(directory->ifd,(layout.planarconfig == PLANARCONFIG_SEPARATE) ? sample : 0);
+          if (find(rawplanes.begin(),rawplanes.end(),plane) != rawplanes.end()) continue;
+          rawplanes.push_back(plane);
+          StreamTask first={is,static_cast<int>(ifield),dimension.channel,directory,sample,0,0};
+          planes.push_back(first);
+        }
+        for (uint32 row=0;row<TilesDown(layout);row++)
+        {
+          for (uint32 col=0;col<TilesAcross(layout);col++)
+          {
+            StreamTask task={is,static_cast<int>(ifield),dimension.channel,directory,sample,col,row};
+            uint32 itile=TileIndex(layout,col,row,sample);
+            tasks.push_back(task);
+            costs.push_back(itile < directory->bytecounts.size() ? directory->bytecounts[itile] : 0);
+          }
+        }
+      }
+    }
+  }
+
+  // Raw Tiles Are Read Straight From The Files
+  vector<int> fds(slides.size(),-1);
+  if (options.raw)
+  {
+    for (size_t is=0;is<slides.size();is++)
+    {
+      fds[is]=open(slides[is]->Filename().c_str(),O_RDONLY);
+      if (fds[is] < 0)
+      {
+        for (size_t jj=0;jj<is;jj++) close(fds[jj]);
+        return SCN_READ_FAILED;
+      }
+    }
+  }
+
+  // JPEGTables Of Every Raw Plane, Sent Ahead Of All Tiles
+  if (options.raw)
+  {
+    SCNReadStatus tablestatus=SendJPEGTables(slides,planes,options.level,writer);
+    if (tablestatus != SCN_READ_OK)
+    {
+      for (size_t is=0;is<fds.size();is++) if (fds[is] >= 0) close(fds[is]);
+      return tablestatus;
+    }
+  }
+
+  // Read Every Tile Into Its Worker's Buffer And Send It
+  atomic<int> status(SCN_READ_OK);
+  vector<vector<uint8> > buffers(scheduler.Size());
+  scheduler.Run(costs,[&](size_t itask, int worker) {
+    if (status.load(memory_order_relaxed) != SCN_READ_OK || writer.Failed()) return;
+    const StreamTask &task=tasks[itask];
+    const SCNDirectoryLayout &layout=task.directory->layout;
+    TileFrame frame;
+    frame.kind=TILE_FRAME_TILE;
+    frame.encoding=options.raw ? TILE_RAW : TILE_DECODED;
+    frame.type=layout.type;
+    frame.compression=options.raw ? layout.compression : 1;
+    frame.slide=task.slide;
+    frame.field=task.field;
+    frame.channel=task.channel;
+    frame.level=options.level;
+    frame.col=task.col;
+    frame.row=task.row;
+    frame.x=task.col*layout.tilewidth;
+    frame.y=task.row*layout.tilelength;
+    frame.width=min(layout.tilewidth,layout.width-frame.x);
+    frame.height=min(layout.tilelength,layout.height-frame.y);
+    vector<uint8> &buffer=buffers[worker];
+
+    if (options.raw)
+    {
+      uint32 itile=TileIndex(layout,task.col,task.row,task.sample);
+      if (itile >= task.directory->offsets.size() || itile >= task.directory->bytecounts.size())
+      {
+        status.store(SCN_READ_FAILED);
+        return;
+      }
+      if (layout.tiled)
+      {
+        frame.width=layout.tilewidth;
+        frame.height=layout.tilelength;
+      }
+      frame.payloadbytes=task.directory->bytecounts[itile];
+      buffer.resize(frame.payloadbytes > 0 ? frame.payloadbytes : 1);
+      if (!PreadAll(fds[task.slide],&buffer[0],frame.payloadbytes,task.directory->offsets[itile]))
+      {
+        status.store(SCN_READ_FAILED);
+        return;
+      }
+    }
+    else
+    {
+      size_t rowbytes=static_cast<size_t>(frame.width)*SampleBytes(layout.type);
+      frame.payloadbytes=rowbytes*frame.height;
+      buffer.resize(frame.payloadbytes > 0 ? frame.payloadbytes : 1);
+      SCNReadStatus tilestatus=slides[task.slide]->ReadRegion(*task.directory,task.channel,frame.x,frame.y,frame.width,
+                                                              frame.height,&buffer[0],rowbytes);
+      if (tilestatus != SCN_READ_OK)
+      {
+        status.store(tilestatus);
+        return;
+      }
+    }
+    writer.Write(frame,&buffer[0]);
+  });
+
+  for (size_t is=0;is<fds.size();is++) if (fds[is] >= 0) close(fds[is]);
+  return static_cast<SCNReadStatus>(status.load());
+}
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Framed Tile Stream For Piping
+//
+// Writes the tiles of one or more slides to a file descriptor (normally stdout) as a
+// stream of frames, so the converter can feed compression, hashing or analysis tools
+// through a pipe without intermediate files. Tiles are decoded (or, raw, read as
+// stored) on all workers of a TileScheduler, largest compressed size first, and each
+// is written as soon as it is ready, so frames arrive in completion order. A full
+// pipe blocks the workers, which keeps memory at one tile per worker.
+//
+// Every frame is a 64 byte little-endian header followed by payloadbytes of payload:
+//
+//   offset  size  field
+//        0     4  magic "SCNT"
+//        4     2  version (1)
+//        6     2  header bytes (64)
+//        8     1  kind: 0 = tile, 1 = end of stream (no payload), 2 = JPEG tables
+//        9     1  encoding: 0 = decoded, 1 = raw
+//       10     1  dtype (SampleType: 0 uint8, 1 int8, 2 uint16, 3 int16, 4 uint32,
+//                 5 int32, 6 float32, 7 float64)
+//       11     1  reserved
+//       12     2  compression (TIFF compression code of raw tiles, 1 if decoded)
+//       14     2  reserved
+//       16     4  slide (position in the list of slides)
+//       20     4  field (position in the slide, as in output filenames)
+//       24     4  channel
+//       28     4  level (resolution level, 0 = highest)
+//       32     4  tile column
+//       36     4  tile row
+//       40     4  x, pixel column of the tile's top left corner
+//       44     4  y, pixel row of the tile's top left corner
+//       48     4  width
+//       52     4  height
+//       56     8  payload bytes
+//
+// Decoded payloads hold width x height samples of the channel in host byte order, top
+// row first, clipped to the image (edge tiles are smaller). Raw payloads are the tile
+// (or strip) exactly as stored in the slide, width x height being its stored size.
+// The end frame tells a consumer the stream is complete rather than cut off.
+//
+// JPEG tiles of a raw stream are usually abbreviated: their quantisation and Huffman
+// tables are stored once per directory in the JPEGTables tag. Such directories get a
+// tables frame (kind 2, with the slide, field, channel and level of their tile frames,
+// col, row, x and y 0, width x height the image size) whose payload is the JPEGTables
+// tag as stored, a complete SOI ... EOI stream. All tables frames are written before
+// the first tile frame, so a consumer keeps the last one per (slide, field, channel,
+// level) and decodes a tile as tables[:-2] + tile[2:] (dropping EOI and SOI), or feeds
+// both to a decoder that accepts separate tables.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILESTREAM_H
+#define TILESTREAM_H
+
+#include "SlideReader.h"
+#include "TileScheduler.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+static const size_t kTileFrameBytes=64;
+
+enum TileFrameKind
+{
+  TILE_FRAME_TILE=0,
+  TILE_FRAME_END=1,
+  TILE_FRAME_TABLES=2
+};
+
+enum TileFrameEncoding
+{
+  TILE_DECODED=0,
+  TILE_RAW=1
+};
+
+struct TileFrame
+{
+  TileFrameKind kind;
+  TileFrameEncoding encoding;
+  SampleType type;
+  uint16_t compression;
+  uint32_t slide;
+  int32_t field, channel, level;
+  uint32_t col, row;
+  uint32_t x, y, width, height;
+  uint64_t payloadbytes;
+};
+
+// Serialize A Frame Header Into kTileFrameBytes Bytes
+void EncodeTileFrame(const TileFrame &frame, uint8_t *out);
+
+class TileStreamWriter
+{
+public:
+  explicit TileStreamWriter(int fd_) : fd(fd_), failed(false), frames(0), bytes(0) {}
+
+  // Write One Frame And Its Payload As A Unit; Safe From Several Threads. Fails Once
+  // The Reader Has Gone (EPIPE; Ignore SIGPIPE) Or Any Write Failed.
+  bool Write(const TileFrame &frame, const void *payload);
+
+  // Write The End Frame
+  bool Finish();
+
+  bool Failed() const;
+  uint64_t Frames() const { return frames; } // Tile frames, valid after the run
+  uint64_t Bytes() const { return bytes; }   // Payload bytes of those frames
+
+private:
+  TileStreamWriter(const TileStreamWriter &);
+  TileStreamWriter &operator=(const TileStreamWriter &);
+
+  int fd;
+  mutable std::mutex lock;
+  bool failed;
+  uint64_t frames, bytes;
+};
+
+// What To Stream; Empty fields Or channels Select All
+struct TileStreamOptions
+{
+  bool raw;
+  int level;
+  std::vector<int> fields;
+  std::vector<int> channels;
+
+  TileStreamOptions() : raw(false), level(0) {}
+};
+
+// Stream Every Selected Tile Of slides, Raw Streams Preceded By The Tables Frames Of
+// Their JPEG Directories. Decoded Streams Skip Directories The Native Path Cannot
+// Read. Returns SCN_READ_FAILED If A Tile Could Not Be Read; Check writer.Failed()
+// For Write Errors.
+SCNReadStatus StreamTiles(const std::vector<SlideReader *> &slides, const TileStreamOptions &options,
+                          TileScheduler &scheduler, TileStreamWriter &writer);
+
+#endif
@@ -0,0 +1,316 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Synthetic Leica SCN Slide For Tests And Benchmarks
+//
+// Writes a BigTIFF laid out like an SCN400F slide: directory 0 is the macro image
+// holding the XML description, followed by one directory per channel and level of
+// each field. The fields cover the storage variants the converter handles:
+//
+//   field  channels  type    storage                          levels
+//       0  3         uint8   tiled 256, JPEG (grayscale)      r=0, r=1 (uncompressed)
+//       1  2         uint16  tiled 128, uncompressed, top     r=0
+//                            rows blank (all zero)
+//       2  1         uint8   stripped, 16 rows per strip      r=0
+//       3  1         uint8   tiled 256, blank (all zero)      r=0
+//       4  RGB       uint8   tiled 256, JPEG YCbCr 2x2,       r=0
+//                            no "c" attribute (brightfield)
+//
+// With --fluorescence the slide is instead like a production fluorescence scan, which
+// the mosaic needs: every field holds the same 3 uint16 channels.
+//
+//   field  channels  type    storage                          levels
+//       0  3         uint16  tiled 256, uncompressed          r=0, r=1
+//       1  3         uint16  tiled 512, uncompressed, top     r=0
+//                            rows blank (all zero)
+//       2  3         uint16  stripped, 32 rows per strip      r=0
+//       3  3         uint16  tiled 256, blank (all zero)      r=0
+//
+// Samples follow simple gradients of x, y and channel, so outputs are deterministic
+// and any misplaced row or tile changes them. --scale=N multiplies every field's width
+// and height by N (e.g. for benchmarks).
+//
+// Usage: MakeTestSlide [--fluorescence] [--scale=N] filename_output
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+extern "C" {
+  #include <tiffio.h>
+}
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Pixel Size Of r=0, nm
+static const long kPixelSize=500;
+
+enum FieldStorage
+{
+  STORAGE_JPEG,
+  STORAGE_TILED,
+  STORAGE_STRIPPED,
+  STORAGE_RGB_JPEG
+};
+
+struct TestField
+{
+  uint32 width, height;
+  int nchannels;          // Directories, one per channel; 1 for RGB
+  uint16 bitspersample;
+  FieldStorage storage;
+  uint32 tilesize;        // Tile side, or rows per strip
+  bool blank;             // All samples zero
+  uint32 blankrows;       // Top rows left zero
+  bool reduced;           // Also an r=1 level at half size
+  long offsetX, offsetY;  // Placement in the collection, nm
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Samples
+////////////////////////////////////////////////////////////////////////////////////////
+static uint32 Sample(const TestField &field, int channel, uint32 x, uint32 y)
+{
+  if (field.blank || y < field.blankrows) return 0;
+  if (field.bitspersample == 16) return (x*37+y*101+channel*1000+(x*y)%251) & 0xffff;
+  return (x/2+y/3+channel*60+((x/16+y/16)%2)*40) & 0xff;
+}
+
+// One Plane Of A Channel (Or, For RGB, The Interleaved Pixels), Top Row First
+static vector<uint8> Plane(const TestField &field, int channel, uint32 ww, uint32 hh, uint32 step)
+{
+  int nsamples=(field.storage == STORAGE_RGB_JPEG) ? 3 : 1;
+  size_t nbytes=field.bitspersample/8;
+  vector<uint8> plane(static_cast<size_t>(ww)*hh*nsamples*nbytes);
+  for (uint32 y=0;y<hh;y++)
+  {
+    for (uint32 x=0;x<ww;x++)
+    {
+      for (int is=0;is<nsamples;is++)
+      {
+        uint32 value=Sample(field,channel+is,x*step,y*step);
+        size_t ii=(static_cast<size_t>(y)*ww+x)*nsamples+is;
+        if (nbytes == 2)
+        {
+          uint16 value16=static_cast<uint16>(value);
+          memcpy(&plane[ii*2],&value16,2);
+        }
+        else plane[ii]=static_cast<uint8>(value);
+      }
+    }
+  }
+  return plane;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Directories
+////////////////////////////////////////////////////////////////////////////////////////
+static bool WriteTiled(TIFF *tif, const vector<uint8> &plane, uint32 ww, uint32 hh, uint32 tile, size_t pixelbytes)
+{
+  vector<uint8> buffer(static_cast<size_t>(tile)*tile*pixelbytes);
+  uint32 itile=0;
+  for (uint32 y0=0;y0<hh;y0+=tile)
+  {
+    for (uint32 x0=0;x0<ww;x0+=tile)
+    {
+      // Edge Tiles Are Padded With Zeros
+      memset(&buffer[0],0,buffer.size());
+      for (uint32 y=y0;y<y0+tile && y<hh;y++)
+      {
+        uint32 nn=(x0+tile <= ww) ? tile : ww-x0;
+        memcpy(&buffer[(static_cast<size_t>(y-y0)*tile)*pixelbytes],&plane[(static_cast<size_t>(y)*ww+x0)*pixelbytes],
+               nn*pixelbytes);
+      }
+      if (TIFFWriteEncodedTile(tif,itile++,&buffer[0],buffer.size()) < 0) return false;
+    }
+  }
+  return true;
+}
+
+static bool WriteStripped(TIFF *tif, const vector<uint8> &plane, uint32 ww, uint32 hh, uint32 rows, size_t pixelbytes)
+{
+  size_t rowbytes=static_cast<size_t>(ww)*pixelbytes;
+  uint32 istrip=0;
+  for (uint32 y0=0;y0<hh;y0+=rows)
+  {
+    uint32 nn=(y0+rows <= hh) ? rows : hh-y0;
+    if (TIFFWriteEncodedStrip(tif,istrip++,const_cast<uint8 *>(&plane[y0*rowbytes]),nn*rowbytes) < 0) return false;
+  }
+  return true;
+}
+
+// One Channel (Or The RGB Image) Of A Field At Level r
+static bool WriteChannel(TIFF *tif, const TestField &field, int channel, int r)
+{
+  uint32 step=1u << r;
+  uint32 ww=(field.width+step-1)/step, hh=(field.height+step-1)/step;
+  bool rgb=(field.storage == STORAGE_RGB_JPEG);
+  bool jpeg=(r == 0 && (field.storage == STORAGE_JPEG || rgb));
+  uint16 nsamples=rgb ? 3 : 1;
+  size_t pixelbytes=nsamples*field.bitspersample/8;
+  vector<uint8> plane=Plane(field,channel,ww,hh,step);
+
+  TIFFSetField(tif,TIFFTAG_SUBFILETYPE,0);
+  TIFFSetField(tif,TIFFTAG_IMAGEWIDTH,ww);
+  TIFFSetField(tif,TIFFTAG_IMAGELENGTH,hh);
+  TIFFSetField(tif,TIFFTAG_BITSPERSAMPLE,field.bitspersample);
+  TIFFSetField(tif,TIFFTAG_SAMPLESPERPIXEL,nsamples);
+  TIFFSetField(tif,TIFFTAG_SAMPLEFORMAT,SAMPLEFORMAT_UINT);
+  TIFFSetField(tif,TIFFTAG_PLANARCONFIG,PLANARCONFIG_CONTIG);
+  TIFFSetField(tif,TIFFTAG_COMPRESSION,jpeg ? COMPRESSION_JPEG : COMPRESSION_NONE);
+  if (jpeg) TIFFSetField(tif,TIFFTAG_JPEGQUALITY,90);
+  if (rgb)
+  {
+    // libjpeg Converts The RGB Samples Written To YCbCr
+    TIFFSetField(tif,TIFFTAG_PHOTOMETRIC,PHOTOMETRIC_YCBCR);
+    TIFFSetField(tif,TIFFTAG_YCBCRSUBSAMPLING,2,2);
+    TIFFSetField(tif,TIFFTAG_JPEGCOLORMODE,JPEGCOLORMODE_RGB);
+  }
+  else TIFFSetField(tif,TIFFTAG_PHOTOMETRIC,PHOTOMETRIC_MINISBLACK);
+
+  bool flag_ok;
+  if (field.storage == STORAGE_STRIPPED)
+  {
+    TIFFSetField(tif,TIFFTAG_ROWSPERSTRIP,field.tilesize);
+    flag_ok=WriteStripped(tif,plane,ww,hh,field.tilesize,pixelbytes);
+  }
+  else
+  {
+    uint32 tile=(r == 0) ? field.tilesize : 128;
+    TIFFSetField(tif,TIFFTAG_TILEWIDTH,tile);
+    TIFFSetField(tif,TIFFTAG_TILELENGTH,tile);
+    flag_ok=WriteTiled(tif,plane,ww,hh,tile,pixelbytes);
+  }
+  return flag_ok && TIFFWriteDirectory(tif);
+}
+
+// Macro Image In Directory 0, Carrying The Description
+static bool WriteMacro(TIFF *tif, const string &description)
+{
+  const uint32 ww=160, hh=120;
+  vector<uint8> pixels(ww*hh*3);
+  for (uint32 ii=0;ii<ww*hh;ii++)
+  {
+    pixels[3*ii]=static_cast<uint8>(ii%ww);
+    pixels[3*ii+1]=static_cast<uint8>(ii/ww);
+    pixels[3*ii+2]=128;
+  }
+  TIFFSetField(tif,TIFFTAG_SUBFILETYPE,0);
+  TIFFSetField(tif,TIFFTAG_IMAGEWIDTH,ww);
+  TIFFSetField(tif,TIFFTAG_IMAGELENGTH,hh);
+  TIFFSetField(tif,TIFFTAG_BITSPERSAMPLE,8);
+  TIFFSetField(tif,TIFFTAG_SAMPLESPERPIXEL,3);
+  TIFFSetField(tif,TIFFTAG_PLANARCONFIG,PLANARCONFIG_CONTIG);
+  TIFFSetField(tif,TIFFTAG_PHOTOMETRIC,PHOTOMETRIC_RGB);
+  TIFFSetField(tif,TIFFTAG_COMPRESSION,COMPRESSION_NONE);
+  TIFFSetField(tif,TIFFTAG_ROWSPERSTRIP,hh);
+  TIFFSetField(tif,TIFFTAG_IMAGEDESCRIPTION,description.c_str());
+  return TIFFWriteEncodedStrip(tif,0,&pixels[0],pixels.size()) >= 0 && TIFFWriteDirectory(tif);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Description
+////////////////////////////////////////////////////////////////////////////////////////
+static string Description(const vector<TestField> &fields, long collectionX, long collectionY)
+{
+  ostringstream xml;
+  xml << "<?xml version=\"1.0\"?>\n"
+      << "<scn xmlns=\"http://www.leica-microsystems.com/scn/2010/10/01\">"
+      << "<collection name=\"MakeTestSlide\" sizeX=\"" << collectionX << "\" sizeY=\"" << collectionY << "\">"
+      << "<image><view sizeX=\"" << collectionX << "\" sizeY=\"" << collectionY << "\" offsetX=\"0\" offsetY=\"0\"/>"
+      << "<pixels><dimension sizeX=\"160\" sizeY=\"120\" ifd=\"0\"/></pixels></image>";
+  int ifd=1;
+  for (size_t ii=0;ii<fields.size();ii++)
+  {
+    const TestField &field=fields[ii];
+    xml << "<image><view sizeX=\"" << field.width*kPixelSize << "\" sizeY=\"" << field.height*kPixelSize
+        << "\" offsetX=\"" << field.offsetX << "\" offsetY=\"" << field.offsetY << "\"/><pixels>";
+    for (int r=0;r <= (field.reduced ? 1 : 0);r++)
+    {
+      uint32 step=1u << r;
+      for (int ic=0;ic<field.nchannels;ic++)
+      {
+        xml << "<dimension sizeX=\"" << (field.width+step-1)/step << "\" sizeY=\"" << (field.height+step-1)/step << "\"";
+        if (field.storage != STORAGE_RGB_JPEG) xml << " c=\"" << ic << "\"";
+        xml << " ifd=\"" << ifd++ << "\" r=\"" << r << "\"/>";
+      }
+    }
+    xml << "</pixels></image>";
+  }
+  xml << "</collection></scn>";
+  return xml.str();
+}
+
+int main(int argc, char * argv[])
+{
+  // Read Inputs
+  uint32 scale=1;
+  string fn_out;
+  bool flag_fluorescence=false, flag_usage=false;
+  for (int ii=1;ii<argc;ii++)
+  {
+    string arg=argv[ii];
+    if (arg.compare(0,8,"--scale=") == 0) scale=static_cast<uint32>(atol(arg.substr(8).c_str()));
+    else if (arg == "--fluorescence") flag_fluorescence=true;
+    else if (arg.compare(0,2,"--") == 0 || !fn_out.empty()) flag_usage=true;
+    else fn_out=arg;
+  }
+  if (flag_usage || fn_out.empty() || scale == 0)
+  {
+    cout << "Usage: MakeTestSlide [--fluorescence] [--scale=N] filename_output" << endl;
+    return -1;
+  }
+
+  // Fields Side By Side, 20 Pixels Apart
+  TestField fields[]={
+    {700,520,3,8,STORAGE_JPEG,256,false,0,true,0,0},
+    {600,1100,2,16,STORAGE_TILED,128,false,300,false,0,0},
+    {333,211,1,8,STORAGE_STRIPPED,16,false,0,false,0,0},
+    {512,300,1,8,STORAGE_TILED,256,true,0,false,0,0},
+    {400,300,1,8,STORAGE_RGB_JPEG,256,false,0,false,0,0}};
+  TestField fluorescence[]={
+    {1000,760,3,16,STORAGE_TILED,256,false,0,true,0,0},
+    {800,1200,3,16,STORAGE_TILED,512,false,400,false,0,0},
+    {640,480,3,16,STORAGE_STRIPPED,32,false,0,false,0,0},
+    {512,512,3,16,STORAGE_TILED,256,true,0,false,0,0}};
+  vector<TestField> slide;
+  if (flag_fluorescence) slide.assign(fluorescence,fluorescence+sizeof(fluorescence)/sizeof(fluorescence[0]));
+  else slide.assign(fields,fields+sizeof(fields)/sizeof(fields[0]));
+  long x=20*kPixelSize, height=0;
+  for (size_t ii=0;ii<slide.size();ii++)
+  {
+    slide[ii].width*=scale;
+    slide[ii].height*=scale;
+    slide[ii].offsetX=x;
+    slide[ii].offsetY=20*kPixelSize;
+    x+=(slide[ii].width+20)*kPixelSize;
+    if (slide[ii].height > height) height=slide[ii].height;
+  }
+  long collectionX=x, collectionY=(height+40)*kPixelSize;
+
+  TIFF *tif=TIFFOpen(fn_out.c_str(),"w8");
+  if (tif == NULL)
+  {
+    cout << "ERROR (MakeTestSlide.cc): Could Not Create " << fn_out << endl;
+    return 1;
+  }
+  bool flag_ok=WriteMacro(tif,Description(slide,collectionX,collectionY));
+  for (size_t ii=0;ii<slide.size() && flag_ok;ii++)
+  {
+    for (int r=0;r <= (slide[ii].reduced ? 1 : 0) && flag_ok;r++)
+    {
+      for (int ic=0;ic<slide[ii].nchannels && flag_ok;ic++) flag_ok=WriteChannel(tif,slide[ii],ic,r);
+    }
+  }
+  TIFFClose(tif);
+  if (!flag_ok)
+  {
+    cout << "ERROR (MakeTestSlide.cc): Could Not Write " << fn_out << endl;
+    return 1;
+  }
+  cout << "Wrote " << fn_out << " (" << slide.size() << " Fields, Scale " << scale << ")" << endl;
+  return 0;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+########################################################################################
+# Time The Main Conversion Paths On One Slide
+#
+# Usage: RunBenchmarks.sh converter slide workdir
+#
+# Each run starts from an empty workdir and without an index, so every run reads the
+# whole slide. Prints one line per run: seconds, MB written and the run's options.
+#
+# License: MIT (see LICENSE.txt)
+########################################################################################
+
+set -e
+if [ $# -ne 3 ]; then
+  echo "Usage: RunBenchmarks.sh converter slide workdir" >&2
+  exit 1
+fi
+converter=$1
+slide=$2
+workdir=$3
+
+run() {
+  name=$1
+  shift
+  rm -rf "$workdir"
+  mkdir -p "$workdir"
+  start=$(date +%s.%N)
+  "$@" > "$workdir.log" 2>&1 || { cat "$workdir.log"; exit 1; }
+  end=$(date +%s.%N)
+  mb=$(du -sm "$workdir" | cut -f1)
+  printf "%-12s %8.2f s %8s MB  %s\n" "$name" "$(awk "BEGIN {print $end - $start}")" "$mb" "$*" | sed "s|$converter|converter|"
+}
+
+run default     "$converter" --no-index --no-journal "$slide" "$workdir/t_"
+run native      "$converter" --no-index --no-journal --native "$slide" "$workdir/t_"
+run checksum    "$converter" --no-index --no-journal --native --checksum=xxh64 "$slide" "$workdir/t_"
+run sparse      "$converter" --no-index --no-journal --native --sparse "$slide" "$workdir/t_"
+run interleaved "$converter" --no-index --no-journal --layout=interleaved "$slide" "$workdir/t_"
+run mosaic      "$converter" mosaic --no-index "$slide" "$workdir/t_"
+run stream      sh -c "\"$converter\" stream --no-index \"$slide\" > /dev/null"
+run stream-raw  sh -c "\"$converter\" stream --raw --no-index \"$slide\" > /dev/null"
+rm -rf "$workdir" "$workdir.log"
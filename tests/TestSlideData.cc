@@ -0,0 +1,1123 @@
+////////////////////////////////////////////////////////////////////////////////////////
+// Converter Tests On A Synthetic Slide
+//
+// Each test case runs the converter (and, for the baseline case, the original
+// converter) on a slide made by MakeTestSlide and checks its outputs. Cases are run
+// by ctest (see tests/CMakeLists.txt):
+//
+//   TestSlideData checksums                        Checksum known-answer values
+//   TestSlideData <case> converter slide workdir [baseline]
+//
+//   baseline   Default and --native outputs byte-identical to the original converter
+//   outputs    --checksum values match the outputs, in Checksums.TYPE and Manifest.json
+//   resume     --resume reuses intact outputs and bands, repairs a damaged one and
+//              keeps its checksum right
+//   sparse     --sparse leaves holes in blank outputs and reads back the same
+//   shards     --tile-rows shards assemble into the unsharded output
+//   npy        --format=npy headers are aligned and describe the samples
+//   stream     stream frames reassemble into the outputs; raw JPEG tiles decode with
+//              the tables frame sent before them
+//   mosaic     mosaic chunks hold each field at its placement, Mosaic.json lists
+//              exactly the non-blank chunks and the rest are holes (run on a
+//              fluorescence slide, as mosaics need the same channels in every field)
+//   unchanged  --skip-unchanged reruns do nothing until an output, a tile byte or
+//              the options change
+//   plan       plan prints one command per shard, which together write the outputs
+//              of a whole run
+//   shm        --shm segments are ready, with headers describing the output and its
+//              samples; a failed run leaves no unpublished segment
+//   thumbnail  thumbnail sizes, components and area-filtered samples
+//   serve      serve answers listing, descriptor, statistics and tile requests, with
+//              full resolution and sampled tiles matching the output
+//   reader     SlideReader::ReadRegion with and without a TileCache, and
+//              PatchSampler batches, match the outputs
+//
+// Exit Code: 0 if every check passed, 1 otherwise.
+//
+// License: MIT (see LICENSE.txt)
+////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Checksum.h"
+#include "PatchSampler.h"
+#include "SharedOutput.h"
+#include "SlideReader.h"
+#include "Thumbnail.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+#include "TileStream.h"
+extern "C" {
+  #include <jpeglib.h>
+}
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Converter Under Test, Slide And Scratch Directory For The Case
+struct TestContext
+{
+  string converter, slide, workdir, baseline;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////////////
+static int nfailed=0;
+
+static bool Check(bool condition, const string &what)
+{
+  if (!condition)
+  {
+    cout << "FAILED: " << what << endl;
+    nfailed++;
+  }
+  return condition;
+}
+
+// Run A Shell Command, Returning Its Exit Code; Its Output Is Kept In output If Given
+static int Run(const string &command, string *output=NULL)
+{
+  cout << "Running: " << command << endl;
+  FILE *pipe=popen((command+" 2>&1").c_str(),"r");
+  if (pipe == NULL) return -1;
+  string text;
+  char buffer[4096];
+  size_t nread;
+  while ((nread=fread(buffer,1,sizeof(buffer),pipe)) > 0) text.append(buffer,nread);
+  int status=pclose(pipe);
+  if (output != NULL) *output=text;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Run The Converter On The Slide With Outputs Under workdir/name/
+static bool Convert(const TestContext &context, const string &name, const string &options, string *output=NULL)
+{
+  string dir=context.workdir+"/"+name;
+  if (Run("mkdir -p '"+dir+"'") != 0) return false;
+  string command="'"+context.converter+"' "+options+" --index-dir='"+context.workdir+"' '"+context.slide+"' '"+
+                 dir+"/t_'";
+  return Check(Run(command,output) == 0,"Converter Succeeds With "+(options.empty() ? string("Defaults") : options));
+}
+
+static bool ReadFile(const string &filename, string &contents)
+{
+  ifstream ifile(filename.c_str(),ios::in | ios::binary);
+  if (!ifile) return false;
+  ostringstream text;
+  text << ifile.rdbuf();
+  contents=text.str();
+  return true;
+}
+
+// Files In A Directory Ending With suffix, Sorted
+static vector<string> ListFiles(const string &dir, const string &suffix)
+{
+  vector<string> names;
+  DIR *dp=opendir(dir.c_str());
+  if (dp == NULL) return names;
+  struct dirent *entry;
+  while ((entry=readdir(dp)) != NULL)
+  {
+    string name=entry->d_name;
+    if (name.size() >= suffix.size() && name.compare(name.size()-suffix.size(),suffix.size(),suffix) == 0)
+    {
+      names.push_back(name);
+    }
+  }
+  closedir(dp);
+  sort(names.begin(),names.end());
+  return names;
+}
+
+static bool SameFile(const string &fn_a, const string &fn_b)
+{
+  string a, b;
+  return ReadFile(fn_a,a) && ReadFile(fn_b,b) && a == b;
+}
+
+// Every .bin Output Of One Run Equals The Same-Named Output Of Another
+static bool SameOutputs(const string &dir_a, const string &dir_b, size_t nexpected)
+{
+  vector<string> names=ListFiles(dir_a,".bin");
+  bool flag_ok=Check(names.size() == nexpected && ListFiles(dir_b,".bin") == names,
+                     "Same Output Files In "+dir_a+" And "+dir_b);
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    flag_ok&=Check(SameFile(dir_a+"/"+names[ii],dir_b+"/"+names[ii]),names[ii]+" Matches");
+  }
+  return flag_ok;
+}
+
+static string HexDigest(const string &data, ChecksumType type)
+{
+  StreamChecksum checksum(type);
+  checksum.Update(data.data(),data.size());
+  return checksum.HexDigest();
+}
+
+static uint64_t GetLE(const uint8_t *p, int nbytes)
+{
+  uint64_t value=0;
+  for (int ii=nbytes-1;ii>=0;ii--) value=(value << 8) | p[ii];
+  return value;
+}
+
+// An Output File Turned Top Row First, Sized From Its Name (..._XW_YH[_uint16])
+struct OutputImage
+{
+  uint32_t width, height;
+  size_t nbytes; // Bytes per sample
+  string rows;
+
+  const uint8_t *Row(uint32_t y) const { return reinterpret_cast<const uint8_t *>(rows.data())+y*width*nbytes; }
+  uint32_t Sample(uint32_t x, uint32_t y) const { return static_cast<uint32_t>(GetLE(Row(y)+x*nbytes,nbytes)); }
+};
+
+static bool LoadOutput(const string &filename, OutputImage &image)
+{
+  size_t ix=filename.rfind("_X");
+  string bin;
+  if (ix == string::npos || sscanf(filename.c_str()+ix,"_X%u_Y%u",&image.width,&image.height) != 2 ||
+      !ReadFile(filename,bin)) return false;
+  image.nbytes=(filename.find("_uint16",ix) != string::npos) ? 2 : 1;
+  size_t rowbytes=image.width*image.nbytes;
+  if (bin.size() != rowbytes*image.height) return false;
+  image.rows.resize(bin.size());
+  for (uint32_t y=0;y<image.height;y++) image.rows.replace(y*rowbytes,rowbytes,bin,(image.height-1-y)*rowbytes,rowbytes);
+  return true;
+}
+
+// The Output Of One Field And Channel In A Directory Of Outputs, Empty If There Is None
+static string FindOutput(const string &dir, int field, int channel, const string &suffix=".bin")
+{
+  ostringstream stem;
+  stem << "t_Image" << field << "_Channel" << channel << "_X";
+  vector<string> names=ListFiles(dir,suffix);
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    if (names[ii].compare(0,stem.str().size(),stem.str()) == 0) return dir+"/"+names[ii];
+  }
+  return "";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Checksum Known-Answer Values
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestChecksums()
+{
+  // Reference Values Of The xxHash, CRC-32C (RFC 3720) And FIPS 180-4 Test Vectors
+  Check(XXH64("",0,0) == 0xEF46DB3751D8E999ull,"XXH64 Of Nothing");
+  Check(XXH64("abc",3,0) == 0x44BC2CF5AD770999ull,"XXH64 Of abc");
+  Check(HexDigest("123456789",CHECKSUM_CRC32C) == "e3069283","CRC32C Of 123456789");
+  Check(HexDigest("abc",CHECKSUM_SHA256) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "SHA256 Of abc");
+
+  // Streams Split At Awkward Points Match The One-Shot Hash
+  string data(100003,'\0');
+  for (size_t ii=0;ii<data.size();ii++) data[ii]=static_cast<char>((ii*7919) >> 3);
+  XXH64Stream stream;
+  for (size_t ii=0;ii<data.size();ii+=997) stream.Update(data.data()+ii,min<size_t>(997,data.size()-ii));
+  Check(stream.Digest() == XXH64(data.data(),data.size(),0),"XXH64 Stream Matches One-Shot XXH64");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Baseline: Byte-Identical To The Original Converter
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestBaseline(const TestContext &context)
+{
+  string dir_base=context.workdir+"/baseline";
+  Check(Run("mkdir -p '"+dir_base+"'") == 0 &&
+        Run("'"+context.baseline+"' '"+context.slide+"' '"+dir_base+"/t_'") == 0,"Baseline Converter Succeeds");
+  if (!Convert(context,"default","") || !Convert(context,"native","--native")) return;
+
+  // Default Outputs Are Those Of The Baseline; With --native, 8 Bit Channels Keep
+  // Their Names And Contents
+  SameOutputs(dir_base,context.workdir+"/default",8);
+  vector<string> names=ListFiles(dir_base,".bin");
+  size_t nsame=0;
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    if (SameFile(dir_base+"/"+names[ii],context.workdir+"/native/"+names[ii])) nsame++;
+  }
+  Check(nsame == 6,"6 Native 8 Bit Outputs Match The Baseline");
+  Check(ListFiles(context.workdir+"/native","_uint16.bin").size() == 2,"2 Native 16 Bit Outputs");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Output Checksums
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestOutputChecksums(const TestContext &context)
+{
+  const char *types[]={"xxh64","crc32c","sha256"};
+  for (int it=0;it<3;it++)
+  {
+    string name=string("checksum_")+types[it];
+    if (!Convert(context,name,string("--native --format=npy --checksum=")+types[it])) continue;
+    ChecksumType type;
+    ParseChecksumType(types[it],type);
+    string dir=context.workdir+"/"+name;
+    string list, manifest;
+    Check(ReadFile(dir+"/t_Checksums."+types[it],list),string("Checksums.")+types[it]+" Written");
+    Check(ReadFile(dir+"/t_Manifest.json",manifest),"Manifest.json Written");
+
+    // Every Output Is Listed With The Digest Of Its Whole File
+    vector<string> outputs=ListFiles(dir,".npy");
+    Check(outputs.size() == 8,"8 Outputs");
+    for (size_t ii=0;ii<outputs.size();ii++)
+    {
+      string data;
+      ReadFile(dir+"/"+outputs[ii],data);
+      string digest=HexDigest(data,type);
+      Check(list.find(digest+"  "+dir+"/"+outputs[ii]+"\n") != string::npos,outputs[ii]+" Listed With Its Digest");
+      Check(manifest.find("\"value\": \""+digest+"\"") != string::npos,outputs[ii]+" Digest In Manifest.json");
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Resume
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestResume(const TestContext &context)
+{
+  // The 16 Bit Channels (1.3 MB) Are Written In 2 Journaled Bands Of 1 MB Or Less
+  string options="--native --checkpoint-mb=1 --checksum=sha256";
+  if (!Convert(context,"fresh",options) || !Convert(context,"resume",options)) return;
+  string fresh=context.workdir+"/fresh", dir=context.workdir+"/resume";
+  string fn_damaged=dir+"/t_Image1_Channel0_X600_Y1100_uint16.bin";
+  string list;
+  ReadFile(dir+"/t_Checksums.sha256",list);
+
+  // Damage The First Band In The File (The Top Tile Rows, Stored Last) And Resume
+  FILE *file=fopen(fn_damaged.c_str(),"r+b");
+  Check(file != NULL && fseek(file,100,SEEK_SET) == 0 && fwrite("XXXX",1,4,file) == 4,"Output Damaged");
+  if (file != NULL) fclose(file);
+  string output;
+  if (!Convert(context,"resume",options+" --resume",&output)) return;
+
+  Check(output.find("In 2 Bands (1 Resumed)") != string::npos,"The Intact Band Is Reused");
+  size_t nskipped=0;
+  for (size_t pos=0;(pos=output.find("Already Converted",pos)) != string::npos;pos++) nskipped++;
+  Check(nskipped == 7,"The 7 Intact Outputs Are Skipped");
+  SameOutputs(fresh,dir,8);
+
+  // The Repaired Output's Checksum Is Of The Output Alone, As Before
+  string relist;
+  ReadFile(dir+"/t_Checksums.sha256",relist);
+  Check(!list.empty() && relist == list,"Checksums.sha256 Unchanged By The Repair");
+  string data;
+  ReadFile(fn_damaged,data);
+  Check(relist.find(HexDigest(data,CHECKSUM_SHA256)+"  "+fn_damaged) != string::npos,"Repaired Output Listed Right");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Sparse Outputs
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestSparse(const TestContext &context)
+{
+  if (!Convert(context,"dense","--native") || !Convert(context,"sparse","--native --sparse")) return;
+  SameOutputs(context.workdir+"/dense",context.workdir+"/sparse",8);
+
+  // The Blank Field Takes Less Space Than Its Size (Holes Of Whole 64 kB Blocks)
+  struct stat info;
+  string fn_blank=context.workdir+"/sparse/t_Image3_Channel0_X512_Y300.bin";
+  Check(stat(fn_blank.c_str(),&info) == 0 && static_cast<uint64_t>(info.st_blocks)*512 < static_cast<uint64_t>(info.st_size),
+        "Blank Output Has Holes");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Tile-Row Shards
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestShards(const TestContext &context)
+{
+  if (!Convert(context,"whole","--native --format=npy")) return;
+
+  // Uneven Shards, Run In Reverse Order, Fill The Same Outputs; The Stripped Field Has
+  // The Most Rows (14 Strips)
+  const char *rows[]={"5:14","2:5","0:2"};
+  for (int ii=0;ii<3;ii++) Convert(context,"sharded",string("--native --format=npy --tile-rows=")+rows[ii]);
+  vector<string> names=ListFiles(context.workdir+"/whole",".npy");
+  Check(names.size() == 8 && ListFiles(context.workdir+"/sharded",".npy") == names,"Same Sharded Output Files");
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    Check(SameFile(context.workdir+"/whole/"+names[ii],context.workdir+"/sharded/"+names[ii]),names[ii]+" Matches");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// .npy Headers
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestNpy(const TestContext &context)
+{
+  if (!Convert(context,"bin","--native") || !Convert(context,"npy","--native --format=npy")) return;
+  vector<string> names=ListFiles(context.workdir+"/bin",".bin");
+  Check(names.size() == 8,"8 Outputs");
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    string stem=names[ii].substr(0,names[ii].size()-4);
+    string bin, npy;
+    ReadFile(context.workdir+"/bin/"+names[ii],bin);
+    if (!Check(ReadFile(context.workdir+"/npy/"+stem+".npy",npy) && npy.size() > 10,stem+".npy Written")) continue;
+
+    // Magic, Version 1.0, Header Padded To 64 Bytes And Ending In A Newline
+    const uint8_t *p=reinterpret_cast<const uint8_t *>(npy.data());
+    size_t headerbytes=10+GetLE(p+8,2);
+    Check(npy.compare(0,8,"\x93NUMPY\x01\x00",8) == 0,stem+" Has The .npy Magic");
+    Check(headerbytes%64 == 0 && headerbytes < npy.size() && npy[headerbytes-1] == '\n',stem+" Header Is Aligned");
+    string header=npy.substr(10,headerbytes-10);
+
+    // Type And Shape From The Filename (..._XW_YH[_uint16])
+    size_t ix=stem.rfind("_X"), iy=stem.rfind("_Y");
+    string width=stem.substr(ix+2,iy-ix-2), height=stem.substr(iy+2,stem.find('_',iy+1)-iy-2);
+    bool flag_16=(stem.find("_uint16") != string::npos);
+    Check(header.find(flag_16 ? "'descr': '<u2'" : "'descr': '|u1'") != string::npos,stem+" dtype");
+    Check(header.find("'fortran_order': False") != string::npos,stem+" Is C Ordered");
+    Check(header.find("'shape': ("+height+", "+width+")") != string::npos,stem+" Shape Is ("+height+", "+width+")");
+    Check(npy.compare(headerbytes,string::npos,bin) == 0,stem+" Samples Match The .bin Output");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Stream Frames
+////////////////////////////////////////////////////////////////////////////////////////
+struct ParsedFrame
+{
+  int kind, encoding;
+  int field, channel;
+  uint32_t x, y, width, height;
+  string payload;
+};
+
+static bool ParseStream(const string &data, vector<ParsedFrame> &frames)
+{
+  frames.clear();
+  size_t pos=0;
+  while (pos < data.size())
+  {
+    if (data.size()-pos < kTileFrameBytes || data.compare(pos,4,"SCNT") != 0) return false;
+    const uint8_t *p=reinterpret_cast<const uint8_t *>(data.data()+pos);
+    ParsedFrame frame;
+    frame.kind=p[8];
+    frame.encoding=p[9];
+    frame.field=static_cast<int>(GetLE(p+20,4));
+    frame.channel=static_cast<int>(GetLE(p+24,4));
+    frame.x=GetLE(p+40,4);
+    frame.y=GetLE(p+44,4);
+    frame.width=GetLE(p+48,4);
+    frame.height=GetLE(p+52,4);
+    uint64_t nbytes=GetLE(p+56,8);
+    pos+=kTileFrameBytes;
+    if (nbytes > data.size()-pos) return false;
+    frame.payload=data.substr(pos,nbytes);
+    pos+=nbytes;
+    frames.push_back(frame);
+  }
+  return !frames.empty() && frames.back().kind == TILE_FRAME_END;
+}
+
+// Decode A JPEG Stream With libjpeg Into Interleaved Samples, Failing Unless It Has
+// ncomponents Components
+static bool DecodeJPEG(const string &jpeg, vector<uint8_t> &samples, uint32_t &ww, uint32_t &hh, int ncomponents=1)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err=jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo,reinterpret_cast<unsigned char *>(const_cast<char *>(jpeg.data())),jpeg.size());
+  if (jpeg_read_header(&cinfo,TRUE) != JPEG_HEADER_OK || cinfo.num_components != ncomponents)
+  {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_start_decompress(&cinfo);
+  ww=cinfo.output_width;
+  hh=cinfo.output_height;
+  samples.resize(static_cast<size_t>(ww)*hh*ncomponents);
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    JSAMPROW row=&samples[static_cast<size_t>(cinfo.output_scanline)*ww*ncomponents];
+    jpeg_read_scanlines(&cinfo,&row,1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+static void TestStream(const TestContext &context)
+{
+  if (!Convert(context,"native","--native")) return;
+  string dir=context.workdir+"/native";
+  for (int iraw=0;iraw<2;iraw++)
+  {
+    // Messages On stderr Stay Out Of The Stream File
+    string command="('"+context.converter+"' stream"+(iraw ? " --raw" : "")+" --index-dir='"+context.workdir+"' '"+
+                   context.slide+"' > '"+context.workdir+(iraw ? "/raw.stream')" : "/decoded.stream')");
+    Check(Run(command) == 0,iraw ? "Raw Stream Succeeds" : "Decoded Stream Succeeds");
+  }
+
+  // Decoded Tiles, Placed Top Row First Into Each Output's Bottom-Up Rows, Rebuild It
+  string data;
+  vector<ParsedFrame> frames;
+  ReadFile(context.workdir+"/decoded.stream",data);
+  if (!Check(ParseStream(data,frames),"Decoded Stream Parses And Ends With An End Frame")) return;
+  vector<string> names=ListFiles(dir,".bin");
+  map<pair<int, int>, string> images;
+  map<pair<int, int>, string> filenames;
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    int field, channel;
+    if (sscanf(names[ii].c_str(),"t_Image%d_Channel%d",&field,&channel) != 2) continue;
+    filenames[make_pair(field,channel)]=names[ii];
+  }
+  size_t ntiles=0;
+  for (size_t ii=0;ii<frames.size();ii++)
+  {
+    const ParsedFrame &frame=frames[ii];
+    if (frame.kind != TILE_FRAME_TILE) continue;
+    ntiles++;
+    pair<int, int> key(frame.field,frame.channel);
+    if (!Check(filenames.count(key) == 1,"Tile Of A Converted Channel")) return;
+    string fn=filenames[key];
+    uint32_t ww, hh;
+    sscanf(fn.substr(fn.rfind("_X")).c_str(),"_X%u_Y%u",&ww,&hh);
+    size_t nbytes=(fn.find("_uint16") != string::npos) ? 2 : 1;
+    string &image=images[key];
+    if (image.empty()) image.assign(static_cast<size_t>(ww)*hh*nbytes,'\0');
+    size_t rowbytes=frame.width*nbytes;
+    if (!Check(frame.payload.size() == rowbytes*frame.height && frame.x+frame.width <= ww && frame.y+frame.height <= hh,
+               "Tile Frame Fits Its Image")) return;
+    for (uint32_t row=0;row<frame.height;row++)
+    {
+      size_t stored=static_cast<size_t>(hh-1-(frame.y+row))*ww+frame.x;
+      image.replace(stored*nbytes,rowbytes,frame.payload,row*rowbytes,rowbytes);
+    }
+  }
+  Check(ntiles > 0 && images.size() == filenames.size(),"Every Channel Streamed");
+  for (map<pair<int, int>, string>::const_iterator it=images.begin();it!=images.end();++it)
+  {
+    string bin;
+    ReadFile(dir+"/"+filenames[it->first],bin);
+    Check(bin == it->second,filenames[it->first]+" Rebuilt From The Stream");
+  }
+
+  // Raw Stream: Tables Frames Come First, And A Grayscale JPEG Tile Joined To Its
+  // Tables Decodes To The Same Samples As The Decoded Stream's Tile
+  vector<ParsedFrame> rawframes;
+  ReadFile(context.workdir+"/raw.stream",data);
+  if (!Check(ParseStream(data,rawframes),"Raw Stream Parses And Ends With An End Frame")) return;
+  map<pair<int, int>, string> tables;
+  bool flag_tile=false, flag_order=true;
+  size_t ndecoded=0;
+  for (size_t ii=0;ii<rawframes.size();ii++)
+  {
+    const ParsedFrame &frame=rawframes[ii];
+    pair<int, int> key(frame.field,frame.channel);
+    if (frame.kind == TILE_FRAME_TABLES)
+    {
+      flag_order&=!flag_tile;
+      tables[key]=frame.payload;
+    }
+    if (frame.kind != TILE_FRAME_TILE) continue;
+    flag_tile=true;
+    if (frame.field != 0 || tables.count(key) == 0) continue;
+    const string &table=tables[key];
+    vector<uint8_t> samples;
+    uint32_t ww, hh;
+    if (!Check(table.size() > 4 && frame.payload.size() > 2 &&
+               DecodeJPEG(table.substr(0,table.size()-2)+frame.payload.substr(2),samples,ww,hh),
+               "Raw JPEG Tile Decodes With Its Tables")) continue;
+    for (size_t jj=0;jj<frames.size();jj++)
+    {
+      const ParsedFrame &decoded=frames[jj];
+      if (decoded.kind != TILE_FRAME_TILE || decoded.field != frame.field || decoded.channel != frame.channel ||
+          decoded.x != frame.x || decoded.y != frame.y) continue;
+      bool flag_same=(ww >= decoded.width && hh >= decoded.height);
+      for (uint32_t row=0;row<decoded.height && flag_same;row++)
+      {
+        flag_same=(memcmp(&samples[static_cast<size_t>(row)*ww],decoded.payload.data()+row*decoded.width,
+                          decoded.width) == 0);
+      }
+      Check(flag_same,"Raw JPEG Tile Matches The Decoded Tile");
+      ndecoded++;
+    }
+  }
+  Check(flag_order,"Tables Frames Precede All Tiles");
+  Check(tables.size() == 4,"Tables For The 3 Grayscale And 1 RGB JPEG Directories");
+  Check(ndecoded == 27,"All 27 Tiles Of Field 0 Channels 0-2 Checked");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Mosaic
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Number Following "key": In A JSON Text, Searching From pos; -1 If Missing
+static long JSONNumber(const string &json, const string &key, size_t pos=0)
+{
+  size_t found=json.find("\""+key+"\": ",pos);
+  return (found == string::npos) ? -1 : atol(json.c_str()+found+key.size()+4);
+}
+
+static void TestMosaic(const TestContext &context)
+{
+  if (!Convert(context,"native","--native") || !Convert(context,"mosaic","mosaic --chunk-size=256")) return;
+  string dir=context.workdir+"/mosaic", json;
+  if (!Check(ReadFile(dir+"/t_Mosaic.json",json),"Mosaic.json Written")) return;
+  long width=JSONNumber(json,"width"), height=JSONNumber(json,"height"), chunksize=JSONNumber(json,"chunk_size");
+  long across=JSONNumber(json,"chunks_across"), down=JSONNumber(json,"chunks_down");
+  if (!Check(chunksize == 256 && across == (width+255)/256 && down == (height+255)/256 &&
+             json.find("\"row_order\": \"top_down\"") != string::npos,"Mosaic.json Describes The Chunk Grid")) return;
+
+  // Field Placements
+  struct Placement
+  {
+    int field;
+    long x, y;
+    uint32_t width, height;
+  };
+  vector<Placement> placements;
+  for (size_t pos=0;(pos=json.find("{\"field\": ",pos)) != string::npos;pos++)
+  {
+    Placement placement;
+    if (sscanf(json.c_str()+pos,"{\"field\": %d, \"x\": %ld, \"y\": %ld, \"width\": %u, \"height\": %u}",&placement.field,
+               &placement.x,&placement.y,&placement.width,&placement.height) == 5) placements.push_back(placement);
+  }
+  Check(placements.size() == 4,"4 Fields Placed");
+
+  size_t nchannels=0;
+  for (size_t pos=0;(pos=json.find("{\"channel\": ",pos)) != string::npos;pos++)
+  {
+    // The Channel's File And Its List Of Written Chunks
+    nchannels++;
+    int channel=static_cast<int>(JSONNumber(json,"channel",pos));
+    size_t ifile=json.find("\"file\": \"",pos)+9, ichunks=json.find("\"chunks\": [",pos);
+    size_t iend=json.find("]}",ichunks);
+    if (!Check(ifile > 9 && ichunks != string::npos && iend != string::npos,"Channel Entry Parses")) return;
+    string fn_mosaic=dir+"/"+json.substr(ifile,json.find('"',ifile)-ifile);
+    set<pair<long, long> > written;
+    for (size_t ic=json.find('[',ichunks+11);ic < iend;ic=json.find('[',ic+1))
+    {
+      long cx, cy;
+      if (sscanf(json.c_str()+ic,"[%ld,%ld]",&cx,&cy) == 2) written.insert(make_pair(cx,cy));
+    }
+
+    // The Whole Mosaic As It Should Be, From The Native Outputs Of Each Field
+    OutputImage image;
+    size_t nbytes=2;
+    string expected(static_cast<size_t>(width)*height*nbytes,'\0');
+    for (size_t ip=0;ip<placements.size();ip++)
+    {
+      const Placement &placement=placements[ip];
+      if (!Check(LoadOutput(FindOutput(context.workdir+"/native",placement.field,channel),image) &&
+                 image.width == placement.width && image.height == placement.height && image.nbytes == nbytes &&
+                 placement.x >= 0 && placement.y >= 0 && placement.x+placement.width <= width &&
+                 placement.y+placement.height <= height,"Field Output Fits Its Placement")) return;
+      for (uint32_t y=0;y<image.height;y++)
+      {
+        expected.replace(((placement.y+y)*width+placement.x)*nbytes,image.width*nbytes,
+                         reinterpret_cast<const char *>(image.Row(y)),image.width*nbytes);
+      }
+    }
+
+    // Each Chunk Holds Its Pixels Top Row First, And Is Listed Exactly When Not Blank
+    string data;
+    size_t chunkbytes=static_cast<size_t>(chunksize)*chunksize*nbytes;
+    if (!Check(ReadFile(fn_mosaic,data) && data.size() == chunkbytes*across*down,fn_mosaic+" Holds Every Chunk")) return;
+    size_t nsame=0, nlisted=0;
+    for (long cy=0;cy<down;cy++)
+    {
+      for (long cx=0;cx<across;cx++)
+      {
+        string chunk(chunkbytes,'\0');
+        for (long row=0;row<chunksize && cy*chunksize+row < height;row++)
+        {
+          long ncols=min(chunksize,width-cx*chunksize);
+          chunk.replace(row*chunksize*nbytes,ncols*nbytes,expected,((cy*chunksize+row)*width+cx*chunksize)*nbytes,
+                        ncols*nbytes);
+        }
+        bool flag_blank=(chunk.find_first_not_of('\0') == string::npos);
+        if (data.compare((cy*across+cx)*chunkbytes,chunkbytes,chunk) == 0) nsame++;
+        if (written.count(make_pair(cx,cy)) == (flag_blank ? 0u : 1u)) nlisted++;
+      }
+    }
+    Check(nsame == static_cast<size_t>(across*down),fn_mosaic+" Chunks Match The Field Outputs");
+    Check(nlisted == static_cast<size_t>(across*down),fn_mosaic+" Lists Exactly Its Non-Blank Chunks");
+
+    // Blank Chunks Are Holes
+    struct stat info;
+    Check(written.size() < static_cast<size_t>(across*down) && stat(fn_mosaic.c_str(),&info) == 0 &&
+          static_cast<uint64_t>(info.st_blocks)*512 < static_cast<uint64_t>(info.st_size),fn_mosaic+" Has Holes");
+  }
+  Check(nchannels == 3,"3 Mosaic Channels");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Skip Unchanged Slides
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Modification Times Of The .bin Outputs In A Directory
+static vector<pair<int64_t, int64_t> > OutputTimes(const string &dir)
+{
+  vector<pair<int64_t, int64_t> > times;
+  vector<string> names=ListFiles(dir,".bin");
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    struct stat info;
+    if (stat((dir+"/"+names[ii]).c_str(),&info) == 0) times.push_back(make_pair(info.st_mtim.tv_sec,info.st_mtim.tv_nsec));
+  }
+  return times;
+}
+
+static void TestUnchanged(const TestContext &context)
+{
+  // Work On A Copy Of The Slide, Which Gets Changed Below
+  TestContext copy=context;
+  copy.slide=context.workdir+"/Slide.scn";
+  if (!Check(Run("cp '"+context.slide+"' '"+copy.slide+"'") == 0,"Slide Copied")) return;
+  string dir=context.workdir+"/unchanged", options="--native --skip-unchanged", output;
+  if (!Convert(copy,"unchanged",options,&output)) return;
+  Check(output.find("Unchanged:") == string::npos,"The First Run Converts");
+  Check(ReadFile(dir+"/t_Conversion.fingerprint",output),"Conversion.fingerprint Written");
+
+  // A Rerun Does Nothing, Also When Only The Slide's Modification Time Changed
+  vector<pair<int64_t, int64_t> > times=OutputTimes(dir);
+  Run("touch '"+copy.slide+"'");
+  if (!Convert(copy,"unchanged",options,&output)) return;
+  Check(output.find("Unchanged:") != string::npos && output.find("Read:") == string::npos,"The Rerun Does Nothing");
+  Check(times.size() == 8 && OutputTimes(dir) == times,"The Rerun Leaves The Outputs Alone");
+
+  // A Missing Output Is Converted Again
+  string fn_changed=FindOutput(dir,1,1), before;
+  ReadFile(fn_changed,before);
+  remove(fn_changed.c_str());
+  if (!Convert(copy,"unchanged",options,&output)) return;
+  string after;
+  Check(output.find("Unchanged:") == string::npos && ReadFile(fn_changed,after) && after == before,
+        "A Missing Output Is Converted Again");
+
+  // One Changed Byte Of Uncompressed Tile Data (The Bottom Right Tile Of Field 1
+  // Channel 1), Same File Size, Converts Again
+  SlideReader reader;
+  const IndexedDirectory *directory=NULL;
+  if (Check(reader.Open(copy.slide,"") == INDEX_OK && (directory=reader.FindChannel(1,1,0)) != NULL &&
+            !directory->offsets.empty(),"Slide Copy Opens"))
+  {
+    uint64_t offset=directory->offsets.back();
+    reader.Close();
+    FILE *file=fopen(copy.slide.c_str(),"r+b");
+    int byte=EOF;
+    Check(file != NULL && fseek(file,offset,SEEK_SET) == 0 && (byte=fgetc(file)) != EOF &&
+          fseek(file,offset,SEEK_SET) == 0 && fputc(byte ^ 0x55,file) != EOF,"Tile Byte Changed");
+    if (file != NULL) fclose(file);
+    if (!Convert(copy,"unchanged",options,&output)) return;
+    Check(output.find("Unchanged:") == string::npos,"A Changed Tile Converts Again");
+    ReadFile(fn_changed,after);
+    Check(after.size() == before.size() && after != before,"The Changed Tile Reaches The Output");
+  }
+
+  // So Do Changed Options, After Which The Same Options Do Nothing Again
+  if (!Convert(copy,"unchanged",options+" --format=npy",&output)) return;
+  Check(output.find("Unchanged:") == string::npos,"Changed Options Convert Again");
+  if (!Convert(copy,"unchanged",options+" --format=npy",&output)) return;
+  Check(output.find("Unchanged:") != string::npos,"The Changed Options Rerun Does Nothing");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Shard Plan
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestPlan(const TestContext &context)
+{
+  if (!Convert(context,"whole","--native")) return;
+  string dir=context.workdir+"/planned", plan;
+  Run("mkdir -p '"+dir+"'");
+  if (!Check(Run("'"+context.converter+"' plan --shards=3 --native --index-dir='"+context.workdir+"' '"+context.slide+"' '"+
+                 dir+"/t_'",&plan) == 0,"Plan Succeeds")) return;
+
+  // One Comment And One Command Line Per Shard; The 16 Bit Field Is Split By Tile Rows
+  vector<string> commands;
+  size_t ncomments=0;
+  istringstream lines(plan);
+  string line;
+  while (getline(lines,line))
+  {
+    if (line.compare(0,8,"# Shard ") == 0) ncomments++;
+    else if (!line.empty()) commands.push_back(line);
+  }
+  if (!Check(ncomments == 3 && commands.size() == 3,"3 Shards Planned")) return;
+  Check(plan.find("--tile-rows=") != string::npos,"A Field Is Split By Tile Rows");
+
+  // The Shards, Run In Reverse Order, Write The Same Outputs As One Whole Run
+  for (size_t ii=commands.size();ii-- > 0;) Check(Run(commands[ii]) == 0,"Shard Command Succeeds");
+  SameOutputs(context.workdir+"/whole",dir,8);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Shared Memory Outputs
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestShm(const TestContext &context)
+{
+  if (!Convert(context,"native","--native")) return;
+  ostringstream prefix;
+  prefix << "SlideDataTest" << getpid() << "_";
+  string shmcommand="'"+context.converter+"' --native --shm --index-dir='"+context.workdir+"' '";
+  Check(Run(shmcommand+context.slide+"' "+prefix.str()) == 0,"Converter Succeeds With --shm");
+
+  // Every Segment Is Ready And Holds The Output File's Samples After Its Header
+  vector<string> names=ListFiles(context.workdir+"/native",".bin");
+  Check(names.size() == 8,"8 Outputs");
+  for (size_t ii=0;ii<names.size();ii++)
+  {
+    string segment=prefix.str()+names[ii].substr(2), data, bin;
+    ReadFile(context.workdir+"/native/"+names[ii],bin);
+    bool flag_read=ReadFile("/dev/shm/"+segment,data);
+    shm_unlink(("/"+segment).c_str());
+    if (!Check(flag_read && data.size() >= sizeof(SharedOutputHeader),segment+" Shared")) continue;
+    SharedOutputHeader header;
+    memcpy(&header,data.data(),sizeof(header));
+    OutputImage image;
+    LoadOutput(context.workdir+"/native/"+names[ii],image);
+    int field, channel;
+    sscanf(names[ii].c_str(),"t_Image%d_Channel%d",&field,&channel);
+    Check(memcmp(header.magic,"SCNSHM1",8) == 0 && header.headerbytes == 64,segment+" Header Magic And Size");
+    Check(header.state == SHARED_READY,segment+" Is Ready");
+    Check(header.databytes == bin.size() && header.width == image.width && header.height == image.height &&
+          header.nchannels == 1 && header.type == static_cast<uint32_t>(image.nbytes == 2 ? SAMPLE_UINT16 : SAMPLE_UINT8) &&
+          header.field == field && header.channel == channel,segment+" Header Describes The Output");
+    Check(data.compare(header.headerbytes,string::npos,bin) == 0,segment+" Samples Match The Output File");
+  }
+
+  // A Conversion That Fails Part Way (Field 0 Channel 1 Tiles Lose Their Frame
+  // Header) Leaves None Of Its Unpublished Segments Behind
+  string fn_broken=context.workdir+"/Broken.scn";
+  SlideReader reader;
+  const IndexedDirectory *directory=NULL;
+  if (!Check(Run("cp '"+context.slide+"' '"+fn_broken+"'") == 0 && reader.Open(fn_broken,"") == INDEX_OK &&
+             (directory=reader.FindChannel(0,1,0)) != NULL,"Slide Copy Opens")) return;
+  string slide;
+  ReadFile(fn_broken,slide);
+  for (size_t it=0;it<directory->offsets.size();it++)
+  {
+    size_t sof=slide.find("\xff\xc0",directory->offsets[it]);
+    if (sof < directory->offsets[it]+directory->bytecounts[it]) slide[sof+1]='\x01';
+  }
+  reader.Close();
+  ofstream(fn_broken.c_str(),ios::out | ios::binary).write(slide.data(),slide.size());
+  Check(Run(shmcommand+fn_broken+"' "+prefix.str()) != 0,"Converter Fails On The Broken Slide");
+  vector<string> left=ListFiles("/dev/shm",".bin");
+  size_t nleft=0;
+  for (size_t ii=0;ii<left.size();ii++)
+  {
+    if (left[ii].compare(0,prefix.str().size(),prefix.str()) != 0) continue;
+    nleft++;
+    shm_unlink(("/"+left[ii]).c_str());
+  }
+  Check(nleft == 1,"Only The Published Field 0 Channel 0 Segment Is Left");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Thumbnails
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestThumbnail(const TestContext &context)
+{
+  if (!Convert(context,"native","--native") || !Convert(context,"jpeg","thumbnail --size=128") ||
+      !Convert(context,"pnm","thumbnail --size=128 --field=2 --format=pnm")) return;
+
+  // JPEGs Of Every Field, The Longest Side 128 Pixels; Field 0 (3 Channels) Is RGB
+  vector<string> names=ListFiles(context.workdir+"/jpeg",".jpg");
+  Check(names.size() == 5,"5 JPEG Thumbnails");
+  string jpeg;
+  vector<uint8_t> samples;
+  uint32_t ww, hh;
+  Check(ReadFile(context.workdir+"/jpeg/t_Image0_Thumbnail_X128_Y95.jpg",jpeg) && DecodeJPEG(jpeg,samples,ww,hh,3) &&
+        ww == 128 && hh == 95,"Field 0 Thumbnail Is A 128 x 95 RGB JPEG");
+  Check(ReadFile(context.workdir+"/jpeg/t_Image1_Thumbnail_X70_Y128.jpg",jpeg) && DecodeJPEG(jpeg,samples,ww,hh,3) &&
+        ww == 70 && hh == 128,"Field 1 Thumbnail Is A 70 x 128 RGB JPEG");
+
+  // The 8 Bit Stripped Field As A PGM: The Output Shrunk With An Area Filter
+  string pgm, header="P5\n128 81\n255\n";
+  OutputImage image;
+  if (!Check(ReadFile(context.workdir+"/pnm/t_Image2_Thumbnail_X128_Y81.pgm",pgm) &&
+             pgm.compare(0,header.size(),header) == 0 &&
+             pgm.size() == header.size()+128*81,"Field 2 Thumbnail Is A 128 x 81 PGM") ||
+      !LoadOutput(FindOutput(context.workdir+"/native",2,0),image)) return;
+  vector<float> source(static_cast<size_t>(image.width)*image.height), small(128*81);
+  for (size_t ii=0;ii<source.size();ii++) source[ii]=static_cast<uint8_t>(image.rows[ii]);
+  ResizeArea(&source[0],image.width,image.height,&small[0],128,81);
+  size_t nclose=0;
+  for (size_t ii=0;ii<small.size();ii++)
+  {
+    if (fabs(static_cast<uint8_t>(pgm[header.size()+ii])-small[ii]) <= 1.0f) nclose++;
+  }
+  Check(nclose == small.size(),"Field 2 Thumbnail Matches The Shrunk Output");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Tile Server
+////////////////////////////////////////////////////////////////////////////////////////
+
+// One HTTP/1.0 GET Request, Returning The Status Code (-1 If It Failed) And The Body
+static int HTTPGet(int port, const string &path, string &body)
+{
+  int fd=socket(AF_INET,SOCK_STREAM,0);
+  if (fd < 0) return -1;
+  struct sockaddr_in address;
+  memset(&address,0,sizeof(address));
+  address.sin_family=AF_INET;
+  address.sin_port=htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  string request="GET "+path+" HTTP/1.0\r\nHost: localhost\r\n\r\n", response;
+  if (connect(fd,reinterpret_cast<struct sockaddr *>(&address),sizeof(address)) != 0 ||
+      write(fd,request.data(),request.size()) != static_cast<ssize_t>(request.size()))
+  {
+    close(fd);
+    return -1;
+  }
+  char buffer[4096];
+  ssize_t nread;
+  while ((nread=read(fd,buffer,sizeof(buffer))) > 0) response.append(buffer,nread);
+  close(fd);
+  int status;
+  size_t iend=response.find("\r\n\r\n");
+  if (iend == string::npos || sscanf(response.c_str(),"HTTP/1.%*d %d",&status) != 1) return -1;
+  body=response.substr(iend+4);
+  return status;
+}
+
+static void TestServe(const TestContext &context)
+{
+  if (!Convert(context,"native","--native")) return;
+
+  // Start The Server On A Free Port, Read From Its First Line Of Output
+  string indexdir="--index-dir="+context.workdir;
+  const char *args[]={context.converter.c_str(),"serve","--port=0","--tile-size=512","--overlap=0","--quality=100",
+                      "--threads=2",indexdir.c_str(),context.slide.c_str(),NULL};
+  int fds[2];
+  if (!Check(pipe(fds) == 0,"Pipe Created")) return;
+  cout << "Running: " << context.converter << " serve ... " << context.slide << endl;
+  pid_t pid=fork();
+  if (pid == 0)
+  {
+    dup2(fds[1],STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execv(args[0],const_cast<char **>(args));
+    _exit(127);
+  }
+  close(fds[1]);
+  FILE *serveroutput=fdopen(fds[0],"r");
+  int port=0;
+  char line[1024];
+  while (port == 0 && fgets(line,sizeof(line),serveroutput) != NULL) sscanf(line,"Serving on http://%*[^:]:%d/",&port);
+
+  OutputImage image;
+  string body;
+  vector<uint8_t> samples;
+  uint32_t ww, hh;
+  if (Check(pid > 0 && port > 0,"Server Started") && Check(LoadOutput(FindOutput(context.workdir+"/native",2,0),image),
+                                                           "Field 2 Output Read"))
+  {
+    // Listing, Descriptor And Statistics
+    Check(HTTPGet(port,"/",body) == 200 && body.find("\"tilesize\":512") != string::npos &&
+          body.find("\"dzi\":\"/0/2/0.dzi\"") != string::npos,"GET / Lists The Channels");
+    Check(HTTPGet(port,"/0/2/0.dzi",body) == 200 && body.find("<Size Width=\"333\" Height=\"211\"/>") != string::npos,
+          "GET /0/2/0.dzi Gives The Field Size");
+    Check(HTTPGet(port,"/stats",body) == 200 && !body.empty() && body[0] == '{',"GET /stats Gives JSON");
+    Check(HTTPGet(port,"/0/9/0.dzi",body) == 404,"Unknown Field Is Not Found");
+    Check(HTTPGet(port,"/0/2/0_files/9/1_0.jpeg",body) == 404,"Tile Outside The Level Is Not Found");
+
+    // Full Resolution (Level 9): The Whole 8 Bit Field In One Tile, Up To JPEG Error
+    if (Check(HTTPGet(port,"/0/2/0_files/9/0_0.jpeg",body) == 200 && DecodeJPEG(body,samples,ww,hh) && ww == 333 &&
+              hh == 211,"Level 9 Tile Is 333 x 211"))
+    {
+      double error=0.0;
+      for (uint32_t y=0;y<hh;y++)
+      {
+        for (uint32_t x=0;x<ww;x++) error+=fabs(static_cast<double>(samples[y*ww+x])-image.Sample(x,y));
+      }
+      Check(error/(ww*hh) < 1.0,"Level 9 Tile Matches The Output");
+    }
+
+    // Level 5 Is 16 Times Smaller And Keeps The Middle Sample Of Each 16 x 16 Block
+    if (Check(HTTPGet(port,"/0/2/0_files/5/0_0.jpeg",body) == 200 && DecodeJPEG(body,samples,ww,hh) && ww == 21 &&
+              hh == 14,"Level 5 Tile Is 21 x 14"))
+    {
+      double error=0.0;
+      for (uint32_t y=0;y<hh;y++)
+      {
+        for (uint32_t x=0;x<ww;x++)
+        {
+          uint32_t xs=x*16+7, ys=y*16+7;
+          error+=fabs(static_cast<double>(samples[y*ww+x])-(ys < image.height ? image.Sample(xs,ys) : 0));
+        }
+      }
+      Check(error/(ww*hh) < 1.0,"Level 5 Tile Samples The Output");
+    }
+  }
+
+  if (pid > 0)
+  {
+    kill(pid,SIGTERM);
+    waitpid(pid,NULL,0);
+  }
+  fclose(serveroutput);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Slide Reader, Tile Cache And Patch Sampler
+////////////////////////////////////////////////////////////////////////////////////////
+static void TestReader(const TestContext &context)
+{
+  if (!Convert(context,"native","--native")) return;
+  OutputImage image;
+  SlideReader reader;
+  const IndexedDirectory *directory=NULL;
+  if (!Check(LoadOutput(FindOutput(context.workdir+"/native",1,1),image),"Field 1 Channel 1 Output Read") ||
+      !Check(reader.Open(context.slide,"") == INDEX_OK && (directory=reader.FindChannel(1,1,0)) != NULL,"Slide Opens"))
+  {
+    return;
+  }
+
+  // A Region Across Tile Boundaries That Runs Off The Left And Bottom Edges, With
+  // Padding Between Rows: Pixels Outside The Field Are Zero
+  const long x0=-37, y0=1000;
+  const uint32_t ww=300, hh=150;
+  size_t rowbytes=(ww+5)*2;
+  vector<uint8_t> region(rowbytes*hh);
+  bool flag_same=true;
+  for (int pass=0;pass<3;pass++)
+  {
+    // Without A Cache, Then Through A Cache Twice
+    TileCache cache(static_cast<size_t>(64)*1024*1024);
+    if (pass > 0) reader.SetTileCache(&cache);
+    for (int read=0;read < (pass > 0 ? 2 : 1);read++)
+    {
+      SCNReadStatus status=reader.ReadRegion(*directory,1,x0,y0,ww,hh,&region[0],rowbytes);
+      if (!Check(status == SCN_READ_OK,"ReadRegion Succeeds")) return;
+      for (uint32_t y=0;y<hh;y++)
+      {
+        for (uint32_t x=0;x<ww;x++)
+        {
+          long xs=x0+x, ys=y0+y;
+          bool flag_inside=(xs >= 0 && xs < image.width && ys < image.height);
+          flag_same&=(GetLE(&region[y*rowbytes+x*2],2) == (flag_inside ? image.Sample(xs,ys) : 0));
+        }
+      }
+    }
+    if (pass == 1)
+    {
+      TileCacheStats stats=cache.Stats();
+      Check(stats.misses > 0 && stats.hits == stats.misses && stats.entries == stats.misses,
+            "The Second Read Finds Every Tile In The Cache");
+    }
+    reader.SetTileCache(NULL);
+  }
+  Check(flag_same,"ReadRegion Matches The Output");
+
+  // A Cache Smaller Than The Region's Tiles Evicts But Still Reads Right
+  TileCache smallcache(static_cast<size_t>(64)*1024,1);
+  reader.SetTileCache(&smallcache);
+  vector<uint8_t> again(region.size());
+  Check(reader.ReadRegion(*directory,1,x0,y0,ww,hh,&again[0],rowbytes) == SCN_READ_OK &&
+        reader.ReadRegion(*directory,1,x0,y0,ww,hh,&again[0],rowbytes) == SCN_READ_OK && again == region &&
+        smallcache.Stats().evictions > 0,"A Small Cache Evicts And Reads Right");
+
+  // Patches Of Both 16 Bit Channels, Inside And Across The Edges, Match ReadRegion
+  ThreadPool pool(2);
+  vector<SlideReader *> slides(1,&reader);
+  PatchSampler sampler(slides,pool);
+  PatchBatch batch;
+  batch.channels.push_back(0);
+  batch.channels.push_back(1);
+  batch.size=64;
+  batch.type=SAMPLE_UINT16;
+  const long corners[][2]={{0,0},{100,500},{570,1080},{-20,-30},{255,255}};
+  vector<PatchRequest> requests;
+  for (int ii=0;ii<5;ii++)
+  {
+    PatchRequest request;
+    request.slide=0;
+    request.field=1;
+    request.x=corners[ii][0];
+    request.y=corners[ii][1];
+    requests.push_back(request);
+  }
+  vector<uint8_t> patches(PatchSampler::BatchBytes(batch,requests.size()));
+  PatchSamplerStats stats;
+  if (!Check(sampler.Sample(batch,requests,&patches[0],&stats) == SCN_READ_OK,"Patches Sampled")) return;
+  Check(stats.patches == 5 && stats.tiles > 0 && stats.tiles < stats.tilerefs,"Tiles Shared By Patches Are Decoded Once");
+  size_t patchbytes=static_cast<size_t>(batch.size)*batch.size*2;
+  vector<uint8_t> expected(patchbytes);
+  size_t nsame=0;
+  for (size_t ip=0;ip<requests.size();ip++)
+  {
+    for (size_t ic=0;ic<batch.channels.size();ic++)
+    {
+      const IndexedDirectory *channel=reader.FindChannel(1,batch.channels[ic],0);
+      if (channel != NULL && reader.ReadRegion(*channel,batch.channels[ic],requests[ip].x,requests[ip].y,batch.size,
+                                               batch.size,&expected[0],batch.size*2) == SCN_READ_OK &&
+          memcmp(&patches[(ip*batch.channels.size()+ic)*patchbytes],&expected[0],patchbytes) == 0) nsame++;
+    }
+  }
+  Check(nsame == 10,"All 10 Patch Channels Match ReadRegion");
+}
+
+int main(int argc, char * argv[])
+{
+  // Read Inputs
+  string testcase=(argc > 1) ? argv[1] : "";
+  TestContext context;
+  if (testcase == "checksums" && argc == 2) TestChecksums();
+  else if (argc == 5 || argc == 6)
+  {
+    context.converter=argv[2];
+    context.slide=argv[3];
+    context.workdir=argv[4];
+    if (argc == 6) context.baseline=argv[5];
+    if (Run("rm -rf '"+context.workdir+"' && mkdir -p '"+context.workdir+"'") != 0) return 1;
+    if (testcase == "baseline" && !context.baseline.empty()) TestBaseline(context);
+    else if (testcase == "outputs") TestOutputChecksums(context);
+    else if (testcase == "resume") TestResume(context);
+    else if (testcase == "sparse") TestSparse(context);
+    else if (testcase == "shards") TestShards(context);
+    else if (testcase == "npy") TestNpy(context);
+    else if (testcase == "stream") TestStream(context);
+    else if (testcase == "mosaic") TestMosaic(context);
+    else if (testcase == "unchanged") TestUnchanged(context);
+    else if (testcase == "plan") TestPlan(context);
+    else if (testcase == "shm") TestShm(context);
+    else if (testcase == "thumbnail") TestThumbnail(context);
+    else if (testcase == "serve") TestServe(context);
+    else if (testcase == "reader") TestReader(context);
+    else return -1;
+  }
+  else
+  {
+    cout << "Usage: TestSlideData checksums" << endl
+         << "       TestSlideData CASE converter slide workdir [baseline]" << endl;
+    return -1;
+  }
+
+  if (nfailed > 0)
+  {
+    cout << nfailed << " Check(s) Failed" << endl;
+    return 1;
+  }
+  cout << "All Checks Passed" << endl;
+  return 0;
+}